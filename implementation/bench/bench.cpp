@@ -0,0 +1,401 @@
+#include "bench.h"
+#include "../interpreter/treewalk.h"
+#include "../profile/memory.h"
+#include "../vm/compiler.h"
+#include "../vm/vm.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Workload {
+    const char* name;
+    const char* source;
+};
+
+// loop-heavy programs over the statements both engines support
+const Workload vmWorkloads[] = {
+    {"sum-loop",
+     "mass total = 0;\n"
+     "rotate (mass i = 0; i < 3000000; i = i + 1) {\n"
+     "    total = total + i * 2 - i / 3;\n"
+     "}\n"},
+    {"branchy-orbit",
+     "mass i = 0;\n"
+     "mass odd = 0;\n"
+     "mass skipped = 0;\n"
+     "orbit (i < 2000000) {\n"
+     "    i = i + 1;\n"
+     "    phase (i % 3 == 0) { skipped = skipped + 1; warp; }\n"
+     "    phase (i % 2 == 1) { odd = odd + 1; } eclipse { odd = odd - 1; }\n"
+     "    phase (odd > 100000000) { darkMatter; }\n"
+     "}\n"},
+    {"nested-rotate",
+     "mass hits = 0;\n"
+     "rotate (mass a = 0; a < 1500; a = a + 1) {\n"
+     "    rotate (mass b = 0; b < 1000; b = b + 1) {\n"
+     "        phase ((a + b) % 7 == 0) { hits = hits + 1; }\n"
+     "    }\n"
+     "}\n"},
+    {"flux-arith",
+     "flux x = 0.0;\n"
+     "flux y = 1.0;\n"
+     "rotate (mass i = 0; i < 2000000; i = i + 1) {\n"
+     "    x = x * 0.5 + 1.25;\n"
+     "    y = y + x / 3.0;\n"
+     "}\n"},
+};
+
+// recursion in all its forms; calls is how many user function calls one run makes
+struct CallWorkload {
+    const char* name;
+    const char* source;
+    double calls;
+    bool jitMustNotLose; // the JIT makes these calls natively: slower than the interpreter fails the run
+};
+
+const CallWorkload callWorkloads[] = {
+    {"fib",                       // 2 * fib(28) - 1 calls
+     "mass fib(mass n) {\n"
+     "    phase (n < 2) { blackHole n; }\n"
+     "    blackHole fib(n - 1) + fib(n - 2);\n"
+     "}\n"
+     "mass result = fib(27);\n",
+     635621, true},
+    {"ackermann",                 // ack(3, 7) = 1021, nested ~1000 calls deep
+     "mass ack(mass m, mass n) {\n"
+     "    phase (m == 0) { blackHole n + 1; }\n"
+     "    phase (n == 0) { blackHole ack(m - 1, 1); }\n"
+     "    blackHole ack(m - 1, ack(m, n - 1));\n"
+     "}\n"
+     "mass result = ack(3, 7);\n",
+     693964, true},
+    {"mutual-tail",               // a million calls, all tail calls: one frame
+     "vacuum isEven(mass n) {\n"
+     "    phase (n == 0) { blackHole starlight; }\n"
+     "    blackHole isOdd(n - 1);\n"
+     "}\n"
+     "vacuum isOdd(mass n) {\n"
+     "    phase (n == 0) { blackHole voidness; }\n"
+     "    blackHole isEven(n - 1);\n"
+     "}\n"
+     "vacuum result = isEven(1000000);\n",
+     1000001, false},
+    {"leaf-in-loop",
+     "mass square(mass x) { blackHole x * x; }\n"
+     "mass total = 0;\n"
+     "rotate (mass i = 0; i < 1000000; i = i + 1) {\n"
+     "    total = total + square(i) % 7;\n"
+     "}\n",
+     1000000, false},
+};
+
+// star building and shine output; both engines keep building stars until
+// the run ends, so sizes stay at a few MB
+const Workload stringWorkloads[] = {
+    {"orbit-append",              // one 600 KB star, two bytes at a time
+     "vacuum s = \"\";\n"
+     "mass i = 0;\n"
+     "orbit (i < 300000) {\n"
+     "    s = s + \"ab\";\n"
+     "    i = i + 1;\n"
+     "}\n"},
+    {"orbit-lines",               // words into lines, lines into a document
+     "vacuum doc = \"\";\n"
+     "vacuum line = \"\";\n"
+     "mass i = 0;\n"
+     "orbit (i < 200000) {\n"
+     "    line = line + \"word \";\n"
+     "    phase (i % 16 == 15) { doc = doc + line + \"|\"; line = \"\"; }\n"
+     "    i = i + 1;\n"
+     "}\n"},
+    {"orbit-prepend",             // the same star built from its end
+     "vacuum s = \"\";\n"
+     "mass i = 0;\n"
+     "orbit (i < 300000) {\n"
+     "    s = \"ab\" + s;\n"
+     "    i = i + 1;\n"
+     "}\n"},
+    {"orbit-scratch",             // short-lived stars: the heap must reclaim them
+     "vacuum s = \"abcdefghijklmnopqrstuvwxyz\";\n"
+     "vacuum t = \"\";\n"
+     "mass i = 0;\n"
+     "orbit (i < 500000) {\n"
+     "    t = s + \"a\";\n"
+     "    t = s + \"b\";\n"
+     "    i = i + 1;\n"
+     "}\n"},
+    {"key-compare",               // a long star against an equal constant
+     "vacuum key = \"configuration.section.entry\";\n"
+     "mass hits = 0;\n"
+     "rotate (mass i = 0; i < 1000000; i = i + 1) {\n"
+     "    phase (key == \"configuration.section.entry\") { hits = hits + 1; }\n"
+     "}\n"},
+    {"shine-values",
+     "rotate (mass i = 0; i < 200000; i = i + 1) {\n"
+     "    shine(\"line\", i, i * 0.5, i % 2 == 0);\n"
+     "}\n"},
+    {"shine-long",                // 640-byte stars, 25 MB in all
+     "vacuum s = \"\";\n"
+     "rotate (mass i = 0; i < 64; i = i + 1) { s = s + \"0123456789\"; }\n"
+     "rotate (mass i = 0; i < 20000; i = i + 1) {\n"
+     "    shine(s, s);\n"
+     "}\n"},
+};
+
+// where the engines shine() to while timed: counts the bytes and hashes
+// them (FNV-1a), so no terminal is measured and the outputs can be compared
+class OutputDigest : public std::streambuf {
+public:
+    uint64_t bytes = 0;
+    uint64_t hash = 14695981039346656037ull;
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) add(traits_type::to_char_type(c));
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        for (std::streamsize i = 0; i < n; i++) add(s[i]);
+        return n;
+    }
+
+private:
+    void add(char c) {
+        bytes++;
+        hash = (hash ^ uint8_t(c)) * 1099511628211ull;
+    }
+};
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+template <typename F>
+double bestOf(int reps, F&& run) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        auto start = Clock::now();
+        run();
+        double t = secondsSince(start);
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+// best-of-reps times of one program in the tree walker, the interpreting VM
+// and the VM with the JIT; false when they print different output or leave
+// different top-level variables behind. shineBytes is what one run prints
+bool timeEngines(const char* source, int reps, double& treeTime, double& vmTime, double& jitTime,
+                 uint64_t* shineBytes = nullptr) {
+    AstArena arena;
+    Scanner scanner(source);
+    Parser parser(scanner, arena);
+    StmtList program = parser.parseProgram();
+    LineTable lines(source);
+
+    Module module;
+    Compiler(module, lines).compileProgram(program);
+
+    OutputDigest treeOut, vmOut, jitOut;
+    std::ostream treeStream(&treeOut), vmStream(&vmOut), jitStream(&jitOut);
+    TreeWalker walker(lines, treeStream);
+    treeTime = bestOf(reps, [&] { walker.run(program); });
+    VM vm(vmStream, jit::Options{false});
+    vmTime = bestOf(reps, [&] { vm.run(module); });
+    // compile time included: every run starts cold
+    VM jitted(jitStream, jit::Options{true});
+    jitTime = bestOf(reps, [&] { jitted.run(module); });
+    if (shineBytes) *shineBytes = treeOut.bytes / uint64_t(reps);
+
+    // all engines must print the same and leave the same top-level variables behind
+    if (treeOut.bytes != vmOut.bytes || treeOut.hash != vmOut.hash || vmOut.hash != jitOut.hash) return false;
+    auto expected = walker.topLevel();
+    if (expected.size() != module.topLevel.size()) return false;
+    for (size_t i = 0; i < expected.size(); i++) {
+        const Value& got = vm.registers()[module.topLevel[i].reg];
+        const Value& native = jitted.registers()[module.topLevel[i].reg];
+        if (expected[i].first != module.topLevel[i].name || valueToString(expected[i].second) != valueToString(got) ||
+            valueToString(got) != valueToString(native))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int runVmBenchmark(std::ostream& out) {
+    const int reps = 3;
+    int status = 0;
+    char line[160];
+    std::snprintf(line, sizeof line, "%-16s %12s %12s %12s %9s %9s  %s\n", "workload", "tree (ms)", "vm (ms)",
+                  "jit (ms)", "vm/tree", "jit/vm", "check");
+    out << line;
+
+    for (const Workload& w : vmWorkloads) {
+        double treeTime, vmTime, jitTime;
+        bool same = timeEngines(w.source, reps, treeTime, vmTime, jitTime);
+        if (!same) status = 1;
+
+        std::snprintf(line, sizeof line, "%-16s %12.2f %12.2f %12.2f %8.2fx %8.2fx  %s\n", w.name, treeTime * 1e3,
+                      vmTime * 1e3, jitTime * 1e3, treeTime / vmTime, vmTime / jitTime, same ? "ok" : "MISMATCH");
+        out << line;
+    }
+    return status;
+}
+
+namespace {
+
+struct FrontendResult {
+    CorpusShape shape;
+    size_t bytes = 0;
+    size_t tokens = 0; // END_OF_FILE excluded
+    size_t nodes = 0;
+    double scanSeconds = 0;
+    double parseSeconds = 0;
+    double scanAllocsPerToken = 0;
+    double parseAllocsPerToken = 0;
+    size_t peakRss = 0;
+};
+
+FrontendResult measureFrontend(CorpusShape shape, const FrontendBenchOptions& options) {
+    FrontendResult r;
+    r.shape = shape;
+    memory::resetPeakRss();
+    std::string source = generateCorpus(shape, options.bytes);
+    r.bytes = source.size();
+
+    std::vector<Token> tokens;
+    memory::AllocCounters before = memory::threadCounters();
+    tokens = Scanner(source).scanTokens();
+    uint64_t scanAllocs = memory::threadCounters().allocations - before.allocations;
+    r.tokens = tokens.size() - 1;
+    r.scanSeconds = bestOf(options.reps, [&] { tokens = Scanner(source).scanTokens(); });
+
+    before = memory::threadCounters();
+    {
+        AstArena arena;
+        Parser(tokens, arena).parseProgram();
+        r.nodes = arena.nodeCount();
+    }
+    uint64_t parseAllocs = memory::threadCounters().allocations - before.allocations;
+    r.parseSeconds = bestOf(options.reps, [&] {
+        AstArena arena;
+        Parser(tokens, arena).parseProgram();
+    });
+
+    r.scanAllocsPerToken = r.tokens ? double(scanAllocs) / r.tokens : 0;
+    r.parseAllocsPerToken = r.tokens ? double(parseAllocs) / r.tokens : 0;
+    r.peakRss = memory::peakRssBytes();
+    return r;
+}
+
+void writeFrontendJson(std::ostream& json, const FrontendBenchOptions& options,
+                       const std::vector<FrontendResult>& results) {
+    json << "{\n  \"schema\": \"astervoid-bench-frontend/1\",\n"
+         << "  \"compiler\": \"" << __VERSION__ << "\",\n"
+         << "  \"simd\": \"" << charscan::kernels().name << "\",\n"
+         << "  \"target_bytes\": " << options.bytes << ",\n"
+         << "  \"reps\": " << options.reps << ",\n"
+         << "  \"results\": [\n";
+    char line[640];
+    for (size_t i = 0; i < results.size(); i++) {
+        const FrontendResult& r = results[i];
+        std::snprintf(line, sizeof line,
+                      "    {\"shape\": \"%s\", \"bytes\": %zu, \"tokens\": %zu, \"nodes\": %zu, "
+                      "\"scan_seconds\": %.6f, \"scan_mb_per_s\": %.2f, \"scan_tokens_per_s\": %.0f, "
+                      "\"parse_seconds\": %.6f, \"parse_nodes_per_s\": %.0f, "
+                      "\"scan_allocs_per_token\": %.6f, \"parse_allocs_per_token\": %.6f, "
+                      "\"peak_rss_bytes\": %zu}%s\n",
+                      corpusShapeName(r.shape), r.bytes, r.tokens, r.nodes, r.scanSeconds,
+                      r.bytes / r.scanSeconds / 1e6, r.tokens / r.scanSeconds, r.parseSeconds,
+                      r.nodes / r.parseSeconds, r.scanAllocsPerToken, r.parseAllocsPerToken, r.peakRss,
+                      i + 1 < results.size() ? "," : "");
+        json << line;
+    }
+    json << "  ]\n}\n";
+}
+
+} // namespace
+
+int runFrontendBenchmark(std::ostream& out, const FrontendBenchOptions& options) {
+    std::vector<CorpusShape> shapes = options.shapes;
+    if (shapes.empty()) shapes.assign(std::begin(ALL_CORPUS_SHAPES), std::end(ALL_CORPUS_SHAPES));
+
+    char line[256];
+    std::snprintf(line, sizeof line, "%-18s %9s %9s %10s %12s %12s %11s %11s %9s\n", "shape", "MB",
+                  "tokens", "scan MB/s", "scan tok/s", "parse node/s", "alloc/tok", "(parse)", "peak MB");
+    out << line;
+    std::vector<FrontendResult> results;
+    for (CorpusShape shape : shapes) {
+        FrontendResult r = measureFrontend(shape, options);
+        std::snprintf(line, sizeof line, "%-18s %9.2f %9zu %10.1f %12.0f %12.0f %11.4f %11.4f %9.1f\n",
+                      corpusShapeName(r.shape), r.bytes / 1e6, r.tokens, r.bytes / r.scanSeconds / 1e6,
+                      r.tokens / r.scanSeconds, r.nodes / r.parseSeconds, r.scanAllocsPerToken,
+                      r.parseAllocsPerToken, r.peakRss / 1e6);
+        out << line;
+        results.push_back(r);
+    }
+
+    if (options.jsonPath == "-") {
+        writeFrontendJson(std::cout, options, results);
+    } else if (!options.jsonPath.empty()) {
+        std::ofstream json(options.jsonPath);
+        if (!json) {
+            std::cerr << "Error: cannot write '" << options.jsonPath << "'\n";
+            return 1;
+        }
+        writeFrontendJson(json, options, results);
+    }
+    return 0;
+}
+
+int runCallBenchmark(std::ostream& out) {
+    const int reps = 5;
+    int status = 0;
+    char line[160];
+    std::snprintf(line, sizeof line, "%-14s %9s %11s %11s %11s %10s %10s %10s  %s\n", "workload", "calls", "tree (ms)",
+                  "vm (ms)", "jit (ms)", "tree Mc/s", "vm Mc/s", "jit Mc/s", "check");
+    out << line;
+
+    for (const CallWorkload& w : callWorkloads) {
+        double treeTime, vmTime, jitTime;
+        bool same = timeEngines(w.source, reps, treeTime, vmTime, jitTime);
+        bool slower = w.jitMustNotLose && jit::available() && jitTime > vmTime;
+        if (!same || slower) status = 1;
+        std::snprintf(line, sizeof line, "%-14s %9.0f %11.2f %11.2f %11.2f %10.2f %10.2f %10.2f  %s\n", w.name, w.calls,
+                      treeTime * 1e3, vmTime * 1e3, jitTime * 1e3, w.calls / treeTime / 1e6, w.calls / vmTime / 1e6,
+                      w.calls / jitTime / 1e6, !same ? "MISMATCH" : slower ? "SLOWER" : "ok");
+        out << line;
+    }
+    return status;
+}
+
+int runStringBenchmark(std::ostream& out) {
+    const int reps = 3;
+    int status = 0;
+    char line[160];
+    std::snprintf(line, sizeof line, "%-14s %9s %11s %11s %11s %9s %9s  %s\n", "workload", "shine MB", "tree (ms)",
+                  "vm (ms)", "jit (ms)", "vm/tree", "jit/vm", "check");
+    out << line;
+
+    for (const Workload& w : stringWorkloads) {
+        double treeTime, vmTime, jitTime;
+        uint64_t shineBytes = 0;
+        bool same = timeEngines(w.source, reps, treeTime, vmTime, jitTime, &shineBytes);
+        if (!same) status = 1;
+        std::snprintf(line, sizeof line, "%-14s %9.2f %11.2f %11.2f %11.2f %8.2fx %8.2fx  %s\n", w.name,
+                      shineBytes / 1e6, treeTime * 1e3, vmTime * 1e3, jitTime * 1e3, treeTime / vmTime,
+                      vmTime / jitTime, same ? "ok" : "MISMATCH");
+        out << line;
+    }
+    return status;
+}
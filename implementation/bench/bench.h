@@ -0,0 +1,42 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "corpus.h"
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// ---------- Benchmarks ----------
+// Built-in workloads run by `astervoid --bench`. Each returns a process exit
+// code (non-zero when engines disagree on a result).
+
+// bytecode VM (interpreted, then with the JIT) vs. the reference tree-walking
+// evaluator
+int runVmBenchmark(std::ostream& out);
+
+// call-heavy programs (recursive fib, Ackermann, mutual recursion through
+// tail calls, a small function called from a loop) in the same three
+// engines: times and millions of calls per second. Fails when the engines
+// disagree, or the JIT runs fib or Ackermann slower than the interpreter
+int runCallBenchmark(std::ostream& out);
+
+// star concatenation in orbit loops, comparisons against long constants and
+// shine-heavy output in the same three engines; shine output is counted and
+// compared, not printed
+int runStringBenchmark(std::ostream& out);
+
+// scanner and parser throughput over generated corpora (corpus.h): MB/s and
+// tokens/s for scanTokens(), nodes/s for parseProgram(), heap allocations
+// per token and peak RSS. The table goes to `out`; jsonPath ("-" = stdout)
+// also gets the results as JSON for tracking regressions between releases.
+struct FrontendBenchOptions {
+    size_t bytes = 8 << 20;          // source size per shape
+    std::vector<CorpusShape> shapes; // empty = all
+    int reps = 3;                    // best of
+    std::string jsonPath;
+};
+
+int runFrontendBenchmark(std::ostream& out, const FrontendBenchOptions& options);
+
+#endif
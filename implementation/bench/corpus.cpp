@@ -0,0 +1,191 @@
+#include "corpus.h"
+
+namespace {
+
+class Generator {
+public:
+    Generator(size_t target, uint64_t seed) : target(target), state(seed) { out.reserve(target + 4096); }
+
+    std::string run(CorpusShape shape) {
+        while (out.size() < target) {
+            switch (shape) {
+                case CorpusShape::CommentHeavy: commentHeavy(); break;
+                case CorpusShape::IdentifierHeavy: identifierHeavy(); break;
+                case CorpusShape::DeepNesting: nested(0, 16 + below(24)); break;
+                case CorpusShape::ArithmeticChains: arithmeticChain(); break;
+                case CorpusShape::Mixed:
+                    switch (below(4)) {
+                        case 0: commentHeavy(); break;
+                        case 1: identifierHeavy(); break;
+                        case 2: nested(0, 4 + below(8)); break;
+                        default: arithmeticChain(); break;
+                    }
+                    break;
+            }
+        }
+        return std::move(out);
+    }
+
+private:
+    size_t target;
+    uint64_t state;
+    std::string out;
+    size_t serial = 0;
+
+    uint64_t next() { // splitmix64
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    size_t below(size_t n) { return size_t(next() % n); }
+
+    void indent(int depth) { out.append(size_t(depth) * 4, ' '); }
+
+    void word(size_t length) {
+        static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+        for (size_t i = 0; i < length; i++) out += letters[below(26)];
+    }
+
+    void identifier() {
+        static const char* stems[] = {"orbital_velocity", "mass", "particle_count", "x", "delta_v",
+                                      "gravitational_constant_scaled", "i", "accumulator", "nebula_id"};
+        out += stems[below(sizeof stems / sizeof *stems)];
+        out += '_';
+        out += std::to_string(below(1000));
+    }
+
+    void number() {
+        if (below(3) == 0) out += std::to_string(below(1000)) + "." + std::to_string(below(100));
+        else out += std::to_string(below(100000));
+    }
+
+    void operand() {
+        switch (below(4)) {
+            case 0: number(); break;
+            case 1: // parenthesised pair
+                out += '(';
+                identifier();
+                out += below(2) ? " + " : " * ";
+                number();
+                out += ')';
+                break;
+            default: identifier(); break;
+        }
+    }
+
+    void expression(size_t operands) {
+        static const char* ops[] = {" + ", " - ", " * ", " / ", " % "};
+        operand();
+        for (size_t i = 1; i < operands; i++) {
+            out += ops[below(5)];
+            operand();
+        }
+    }
+
+    void commentHeavy() {
+        for (size_t lines = 1 + below(4); lines-- > 0;) {
+            out += "** ";
+            word(20 + below(60));
+            out += '\n';
+        }
+        if (below(2)) {
+            out += "*** ";
+            for (size_t lines = 1 + below(6); lines-- > 0;) {
+                word(30 + below(50));
+                out += '\n';
+            }
+            out += "***\n";
+        }
+        out += "mass c" + std::to_string(serial++) + " = ";
+        number();
+        out += ";   ** ";
+        word(10 + below(30));
+        out += '\n';
+    }
+
+    void identifierHeavy() {
+        static const char* types[] = {"mass", "flux", "quantum"};
+        out += types[below(3)];
+        out += ' ';
+        identifier();
+        out += std::to_string(serial++);
+        out += " = ";
+        identifier();
+        out += below(2) ? " + " : " - ";
+        identifier();
+        out += ";\n";
+        if (below(3) == 0) {
+            identifier();
+            out += " = ";
+            identifier();
+            out += ";\n";
+        }
+    }
+
+    void arithmeticChain() {
+        out += below(2) ? "flux " : "mass ";
+        out += "chain" + std::to_string(serial++) + " = ";
+        expression(20 + below(60));
+        out += ";\n";
+    }
+
+    void nested(int depth, int maxDepth) {
+        indent(depth);
+        switch (below(3)) {
+            case 0:
+                out += "orbit (";
+                identifier();
+                out += " < ";
+                number();
+                out += ") {\n";
+                break;
+            case 1:
+                out += "rotate (mass i = 0; i < ";
+                number();
+                out += "; i = i + 1) {\n";
+                break;
+            default:
+                out += "phase (";
+                identifier();
+                out += " == ";
+                number();
+                out += ") {\n";
+                break;
+        }
+        indent(depth + 1);
+        identifier();
+        out += " = ";
+        expression(2 + below(3));
+        out += ";\n";
+        if (depth + 1 < maxDepth) nested(depth + 1, maxDepth);
+        indent(depth);
+        out += "}\n";
+    }
+};
+
+} // namespace
+
+const char* corpusShapeName(CorpusShape shape) {
+    switch (shape) {
+        case CorpusShape::CommentHeavy: return "comment-heavy";
+        case CorpusShape::IdentifierHeavy: return "identifier-heavy";
+        case CorpusShape::DeepNesting: return "deep-nesting";
+        case CorpusShape::ArithmeticChains: return "arithmetic-chains";
+        case CorpusShape::Mixed: return "mixed";
+    }
+    return "?";
+}
+
+bool parseCorpusShape(std::string_view name, CorpusShape& shape) {
+    for (CorpusShape s : ALL_CORPUS_SHAPES)
+        if (name == corpusShapeName(s)) {
+            shape = s;
+            return true;
+        }
+    return false;
+}
+
+std::string generateCorpus(CorpusShape shape, size_t targetBytes, uint64_t seed) {
+    return Generator(targetBytes, seed).run(shape);
+}
@@ -0,0 +1,31 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// ---------- Synthetic corpus ----------
+// Deterministic .astv programs for the front-end benchmarks: the same shape,
+// size and seed give byte-identical text on every platform (the generator
+// uses its own PRNG, not <random> distributions). Every program parses.
+enum class CorpusShape {
+    CommentHeavy,    // mostly ** and *** comments around sparse declarations
+    IdentifierHeavy, // long identifiers and keywords, short expressions
+    DeepNesting,     // orbit / rotate / phase blocks nested dozens deep
+    ArithmeticChains,// long mixed-precedence expressions
+    Mixed,           // all of the above, interleaved
+};
+
+constexpr CorpusShape ALL_CORPUS_SHAPES[] = {CorpusShape::CommentHeavy, CorpusShape::IdentifierHeavy,
+                                             CorpusShape::DeepNesting, CorpusShape::ArithmeticChains,
+                                             CorpusShape::Mixed};
+
+const char* corpusShapeName(CorpusShape shape);
+bool parseCorpusShape(std::string_view name, CorpusShape& shape);
+
+// at least targetBytes of source (it stops after the statement that crosses it)
+std::string generateCorpus(CorpusShape shape, size_t targetBytes, uint64_t seed = 1);
+
+#endif
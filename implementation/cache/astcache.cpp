@@ -0,0 +1,547 @@
+#include "astcache.h"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char MAGIC[8] = {'A', 'S', 'T', 'V', 'C', 'A', 'C', 'H'};
+constexpr uint64_t NONE = ~uint64_t(0); // null pointer target
+
+struct Header {
+    char magic[8];
+    uint32_t format;
+    uint32_t layout;
+    uint64_t key;
+    uint64_t sourceSize;
+    uint64_t imageOffset;
+    uint64_t imageSize;
+    uint64_t relocOffset;
+    uint64_t relocCount;
+    uint64_t tokenRelocs;  // the first tokenRelocs entries patch the token array
+    uint64_t tokensOffset; // image offsets from here on
+    uint64_t tokenCount;
+    uint64_t rootOffset;
+    uint64_t nodeCount;
+    uint64_t contentHash; // entryHash(): everything above, the image and the relocations
+};
+
+// symbols are process-local, so identifier tokens store their text and are
+// re-interned on load
+enum class RelocKind : uint32_t { NullPointer, ImagePointer, NullView, SourceView, ImageView, SourceSymbol, ImageSymbol };
+
+// 32-bit fields keep the table small; units over 4 GiB are simply not cached
+struct Reloc {
+    uint32_t at;     // image offset of the pointer / string_view / symbol
+    uint32_t target; // image or source offset
+    uint32_t size;   // string views and symbols: length of the text
+    RelocKind kind;
+};
+
+constexpr uint64_t IMAGE_ALIGN = 64;
+
+uint64_t alignUp(uint64_t n, uint64_t align) { return (n + align - 1) & ~(align - 1); }
+
+uint64_t mix(uint64_t x) { // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// word-at-a-time hash of a byte string; reads the source about as fast as memcpy
+uint64_t hashBytes(std::string_view bytes, uint64_t seed) {
+    uint64_t h = seed ^ (bytes.size() * 0x9e3779b97f4a7c15ULL);
+    size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        uint64_t w;
+        std::memcpy(&w, bytes.data() + i, 8);
+        h = (h ^ mix(w)) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+    return mix(h ^ mix(tail ^ 0xa5a5a5a5a5a5a5a5ULL));
+}
+
+// a flipped byte anywhere in an entry must not turn into a wild pointer after
+// relocation, so the header (with contentHash zeroed), the image and the
+// relocation table are hashed together
+uint64_t entryHash(Header h, std::string_view image, std::string_view relocs) {
+    h.contentHash = 0;
+    uint64_t seed = hashBytes(std::string_view(reinterpret_cast<const char*>(&h), sizeof h), 0);
+    return hashBytes(relocs, hashBytes(image, seed));
+}
+
+// size and alignment of everything written raw into an image
+uint32_t layoutFingerprint() {
+    const size_t shape[] = {
+        sizeof(void*), sizeof(std::string_view), alignof(std::string_view), sizeof(Token), alignof(Token),
+        sizeof(StmtList), sizeof(ExprList), sizeof(AstList<Param>), sizeof(Param), alignof(Param),
+        sizeof(VarDecl), sizeof(FuncDecl), sizeof(BlockStmt), sizeof(ExprStmt), sizeof(IfStmt),
+        sizeof(WhileStmt), sizeof(ForStmt), sizeof(ReturnStmt), sizeof(BreakStmt), sizeof(ContinueStmt),
+        sizeof(BinaryExpr), sizeof(LiteralExpr), sizeof(VariableExpr), sizeof(AssignExpr),
+        sizeof(UnaryExpr), sizeof(LogicalExpr), sizeof(CallExpr), size_t(StmtKind::Continue) + 1,
+        size_t(ExprKind::Call) + 1, size_t(TokenType::ERROR)};
+    uint64_t h = 0x243f6a8885a308d3ULL;
+    for (size_t v : shape) h = mix(h ^ v);
+    return uint32_t(h ^ (h >> 32));
+}
+
+template <typename Object, typename Field>
+size_t fieldAt(const Object& object, const Field& field) {
+    return size_t(reinterpret_cast<const char*>(&field) - reinterpret_cast<const char*>(&object));
+}
+
+// ---------- Image writer ----------
+// Copies a tree into one byte buffer, recording a relocation for every
+// pointer and view it copies (and blanking those bytes, so entries are
+// reproducible).
+class ImageWriter {
+public:
+    explicit ImageWriter(std::string_view source) : source(source) {}
+
+    std::vector<char> image;
+    std::vector<Reloc> relocs;
+
+    size_t place(const void* bytes, size_t size, size_t align) {
+        size_t at = size_t(alignUp(image.size(), align));
+        image.resize(at + size);
+        if (bytes && size) std::memcpy(image.data() + at, bytes, size);
+        return at;
+    }
+
+    template <typename T>
+    size_t put(const T& object) {
+        static_assert(std::is_trivially_copyable<T>::value, "images are copied bytewise");
+        return place(&object, sizeof(T), alignof(T));
+    }
+
+    void pointer(size_t at, uint64_t target) {
+        std::memset(image.data() + at, 0, sizeof(void*));
+        relocs.push_back({uint32_t(at), uint32_t(target == NONE ? 0 : target), 0,
+                          target == NONE ? RelocKind::NullPointer : RelocKind::ImagePointer});
+    }
+
+    void view(size_t at, std::string_view text) {
+        std::memset(image.data() + at, 0, sizeof(std::string_view));
+        if (text.data() == nullptr) {
+            relocs.push_back({uint32_t(at), 0, 0, RelocKind::NullView});
+        } else if (text.data() >= source.data() && text.data() + text.size() <= source.data() + source.size()) {
+            relocs.push_back({uint32_t(at), uint32_t(text.data() - source.data()), uint32_t(text.size()),
+                              RelocKind::SourceView});
+        } else {
+            size_t copy = place(text.data(), text.size(), 1);
+            relocs.push_back({uint32_t(at), uint32_t(copy), uint32_t(text.size()), RelocKind::ImageView});
+        }
+    }
+
+    void symbol(size_t at, symbols::Symbol id) {
+        std::memset(image.data() + at, 0, sizeof(symbols::Symbol));
+        if (id == symbols::NO_SYMBOL) return; // zero is already right
+        std::string_view text = symbols::name(id);
+        if (text.data() >= source.data() && text.data() + text.size() <= source.data() + source.size()) {
+            relocs.push_back({uint32_t(at), uint32_t(text.data() - source.data()), uint32_t(text.size()),
+                              RelocKind::SourceSymbol});
+        } else {
+            size_t copy = place(text.data(), text.size(), 1);
+            relocs.push_back({uint32_t(at), uint32_t(copy), uint32_t(text.size()), RelocKind::ImageSymbol});
+        }
+    }
+
+    void token(size_t at, const Token& t) {
+        // the payload is a symbol only for identifiers; a decoded number is plain data
+        if (t.type == TokenType::IDENTIFIER) symbol(at + fieldAt(t, t.interned), t.symbol());
+        view(at + fieldAt(t, t.lexeme), t.lexeme);
+    }
+
+    size_t tokens(const Token* items, size_t n) {
+        size_t at = place(items, n * sizeof(Token), alignof(Token));
+        for (size_t i = 0; i < n; i++) token(at + i * sizeof(Token), items[i]);
+        return at;
+    }
+
+    // `at` is where the AstList itself sits in the image
+    void stmtList(size_t at, const StmtList& list) {
+        size_t items = list.empty() ? NONE : place(nullptr, list.size() * sizeof(Stmt*), alignof(Stmt*));
+        for (size_t i = 0; i < list.size(); i++) pointer(items + i * sizeof(Stmt*), stmt(list[i]));
+        pointer(at + fieldAt(list, list.items), items);
+    }
+
+    void exprList(size_t at, const ExprList& list) {
+        size_t items = list.empty() ? NONE : place(nullptr, list.size() * sizeof(Expr*), alignof(Expr*));
+        for (size_t i = 0; i < list.size(); i++) pointer(items + i * sizeof(Expr*), expr(list[i]));
+        pointer(at + fieldAt(list, list.items), items);
+    }
+
+    void paramList(size_t at, const AstList<Param>& list) {
+        size_t items = list.empty() ? NONE : place(list.items, list.size() * sizeof(Param), alignof(Param));
+        for (size_t i = 0; i < list.size(); i++) {
+            const Param& p = list[i];
+            size_t base = items + i * sizeof(Param);
+            token(base + fieldAt(p, p.type), p.type);
+            token(base + fieldAt(p, p.name), p.name);
+        }
+        pointer(at + fieldAt(list, list.items), items);
+    }
+
+    uint64_t stmt(const Stmt* s) {
+        if (!s) return NONE;
+        switch (s->kind) {
+            case StmtKind::VarDecl: {
+                auto& n = *static_cast<const VarDecl*>(s);
+                size_t at = put(n);
+                token(at + fieldAt(n, n.type), n.type);
+                token(at + fieldAt(n, n.name), n.name);
+                pointer(at + fieldAt(n, n.initializer), expr(n.initializer));
+                return at;
+            }
+            case StmtKind::FuncDecl: {
+                auto& n = *static_cast<const FuncDecl*>(s);
+                size_t at = put(n);
+                token(at + fieldAt(n, n.returnType), n.returnType);
+                token(at + fieldAt(n, n.name), n.name);
+                paramList(at + fieldAt(n, n.params), n.params);
+                stmtList(at + fieldAt(n, n.body), n.body);
+                return at;
+            }
+            case StmtKind::Block: {
+                auto& n = *static_cast<const BlockStmt*>(s);
+                size_t at = put(n);
+                stmtList(at + fieldAt(n, n.statements), n.statements);
+                return at;
+            }
+            case StmtKind::Expression: {
+                auto& n = *static_cast<const ExprStmt*>(s);
+                size_t at = put(n);
+                pointer(at + fieldAt(n, n.expression), expr(n.expression));
+                return at;
+            }
+            case StmtKind::If: {
+                auto& n = *static_cast<const IfStmt*>(s);
+                size_t at = put(n);
+                pointer(at + fieldAt(n, n.condition), expr(n.condition));
+                pointer(at + fieldAt(n, n.thenBranch), stmt(n.thenBranch));
+                pointer(at + fieldAt(n, n.elseBranch), stmt(n.elseBranch));
+                return at;
+            }
+            case StmtKind::While: {
+                auto& n = *static_cast<const WhileStmt*>(s);
+                size_t at = put(n);
+                pointer(at + fieldAt(n, n.condition), expr(n.condition));
+                pointer(at + fieldAt(n, n.body), stmt(n.body));
+                return at;
+            }
+            case StmtKind::For: {
+                auto& n = *static_cast<const ForStmt*>(s);
+                size_t at = put(n);
+                pointer(at + fieldAt(n, n.initializer), stmt(n.initializer));
+                pointer(at + fieldAt(n, n.condition), expr(n.condition));
+                pointer(at + fieldAt(n, n.increment), expr(n.increment));
+                pointer(at + fieldAt(n, n.body), stmt(n.body));
+                return at;
+            }
+            case StmtKind::Return: {
+                auto& n = *static_cast<const ReturnStmt*>(s);
+                size_t at = put(n);
+                pointer(at + fieldAt(n, n.value), expr(n.value));
+                return at;
+            }
+            case StmtKind::Break: return put(*static_cast<const BreakStmt*>(s));
+            case StmtKind::Continue: return put(*static_cast<const ContinueStmt*>(s));
+        }
+        throw std::runtime_error("cache: unknown statement kind");
+    }
+
+    uint64_t expr(const Expr* e) {
+        if (!e) return NONE;
+        switch (e->kind) {
+            case ExprKind::Binary: {
+                auto& n = *static_cast<const BinaryExpr*>(e);
+                size_t at = put(n);
+                pointer(at + fieldAt(n, n.left), expr(n.left));
+                token(at + fieldAt(n, n.op), n.op);
+                pointer(at + fieldAt(n, n.right), expr(n.right));
+                return at;
+            }
+            case ExprKind::Literal: {
+                auto& n = *static_cast<const LiteralExpr*>(e);
+                size_t at = put(n);
+                view(at + fieldAt(n, n.text), n.text);
+                return at;
+            }
+            case ExprKind::Variable: {
+                auto& n = *static_cast<const VariableExpr*>(e);
+                size_t at = put(n);
+                token(at + fieldAt(n, n.name), n.name);
+                return at;
+            }
+            case ExprKind::Assign: {
+                auto& n = *static_cast<const AssignExpr*>(e);
+                size_t at = put(n);
+                token(at + fieldAt(n, n.name), n.name);
+                token(at + fieldAt(n, n.op), n.op);
+                pointer(at + fieldAt(n, n.value), expr(n.value));
+                return at;
+            }
+            case ExprKind::Unary: {
+                auto& n = *static_cast<const UnaryExpr*>(e);
+                size_t at = put(n);
+                token(at + fieldAt(n, n.op), n.op);
+                pointer(at + fieldAt(n, n.operand), expr(n.operand));
+                return at;
+            }
+            case ExprKind::Logical: {
+                auto& n = *static_cast<const LogicalExpr*>(e);
+                size_t at = put(n);
+                pointer(at + fieldAt(n, n.left), expr(n.left));
+                token(at + fieldAt(n, n.op), n.op);
+                pointer(at + fieldAt(n, n.right), expr(n.right));
+                return at;
+            }
+            case ExprKind::Call: {
+                auto& n = *static_cast<const CallExpr*>(e);
+                size_t at = put(n);
+                token(at + fieldAt(n, n.callee), n.callee);
+                token(at + fieldAt(n, n.paren), n.paren);
+                exprList(at + fieldAt(n, n.args), n.args);
+                return at;
+            }
+        }
+        throw std::runtime_error("cache: unknown expression kind");
+    }
+
+private:
+    std::string_view source;
+};
+
+std::string buildId() {
+    return "astervoid-cache/" + std::to_string(CACHE_FORMAT_VERSION) + "/" +
+           std::to_string(layoutFingerprint()) + "/" + __VERSION__;
+}
+
+} // namespace
+
+// ---------- CachedUnit ----------
+
+CachedUnit::CachedUnit(CachedUnit&& other) noexcept { *this = std::move(other); }
+
+CachedUnit& CachedUnit::operator=(CachedUnit&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    base = other.base, size = other.size, mapped = other.mapped;
+    root = other.root, tokenData = other.tokenData, tokenTotal = other.tokenTotal, nodes = other.nodes;
+    other.base = nullptr, other.size = 0, other.mapped = false;
+    return *this;
+}
+
+CachedUnit::~CachedUnit() { release(); }
+
+void CachedUnit::release() {
+#ifndef _WIN32
+    if (mapped && base) ::munmap(base, size);
+#endif
+    if (!mapped) delete[] base;
+    base = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+// ---------- AstCache ----------
+
+AstCache::AstCache(std::string directory) : dir(std::move(directory)) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec || !std::filesystem::is_directory(dir))
+        throw std::runtime_error("cannot use cache directory '" + dir + "': " + ec.message());
+}
+
+uint64_t AstCache::key(std::string_view source) const {
+    static const uint64_t buildSeed = hashBytes(buildId(), 0);
+    return hashBytes(source, buildSeed);
+}
+
+std::string AstCache::entryPath(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof name, "%016llx.astc", (unsigned long long)key);
+    return (std::filesystem::path(dir) / name).string();
+}
+
+bool AstCache::load(uint64_t key, std::string_view source, CachedUnit& unit, bool withTokens) const {
+    std::string path = entryPath(key);
+    CachedUnit entry;
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    entry.size = size_t(in.tellg());
+    entry.base = new char[entry.size ? entry.size : 1];
+    in.seekg(0);
+    if (!in.read(entry.base, std::streamsize(entry.size))) return false;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || st.st_size < off_t(sizeof(Header))) {
+        ::close(fd);
+        return false;
+    }
+    // private mapping: relocation writes go to copy-on-write pages, never the file
+    void* p = ::mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    entry.base = static_cast<char*>(p);
+    entry.size = size_t(st.st_size);
+    entry.mapped = true;
+#endif
+    if (entry.size < sizeof(Header)) return false;
+
+    Header h;
+    std::memcpy(&h, entry.base, sizeof h);
+    if (std::memcmp(h.magic, MAGIC, sizeof MAGIC) != 0 || h.format != CACHE_FORMAT_VERSION ||
+        h.layout != layoutFingerprint() || h.key != key || h.sourceSize != source.size())
+        return false;
+    if (h.imageOffset % IMAGE_ALIGN || h.imageOffset > entry.size || h.imageSize > entry.size - h.imageOffset ||
+        h.relocOffset > entry.size || h.relocCount > (entry.size - h.relocOffset) / sizeof(Reloc) ||
+        h.tokenRelocs > h.relocCount ||
+        h.tokenCount > h.imageSize / sizeof(Token) || h.tokensOffset > h.imageSize - h.tokenCount * sizeof(Token) ||
+        h.rootOffset > h.imageSize - sizeof(StmtList))
+        return false;
+    if (entryHash(h, std::string_view(entry.base + h.imageOffset, h.imageSize),
+                  std::string_view(entry.base + h.relocOffset, h.relocCount * sizeof(Reloc))) != h.contentHash)
+        return false;
+
+    // patch every pointer and view; the image is then usable as it lies. The
+    // token array is left alone (and its pages untouched) unless asked for
+    char* image = entry.base + h.imageOffset;
+    const char* relocBytes = entry.base + h.relocOffset;
+    for (uint64_t i = withTokens ? 0 : h.tokenRelocs; i < h.relocCount; i++) {
+        Reloc r;
+        std::memcpy(&r, relocBytes + i * sizeof(Reloc), sizeof r);
+        size_t width = r.kind >= RelocKind::SourceSymbol ? sizeof(symbols::Symbol)
+                       : r.kind >= RelocKind::NullView   ? sizeof(std::string_view)
+                                                         : sizeof(void*);
+        if (r.at > h.imageSize - width) return false;
+        switch (r.kind) {
+            case RelocKind::NullPointer: {
+                void* null = nullptr;
+                std::memcpy(image + r.at, &null, sizeof null);
+                break;
+            }
+            case RelocKind::ImagePointer: {
+                if (r.target >= h.imageSize) return false;
+                void* ptr = image + r.target;
+                std::memcpy(image + r.at, &ptr, sizeof ptr);
+                break;
+            }
+            case RelocKind::NullView: new (image + r.at) std::string_view(); break;
+            case RelocKind::SourceView:
+                if (r.target > source.size() || r.size > source.size() - r.target) return false;
+                new (image + r.at) std::string_view(source.data() + r.target, r.size);
+                break;
+            case RelocKind::ImageView:
+                if (r.target > h.imageSize || r.size > h.imageSize - r.target) return false;
+                new (image + r.at) std::string_view(image + r.target, r.size);
+                break;
+            case RelocKind::SourceSymbol:
+            case RelocKind::ImageSymbol: {
+                std::string_view text;
+                if (r.kind == RelocKind::SourceSymbol) {
+                    if (r.target > source.size() || r.size > source.size() - r.target) return false;
+                    text = source.substr(r.target, r.size);
+                } else {
+                    if (r.target > h.imageSize || r.size > h.imageSize - r.target) return false;
+                    text = std::string_view(image + r.target, r.size);
+                }
+                symbols::Symbol id = symbols::intern(text);
+                std::memcpy(image + r.at, &id, sizeof id);
+                break;
+            }
+            default: return false;
+        }
+    }
+
+    entry.root = *reinterpret_cast<const StmtList*>(image + h.rootOffset);
+    if (withTokens) entry.tokenData = reinterpret_cast<const Token*>(image + h.tokensOffset);
+    entry.tokenTotal = size_t(h.tokenCount);
+    entry.nodes = size_t(h.nodeCount);
+    unit = std::move(entry);
+    return true;
+}
+
+bool AstCache::store(uint64_t key, std::string_view source, const std::vector<Token>& tokens,
+                     const StmtList& program, size_t nodeCount) const {
+    ImageWriter writer(source);
+    Header h{};
+    std::memcpy(h.magic, MAGIC, sizeof MAGIC);
+    h.format = CACHE_FORMAT_VERSION;
+    h.layout = layoutFingerprint();
+    h.key = key;
+    h.sourceSize = source.size();
+    h.tokenCount = tokens.size();
+    h.nodeCount = nodeCount;
+    if (source.size() > UINT32_MAX) return false;
+    try {
+        h.tokensOffset = writer.tokens(tokens.data(), tokens.size());
+        h.tokenRelocs = writer.relocs.size();
+        h.rootOffset = writer.put(program);
+        writer.stmtList(size_t(h.rootOffset), program);
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (writer.image.size() > UINT32_MAX) return false;
+    h.imageOffset = alignUp(sizeof(Header), IMAGE_ALIGN);
+    h.imageSize = writer.image.size();
+    h.relocOffset = alignUp(h.imageOffset + h.imageSize, alignof(Reloc));
+    h.relocCount = writer.relocs.size();
+    h.contentHash = entryHash(h, std::string_view(writer.image.data(), writer.image.size()),
+                              std::string_view(reinterpret_cast<const char*>(writer.relocs.data()),
+                                               writer.relocs.size() * sizeof(Reloc)));
+
+    // write a private temp file and rename it over the entry, so readers and
+    // other writers never see a half-written file
+    static std::atomic<unsigned> serial{0};
+#ifdef _WIN32
+    long pid = long(_getpid());
+#else
+    long pid = long(::getpid());
+#endif
+    std::string path = entryPath(key);
+    std::string temp = path + ".tmp." + std::to_string(pid) + "." + std::to_string(serial++);
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        static const char zeros[IMAGE_ALIGN] = {};
+        out.write(reinterpret_cast<const char*>(&h), sizeof h);
+        out.write(zeros, std::streamsize(h.imageOffset - sizeof h));
+        out.write(writer.image.data(), std::streamsize(writer.image.size()));
+        out.write(zeros, std::streamsize(h.relocOffset - h.imageOffset - h.imageSize));
+        out.write(reinterpret_cast<const char*>(writer.relocs.data()),
+                  std::streamsize(writer.relocs.size() * sizeof(Reloc)));
+        if (!out) {
+            out.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include "../parser/parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------- Token / AST cache ----------
+// On-disk cache of scanned and parsed files, one file per source, named after
+// a 64-bit hash of the source bytes and the compiler build. An entry is a
+// relocatable image of the unit rather than a serialized stream:
+//
+//   header   magic, format version, layout fingerprint, source hash and size,
+//            counts and the offsets of the sections below, and a hash of
+//            the header, the image and the relocations
+//   image    the Token array and every AST node, byte-for-byte as they sit in
+//            memory, with all pointers and string views blanked out
+//   relocs   one entry per pointer / string view in the image: where it is,
+//            what it points at (an image offset, a source offset or null) and,
+//            for views, the length
+//
+// Loading maps the file copy-on-write, checks the header and the hash (a
+// damaged entry is a miss, never a crash), and patches the relocations in
+// place; the nodes are then used where they lie, no node is rebuilt. Text
+// that does not come from the source (folded literals) is stored in the image. Symbols are not stored:
+// each identifier token records its text and is re-interned when loaded.
+// The layout fingerprint covers the size and alignment of every node type, so
+// a build whose AST layout differs never reads an old entry; bump
+// CACHE_FORMAT_VERSION when the meaning of a node changes without its layout.
+constexpr uint32_t CACHE_FORMAT_VERSION = 5;
+
+// A cache hit: the nodes and tokens live in the mapping and point into the
+// source text passed to load(), which must outlive the unit.
+class CachedUnit {
+public:
+    CachedUnit() = default;
+    CachedUnit(CachedUnit&& other) noexcept;
+    CachedUnit& operator=(CachedUnit&& other) noexcept;
+    CachedUnit(const CachedUnit&) = delete;
+    CachedUnit& operator=(const CachedUnit&) = delete;
+    ~CachedUnit();
+
+    StmtList program() const { return root; }
+    const Token* tokens() const { return tokenData; } // null unless loaded withTokens
+    size_t tokenCount() const { return tokenTotal; } // END_OF_FILE included
+    size_t nodeCount() const { return nodes; }
+
+private:
+    friend class AstCache;
+    char* base = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    StmtList root;
+    const Token* tokenData = nullptr;
+    size_t tokenTotal = 0;
+    size_t nodes = 0;
+
+    void release();
+};
+
+class AstCache {
+public:
+    explicit AstCache(std::string directory); // creates it; throws std::runtime_error
+
+    // cache key of a source text: its bytes, the cache format and the build
+    uint64_t key(std::string_view source) const;
+    // true on a hit. Stale or foreign entries, and entries whose header or
+    // relocations are out of bounds, read as misses; the node bytes themselves
+    // are trusted like any other build output. The token array is only made
+    // usable with withTokens
+    bool load(uint64_t key, std::string_view source, CachedUnit& unit, bool withTokens = false) const;
+    // write the unit's entry (atomically, so concurrent writers are safe);
+    // best effort: returns false instead of throwing when it cannot
+    bool store(uint64_t key, std::string_view source, const std::vector<Token>& tokens,
+               const StmtList& program, size_t nodeCount) const;
+
+private:
+    std::string dir;
+
+    std::string entryPath(uint64_t key) const;
+};
+
+#endif
@@ -0,0 +1,469 @@
+#include "cemit.h"
+#include "runtime.h"
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace cgen {
+namespace {
+
+using ir::BlockId;
+using ir::Inst;
+using ir::NONE;
+using ir::Opcode;
+using ir::Type;
+using ir::ValueId;
+
+bool isBoxed(Type t) { return t == Type::Nil || t == Type::Any; }
+
+const char* cTypeName(Type t) {
+    switch (t) {
+        case Type::Int: return "int64_t";
+        case Type::Float: return "double";
+        case Type::Bool: return "bool";
+        case Type::Str: return "av_star";
+        default: return "av_value";
+    }
+}
+
+// the runtime type tag of a statically typed value
+const char* typeTag(Type t) {
+    switch (t) {
+        case Type::Int: return "AV_INT";
+        case Type::Float: return "AV_FLOAT";
+        case Type::Bool: return "AV_BOOL";
+        case Type::Str: return "AV_STR";
+        default: return "AV_NIL";
+    }
+}
+
+// the runtime's operator constant, the C operator and the verb of type errors
+struct OpSpelling {
+    const char* runtime;
+    const char* c;
+    const char* verb;
+};
+
+OpSpelling spell(Opcode op) {
+    switch (op) {
+        case Opcode::Add: return {"AV_ADD", "+", "add"};
+        case Opcode::Sub: return {"AV_SUB", "-", "subtract"};
+        case Opcode::Mul: return {"AV_MUL", "*", "multiply"};
+        case Opcode::Div: return {"AV_DIV", "/", "divide"};
+        case Opcode::Mod: return {"AV_MOD", "%", "take the remainder of"};
+        case Opcode::Eq: return {"AV_EQ", "==", "compare"};
+        case Opcode::Ne: return {"AV_NE", "!=", "compare"};
+        case Opcode::Lt: return {"AV_LT", "<", "compare"};
+        case Opcode::Le: return {"AV_LE", "<=", "compare"};
+        case Opcode::Gt: return {"AV_GT", ">", "compare"};
+        case Opcode::Ge: return {"AV_GE", ">=", "compare"};
+        case Opcode::BAnd: return {"AV_AND", "&", "bitwise-and"};
+        case Opcode::BOr: return {"AV_OR", "|", "bitwise-or"};
+        case Opcode::BXor: return {"AV_XOR", "^", "bitwise-xor"};
+        default: throw std::runtime_error("Unsupported binary operator");
+    }
+}
+
+std::string intLiteral(int64_t v) {
+    if (v == INT64_MIN) return "INT64_MIN";
+    return "INT64_C(" + std::to_string(v) + ")";
+}
+
+std::string floatLiteral(double d) {
+    if (std::isnan(d)) return "NAN";
+    if (std::isinf(d)) return d > 0 ? "INFINITY" : "(-INFINITY)";
+    char buf[32];
+    std::snprintf(buf, sizeof buf, "%.17g", d);
+    std::string text = buf;
+    if (text.find_first_of(".e") == std::string::npos) text += ".0";
+    return std::signbit(d) ? "(" + text + ")" : text;
+}
+
+std::string stringLiteral(std::string_view text) {
+    std::string out = "\"";
+    for (unsigned char c : text) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"': out += "\\\""; break;
+            case '?': out += "\\?"; break; // no trigraphs
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c >= 0x20 && c < 0x7F) {
+                    out += char(c);
+                } else {
+                    char buf[8];
+                    std::snprintf(buf, sizeof buf, "\\%03o", c);
+                    out += buf;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+// ---------- Emitter ----------
+// One C function per IR function: every value the IR types gets a local of
+// that type, declared up front, and each block is a run of assignments that
+// ends in a goto, a return or a failure.
+class Emitter {
+public:
+    Emitter(const ir::Program& program, const LineTable& lines) : program(program), lines(lines) {}
+    void run(const std::string& sourceName, std::ostream& out);
+
+private:
+    // C code of an operand and its static type
+    struct CExpr {
+        std::string code;
+        Type type;
+    };
+
+    const ir::Program& program;
+    const LineTable& lines;
+
+    // per C function
+    const ir::Function* fn = nullptr;
+    bool script = false;
+    std::string body;
+    int indent = 1;
+    std::vector<bool> targeted; // by block: some goto names its label
+
+    int line(const Inst& inst) const { return lines.line(inst.offset); }
+    std::string signature(const ir::Function& f) const;
+    std::string globalName(uint32_t slot) const;
+
+    void emitFunction(const ir::Function& f, std::ostream& out);
+    void emitBlock(BlockId b, BlockId next);
+    void instruction(ValueId v);
+    void jump(BlockId from, BlockId to, BlockId next);
+    void put(const std::string& text);
+
+    CExpr value(ValueId v) const;
+    bool reached(const Inst& inst) const;
+    CExpr binary(const Inst& inst, const CExpr& l, const CExpr& r) const;
+    std::string print(const Inst& inst) const;
+    std::string call(const Inst& inst) const;
+    static CExpr convert(const CExpr& value, Type to);
+    static std::string box(const CExpr& value);
+    static std::string truthy(const CExpr& value);
+};
+
+std::string Emitter::globalName(uint32_t slot) const {
+    return "g_" + program.globals[slot] + "_" + std::to_string(slot);
+}
+
+std::string Emitter::signature(const ir::Function& f) const {
+    std::string text = std::string("static ") + cTypeName(f.returnType) + " f_" + f.name + "(";
+    for (uint32_t i = 0; i < f.numParams; i++)
+        text += std::string(i ? ", " : "") + cTypeName(f.paramTypes[i]) + " a" + std::to_string(i);
+    return text + (f.numParams ? ")" : "void)");
+}
+
+// ---------- operands ----------
+// a constant is spelled out where it is used; a parameter is the C one
+Emitter::CExpr Emitter::value(ValueId v) const {
+    const Inst& inst = (*fn)[v];
+    if (inst.op == Opcode::Param) return {"a" + std::to_string(inst.index), inst.type};
+    if (inst.op != Opcode::Const) return {"v" + std::to_string(v), inst.type};
+    const Value& k = inst.constant;
+    switch (k.type) {
+        case Value::Type::Int: return {intLiteral(k.i), Type::Int};
+        case Value::Type::Float: return {floatLiteral(k.f), Type::Float};
+        case Value::Type::Bool: return {k.b ? "true" : "false", Type::Bool};
+        case Value::Type::Str: {
+            std::string_view text = starText(k);
+            return {"av_lit(" + stringLiteral(text) + ", " + std::to_string(text.size()) + ")", Type::Str};
+        }
+        default: return {"av_nil()", Type::Nil};
+    }
+}
+
+// an argument no value reaches was defined by an operation that always
+// fails: whatever uses it never runs
+bool Emitter::reached(const Inst& inst) const {
+    for (ValueId a : inst.args)
+        if ((*fn)[a].type == Type::Unset) return false;
+    return true;
+}
+
+Emitter::CExpr Emitter::convert(const CExpr& value, Type to) {
+    Type from = value.type;
+    if (from == to || (isBoxed(from) && isBoxed(to))) return {value.code, to};
+    if (isBoxed(to)) return {box(value), to};
+    if (from == Type::Int && to == Type::Float) return {"((double)" + value.code + ")", to};
+    if (from == Type::Float && to == Type::Int) return {"av_f2i(" + value.code + ")", to};
+    throw std::runtime_error("C backend: no conversion between inferred types");
+}
+
+std::string Emitter::box(const CExpr& value) {
+    switch (value.type) {
+        case Type::Int: return "av_int(" + value.code + ")";
+        case Type::Float: return "av_float(" + value.code + ")";
+        case Type::Bool: return "av_bool(" + value.code + ")";
+        case Type::Str: return "av_str(" + value.code + ")";
+        default: return value.code;
+    }
+}
+
+std::string Emitter::truthy(const CExpr& value) {
+    switch (value.type) {
+        case Type::Int: return "(" + value.code + " != 0)";
+        case Type::Float: return "(" + value.code + " != 0.0)";
+        case Type::Bool: return value.code;
+        case Type::Str: return "(" + value.code + ".n != 0)";
+        case Type::Any: return "av_truthy(" + value.code + ")";
+        default: return "false";
+    }
+}
+
+// ---------- instructions ----------
+// the result type is the instruction's; Unset when the types prove it fails
+Emitter::CExpr Emitter::binary(const Inst& inst, const CExpr& l, const CExpr& r) const {
+    Type type = inst.type;
+    OpSpelling s = spell(inst.op);
+    std::string lineArg = std::to_string(line(inst));
+
+    if (l.type == Type::Any || r.type == Type::Any) {
+        // the shim checks the operand types and raises the VM's errors
+        std::string args = std::string(s.runtime) + ", " + box(l) + ", " + box(r) + ", " + lineArg + ")";
+        std::string call = isArithmetic(inst.op) ? "av_arith(" + args
+                           : isBitwise(inst.op)  ? "av_bitwise(" + args
+                                                 : "av_compare(" + args;
+        return {call, type};
+    }
+    if (type == Type::Unset)
+        return {"av_type_error(" + lineArg + ", \"" + s.verb + "\", " + typeTag(l.type) + ", " + typeTag(r.type) + ")",
+                type};
+
+    if (isArithmetic(inst.op)) {
+        if (type == Type::Str) return {"av_concat(" + l.code + ", " + r.code + ")", type};
+        if (type == Type::Int) {
+            switch (inst.op) {
+                case Opcode::Add: return {"av_iadd(" + l.code + ", " + r.code + ")", type};
+                case Opcode::Sub: return {"av_isub(" + l.code + ", " + r.code + ")", type};
+                case Opcode::Mul: return {"av_imul(" + l.code + ", " + r.code + ")", type};
+                case Opcode::Div: return {"av_idiv(" + l.code + ", " + r.code + ", " + lineArg + ")", type};
+                default: return {"av_imod(" + l.code + ", " + r.code + ", " + lineArg + ")", type};
+            }
+        }
+        if (inst.op == Opcode::Mod) return {"fmod(" + convert(l, type).code + ", " + convert(r, type).code + ")", type};
+        return {"(" + convert(l, type).code + " " + s.c + " " + convert(r, type).code + ")", type};
+    }
+    if (isBitwise(inst.op)) return {"(" + l.code + " " + s.c + " " + r.code + ")", type};
+
+    if (isNumeric(l.type) && isNumeric(r.type)) {
+        Type common = l.type == r.type ? l.type : Type::Float;
+        return {"(" + convert(l, common).code + " " + s.c + " " + convert(r, common).code + ")", type};
+    }
+    if (l.type == Type::Str && r.type == Type::Str)
+        return {"(av_star_compare(" + l.code + ", " + r.code + ") " + s.c + " 0)", type};
+    // equality of anything else: only truth == truth and vacuum == vacuum can hold
+    if (l.type == Type::Bool && r.type == Type::Bool) return {"(" + l.code + " " + s.c + " " + r.code + ")", type};
+    bool same = l.type == r.type; // both vacuum
+    return {(same != (inst.op == Opcode::Ne)) ? "true" : "false", type};
+}
+
+std::string Emitter::print(const Inst& inst) const {
+    std::string code;
+    for (size_t i = 0; i < inst.args.size(); i++) {
+        CExpr arg = value(inst.args[i]);
+        if (i > 0) code += "av_print_space(); ";
+        switch (arg.type) {
+            case Type::Int: code += "av_print_int("; break;
+            case Type::Float: code += "av_print_float("; break;
+            case Type::Bool: code += "av_print_bool("; break;
+            case Type::Str: code += "av_print_str("; break;
+            default: code += "av_print("; break;
+        }
+        code += arg.code + "); ";
+    }
+    return code + "av_print_end();";
+}
+
+// the arguments become what the callee's parameters hold (boxed where those vary)
+std::string Emitter::call(const Inst& inst) const {
+    const ir::Function& callee = program.functions[inst.index];
+    std::string code = "f_" + callee.name + "(";
+    for (size_t i = 0; i < inst.args.size(); i++)
+        code += std::string(i ? ", " : "") + convert(value(inst.args[i]), callee.paramTypes[i]).code;
+    return code + ")";
+}
+
+void Emitter::put(const std::string& text) {
+    body.append(size_t(indent) * 4, ' ');
+    body += text;
+    body += '\n';
+}
+
+void Emitter::instruction(ValueId v) {
+    const Inst& inst = (*fn)[v];
+    if (!reached(inst)) return;
+    std::string lineArg = std::to_string(line(inst));
+    std::string result = "v" + std::to_string(v);
+    auto assign = [&](const CExpr& e) {
+        if (e.type == Type::Unset) put("(void)" + e.code + ";");
+        else put(result + " = " + e.code + ";");
+    };
+    switch (inst.op) {
+        case Opcode::Const:
+        case Opcode::Phi:
+        case Opcode::Param: return; // spelled out, copied on the edges, or the C parameter
+        case Opcode::Print: put(print(inst)); return;
+        case Opcode::GetGlobal: put(result + " = " + globalName(inst.index) + ";"); return;
+        case Opcode::SetGlobal:
+            put(globalName(inst.index) + " = " + convert(value(inst.args[0]), program.globalTypes[inst.index]).code + ";");
+            return;
+        case Opcode::Call:
+            put(result + " = " + call(inst) + ";");
+            return;
+        case Opcode::ToInt:
+        case Opcode::ToFloat: {
+            // coercion changes flux to mass and back; anything else stays as it is
+            CExpr arg = value(inst.args[0]);
+            bool toInt = inst.op == Opcode::ToInt;
+            if (isBoxed(arg.type)) assign({std::string(toInt ? "av_to_mass(" : "av_to_flux(") + arg.code + ")", inst.type});
+            else assign(convert(arg, inst.type));
+            return;
+        }
+        case Opcode::Neg: {
+            CExpr arg = value(inst.args[0]);
+            switch (arg.type) {
+                case Type::Int: assign({"av_ineg(" + arg.code + ")", Type::Int}); break;
+                case Type::Float: assign({"(-" + arg.code + ")", Type::Float}); break;
+                case Type::Any: assign({"av_negate(" + arg.code + ", " + lineArg + ")", Type::Any}); break;
+                default: put("av_negate_error(" + lineArg + ", " + typeTag(arg.type) + ");");
+            }
+            return;
+        }
+        case Opcode::Not: assign({"!" + truthy(value(inst.args[0])), Type::Bool}); return;
+        case Opcode::ToBool: assign({truthy(value(inst.args[0])), Type::Bool}); return;
+        default: assign(binary(inst, value(inst.args[0]), value(inst.args[1])));
+    }
+}
+
+// the phi copies of the edge, through temporaries when one phi reads another
+// of the same block, then the goto (none into the next block in the layout)
+void Emitter::jump(BlockId from, BlockId to, BlockId next) {
+    const ir::Block& target = fn->blocks[to];
+    size_t edge = 0;
+    while (target.preds[edge] != from) edge++;
+    std::vector<std::pair<ValueId, CExpr>> moves;
+    bool swaps = false;
+    for (ValueId phi : target.insts) {
+        const Inst& inst = (*fn)[phi];
+        if (inst.op != Opcode::Phi) break;
+        ValueId in = inst.args[edge];
+        if (in == phi || inst.type == Type::Unset || (*fn)[in].type == Type::Unset) continue;
+        swaps = swaps || ((*fn)[in].op == Opcode::Phi && (*fn)[in].block == to);
+        moves.push_back({phi, convert(value(in), inst.type)});
+    }
+    if (swaps) {
+        std::string open = "{ ";
+        for (size_t i = 0; i < moves.size(); i++)
+            open += std::string(cTypeName((*fn)[moves[i].first].type)) + " c" + std::to_string(i) + " = " +
+                    moves[i].second.code + "; ";
+        put(open);
+        indent++;
+        for (size_t i = 0; i < moves.size(); i++)
+            put("v" + std::to_string(moves[i].first) + " = c" + std::to_string(i) + ";");
+        indent--;
+        put("}");
+    } else {
+        for (const auto& [phi, in] : moves) put("v" + std::to_string(phi) + " = " + in.code + ";");
+    }
+    if (to == next) return;
+    targeted[to] = true;
+    put("goto b" + std::to_string(to) + ";");
+}
+
+void Emitter::emitBlock(BlockId b, BlockId next) {
+    const ir::Block& block = fn->blocks[b];
+    for (ValueId v : block.insts) {
+        const Inst& inst = (*fn)[v];
+        if (!isTerminator(inst.op)) {
+            instruction(v);
+            continue;
+        }
+        if (!reached(inst)) {
+            put("abort(); /* unreachable */");
+            continue;
+        }
+        switch (inst.op) {
+            case Opcode::Jump: jump(b, block.succs[0], next); break;
+            case Opcode::Branch: {
+                // the edge into the next block in the layout falls through
+                BlockId ifTrue = block.succs[0], ifFalse = block.succs[1];
+                std::string cond = truthy(value(inst.args[0]));
+                if (ifTrue == next) {
+                    std::swap(ifTrue, ifFalse);
+                    cond = "!" + cond;
+                }
+                put("if (" + cond + ") {");
+                indent++;
+                jump(b, ifTrue, NONE);
+                indent--;
+                put("}");
+                jump(b, ifFalse, next);
+                break;
+            }
+            case Opcode::Return:
+                if (script) put("return 0;");
+                else put("return " + convert(value(inst.args[0]), fn->returnType).code + ";");
+                break;
+            default: // TailCall: the C compiler turns this into a jump where it can
+                put("return " + convert({call(inst), program.functions[inst.index].returnType}, fn->returnType).code +
+                    ";");
+        }
+    }
+}
+
+void Emitter::emitFunction(const ir::Function& f, std::ostream& out) {
+    fn = &f;
+    script = &f == &program.functions[0];
+    targeted.assign(f.blocks.size(), false);
+    std::vector<BlockId> order = f.reversePostorder();
+    std::vector<std::string> blocks;
+    for (size_t i = 0; i < order.size(); i++) {
+        emitBlock(order[i], i + 1 < order.size() ? order[i + 1] : NONE);
+        blocks.push_back(std::move(body));
+        body.clear();
+    }
+
+    out << "\n" << (script ? std::string("int main(void)") : signature(f)) << " {\n";
+    for (BlockId b : order)
+        for (ValueId v : f.blocks[b].insts) {
+            const Inst& inst = f[v];
+            bool local = inst.type != Type::Unset && inst.op != Opcode::Const && inst.op != Opcode::Param &&
+                         !isTerminator(inst.op);
+            if (local) out << "    " << cTypeName(inst.type) << " v" << v << ";\n";
+        }
+    for (size_t i = 0; i < order.size(); i++) {
+        if (targeted[order[i]]) out << "b" << order[i] << ":;\n";
+        out << blocks[i];
+    }
+    out << "}\n";
+}
+
+// ---------- driver ----------
+void Emitter::run(const std::string& sourceName, std::ostream& out) {
+    out << "/* generated by astervoid --emit=c from " << sourceName << "\n"
+        << "   build: cc -O2 -o prog this.c -lm */\n"
+        << runtimeSource << "\n/* ---------- program ---------- */\n";
+    for (uint32_t slot = 0; slot < program.globals.size(); slot++)
+        out << "static " << cTypeName(program.globalTypes[slot]) << " " << globalName(slot) << ";\n";
+    if (program.functions.size() > 1) out << "\n";
+    for (size_t i = 1; i < program.functions.size(); i++) out << signature(program.functions[i]) << ";\n";
+    for (size_t i = 1; i < program.functions.size(); i++) emitFunction(program.functions[i], out);
+    emitFunction(program.functions[0], out);
+}
+
+} // namespace
+
+void emitProgram(const ir::Program& program, const LineTable& lines, const std::string& sourceName,
+                 std::ostream& out) {
+    Emitter(program, lines).run(sourceName, out);
+}
+
+} // namespace cgen
@@ -0,0 +1,29 @@
+#ifndef CEMIT_H
+#define CEMIT_H
+
+#include "../ir/ir.h"
+#include "../source/linetable.h"
+#include <ostream>
+#include <string>
+
+// ---------- C backend ----------
+// Lowers an optimized IR program (see ir/build.h, ir/passes.h) to one
+// self-contained C99 file for an ahead-of-time native build: `cc -O2 prog.c
+// -lm`. Each function becomes a C function and each IR value a C local of
+// the type the IR inferred for it, over the whole program: mass is int64_t,
+// flux is double, truth is bool, star is av_star, and a value whose type
+// really varies is the tagged av_value of the runtime shim (see runtime.h),
+// which the shim's dynamic helpers work on. Blocks become labels, phis
+// copies on the edges into them, and the script's global slots static
+// variables. The emitted program prints what the VM prints and fails with
+// the VM's runtime errors ("Error: Line N: ...", exit status 1); errors the
+// types already prove are emitted as unconditional failures at the same point.
+namespace cgen {
+
+// sourceName only goes into the header comment
+void emitProgram(const ir::Program& program, const LineTable& lines, const std::string& sourceName,
+                 std::ostream& out);
+
+} // namespace cgen
+
+#endif
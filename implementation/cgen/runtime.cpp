@@ -0,0 +1,266 @@
+#include "runtime.h"
+
+namespace cgen {
+
+// kept in step with vm/value.cpp: both engines and the emitted programs must
+// print the same text and fail with the same messages
+const char runtimeSource[] = R"ASTERVOID_RT(
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---------- astervoid runtime ---------- */
+/* a star: the first n bytes at p. One that concatenation built is the start
+   of buf's bytes; literals have no buffer */
+typedef struct {
+    size_t used;     /* bytes written; the star ending here may be appended to in place */
+    size_t capacity; /* bytes allocated after the header */
+} av_buf;
+
+typedef struct {
+    const char* p;
+    size_t n;
+    av_buf* buf;
+} av_star;
+
+/* values whose type is only known at run time; statically typed ones are
+   plain int64_t (mass), double (flux), bool (truth) and av_star (star) */
+typedef enum { AV_NIL, AV_INT, AV_FLOAT, AV_BOOL, AV_STR } av_type;
+
+typedef struct {
+    av_type type;
+    union {
+        int64_t i;
+        double f;
+        bool b;
+        av_star s;
+    } as;
+} av_value;
+
+enum { AV_ADD, AV_SUB, AV_MUL, AV_DIV, AV_MOD };
+enum { AV_EQ, AV_NE, AV_LT, AV_LE, AV_GT, AV_GE };
+enum { AV_AND, AV_OR, AV_XOR };
+
+#if defined(__GNUC__)
+#define AV_NORETURN __attribute__((noreturn))
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define AV_NORETURN _Noreturn
+#else
+#define AV_NORETURN
+#endif
+
+static const char* const av_type_names[] = {"vacuum", "mass", "flux", "truth", "star"};
+
+AV_NORETURN static inline void av_fail(int line, const char* message) {
+    fflush(stdout);
+    fprintf(stderr, "Error: Line %d: %s\n", line, message);
+    exit(1);
+}
+
+AV_NORETURN static inline void av_type_error(int line, const char* what, av_type a, av_type b) {
+    char message[96];
+    snprintf(message, sizeof message, "Runtime error: cannot %s %s and %s", what, av_type_names[a], av_type_names[b]);
+    av_fail(line, message);
+}
+
+AV_NORETURN static inline void av_negate_error(int line, av_type t) {
+    char message[64];
+    snprintf(message, sizeof message, "Runtime error: cannot negate %s", av_type_names[t]);
+    av_fail(line, message);
+}
+
+static inline av_value av_nil(void) { av_value v; v.type = AV_NIL; v.as.i = 0; return v; }
+static inline av_value av_int(int64_t x) { av_value v; v.type = AV_INT; v.as.i = x; return v; }
+static inline av_value av_float(double x) { av_value v; v.type = AV_FLOAT; v.as.f = x; return v; }
+static inline av_value av_bool(bool x) { av_value v; v.type = AV_BOOL; v.as.i = 0; v.as.b = x; return v; }
+static inline av_value av_str(av_star x) { av_value v; v.type = AV_STR; v.as.s = x; return v; }
+static inline av_star av_lit(const char* p, size_t n) { av_star s; s.p = p; s.n = n; s.buf = NULL; return s; }
+
+/* a + b, like StarHeap::concat: appended in place when a is all its buffer
+   holds and there is room, else copied into a buffer twice the size. Buffers
+   are never freed; the program's own exit releases them */
+static inline av_star av_concat(av_star a, av_star b) {
+    size_t n = a.n + b.n, capacity;
+    av_star r;
+    av_buf* buf = a.buf;
+    char* bytes;
+    if (buf && buf->used == a.n && buf->capacity - buf->used >= b.n) {
+        memcpy((char*)(buf + 1) + buf->used, b.p, b.n);
+        buf->used = n;
+        r = a;
+        r.n = n;
+        return r;
+    }
+    if (buf && buf->used - a.n >= b.n && memcmp((char*)(buf + 1) + a.n, b.p, b.n) == 0) {
+        r = a;
+        r.n = n;
+        return r;
+    }
+    capacity = n < 32 ? 64 : 2 * n;
+    buf = (av_buf*)malloc(sizeof(av_buf) + capacity);
+    if (!buf) {
+        fflush(stdout);
+        fputs("Error: out of memory\n", stderr);
+        exit(1);
+    }
+    bytes = (char*)(buf + 1);
+    memcpy(bytes, a.p, a.n);
+    memcpy(bytes + a.n, b.p, b.n);
+    buf->used = n;
+    buf->capacity = capacity;
+    r.p = bytes;
+    r.n = n;
+    r.buf = buf;
+    return r;
+}
+
+static inline int av_star_compare(av_star a, av_star b) {
+    int c = memcmp(a.p, b.p, a.n < b.n ? a.n : b.n);
+    if (c != 0) return c;
+    return a.n < b.n ? -1 : a.n > b.n ? 1 : 0;
+}
+
+/* two's-complement wrap-around instead of signed-overflow UB */
+static inline int64_t av_iadd(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static inline int64_t av_isub(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static inline int64_t av_imul(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+static inline int64_t av_ineg(int64_t a) { return (int64_t)(0 - (uint64_t)a); }
+
+static inline int64_t av_idiv(int64_t a, int64_t b, int line) {
+    if (b == 0) av_fail(line, "Runtime error: division by zero");
+    if (b == -1) return av_ineg(a);
+    return a / b;
+}
+
+static inline int64_t av_imod(int64_t a, int64_t b, int line) {
+    if (b == 0) av_fail(line, "Runtime error: division by zero");
+    if (b == -1) return 0;
+    return a % b;
+}
+
+/* truncating and saturating like truncateToMass(): a plain cast is UB for NaN
+   and anything out of range */
+static inline int64_t av_f2i(double f) {
+    if (f != f) return 0;
+    if (f >= 9223372036854775808.0) return INT64_MAX;
+    if (f < -9223372036854775808.0) return INT64_MIN;
+    return (int64_t)f;
+}
+static inline bool av_is_number(av_value v) { return v.type == AV_INT || v.type == AV_FLOAT; }
+static inline double av_as_float(av_value v) { return v.type == AV_INT ? (double)v.as.i : v.as.f; }
+
+static inline bool av_truthy(av_value v) {
+    switch (v.type) {
+        case AV_INT: return v.as.i != 0;
+        case AV_FLOAT: return v.as.f != 0.0;
+        case AV_BOOL: return v.as.b;
+        case AV_STR: return v.as.s.n != 0;
+        default: return false;
+    }
+}
+
+static inline av_value av_arith(int op, av_value a, av_value b, int line) {
+    static const char* const names[] = {"add", "subtract", "multiply", "divide", "take the remainder of"};
+    double x, y;
+    if (op == AV_ADD && a.type == AV_STR && b.type == AV_STR) return av_str(av_concat(a.as.s, b.as.s));
+    if (!av_is_number(a) || !av_is_number(b)) av_type_error(line, names[op], a.type, b.type);
+    if (a.type == AV_INT && b.type == AV_INT) {
+        switch (op) {
+            case AV_ADD: return av_int(av_iadd(a.as.i, b.as.i));
+            case AV_SUB: return av_int(av_isub(a.as.i, b.as.i));
+            case AV_MUL: return av_int(av_imul(a.as.i, b.as.i));
+            case AV_DIV: return av_int(av_idiv(a.as.i, b.as.i, line));
+            default: return av_int(av_imod(a.as.i, b.as.i, line));
+        }
+    }
+    x = av_as_float(a);
+    y = av_as_float(b);
+    switch (op) {
+        case AV_ADD: return av_float(x + y);
+        case AV_SUB: return av_float(x - y);
+        case AV_MUL: return av_float(x * y);
+        case AV_DIV: return av_float(x / y);
+        default: return av_float(fmod(x, y));
+    }
+}
+
+static inline bool av_equal(av_value a, av_value b) {
+    if (av_is_number(a) && av_is_number(b)) {
+        if (a.type == AV_INT && b.type == AV_INT) return a.as.i == b.as.i;
+        return av_as_float(a) == av_as_float(b);
+    }
+    if (a.type != b.type) return false;
+    switch (a.type) {
+        case AV_NIL: return true;
+        case AV_BOOL: return a.as.b == b.as.b;
+        case AV_STR: return av_star_compare(a.as.s, b.as.s) == 0;
+        default: return false;
+    }
+}
+
+static inline bool av_compare(int op, av_value a, av_value b, int line) {
+    int c = 0;
+    if (op == AV_EQ) return av_equal(a, b);
+    if (op == AV_NE) return !av_equal(a, b);
+    if (a.type == AV_INT && b.type == AV_INT) {
+        c = a.as.i < b.as.i ? -1 : a.as.i > b.as.i ? 1 : 0;
+    } else if (av_is_number(a) && av_is_number(b)) {
+        double x = av_as_float(a), y = av_as_float(b);
+        if (isnan(x) || isnan(y)) return false;
+        c = x < y ? -1 : x > y ? 1 : 0;
+    } else if (a.type == AV_STR && b.type == AV_STR) {
+        c = av_star_compare(a.as.s, b.as.s);
+    } else {
+        av_type_error(line, "compare", a.type, b.type);
+    }
+    switch (op) {
+        case AV_LT: return c < 0;
+        case AV_LE: return c <= 0;
+        case AV_GT: return c > 0;
+        default: return c >= 0;
+    }
+}
+
+static inline int64_t av_bitwise(int op, av_value a, av_value b, int line) {
+    static const char* const names[] = {"bitwise-and", "bitwise-or", "bitwise-xor"};
+    if (a.type != AV_INT || b.type != AV_INT) av_type_error(line, names[op], a.type, b.type);
+    return op == AV_AND ? (a.as.i & b.as.i) : op == AV_OR ? (a.as.i | b.as.i) : (a.as.i ^ b.as.i);
+}
+
+static inline av_value av_negate(av_value v, int line) {
+    if (v.type == AV_INT) return av_int(av_ineg(v.as.i));
+    if (v.type == AV_FLOAT) return av_float(-v.as.f);
+    av_negate_error(line, v.type);
+    return v;
+}
+
+/* the value stored into a mass / flux variable */
+static inline av_value av_to_mass(av_value v) { return v.type == AV_FLOAT ? av_int(av_f2i(v.as.f)) : v; }
+static inline av_value av_to_flux(av_value v) { return v.type == AV_INT ? av_float((double)v.as.i) : v; }
+
+/* shine(): values separated by spaces, then a newline */
+static inline void av_print_int(int64_t x) { printf("%" PRId64, x); }
+static inline void av_print_float(double x) {
+    if (isnan(x)) fputs("nan", stdout);
+    else printf("%.17g", x);
+}
+static inline void av_print_bool(bool x) { fputs(x ? "starlight" : "voidness", stdout); }
+static inline void av_print_str(av_star x) { fwrite(x.p, 1, x.n, stdout); }
+static inline void av_print(av_value v) {
+    switch (v.type) {
+        case AV_INT: av_print_int(v.as.i); break;
+        case AV_FLOAT: av_print_float(v.as.f); break;
+        case AV_BOOL: av_print_bool(v.as.b); break;
+        case AV_STR: av_print_str(v.as.s); break;
+        default: fputs("vacuum", stdout); break;
+    }
+}
+static inline void av_print_space(void) { putchar(' '); }
+static inline void av_print_end(void) { putchar('\n'); }
+)ASTERVOID_RT";
+
+} // namespace cgen
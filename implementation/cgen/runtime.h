@@ -0,0 +1,12 @@
+#ifndef CGEN_RUNTIME_H
+#define CGEN_RUNTIME_H
+
+namespace cgen {
+
+// the C source every emitted program starts with: the dynamic value type,
+// wrap-around integer helpers, runtime errors and the built-ins (shine)
+extern const char runtimeSource[];
+
+} // namespace cgen
+
+#endif
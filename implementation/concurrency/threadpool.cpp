@@ -0,0 +1,111 @@
+#include "threadpool.h"
+
+namespace {
+thread_local int workerIndex = -1;
+thread_local const void* workerPool = nullptr;
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    for (unsigned i = 0; i < threads; i++) queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < threads; i++) workers.emplace_back([this, i] { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (std::thread& t : workers) t.join();
+}
+
+int ThreadPool::currentWorker() { return workerIndex; }
+
+void ThreadPool::submit(Task task) {
+    // a worker feeds its own deque; outside threads spread work round-robin
+    size_t target = (workerPool == this && workerIndex >= 0)
+                        ? size_t(workerIndex)
+                        : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> guard(queues[target]->lock);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        queued.fetch_add(1);
+    }
+    workAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> guard(doneLock);
+    allDone.wait(guard, [this] { return pending.load() == 0; });
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& body) {
+    if (n == 0) return;
+    std::atomic<size_t> remaining{n};
+    for (size_t i = 0; i < n; i++)
+        submit([&body, &remaining, i] {
+            body(i);
+            remaining.fetch_sub(1, std::memory_order_release);
+        });
+    int self = workerPool == this ? workerIndex : -1;
+    while (remaining.load(std::memory_order_acquire) > 0)
+        if (!runOne(self)) std::this_thread::yield();
+}
+
+bool ThreadPool::popLocal(unsigned self, Task& out) {
+    Queue& q = *queues[self];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.tasks.empty()) return false;
+    out = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(unsigned self, Task& out) {
+    for (size_t k = 1; k < queues.size(); k++) {
+        Queue& q = *queues[(self + k) % queues.size()];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.tasks.empty()) continue;
+        out = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::runOne(int self) {
+    Task task;
+    // outside the pool there is no own deque: steal starting from queue 0
+    bool found = self >= 0 ? popLocal(unsigned(self), task) || steal(unsigned(self), task)
+                           : popLocal(0, task) || steal(0, task);
+    if (!found) return false;
+    finish(task);
+    return true;
+}
+
+void ThreadPool::finish(Task& task) {
+    queued.fetch_sub(1);
+    task();
+    if (pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> guard(doneLock);
+        allDone.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop(unsigned self) {
+    workerIndex = int(self);
+    workerPool = this;
+    while (true) {
+        if (runOne(int(self))) continue;
+        std::unique_lock<std::mutex> guard(sleepLock);
+        workAvailable.wait(guard, [this] { return stopping.load() || queued.load() > 0; });
+        if (stopping && queued.load() == 0) return;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ---------- Work-stealing thread pool ----------
+// Every worker owns a deque: it pops its own work LIFO (cache-warm) and, when
+// that runs dry, steals FIFO from the other workers, so one slow task (a huge
+// file) never leaves the remaining cores idle. Tasks submitted from outside
+// the pool are dealt round-robin; tasks submitted by a worker go to its own
+// deque. Tasks must not throw.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(unsigned threads = 0); // 0: one per hardware thread
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(Task task);
+    void wait(); // block until every submitted task has finished
+    // run body(0..n-1) on the pool and return when all n calls are done. The
+    // caller executes queued tasks while it waits, so this may be called from
+    // inside a pool task (nested parallelism) without deadlocking
+    void parallelFor(size_t n, const std::function<void(size_t)>& body);
+    unsigned size() const { return unsigned(workers.size()); }
+
+    // index of the calling worker thread, or -1 outside the pool
+    static int currentWorker();
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<size_t> queued{0};  // submitted, not yet picked up
+    std::atomic<size_t> pending{0}; // submitted, not yet finished
+    std::atomic<bool> stopping{false};
+
+    std::mutex sleepLock;
+    std::condition_variable workAvailable;
+    std::mutex doneLock;
+    std::condition_variable allDone;
+
+    void workerLoop(unsigned self);
+    bool popLocal(unsigned self, Task& out);
+    bool steal(unsigned self, Task& out);
+    bool runOne(int self); // pop or steal one task and run it
+    void finish(Task& task);
+};
+
+#endif
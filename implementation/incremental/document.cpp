@@ -0,0 +1,441 @@
+#include "document.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// end offset of a token in `text`. Every lexeme is the source the token
+// consumed, except that a string drops its quotes. The keyword star has the
+// same token type, so a string is told apart by its lexeme starting after the
+// opening quote
+size_t endOffset(const Token& token, const std::string& text) {
+    size_t begin = size_t(token.lexeme.data() - text.data());
+    return begin + token.lexeme.size() + (begin != token.offset ? 1 : 0);
+}
+
+// replace v[from, to) with `with`, moving the tail at most once
+template <typename T>
+void splice(std::vector<T>& v, size_t from, size_t to, const std::vector<T>& with) {
+    size_t common = std::min(to - from, with.size());
+    std::copy(with.begin(), with.begin() + ptrdiff_t(common), v.begin() + ptrdiff_t(from));
+    if (with.size() > common) v.insert(v.begin() + ptrdiff_t(to), with.begin() + ptrdiff_t(common), with.end());
+    else v.erase(v.begin() + ptrdiff_t(from + common), v.begin() + ptrdiff_t(to));
+}
+
+void shiftOffsets(Expr* expr, uint32_t delta);
+
+void shiftOffsets(Stmt* stmt, uint32_t delta) {
+    if (!stmt) return;
+    switch (stmt->kind) {
+        case StmtKind::VarDecl: {
+            auto* s = static_cast<VarDecl*>(stmt);
+            s->type.offset += delta;
+            s->name.offset += delta;
+            shiftOffsets(s->initializer, delta);
+            break;
+        }
+        case StmtKind::FuncDecl: {
+            auto* s = static_cast<FuncDecl*>(stmt);
+            s->returnType.offset += delta;
+            s->name.offset += delta;
+            for (Param& param : s->params) param.type.offset += delta, param.name.offset += delta;
+            for (Stmt* body : s->body) shiftOffsets(body, delta);
+            break;
+        }
+        case StmtKind::Block:
+            for (Stmt* inner : static_cast<BlockStmt*>(stmt)->statements) shiftOffsets(inner, delta);
+            break;
+        case StmtKind::Expression:
+            shiftOffsets(static_cast<ExprStmt*>(stmt)->expression, delta);
+            break;
+        case StmtKind::If: {
+            auto* s = static_cast<IfStmt*>(stmt);
+            shiftOffsets(s->condition, delta);
+            shiftOffsets(s->thenBranch, delta);
+            shiftOffsets(s->elseBranch, delta);
+            break;
+        }
+        case StmtKind::While: {
+            auto* s = static_cast<WhileStmt*>(stmt);
+            shiftOffsets(s->condition, delta);
+            shiftOffsets(s->body, delta);
+            break;
+        }
+        case StmtKind::For: {
+            auto* s = static_cast<ForStmt*>(stmt);
+            shiftOffsets(s->initializer, delta);
+            shiftOffsets(s->condition, delta);
+            shiftOffsets(s->increment, delta);
+            shiftOffsets(s->body, delta);
+            break;
+        }
+        case StmtKind::Return:
+            shiftOffsets(static_cast<ReturnStmt*>(stmt)->value, delta);
+            break;
+        case StmtKind::Break:
+        case StmtKind::Continue:
+            break;
+    }
+}
+
+void shiftOffsets(Expr* expr, uint32_t delta) {
+    if (!expr) return;
+    switch (expr->kind) {
+        case ExprKind::Binary: {
+            auto* e = static_cast<BinaryExpr*>(expr);
+            shiftOffsets(e->left, delta);
+            e->op.offset += delta;
+            shiftOffsets(e->right, delta);
+            break;
+        }
+        case ExprKind::Literal: static_cast<LiteralExpr*>(expr)->offset += delta; break;
+        case ExprKind::Variable: static_cast<VariableExpr*>(expr)->name.offset += delta; break;
+        case ExprKind::Assign: {
+            auto* e = static_cast<AssignExpr*>(expr);
+            e->name.offset += delta;
+            e->op.offset += delta;
+            shiftOffsets(e->value, delta);
+            break;
+        }
+        case ExprKind::Unary: {
+            auto* e = static_cast<UnaryExpr*>(expr);
+            e->op.offset += delta;
+            shiftOffsets(e->operand, delta);
+            break;
+        }
+        case ExprKind::Logical: {
+            auto* e = static_cast<LogicalExpr*>(expr);
+            shiftOffsets(e->left, delta);
+            e->op.offset += delta;
+            shiftOffsets(e->right, delta);
+            break;
+        }
+        case ExprKind::Call: {
+            auto* e = static_cast<CallExpr*>(expr);
+            e->callee.offset += delta;
+            e->paren.offset += delta;
+            for (Expr* arg : e->args) shiftOffsets(arg, delta);
+            break;
+        }
+    }
+}
+
+// edit arenas start small: most edits reparse one declaration
+const size_t EDIT_CHUNK_BYTES = 1024;
+const size_t FULL_CHUNK_BYTES = 64 * 1024;
+
+} // namespace
+
+IncrementalDocument::IncrementalDocument(std::string text) : source(std::move(text)) { rebuild(); }
+
+const std::vector<Token>& IncrementalDocument::tokens() const {
+    shiftTokens(tokensFrom, toks.size(), tokensShift);
+    tokensFrom = toks.size();
+    tokensShift = 0;
+    return toks;
+}
+
+StmtList IncrementalDocument::program() const {
+    shiftDecls(declsFrom, decls.size(), declsIndex, declsShift);
+    declsFrom = decls.size();
+    declsIndex = 0;
+    declsShift = 0;
+    StmtList list;
+    list.items = const_cast<Stmt**>(roots.data());
+    list.count = uint32_t(roots.size());
+    return list;
+}
+
+void IncrementalDocument::shiftTokens(size_t from, size_t to, uint32_t offset) const {
+    if (offset == 0) return;
+    for (size_t i = from; i < to; i++) toks[i].offset += offset;
+}
+
+void IncrementalDocument::shiftDecls(size_t from, size_t to, size_t index, uint32_t offset) const {
+    for (size_t d = from; d < to; d++) {
+        TopLevel& decl = decls[d];
+        decl.first += index, decl.end += index, decl.lookahead += index;
+        if (offset != 0) shiftOffsets(decl.stmt, offset);
+    }
+}
+
+// scan and parse the whole text again, into a fresh copy of it; everything
+// the old tokens and nodes pointed into is dropped
+void IncrementalDocument::rebuild() {
+    decls.clear(); // the arenas go with them
+    roots.clear();
+    liveNodes = 0;
+    tokensFrom = declsFrom = declsIndex = 0;
+    tokensShift = declsShift = 0;
+    pieces.clear();
+    pieces.push_back(source);
+    const std::string& text = pieces.back();
+    held = text.size();
+    toks = Scanner(text).scanTokens();
+    widths.resize(toks.size());
+    for (size_t i = 0; i < toks.size(); i++) widths[i] = uint32_t(endOffset(toks[i], text) - toks[i].offset);
+    stats.tokensRescanned = toks.size();
+    reparse(0, 0, 0, FULL_CHUNK_BYTES);
+}
+
+const EditStats& IncrementalDocument::apply(const TextEdit& edit) {
+    if (edit.offset > source.size() || edit.length > source.size() - edit.offset)
+        throw std::runtime_error("edit range is outside the document");
+    stats = EditStats();
+    ptrdiff_t shift = ptrdiff_t(edit.replacement.size()) - ptrdiff_t(edit.length);
+
+    // ---------- re-lex ----------
+    // first token the edit can affect. The scanner peeks up to two bytes past
+    // a token ("1" stops before ".x" but not ".5"), so a token is safe only if
+    // those bytes are also in front of the edit
+    const size_t SCAN_LOOKAHEAD = 2;
+    size_t k = size_t(std::partition_point(toks.begin(), toks.end(), [&](const Token& t) {
+                          return tokenEnd(size_t(&t - toks.data())) + SCAN_LOOKAHEAD <= edit.offset;
+                      }) - toks.begin());
+    size_t resumeAt = k ? tokenEnd(k - 1) : 0;
+    source.replace(edit.offset, edit.length, edit.replacement);
+    if (held > budget) {
+        rebuild();
+        return stats;
+    }
+    Scanner scanner(source, resumeAt);
+
+    std::vector<Token> rescanned;
+    std::vector<uint32_t> rescannedWidths;
+    size_t editEnd = edit.offset + edit.replacement.size(); // in new text
+    size_t j = k;                // old token being compared
+    size_t suffix = toks.size(); // first old token reused after the edit
+    while (true) {
+        Token t = scanner.next();
+        size_t end = endOffset(t, source);
+        rescanned.push_back(t);
+        rescannedWidths.push_back(uint32_t(end - t.offset));
+        if (t.type == TokenType::END_OF_FILE) break;
+        if (end < editEnd) continue;
+        // resync: an old token ends on the same (shifted) byte, so the scanner
+        // is in the state it was in back then
+        size_t oldEnd = size_t(ptrdiff_t(end) - shift);
+        while (j < toks.size() && toks[j].type != TokenType::END_OF_FILE && tokenEnd(j) < oldEnd) j++;
+        if (j < toks.size() && toks[j].type != TokenType::END_OF_FILE && tokenEnd(j) == oldEnd) {
+            suffix = j + 1;
+            break;
+        }
+    }
+
+    // the text changes under the new lexemes with the next edit: copy the
+    // bytes they cover into a piece and point them there
+    size_t spanEnd = rescanned.back().offset + rescannedWidths.back();
+    pieces.emplace_back(source, resumeAt, spanEnd - resumeAt);
+    const std::string& piece = pieces.back();
+    held += piece.size();
+    for (Token& t : rescanned)
+        if (t.lexeme.data())
+            t.lexeme = std::string_view(piece.data() + (t.lexeme.data() - source.data() - ptrdiff_t(resumeAt)),
+                                        t.lexeme.size());
+
+    // the rescanned tokens replace [k, suffix). One pending shift covers the
+    // tokens after them: settle the ones before the edit that the last edit's
+    // reached, or take it out of those it left settled. Either way only the
+    // tokens between the two edits are touched
+    size_t oldCount = toks.size();
+    size_t added = rescanned.size();
+    if (tokensFrom >= oldCount) tokensShift = 0;
+    else if (tokensFrom < k) shiftTokens(tokensFrom, k, tokensShift);
+    else if (tokensFrom > suffix) shiftTokens(suffix, tokensFrom, 0 - tokensShift);
+    splice(toks, k, suffix, rescanned);
+    splice(widths, k, suffix, rescannedWidths);
+    tokensFrom = k + added;
+    tokensShift += uint32_t(shift);
+    stats.tokensRescanned = added;
+    stats.tokensReused = toks.size() - added;
+
+    // ---------- re-parse ----------
+    if (!treeValid) {
+        reparse(0, 0, 0, EDIT_CHUNK_BYTES);
+        return stats;
+    }
+    // declarations whose tokens and lookahead all lie before the damage stay
+    // as they are; those entirely in the reused suffix move with it
+    auto startsBefore = [&](size_t token) {
+        return size_t(std::partition_point(decls.begin(), decls.end(), [&](const TopLevel& decl) {
+                          return firstOf(size_t(&decl - decls.data())) < token;
+                      }) - decls.begin());
+    };
+    size_t kept = startsBefore(k);
+    while (kept > 0 && lookaheadOf(kept - 1) >= k) kept--;
+    size_t moved = suffix < oldCount ? std::max(kept, startsBefore(suffix)) : decls.size();
+
+    // the declarations get one pending shift the same way
+    if (declsFrom >= decls.size()) declsIndex = 0, declsShift = 0;
+    else if (declsFrom < kept) shiftDecls(declsFrom, kept, declsIndex, declsShift);
+    else if (declsFrom > moved) shiftDecls(moved, declsFrom, 0 - declsIndex, 0 - declsShift);
+    declsFrom = moved;
+    declsIndex += size_t(ptrdiff_t(k + added) - ptrdiff_t(suffix));
+    declsShift += uint32_t(shift);
+    reparse(kept ? decls[kept - 1].end : 0, kept, moved, EDIT_CHUNK_BYTES);
+    return stats;
+}
+
+void IncrementalDocument::reparse(size_t from, size_t kept, size_t moved, size_t chunkBytes) {
+    auto gen = std::make_shared<Generation>(held, chunkBytes);
+    std::vector<TopLevel> parsed;
+    std::vector<Stmt*> parsedRoots;
+
+    // errors can only come from the declarations parsed here: a tree is kept
+    // only when it had none, so every reused declaration is clean
+    size_t reuse = moved; // next candidate in the old suffix
+    bool reached = false;
+    Parser parser(toks, from, gen->arena, tokensFrom, tokensShift);
+    while (!parser.isAtEnd()) {
+        size_t at = parser.tokenIndex();
+        while (reuse < decls.size() && firstOf(reuse) < at) reuse++;
+        if (reuse < decls.size() && firstOf(reuse) == at) {
+            reached = true;
+            break;
+        }
+        size_t before = gen->arena.nodeCount();
+        Stmt* stmt = parser.parseDeclaration();
+        size_t nodes = gen->arena.nodeCount() - before;
+        parsed.push_back(TopLevel{stmt, at, parser.tokenIndex(), parser.lookaheadIndex(), nodes, gen});
+        parsedRoots.push_back(stmt);
+        stats.nodesRebuilt += nodes;
+        stats.declsReparsed++;
+    }
+    held += gen->arena.bytesReserved();
+    if (!reached) reuse = decls.size();
+    // a parse of the whole text shows what a fresh build holds, whether or
+    // not it parsed
+    if (kept == 0 && !reached) budget = 2 * (source.size() + gen->arena.bytesReserved()) + FULL_CHUNK_BYTES;
+
+    // the new declarations replace decls[kept, reuse)
+    for (size_t d = kept; d < reuse; d++) liveNodes -= decls[d].nodes;
+    liveNodes += stats.nodesRebuilt;
+    splice(decls, kept, reuse, parsed);
+    splice(roots, kept, reuse, parsedRoots);
+    declsFrom = kept + parsed.size();
+    stats.declsReused = decls.size() - parsed.size();
+    stats.nodesReused = liveNodes - stats.nodesRebuilt;
+
+    errors = parser.diagnostics();
+    treeValid = errors.empty();
+    if (!treeValid) {
+        decls.clear();
+        roots.clear();
+        liveNodes = 0;
+        declsFrom = declsIndex = 0;
+        declsShift = 0;
+    }
+}
+
+// ---------- Structural comparison ----------
+namespace {
+
+bool sameToken(const Token& a, const Token& b) {
+    return a.type == b.type && a.lexeme == b.lexeme && a.offset == b.offset;
+}
+
+bool sameLiteral(const LiteralExpr& a, const LiteralExpr& b) {
+    if (a.type != b.type || a.offset != b.offset) return false;
+    switch (a.type) {
+        case LiteralExpr::Type::Bool: return a.boolean == b.boolean;
+        case LiteralExpr::Type::Int: return a.integer == b.integer;
+        case LiteralExpr::Type::Float: return a.real == b.real;
+        case LiteralExpr::Type::Str: return a.text == b.text;
+    }
+    return false;
+}
+
+bool sameExpr(const Expr* a, const Expr* b) {
+    if (!a || !b) return a == b;
+    if (a->kind != b->kind) return false;
+    switch (a->kind) {
+        case ExprKind::Binary: {
+            auto *x = static_cast<const BinaryExpr*>(a), *y = static_cast<const BinaryExpr*>(b);
+            return sameToken(x->op, y->op) && sameExpr(x->left, y->left) && sameExpr(x->right, y->right);
+        }
+        case ExprKind::Literal:
+            return sameLiteral(*static_cast<const LiteralExpr*>(a), *static_cast<const LiteralExpr*>(b));
+        case ExprKind::Variable:
+            return sameToken(static_cast<const VariableExpr*>(a)->name, static_cast<const VariableExpr*>(b)->name);
+        case ExprKind::Assign: {
+            auto *x = static_cast<const AssignExpr*>(a), *y = static_cast<const AssignExpr*>(b);
+            return sameToken(x->name, y->name) && sameToken(x->op, y->op) && sameExpr(x->value, y->value);
+        }
+        case ExprKind::Unary: {
+            auto *x = static_cast<const UnaryExpr*>(a), *y = static_cast<const UnaryExpr*>(b);
+            return sameToken(x->op, y->op) && sameExpr(x->operand, y->operand);
+        }
+        case ExprKind::Logical: {
+            auto *x = static_cast<const LogicalExpr*>(a), *y = static_cast<const LogicalExpr*>(b);
+            return sameToken(x->op, y->op) && sameExpr(x->left, y->left) && sameExpr(x->right, y->right);
+        }
+        case ExprKind::Call: {
+            auto *x = static_cast<const CallExpr*>(a), *y = static_cast<const CallExpr*>(b);
+            if (!sameToken(x->callee, y->callee) || !sameToken(x->paren, y->paren) ||
+                x->args.size() != y->args.size())
+                return false;
+            for (uint32_t i = 0; i < x->args.size(); i++)
+                if (!sameExpr(x->args[i], y->args[i])) return false;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool sameStmt(const Stmt* a, const Stmt* b) {
+    if (!a || !b) return a == b;
+    if (a->kind != b->kind) return false;
+    switch (a->kind) {
+        case StmtKind::VarDecl: {
+            auto *x = static_cast<const VarDecl*>(a), *y = static_cast<const VarDecl*>(b);
+            return sameToken(x->type, y->type) && sameToken(x->name, y->name) &&
+                   sameExpr(x->initializer, y->initializer);
+        }
+        case StmtKind::FuncDecl: {
+            auto *x = static_cast<const FuncDecl*>(a), *y = static_cast<const FuncDecl*>(b);
+            if (!sameToken(x->returnType, y->returnType) || !sameToken(x->name, y->name) ||
+                x->params.size() != y->params.size())
+                return false;
+            for (uint32_t i = 0; i < x->params.size(); i++)
+                if (!sameToken(x->params[i].type, y->params[i].type) ||
+                    !sameToken(x->params[i].name, y->params[i].name))
+                    return false;
+            return sameTree(x->body, y->body);
+        }
+        case StmtKind::Block:
+            return sameTree(static_cast<const BlockStmt*>(a)->statements,
+                            static_cast<const BlockStmt*>(b)->statements);
+        case StmtKind::Expression:
+            return sameExpr(static_cast<const ExprStmt*>(a)->expression,
+                            static_cast<const ExprStmt*>(b)->expression);
+        case StmtKind::If: {
+            auto *x = static_cast<const IfStmt*>(a), *y = static_cast<const IfStmt*>(b);
+            return sameExpr(x->condition, y->condition) && sameStmt(x->thenBranch, y->thenBranch) &&
+                   sameStmt(x->elseBranch, y->elseBranch);
+        }
+        case StmtKind::While: {
+            auto *x = static_cast<const WhileStmt*>(a), *y = static_cast<const WhileStmt*>(b);
+            return sameExpr(x->condition, y->condition) && sameStmt(x->body, y->body);
+        }
+        case StmtKind::For: {
+            auto *x = static_cast<const ForStmt*>(a), *y = static_cast<const ForStmt*>(b);
+            return sameStmt(x->initializer, y->initializer) && sameExpr(x->condition, y->condition) &&
+                   sameExpr(x->increment, y->increment) && sameStmt(x->body, y->body);
+        }
+        case StmtKind::Return:
+            return sameExpr(static_cast<const ReturnStmt*>(a)->value, static_cast<const ReturnStmt*>(b)->value);
+        case StmtKind::Break:
+        case StmtKind::Continue:
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool sameTree(const StmtList& a, const StmtList& b) {
+    if (a.size() != b.size()) return false;
+    for (uint32_t i = 0; i < a.size(); i++)
+        if (!sameStmt(a[i], b[i])) return false;
+    return true;
+}
@@ -0,0 +1,130 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include "../parser/parser.h"
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ---------- Incremental document ----------
+// Keeps the tokens and the top-level AST of one source text across edits, for
+// editor integrations that reparse on every keystroke.
+//  - re-lexing resumes at the end of the last token before the edit (a token
+//    boundary, so never inside a string or *** comment) and stops as soon as
+//    a new token ends where an old one did (shifted by the edit); everything
+//    after that is the old token stream moved by the edit
+//  - re-parsing starts at the first top-level declaration whose tokens or
+//    lookahead the edit touched and stops at the first old declaration that
+//    starts in the unchanged suffix; the rest are reused as they are (their
+//    offsets move with the edit, see below)
+// Memory stays within a constant factor of one full parse of the current text:
+//  - the text is edited in place and no token points into it. The first
+//    scan's lexemes point into a copy of the text, and each edit's rescanned
+//    lexemes into a copy of just the bytes they cover (a piece); pieces never
+//    change, so reused tokens and nodes keep pointing where they did
+//  - every edit's reparsed nodes live in a small arena of their own, freed
+//    with the last declaration that uses it
+//  - once pieces and arenas hold twice what a fresh build did, the next edit
+//    rebuilds from scratch and everything older is dropped
+// Work per edit is the rescanned tokens and the reparsed declarations, plus
+// whatever lies between it and the last edit, not a walk over the file: the
+// tokens and the reused declarations after the last edit carry its shift as
+// a pending one. It is applied when a later edit reaches them, or when
+// tokens() or program() hands them out. The program() tree is shared with the
+// next edit: don't fold or otherwise rewrite it.
+struct TextEdit {
+    size_t offset = 0;       // byte offset into the current text
+    size_t length = 0;       // bytes replaced
+    std::string replacement;
+};
+
+struct EditStats {
+    size_t tokensRescanned = 0;
+    size_t tokensReused = 0;
+    size_t declsReparsed = 0;
+    size_t declsReused = 0;
+    size_t nodesRebuilt = 0; // AST nodes allocated by this edit
+    size_t nodesReused = 0;  // AST nodes carried over from earlier versions
+};
+
+class IncrementalDocument {
+public:
+    explicit IncrementalDocument(std::string text); // full scan and parse
+    // apply one edit (throws std::runtime_error only for a range outside the
+    // text). With syntax errors the text and tokens are still updated, the
+    // errors go to diagnostics() and the tree is dropped: the next edit
+    // parses from scratch
+    const EditStats& apply(const TextEdit& edit);
+
+    const std::string& text() const { return source; }
+    const std::vector<Token>& tokens() const;
+    StmtList program() const;
+    bool hasTree() const { return treeValid; }
+    const std::vector<Diagnostic>& diagnostics() const { return errors; } // of the last parse
+    const EditStats& lastEdit() const { return stats; }
+
+    IncrementalDocument(const IncrementalDocument&) = delete;
+    IncrementalDocument& operator=(const IncrementalDocument&) = delete;
+
+private:
+    // the nodes of one parse; gives its chunks back to the document's count
+    struct Generation {
+        AstArena arena;
+        size_t& held;
+        Generation(size_t& held, size_t chunkBytes) : arena(chunkBytes), held(held) {}
+        ~Generation() { held -= arena.bytesReserved(); }
+    };
+    struct TopLevel {
+        Stmt* stmt;
+        size_t first;     // token index of the declaration's first token
+        size_t end;       // token index just after it
+        size_t lookahead; // highest token index the parser looked at
+        size_t nodes;
+        std::shared_ptr<Generation> gen;
+    };
+
+    std::string source;
+    std::deque<std::string> pieces;      // where lexemes point; never changed once added
+    size_t held = 0;                     // bytes in pieces and live arenas
+    size_t budget = 0;                   // rebuild from scratch once held passes it
+    mutable std::vector<Token> toks;     // tokens() settles pending shifts
+    std::vector<uint32_t> widths;        // source bytes of each token
+    mutable std::vector<TopLevel> decls; // program() settles pending shifts
+    std::vector<Stmt*> roots;            // decls[i].stmt
+    size_t liveNodes = 0;                // nodes of all decls
+    // tokens from tokensFrom on start tokensShift bytes after their offset;
+    // decls from declsFrom on are behind by declsIndex tokens and their
+    // nodes by declsShift bytes (all wrap around when negative)
+    mutable size_t tokensFrom = 0;
+    mutable uint32_t tokensShift = 0;
+    mutable size_t declsFrom = 0;
+    mutable size_t declsIndex = 0;
+    mutable uint32_t declsShift = 0;
+    bool treeValid = false;
+    std::vector<Diagnostic> errors;
+    EditStats stats;
+
+    size_t tokenEnd(size_t i) const {
+        return uint32_t(toks[i].offset + (i >= tokensFrom ? tokensShift : 0)) + widths[i];
+    }
+    // move toks[from, to) by `offset` bytes (see shiftDecls)
+    void shiftTokens(size_t from, size_t to, uint32_t offset) const;
+    size_t firstOf(size_t d) const { return decls[d].first + (d >= declsFrom ? declsIndex : 0); }
+    size_t lookaheadOf(size_t d) const { return decls[d].lookahead + (d >= declsFrom ? declsIndex : 0); }
+    // move decls [from, to) by `index` tokens and `offset` bytes: the pending
+    // shifts to settle them, their negation to take the shifts back out
+    void shiftDecls(size_t from, size_t to, size_t index, uint32_t offset) const;
+    void rebuild();
+    // parse from token index `from` in place of decls[kept, moved); decls
+    // from `moved` on are the old suffix, reused as soon as the parser
+    // reaches the first token of one
+    void reparse(size_t from, size_t kept, size_t moved, size_t chunkBytes);
+};
+
+// structural equality of two trees (node kinds, token types, text and
+// offsets); used to check incremental results against a full parse
+bool sameTree(const StmtList& a, const StmtList& b);
+
+#endif
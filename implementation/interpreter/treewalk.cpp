@@ -0,0 +1,262 @@
+#include "treewalk.h"
+#include <stdexcept>
+
+void TreeWalker::runtimeError(uint32_t at, const std::string& message) const {
+    throw std::runtime_error("Line " + std::to_string(lines.line(at)) + ": " + message);
+}
+
+Value TreeWalker::run(const StmtList& program) {
+    Resolution resolution = Resolver().resolve(program);
+    if (!resolution.ok()) runtimeError(resolution.errors[0].offset, resolution.errors[0].message);
+    functions = std::move(resolution.functions);
+    stack.assign(resolution.frameSize, Binding{Value(), TokenType::IDENTIFIER});
+    base = 0;
+    top = resolution.frameSize;
+    calls = 0;
+    function = tailCallee = nullptr;
+    outermost.clear();
+    pinned.clear();
+    strings.clear();
+    depth = 0;
+    for (Stmt* stmt : program) {
+        Flow flow = execute(stmt);
+        if (flow == Flow::Return) return returnValue;
+        if (flow != Flow::Normal) throw std::runtime_error("'darkMatter'/'warp' outside of a loop");
+    }
+    return Value();
+}
+
+std::vector<std::pair<std::string, Value>> TreeWalker::topLevel() const {
+    std::vector<std::pair<std::string, Value>> out;
+    for (const VarDecl* decl : outermost) out.emplace_back(std::string(decl->name.lexeme), stack[decl->slot].value);
+    return out;
+}
+
+TreeWalker::Flow TreeWalker::executeBlock(const StmtList& statements) {
+    depth++;
+    Flow flow = Flow::Normal;
+    for (Stmt* stmt : statements) {
+        flow = execute(stmt);
+        if (flow != Flow::Normal) break;
+    }
+    depth--;
+    return flow;
+}
+
+TreeWalker::Flow TreeWalker::execute(Stmt* stmt) {
+    switch (stmt->kind) {
+        case StmtKind::VarDecl: {
+            auto* decl = static_cast<VarDecl*>(stmt);
+            TokenType declType = decl->type.type;
+            Value v = decl->initializer ? coerceToDeclared(declType, evaluate(decl->initializer))
+                                        : defaultForDeclared(declType);
+            stack[base + decl->slot] = Binding{v, declType};
+            if (depth == 0) outermost.push_back(decl);
+            return Flow::Normal;
+        }
+        case StmtKind::FuncDecl: return Flow::Normal; // runs when called
+        case StmtKind::Block:
+            return executeBlock(static_cast<BlockStmt*>(stmt)->statements);
+        case StmtKind::Expression:
+            evaluate(static_cast<ExprStmt*>(stmt)->expression);
+            return Flow::Normal;
+        case StmtKind::If: {
+            auto* s = static_cast<IfStmt*>(stmt);
+            if (isTruthy(evaluate(s->condition))) return execute(s->thenBranch);
+            if (s->elseBranch) return execute(s->elseBranch);
+            return Flow::Normal;
+        }
+        case StmtKind::While: {
+            auto* s = static_cast<WhileStmt*>(stmt);
+            while (isTruthy(evaluate(s->condition))) {
+                Flow flow = execute(s->body);
+                if (flow == Flow::Break) break;
+                if (flow == Flow::Return) return flow;
+            }
+            return Flow::Normal;
+        }
+        case StmtKind::For: {
+            auto* s = static_cast<ForStmt*>(stmt);
+            depth++;
+            Flow result = Flow::Normal;
+            if (s->initializer) execute(s->initializer);
+            while (!s->condition || isTruthy(evaluate(s->condition))) {
+                Flow flow = execute(s->body);
+                if (flow == Flow::Break) break;
+                if (flow == Flow::Return) { result = flow; break; }
+                if (s->increment) evaluate(s->increment);
+            }
+            depth--;
+            return result;
+        }
+        case StmtKind::Return: {
+            auto* s = static_cast<ReturnStmt*>(stmt);
+            if (function && s->value && s->value->kind == ExprKind::Call) {
+                auto* call = static_cast<CallExpr*>(s->value);
+                if (call->function != CallExpr::NO_FUNCTION &&
+                    tailCallKeepsResult(function->returnType.type, functions[call->function]->returnType.type)) {
+                    // evaluated above the frame, then moved down over the parameters
+                    arguments(call, top);
+                    for (size_t i = 0; i < call->args.size(); i++) stack[base + i].value = stack[top + i].value;
+                    tailCallee = functions[call->function];
+                    return Flow::Return;
+                }
+            }
+            returnValue = s->value ? evaluate(s->value) : Value();
+            // a function's result becomes its declared type
+            if (function && s->value) returnValue = coerceToDeclared(function->returnType.type, returnValue);
+            return Flow::Return;
+        }
+        case StmtKind::Break: return Flow::Break;
+        case StmtKind::Continue: return Flow::Continue;
+    }
+    return Flow::Normal;
+}
+
+// before an operation on a and b that may build a star: every other value
+// the walker still needs is in its stack, pinned or returnValue
+void TreeWalker::collectStars(const Value& a, const Value& b) {
+    strings.beginCollection();
+    for (const Binding& binding : stack) strings.mark(binding.value);
+    for (const Value& v : pinned) strings.mark(v);
+    strings.mark(returnValue);
+    strings.mark(a);
+    strings.mark(b);
+    strings.sweep();
+}
+
+Value TreeWalker::literal(const LiteralExpr& literal) {
+    switch (literal.type) {
+        case LiteralExpr::Type::Bool: return Value::makeBool(literal.boolean);
+        case LiteralExpr::Type::Int: return Value::makeInt(literal.integer);
+        case LiteralExpr::Type::Float: return Value::makeFloat(literal.real);
+        case LiteralExpr::Type::Str: return strings.intern(literal.text);
+    }
+    runtimeError(literal.offset, "unsupported literal");
+}
+
+Value TreeWalker::evaluate(Expr* expr) {
+    switch (expr->kind) {
+        case ExprKind::Literal:
+            return literal(*static_cast<LiteralExpr*>(expr));
+        case ExprKind::Variable:
+            return slot(static_cast<VariableExpr*>(expr)->var).value;
+        case ExprKind::Assign: {
+            auto* a = static_cast<AssignExpr*>(expr);
+            Value v = evaluate(a->value);
+            Binding& binding = slot(a->var);
+            // compound: the target is read after the right-hand side ran
+            if (a->op.type != TokenType::EQUAL) {
+                if (strings.wantsCollection()) collectStars(v, binding.value);
+                try {
+                    applyOperator(a->op.type, binding.value, v, v, &strings);
+                } catch (const std::runtime_error& e) {
+                    runtimeError(a->op.offset, e.what());
+                }
+            }
+            binding.value = coerceToDeclared(binding.declType, v);
+            return binding.value;
+        }
+        case ExprKind::Binary: {
+            auto* b = static_cast<BinaryExpr*>(expr);
+            Value left = evaluate(b->left);
+            // the right operand may run a whole function; its collections must see left
+            bool pin = left.type == Value::Type::Str && !left.small;
+            if (pin) pinned.push_back(left);
+            Value right = evaluate(b->right);
+            if (pin) pinned.pop_back();
+            if (strings.wantsCollection()) collectStars(left, right);
+            Value result;
+            try {
+                if (applyOperator(b->op.type, left, right, result, &strings)) return result;
+            } catch (const std::runtime_error& e) {
+                runtimeError(b->op.offset, e.what());
+            }
+            runtimeError(b->op.offset, "unsupported operator '" + std::string(b->op.lexeme) + "'");
+        }
+        case ExprKind::Unary: {
+            auto* u = static_cast<UnaryExpr*>(expr);
+            Value v = evaluate(u->operand);
+            if (u->op.type == TokenType::BANG) return Value::makeBool(!isTruthy(v));
+            try {
+                return negate(v);
+            } catch (const std::runtime_error& e) {
+                runtimeError(u->op.offset, e.what());
+            }
+        }
+        case ExprKind::Logical: {
+            auto* l = static_cast<LogicalExpr*>(expr);
+            bool left = isTruthy(evaluate(l->left));
+            if (l->op.type == TokenType::AND ? !left : left) return Value::makeBool(left);
+            return Value::makeBool(isTruthy(evaluate(l->right)));
+        }
+        case ExprKind::Call:
+            return call(static_cast<CallExpr*>(expr));
+    }
+    return Value();
+}
+
+Value TreeWalker::call(CallExpr* expr) {
+    if (expr->function != CallExpr::NO_FUNCTION) {
+        // the callee's frame starts right above the caller's
+        size_t at = top;
+        arguments(expr, at);
+        if (calls >= MAX_CALL_DEPTH) runtimeError(expr->callee.offset, "stack overflow");
+        size_t callerBase = base;
+        const FuncDecl* caller = function;
+        base = at;
+        calls++;
+        Value result = invoke(functions[expr->function]);
+        calls--;
+        base = callerBase;
+        top = at;
+        function = caller;
+        return result;
+    }
+    // shine: every argument, space separated, then a newline. All are
+    // evaluated first, as in the VM, so a failing one prints nothing
+    size_t at = top;
+    arguments(expr, at);
+    for (size_t i = 0; i < expr->args.size(); i++) {
+        if (i) out.put(' ');
+        printValue(out, stack[at + i].value);
+    }
+    out.put('\n');
+    return Value();
+}
+
+// evaluates a call's arguments into stack[at..]; calls among them get their
+// frames above the arguments already evaluated
+void TreeWalker::arguments(const CallExpr* expr, size_t at) {
+    size_t saved = top;
+    for (size_t i = 0; i < expr->args.size(); i++) {
+        Value v = evaluate(expr->args[i]);
+        reserve(at + i + 1);
+        stack[at + i].value = v;
+        top = at + i + 1;
+    }
+    top = saved;
+}
+
+// runs callee in the frame at base, whose parameter slots hold the
+// arguments, then whatever it tail-calls in the same frame
+Value TreeWalker::invoke(const FuncDecl* callee) {
+    for (;;) {
+        function = callee;
+        top = base + callee->frameSize;
+        reserve(top);
+        for (size_t i = 0; i < callee->params.size(); i++) {
+            TokenType declType = callee->params[i].type.type;
+            stack[base + i] = Binding{coerceToDeclared(declType, stack[base + i].value), declType};
+        }
+        Flow flow = executeBlock(callee->body);
+        if (flow == Flow::Return && tailCallee) {
+            callee = tailCallee;
+            tailCallee = nullptr;
+            continue;
+        }
+        if (flow != Flow::Normal && flow != Flow::Return)
+            throw std::runtime_error("'darkMatter'/'warp' outside of a loop");
+        return flow == Flow::Return ? returnValue : Value();
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef TREEWALK_H
+#define TREEWALK_H
+
+#include "../parser/parser.h"
+#include "../resolver/resolver.h"
+#include "../vm/star.h"
+#include "../vm/value.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// ---------- Reference tree-walking evaluator ----------
+// Evaluates the AST directly. Names are bound by the Resolver before the
+// first statement runs, so variables are plain slots of a frame. Frames are
+// stacked in one growable vector (the script's at the bottom, a call's right
+// above its caller's), the arguments are evaluated straight into the
+// callee's parameter slots, and `blackHole f(...)` hands the caller's frame
+// to f when the VM would make it a tail call. It is deliberately
+// straightforward: it defines the expected behaviour the bytecode VM is
+// checked against, and is the baseline in the VM benchmark.
+class TreeWalker {
+public:
+    // calls nested deeper than this fail with "stack overflow": the walker
+    // recurses in C++, up to ~2 KB of native stack per call (the VM, whose
+    // frames live on the heap, goes much deeper; see VM_MAX_CALL_DEPTH)
+    static constexpr int MAX_CALL_DEPTH = 2000;
+
+    // lines gives runtime errors their line numbers; out is where shine() prints
+    explicit TreeWalker(const LineTable& lines, std::ostream& out = std::cout) : lines(lines), out(out) {}
+    // resolves the program first; a resolution error is thrown as "Line N: message"
+    Value run(const StmtList& program);
+    // variables of the outermost scope after run(), in declaration order
+    std::vector<std::pair<std::string, Value>> topLevel() const;
+
+private:
+    enum class Flow { Normal, Break, Continue, Return };
+
+    struct Binding {
+        Value value;
+        TokenType declType;
+    };
+
+    const LineTable& lines;
+    std::ostream& out;
+    std::vector<Binding> stack;              // frames, by slot; the script's first
+    size_t base = 0;                         // frame of the running function (0: the script)
+    size_t top = 0;                          // first slot above it
+    int calls = 0;                           // nested calls running
+    std::vector<FuncDecl*> functions;        // Resolution::functions
+    const FuncDecl* function = nullptr;      // running; nullptr for the script
+    const FuncDecl* tailCallee = nullptr;    // set with Flow::Return by a tail call
+    std::vector<const VarDecl*> outermost;   // declarations run in the outermost scope, in order
+    int depth = 0;                           // scopes entered; 0 is the outermost
+    StarHeap strings;                        // literals and the stars the last run() built
+    std::vector<Value> pinned;               // long stars only C++ locals hold, for collections
+    Value returnValue;
+
+    Flow execute(Stmt* stmt);
+    Flow executeBlock(const StmtList& statements);
+    Value evaluate(Expr* expr);
+    Value call(CallExpr* expr);
+    Value invoke(const FuncDecl* callee);
+    void arguments(const CallExpr* expr, size_t at);
+    Value literal(const LiteralExpr& literal);
+    void collectStars(const Value& a, const Value& b);
+    // depth 1 is the script's frame, seen from a function
+    Binding& slot(const VarSlot& var) { return stack[var.depth ? var.slot : base + var.slot]; }
+    void reserve(size_t slots) {
+        if (stack.size() < slots) stack.resize(std::max(slots, stack.size() * 2), Binding{Value(), TokenType::IDENTIFIER});
+    }
+    [[noreturn]] void runtimeError(uint32_t at, const std::string& message) const; // "Line N: message"
+};
+
+#endif
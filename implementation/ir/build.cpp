@@ -0,0 +1,671 @@
+#include "build.h"
+#include <stdexcept>
+#include <string>
+
+namespace ir {
+
+namespace {
+
+// the opcode of a binary (or compound assignment) operator token
+Opcode binaryOpcode(TokenType t) {
+    switch (t) {
+        case TokenType::PLUS: case TokenType::PLUS_EQ: return Opcode::Add;
+        case TokenType::MINUS: case TokenType::MINUS_EQ: return Opcode::Sub;
+        case TokenType::STARR: case TokenType::STARR_EQ: return Opcode::Mul;
+        case TokenType::SLASH: case TokenType::SLASH_EQ: return Opcode::Div;
+        case TokenType::PERCENT: case TokenType::PERCENT_EQ: return Opcode::Mod;
+        case TokenType::BIT_AND: return Opcode::BAnd;
+        case TokenType::BIT_OR: return Opcode::BOr;
+        case TokenType::XOR: return Opcode::BXor;
+        case TokenType::EQUAL_EQ: return Opcode::Eq;
+        case TokenType::BANG_EQ: return Opcode::Ne;
+        case TokenType::LESS: return Opcode::Lt;
+        case TokenType::LESS_EQ: return Opcode::Le;
+        case TokenType::GREATER: return Opcode::Gt;
+        case TokenType::GREATER_EQ: return Opcode::Ge;
+        default: throw std::runtime_error("Unsupported binary operator");
+    }
+}
+
+// the names an expression uses that `scope` does not declare
+void freeNames(const Expr* expr, const std::vector<symbols::Symbol>& scope, std::vector<symbols::Symbol>& out) {
+    auto use = [&](const Token& name) {
+        for (symbols::Symbol s : scope)
+            if (s == name.symbol()) return;
+        out.push_back(name.symbol());
+    };
+    switch (expr->kind) {
+        case ExprKind::Literal: break;
+        case ExprKind::Variable: use(static_cast<const VariableExpr*>(expr)->name); break;
+        case ExprKind::Binary:
+            freeNames(static_cast<const BinaryExpr*>(expr)->left, scope, out);
+            freeNames(static_cast<const BinaryExpr*>(expr)->right, scope, out);
+            break;
+        case ExprKind::Assign:
+            use(static_cast<const AssignExpr*>(expr)->name);
+            freeNames(static_cast<const AssignExpr*>(expr)->value, scope, out);
+            break;
+        case ExprKind::Unary: freeNames(static_cast<const UnaryExpr*>(expr)->operand, scope, out); break;
+        case ExprKind::Logical:
+            freeNames(static_cast<const LogicalExpr*>(expr)->left, scope, out);
+            freeNames(static_cast<const LogicalExpr*>(expr)->right, scope, out);
+            break;
+        case ExprKind::Call:
+            for (const Expr* arg : static_cast<const CallExpr*>(expr)->args) freeNames(arg, scope, out);
+            break;
+    }
+}
+
+// the same for a statement; `scope` holds the names declared around it,
+// innermost last, and is back as it was afterwards
+void freeNames(const Stmt* stmt, std::vector<symbols::Symbol>& scope, std::vector<symbols::Symbol>& out) {
+    size_t mark = scope.size();
+    switch (stmt->kind) {
+        case StmtKind::VarDecl: {
+            auto* decl = static_cast<const VarDecl*>(stmt);
+            if (decl->initializer) freeNames(decl->initializer, scope, out);
+            scope.push_back(decl->name.symbol());
+            return; // stays declared for the rest of the enclosing block
+        }
+        case StmtKind::FuncDecl: break; // an error once built
+        case StmtKind::Block:
+            for (const Stmt* s : static_cast<const BlockStmt*>(stmt)->statements) freeNames(s, scope, out);
+            break;
+        case StmtKind::Expression: freeNames(static_cast<const ExprStmt*>(stmt)->expression, scope, out); break;
+        case StmtKind::If: {
+            auto* s = static_cast<const IfStmt*>(stmt);
+            freeNames(s->condition, scope, out);
+            freeNames(s->thenBranch, scope, out);
+            scope.resize(mark);
+            if (s->elseBranch) freeNames(s->elseBranch, scope, out);
+            break;
+        }
+        case StmtKind::While:
+            freeNames(static_cast<const WhileStmt*>(stmt)->condition, scope, out);
+            freeNames(static_cast<const WhileStmt*>(stmt)->body, scope, out);
+            break;
+        case StmtKind::For: {
+            auto* s = static_cast<const ForStmt*>(stmt);
+            if (s->initializer) freeNames(s->initializer, scope, out);
+            if (s->condition) freeNames(s->condition, scope, out);
+            freeNames(s->body, scope, out);
+            if (s->increment) freeNames(s->increment, scope, out);
+            break;
+        }
+        case StmtKind::Return:
+            if (static_cast<const ReturnStmt*>(stmt)->value) freeNames(static_cast<const ReturnStmt*>(stmt)->value, scope, out);
+            break;
+        case StmtKind::Break:
+        case StmtKind::Continue: break;
+    }
+    scope.resize(mark);
+}
+
+} // namespace
+
+Builder::Builder(Program& program, const LineTable& lines, bool exportTopLevel)
+    : program(program), fn(program.add("<script>")), lines(lines), exportTopLevel(exportTopLevel),
+      owned(new Shared()), shared(owned.get()) {}
+
+Builder::Builder(const Builder& script, Function& fn, const FuncDecl* decl)
+    : program(script.program), fn(fn), lines(script.lines), exportTopLevel(false), script(&script),
+      function(decl), shared(script.shared) {}
+
+void Builder::error(uint32_t at, const std::string& message) const {
+    throw std::runtime_error("Line " + std::to_string(lines.line(at)) + ": " + message);
+}
+
+void Builder::build(const StmtList& statements) {
+    // functions are visible everywhere, including before their declaration;
+    // each has its Function up front so that calls can name it
+    for (Stmt* stmt : statements) {
+        if (stmt->kind != StmtKind::FuncDecl) continue;
+        auto* decl = static_cast<FuncDecl*>(stmt);
+        if (shared->functionIndex.find(decl->name.symbol()))
+            error(decl->name.offset, "function '" + std::string(decl->name.lexeme) + "' already declared");
+        if (shared->functions.size() >= UINT16_MAX) throw std::runtime_error("Too many functions");
+        shared->functionIndex.set(decl->name.symbol(), uint32_t(1 + shared->functions.size()));
+        shared->functions.push_back(decl);
+    }
+    for (const FuncDecl* decl : shared->functions) {
+        Function& f = program.add(std::string(decl->name.lexeme));
+        f.numParams = uint32_t(decl->params.size());
+        f.paramTypes.assign(f.numParams, Type::Any);
+    }
+    findGlobals(statements);
+
+    startBlock(newBlock(true));
+    for (Stmt* stmt : statements) statement(stmt);
+    returnStatement();
+    finish();
+}
+
+// the script's variables that some function uses can change under any call,
+// so they are not SSA values but global slots, read and written in order
+void Builder::findGlobals(const StmtList& statements) {
+    SymbolMap<const VarDecl*> declared; // the script's so far
+    std::unordered_map<const VarDecl*, bool> used;
+    for (const Stmt* stmt : statements) {
+        if (stmt->kind == StmtKind::VarDecl) {
+            auto* decl = static_cast<const VarDecl*>(stmt);
+            declared.set(decl->name.symbol(), decl);
+        }
+        if (stmt->kind != StmtKind::FuncDecl) continue;
+        auto* decl = static_cast<const FuncDecl*>(stmt);
+        std::vector<symbols::Symbol> scope, names;
+        for (const Param& param : decl->params) scope.push_back(param.name.symbol());
+        for (const Stmt* s : decl->body) freeNames(s, scope, names);
+        for (symbols::Symbol name : names)
+            if (const VarDecl* const* var = declared.find(name)) used[*var] = true;
+    }
+    for (const Stmt* stmt : statements) {
+        if (stmt->kind != StmtKind::VarDecl || !used.count(static_cast<const VarDecl*>(stmt))) continue;
+        auto* decl = static_cast<const VarDecl*>(stmt);
+        shared->globalSlots.emplace(decl, uint32_t(program.globals.size()));
+        program.globals.push_back(std::string(decl->name.lexeme));
+        program.globalTypes.push_back(Type::Any);
+    }
+}
+
+// ---------- blocks ----------
+BlockId Builder::newBlock(bool isSealed) {
+    BlockId b = fn.newBlock();
+    defs.emplace_back();
+    incompletePhis.emplace_back();
+    phis.emplace_back();
+    sealed.push_back(isSealed);
+    return b;
+}
+
+void Builder::seal(BlockId block) {
+    for (auto [var, phi] : incompletePhis[block]) completePhi(var, phi);
+    incompletePhis[block].clear();
+    sealed[block] = true;
+}
+
+void Builder::startBlock(BlockId block) {
+    current = block;
+    open = true;
+}
+
+// jumps out of a block that already ended (after blackHole, darkMatter or
+// warp) are dropped: the code that would take them is unreachable
+void Builder::jump(BlockId to) {
+    if (!open) return;
+    fn.append(current, fn.make(Opcode::Jump, {}));
+    fn.addEdge(current, to);
+    open = false;
+}
+
+void Builder::branch(ValueId cond, BlockId ifTrue, BlockId ifFalse) {
+    if (!open) return;
+    fn.append(current, fn.make(Opcode::Branch, {cond}));
+    fn.addEdge(current, ifTrue);
+    fn.addEdge(current, ifFalse);
+    open = false;
+}
+
+ValueId Builder::emit(Opcode op, std::vector<ValueId> args, uint32_t offset) {
+    if (!open) startBlock(newBlock(true));
+    ValueId v = fn.make(op, std::move(args), offset);
+    fn.append(current, v);
+    return v;
+}
+
+// constants live at the top of the entry block, one per distinct value
+ValueId Builder::constant(const Value& v) {
+    std::string key = constantKey(v);
+    auto found = constantIndex.find(key);
+    if (found != constantIndex.end()) return found->second;
+    Value k = v;
+    if (v.type == Value::Type::Str) k = fn.strings.intern(starText(v));
+    ValueId id = fn.makeConst(k);
+    fn[id].block = 0;
+    constants.push_back(id);
+    constantIndex.emplace(std::move(key), id);
+    return id;
+}
+
+// ---------- variables ----------
+ValueId Builder::resolve(ValueId v) {
+    while (v < forward.size() && forward[v] != NONE) v = forward[v];
+    return v;
+}
+
+void Builder::write(uint32_t var, BlockId block, ValueId value) { defs[block][var] = value; }
+
+ValueId Builder::read(uint32_t var, BlockId block) {
+    auto found = defs[block].find(var);
+    if (found != defs[block].end()) return resolve(found->second);
+    return readRecursive(var, block);
+}
+
+ValueId Builder::readRecursive(uint32_t var, BlockId block) {
+    const std::vector<BlockId>& preds = fn.blocks[block].preds;
+    ValueId value;
+    if (!sealed[block]) {
+        value = newPhi(var, block);
+        incompletePhis[block].push_back({var, value});
+    } else if (preds.size() == 1) {
+        value = read(var, preds[0]);
+    } else if (preds.empty()) {
+        value = constant(Value()); // unreachable code
+    } else {
+        ValueId phi = newPhi(var, block);
+        write(var, block, phi); // breaks cycles through loops
+        value = completePhi(var, phi);
+    }
+    write(var, block, value);
+    return value;
+}
+
+ValueId Builder::newPhi(uint32_t var, BlockId block) {
+    ValueId phi = fn.make(Opcode::Phi, {});
+    fn[phi].block = block;
+    fn[phi].name = varNames[var];
+    phis[block].push_back(phi);
+    return phi;
+}
+
+// fill in the arguments, then forward the phi if it only merges one value
+ValueId Builder::completePhi(uint32_t var, ValueId phi) {
+    for (BlockId p : fn.blocks[fn[phi].block].preds) {
+        ValueId arg = read(var, p);
+        fn[phi].args.push_back(arg);
+    }
+    ValueId same = NONE;
+    for (ValueId arg : fn[phi].args) {
+        arg = resolve(arg);
+        if (arg == same || arg == phi) continue;
+        if (same != NONE) return phi;
+        same = arg;
+    }
+    if (same == NONE) same = constant(Value());
+    if (forward.size() <= phi) forward.resize(fn.values.size(), NONE);
+    forward[phi] = same;
+    return same;
+}
+
+ValueId Builder::coerce(TokenType declType, ValueId value, uint32_t offset) {
+    if (declType == TokenType::MASS) return emit(Opcode::ToInt, {value}, offset);
+    if (declType == TokenType::FLUX) return emit(Opcode::ToFloat, {value}, offset);
+    return value;
+}
+
+// a function sees its own variables, then the script's declared before it
+Builder::Ref Builder::lookup(const Token& name) const {
+    if (const Local* local = locals.find(name.symbol()))
+        return {local->var, varSlots[local->var], declTypes[local->var]};
+    if (script)
+        if (const Local* local = script->locals.find(name.symbol()))
+            return {NONE, script->varSlots[local->var], script->declTypes[local->var]};
+    error(name.offset, "undefined variable '" + std::string(name.lexeme) + "'");
+}
+
+ValueId Builder::load(const Ref& ref, uint32_t offset) {
+    if (ref.slot == NONE) return read(ref.var, current);
+    ValueId v = emit(Opcode::GetGlobal, {}, offset);
+    fn[v].index = ref.slot;
+    return v;
+}
+
+void Builder::store(const Ref& ref, ValueId value, uint32_t offset) {
+    if (ref.slot == NONE) {
+        write(ref.var, current, value);
+        return;
+    }
+    ValueId v = emit(Opcode::SetGlobal, {value}, offset);
+    fn[v].index = ref.slot;
+}
+
+void Builder::endScope() {
+    scopeDepth--;
+    while (!locals.empty() && locals.back().depth > scopeDepth) locals.pop_back();
+}
+
+// ---------- statements ----------
+void Builder::statement(Stmt* stmt) {
+    // whatever follows blackHole, darkMatter or warp goes to a block of its own
+    if (!open) startBlock(newBlock(true));
+    switch (stmt->kind) {
+        case StmtKind::VarDecl: varDeclaration(static_cast<VarDecl*>(stmt)); break;
+        case StmtKind::FuncDecl: functionDeclaration(static_cast<FuncDecl*>(stmt)); break;
+        case StmtKind::Block:
+            beginScope();
+            for (Stmt* s : static_cast<BlockStmt*>(stmt)->statements) statement(s);
+            endScope();
+            break;
+        case StmtKind::Expression: expression(static_cast<ExprStmt*>(stmt)->expression); break;
+        case StmtKind::If: ifStatement(static_cast<IfStmt*>(stmt)); break;
+        case StmtKind::While: whileStatement(static_cast<WhileStmt*>(stmt)); break;
+        case StmtKind::For: forStatement(static_cast<ForStmt*>(stmt)); break;
+        case StmtKind::Return: {
+            auto* s = static_cast<ReturnStmt*>(stmt);
+            if (function) {
+                functionReturn(s);
+                break;
+            }
+            if (s->value) expression(s->value); // the script's result is dropped
+            returnStatement();
+            break;
+        }
+        case StmtKind::Break:
+        case StmtKind::Continue: {
+            bool isBreak = stmt->kind == StmtKind::Break;
+            if (loops.empty())
+                throw std::runtime_error(std::string(isBreak ? "'darkMatter'" : "'warp'") + " outside of a loop");
+            jump(isBreak ? loops.back().breakTo : loops.back().continueTo);
+            break;
+        }
+    }
+}
+
+void Builder::varDeclaration(VarDecl* decl) {
+    const Local* same = locals.find(decl->name.symbol());
+    if (same && same->depth == scopeDepth)
+        error(decl->name.offset, "variable '" + std::string(decl->name.lexeme) + "' already declared in this scope");
+    TokenType declType = decl->type.type;
+    ValueId value = decl->initializer ? coerce(declType, expression(decl->initializer), decl->name.offset)
+                                      : constant(defaultForDeclared(declType));
+    // declared after the initializer, so `mass x = x;` sees an outer x
+    uint32_t var = uint32_t(declTypes.size());
+    auto slot = shared->globalSlots.find(decl);
+    declTypes.push_back(declType);
+    varNames.push_back(decl->name.lexeme);
+    varSlots.push_back(!function && slot != shared->globalSlots.end() ? slot->second : NONE);
+    // a function called before the declaration finds the variable vacuum
+    if (varSlots[var] != NONE && called) readEarly.push_back(varSlots[var]);
+    locals.push({decl->name.symbol(), var, scopeDepth});
+    store({var, varSlots[var], declType}, value, decl->name.offset);
+}
+
+// built where it stands, into its own Function
+void Builder::functionDeclaration(FuncDecl* decl) {
+    if (scopeDepth > 0 || function) error(decl->name.offset, "functions can only be declared at the top level");
+    Builder builder(*this, program.functions[*shared->functionIndex.find(decl->name.symbol())], decl);
+    builder.buildFunction();
+}
+
+void Builder::buildFunction() {
+    startBlock(newBlock(true));
+    beginScope();
+    std::vector<ValueId> params;
+    for (uint32_t i = 0; i < function->params.size(); i++) {
+        const Param& param = function->params[i];
+        const Local* same = locals.find(param.name.symbol());
+        if (same && same->depth == scopeDepth)
+            error(param.name.offset, "variable '" + std::string(param.name.lexeme) + "' already declared in this scope");
+        uint32_t var = uint32_t(declTypes.size());
+        declTypes.push_back(param.type.type);
+        varNames.push_back(param.name.lexeme);
+        varSlots.push_back(NONE);
+        locals.push({param.name.symbol(), var, scopeDepth});
+        ValueId v = emit(Opcode::Param, {}, param.name.offset);
+        fn[v].index = i;
+        fn[v].name = param.name.lexeme;
+        params.push_back(v);
+    }
+    // the caller passes the arguments as they are; a tail call lands here too
+    for (uint32_t i = 0; i < params.size(); i++)
+        write(i, current, coerce(declTypes[i], params[i], function->params[i].name.offset));
+    for (Stmt* s : function->body) statement(s);
+    // falling off the end returns vacuum
+    if (open) emit(Opcode::Return, {constant(Value())}, 0);
+    open = false;
+    endScope();
+    finish();
+}
+
+void Builder::ifStatement(IfStmt* stmt) {
+    ValueId cond = expression(stmt->condition);
+    BlockId thenBlock = newBlock(true);
+    BlockId elseBlock = stmt->elseBranch ? newBlock(true) : NONE;
+    BlockId join = newBlock(false);
+    branch(cond, thenBlock, stmt->elseBranch ? elseBlock : join);
+    startBlock(thenBlock);
+    statement(stmt->thenBranch);
+    jump(join);
+    if (stmt->elseBranch) {
+        startBlock(elseBlock);
+        statement(stmt->elseBranch);
+        jump(join);
+    }
+    seal(join);
+    startBlock(join);
+}
+
+void Builder::whileStatement(WhileStmt* stmt) {
+    BlockId header = newBlock(false);
+    jump(header);
+    startBlock(header);
+    ValueId cond = expression(stmt->condition);
+    BlockId body = newBlock(true);
+    BlockId exit = newBlock(false);
+    branch(cond, body, exit);
+
+    loops.push_back({exit, header});
+    startBlock(body);
+    statement(stmt->body);
+    jump(header);
+    loops.pop_back();
+
+    seal(header);
+    seal(exit);
+    startBlock(exit);
+}
+
+void Builder::forStatement(ForStmt* stmt) {
+    beginScope();
+    if (stmt->initializer) statement(stmt->initializer);
+
+    BlockId header = newBlock(false);
+    jump(header);
+    startBlock(header);
+    BlockId body = newBlock(true);
+    BlockId exit = newBlock(false);
+    if (stmt->condition) branch(expression(stmt->condition), body, exit);
+    else jump(body);
+
+    // warp goes to the increment
+    BlockId step = newBlock(false);
+    loops.push_back({exit, step});
+    startBlock(body);
+    statement(stmt->body);
+    jump(step);
+    loops.pop_back();
+
+    seal(step);
+    startBlock(step);
+    if (stmt->increment) expression(stmt->increment);
+    jump(header);
+    seal(header);
+    seal(exit);
+    startBlock(exit);
+    endScope();
+}
+
+void Builder::returnStatement() {
+    if (!open) return;
+    ValueId ret = emit(Opcode::Return, {}, 0);
+    returns.push_back({ret, declTypes.size()});
+    open = false;
+}
+
+// blackHole in a function: its value becomes the declared return type, unless
+// it is a call handing over its frame
+void Builder::functionReturn(ReturnStmt* stmt) {
+    if (!stmt->value) {
+        emit(Opcode::Return, {constant(Value())}, 0);
+        open = false;
+        return;
+    }
+    if (stmt->value->kind == ExprKind::Call) {
+        auto* call = static_cast<CallExpr*>(stmt->value);
+        const uint32_t* index = shared->functionIndex.find(call->callee.symbol());
+        if (call->callee.type != TokenType::SHINE && index &&
+            tailCallKeepsResult(function->returnType.type, shared->functions[*index - 1]->returnType.type)) {
+            std::vector<ValueId> args = arguments(call);
+            ValueId v = emit(Opcode::TailCall, std::move(args), call->callee.offset);
+            fn[v].index = callee(call);
+            open = false;
+            return;
+        }
+    }
+    ValueId value = coerce(function->returnType.type, expression(stmt->value), 0);
+    emit(Opcode::Return, {value}, 0);
+    open = false;
+}
+
+// ---------- expressions ----------
+ValueId Builder::expression(Expr* expr) {
+    switch (expr->kind) {
+        case ExprKind::Literal: {
+            auto* lit = static_cast<LiteralExpr*>(expr);
+            switch (lit->type) {
+                case LiteralExpr::Type::Bool: return constant(Value::makeBool(lit->boolean));
+                case LiteralExpr::Type::Int: return constant(Value::makeInt(lit->integer));
+                case LiteralExpr::Type::Float: return constant(Value::makeFloat(lit->real));
+                case LiteralExpr::Type::Str: return constant(fn.strings.intern(lit->text));
+            }
+            throw std::runtime_error("Unsupported literal");
+        }
+        case ExprKind::Variable: {
+            const Token& name = static_cast<VariableExpr*>(expr)->name;
+            return load(lookup(name), name.offset);
+        }
+        case ExprKind::Binary: {
+            auto* e = static_cast<BinaryExpr*>(expr);
+            ValueId l = expression(e->left);
+            ValueId r = expression(e->right);
+            return emit(binaryOpcode(e->op.type), {l, r}, e->op.offset);
+        }
+        case ExprKind::Assign: {
+            // x op= v: the variable is read after v is evaluated
+            auto* e = static_cast<AssignExpr*>(expr);
+            Ref ref = lookup(e->name);
+            ValueId value = expression(e->value);
+            if (e->op.type != TokenType::EQUAL)
+                value = emit(binaryOpcode(e->op.type), {load(ref, e->name.offset), value}, e->op.offset);
+            value = coerce(ref.declType, value, e->name.offset);
+            store(ref, value, e->name.offset);
+            return value;
+        }
+        case ExprKind::Unary: {
+            auto* e = static_cast<UnaryExpr*>(expr);
+            ValueId operand = expression(e->operand);
+            return emit(e->op.type == TokenType::BANG ? Opcode::Not : Opcode::Neg, {operand}, e->op.offset);
+        }
+        case ExprKind::Logical: return logical(static_cast<LogicalExpr*>(expr));
+        case ExprKind::Call: return call(static_cast<CallExpr*>(expr));
+    }
+    throw std::runtime_error("Unsupported expression");
+}
+
+// a && b is truth(a) ? truth(b) : voidness, a || b is truth(a) ? starlight : truth(b)
+ValueId Builder::logical(LogicalExpr* expr) {
+    bool isAnd = expr->op.type == TokenType::AND;
+    ValueId left = expression(expr->left);
+    BlockId rhs = newBlock(true);
+    BlockId join = newBlock(false);
+    BlockId shortCircuit = current;
+    if (isAnd) branch(left, rhs, join);
+    else branch(left, join, rhs);
+
+    startBlock(rhs);
+    ValueId right = emit(Opcode::ToBool, {expression(expr->right)}, expr->op.offset);
+    jump(join);
+    seal(join);
+    startBlock(join);
+
+    ValueId known = constant(Value::makeBool(!isAnd));
+    const std::vector<BlockId>& preds = fn.blocks[join].preds;
+    if (preds.size() < 2) return preds.size() == 1 && preds[0] == shortCircuit ? known : right;
+    ValueId phi = fn.make(Opcode::Phi, {});
+    fn[phi].block = join;
+    for (BlockId p : preds) fn[phi].args.push_back(p == shortCircuit ? known : right);
+    phis[join].push_back(phi);
+    return phi;
+}
+
+ValueId Builder::call(CallExpr* expr) {
+    std::vector<ValueId> args = arguments(expr);
+    if (expr->callee.type == TokenType::SHINE) {
+        emit(Opcode::Print, std::move(args), expr->paren.offset);
+        return constant(Value());
+    }
+    uint32_t index = callee(expr);
+    called = true;
+    ValueId v = emit(Opcode::Call, std::move(args), expr->callee.offset);
+    fn[v].index = index;
+    return v;
+}
+
+std::vector<ValueId> Builder::arguments(const CallExpr* expr) {
+    std::vector<ValueId> args;
+    for (Expr* arg : expr->args) args.push_back(expression(arg));
+    return args;
+}
+
+// index of the function a call names, once its arguments are built (their
+// errors come first, as in the Compiler)
+uint32_t Builder::callee(const CallExpr* expr) const {
+    const uint32_t* index = shared->functionIndex.find(expr->callee.symbol());
+    if (!index) error(expr->callee.offset, "undefined function '" + std::string(expr->callee.lexeme) + "'");
+    const FuncDecl* decl = shared->functions[*index - 1];
+    if (decl->params.size() != expr->args.size())
+        error(expr->callee.offset, "function '" + std::string(expr->callee.lexeme) + "' expects " +
+                                       std::to_string(decl->params.size()) + " arguments but got " +
+                                       std::to_string(expr->args.size()));
+    return *index;
+}
+
+// ---------- finishing ----------
+void Builder::finish() {
+    // each return hands over the outermost variables declared before it
+    if (exportTopLevel) {
+        for (size_t i = 0; i < locals.size(); i++) fn.exported.push_back(std::string(symbols::name(locals[i].name)));
+        for (auto [ret, declared] : returns) {
+            std::vector<ValueId> args;
+            for (size_t i = 0; i < locals.size(); i++) {
+                uint32_t var = locals[i].var;
+                if (var >= declared) {
+                    args.push_back(constant(Value()));
+                } else if (varSlots[var] == NONE) {
+                    args.push_back(read(var, fn[ret].block));
+                } else {
+                    // read back just before the return
+                    ValueId v = fn.make(Opcode::GetGlobal, {}, 0);
+                    fn[v].index = varSlots[var];
+                    std::vector<ValueId>& insts = fn.blocks[fn[ret].block].insts;
+                    fn[v].block = fn[ret].block;
+                    insts.insert(insts.end() - 1, v);
+                    args.push_back(v);
+                }
+            }
+            fn[ret].args = std::move(args);
+        }
+    }
+
+    for (Inst& inst : fn.values)
+        for (ValueId& a : inst.args) a = resolve(a);
+    std::vector<ValueId> early;
+    for (uint32_t slot : readEarly) {
+        ValueId v = fn.make(Opcode::SetGlobal, {constant(Value())}, 0);
+        fn[v].index = slot;
+        fn[v].block = 0;
+        early.push_back(v);
+    }
+    for (BlockId b = 0; b < fn.blocks.size(); b++) {
+        std::vector<ValueId> front;
+        if (b == 0) front = constants;
+        if (b == 0) front.insert(front.end(), early.begin(), early.end());
+        for (ValueId phi : phis[b]) {
+            if (resolve(phi) != phi) fn[phi].dead = true;
+            else front.push_back(phi);
+        }
+        std::vector<ValueId>& insts = fn.blocks[b].insts;
+        insts.insert(insts.begin(), front.begin(), front.end());
+    }
+}
+
+} // namespace ir
@@ -0,0 +1,140 @@
+#ifndef IR_BUILD_H
+#define IR_BUILD_H
+
+#include "../parser/parser.h"
+#include "../symbols/symbolmap.h"
+#include "ir.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// ---------- AST -> SSA ----------
+// Builds SSA directly from the tree, without a dominance-frontier pass
+// (Braun et al., "Simple and Efficient Construction of Static Single
+// Assignment Form"): each block keeps the current value of every variable
+// written in it, reads look through the predecessors, and a block whose
+// predecessors are not all known yet (a loop header before its back-edge)
+// gets placeholder phis that are completed when the block is sealed. Phis
+// that turn out to merge a single value are forwarded to it.
+// Rejects what the bytecode Compiler rejects, with the same messages.
+// Each declared function is built where it stands, by a Builder of its own,
+// into its own Function; the script's variables it uses were found before
+// anything was built, and are global slots from their declaration on.
+namespace ir {
+
+class Builder {
+public:
+    // exportTopLevel: every return passes the outermost variables along
+    // (for --vars); otherwise their final values are dead unless printed
+    Builder(Program& program, const LineTable& lines, bool exportTopLevel);
+    void build(const StmtList& program);
+
+private:
+    struct Local {
+        symbols::Symbol name;
+        uint32_t var; // index into declTypes
+        int depth;
+    };
+
+    // a variable as an expression names it: var is NONE for a script
+    // variable used from a function, slot NONE unless it is global
+    struct Ref {
+        uint32_t var;
+        uint32_t slot;
+        TokenType declType;
+    };
+
+    // what the script's Builder and the functions' share
+    struct Shared {
+        SymbolMap<uint32_t> functionIndex; // into Program::functions
+        std::vector<const FuncDecl*> functions; // by index - 1
+        std::unordered_map<const VarDecl*, uint32_t> globalSlots;
+    };
+
+    // a declared function, inside the script's build
+    Builder(const Builder& script, Function& fn, const FuncDecl* decl);
+
+    struct LoopTargets {
+        BlockId breakTo;
+        BlockId continueTo;
+    };
+
+    Program& program;
+    Function& fn;
+    const LineTable& lines;
+    bool exportTopLevel;
+    const Builder* script = nullptr;  // set in a function's Builder
+    const FuncDecl* function = nullptr; // the function being built
+    std::unique_ptr<Shared> owned;    // the script's Builder owns it
+    Shared* shared;
+
+    ScopeStack<Local> locals;
+    int scopeDepth = 0;
+    std::vector<TokenType> declTypes;              // by variable
+    std::vector<std::string_view> varNames;        // by variable
+    std::vector<uint32_t> varSlots;                // by variable: global slot or NONE
+    std::vector<LoopTargets> loops;
+    BlockId current = 0;
+    bool open = true; // current block still takes instructions (no terminator yet)
+
+    // SSA construction state, by block
+    std::vector<std::unordered_map<uint32_t, ValueId>> defs;
+    std::vector<std::vector<std::pair<uint32_t, ValueId>>> incompletePhis;
+    std::vector<std::vector<ValueId>> phis;
+    std::vector<bool> sealed;
+    std::vector<ValueId> forward; // trivial phi -> the value it stands for
+    std::vector<ValueId> constants;
+    std::unordered_map<std::string, ValueId> constantIndex;
+    std::vector<std::pair<ValueId, size_t>> returns; // Return inst, variables declared at that point
+    bool called = false;                 // a function may have run (the script's build)
+    std::vector<uint32_t> readEarly;     // global slots a call may read before their declaration
+
+    [[noreturn]] void error(uint32_t at, const std::string& message) const;
+
+    BlockId newBlock(bool isSealed);
+    void seal(BlockId block);
+    void jump(BlockId to);
+    void branch(ValueId cond, BlockId ifTrue, BlockId ifFalse);
+    void startBlock(BlockId block);
+    ValueId emit(Opcode op, std::vector<ValueId> args, uint32_t offset);
+    ValueId constant(const Value& v);
+
+    // variables
+    ValueId resolve(ValueId v);
+    void write(uint32_t var, BlockId block, ValueId value);
+    ValueId read(uint32_t var, BlockId block);
+    ValueId readRecursive(uint32_t var, BlockId block);
+    ValueId newPhi(uint32_t var, BlockId block);
+    ValueId completePhi(uint32_t var, ValueId phi);
+    ValueId coerce(TokenType declType, ValueId value, uint32_t offset);
+
+    // statements
+    void statement(Stmt* stmt);
+    void varDeclaration(VarDecl* decl);
+    void functionDeclaration(FuncDecl* decl);
+    void buildFunction();
+    void ifStatement(IfStmt* stmt);
+    void whileStatement(WhileStmt* stmt);
+    void forStatement(ForStmt* stmt);
+    void returnStatement();
+    void functionReturn(ReturnStmt* stmt);
+    void beginScope() { scopeDepth++; }
+    void endScope();
+
+    // expressions
+    ValueId expression(Expr* expr);
+    ValueId logical(LogicalExpr* expr);
+    ValueId call(CallExpr* expr);
+    std::vector<ValueId> arguments(const CallExpr* expr);
+    uint32_t callee(const CallExpr* expr) const;
+    Ref lookup(const Token& name) const;
+    ValueId load(const Ref& ref, uint32_t offset);
+    void store(const Ref& ref, ValueId value, uint32_t offset);
+    void findGlobals(const StmtList& program);
+
+    void finish();
+};
+
+} // namespace ir
+
+#endif
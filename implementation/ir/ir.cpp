@@ -0,0 +1,406 @@
+#include "ir.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace ir {
+
+const char* opcodeName(Opcode op) {
+    static const char* names[] = {
+#define IR_OP_NAME(name, text) text,
+        ASTERVOID_IR_OPS(IR_OP_NAME)
+#undef IR_OP_NAME
+    };
+    return names[int(op)];
+}
+
+const char* typeName(Type type) {
+    switch (type) {
+        case Type::Unset: return "-";
+        case Type::Int: return "mass";
+        case Type::Float: return "flux";
+        case Type::Bool: return "truth";
+        case Type::Str: return "star";
+        case Type::Nil: return "vacuum";
+        case Type::Any: return "any";
+    }
+    return "?";
+}
+
+// ---------- Function ----------
+BlockId Function::newBlock() {
+    blocks.emplace_back();
+    return BlockId(blocks.size() - 1);
+}
+
+ValueId Function::make(Opcode op, std::vector<ValueId> args, uint32_t offset) {
+    Inst inst;
+    inst.op = op;
+    inst.args = std::move(args);
+    inst.offset = offset;
+    values.push_back(std::move(inst));
+    return ValueId(values.size() - 1);
+}
+
+ValueId Function::makeConst(const Value& v) {
+    ValueId id = make(Opcode::Const, {});
+    values[id].constant = v;
+    return id;
+}
+
+void Function::append(BlockId block, ValueId inst) {
+    values[inst].block = block;
+    blocks[block].insts.push_back(inst);
+}
+
+void Function::addEdge(BlockId from, BlockId to) {
+    blocks[from].succs.push_back(to);
+    blocks[to].preds.push_back(from);
+}
+
+void Function::removeEdge(BlockId from, BlockId to) {
+    Block& target = blocks[to];
+    auto at = std::find(target.preds.begin(), target.preds.end(), from);
+    if (at == target.preds.end()) return;
+    size_t index = size_t(at - target.preds.begin());
+    target.preds.erase(at);
+    for (ValueId v : target.insts) {
+        Inst& inst = values[v];
+        if (inst.op != Opcode::Phi) break;
+        inst.args.erase(inst.args.begin() + long(index));
+    }
+    std::vector<BlockId>& succs = blocks[from].succs;
+    succs.erase(std::find(succs.begin(), succs.end(), to));
+}
+
+void Function::replaceUses(ValueId from, ValueId to) {
+    for (Inst& inst : values)
+        if (!inst.dead)
+            for (ValueId& a : inst.args)
+                if (a == from) a = to;
+}
+
+void Function::compact() {
+    for (BlockId b = 0; b < blocks.size(); b++) {
+        Block& block = blocks[b];
+        if (block.dead) {
+            for (ValueId v : block.insts) values[v].dead = true;
+            block.insts.clear();
+            while (!block.succs.empty()) removeEdge(b, block.succs.back());
+            continue;
+        }
+        block.insts.erase(std::remove_if(block.insts.begin(), block.insts.end(),
+                                         [&](ValueId v) { return values[v].dead; }),
+                          block.insts.end());
+    }
+}
+
+Function& Program::add(std::string name) {
+    functions.emplace_back();
+    Function& fn = functions.back();
+    fn.name = std::move(name);
+    fn.program = this;
+    return fn;
+}
+
+std::vector<BlockId> Function::reversePostorder() const {
+    std::vector<BlockId> order;
+    std::vector<uint8_t> state(blocks.size(), 0); // 0 new, 1 on the stack, 2 done
+    std::vector<std::pair<BlockId, size_t>> stack{{0, 0}};
+    state[0] = 1;
+    while (!stack.empty()) {
+        auto& [b, next] = stack.back();
+        // successors are visited last to first, so the first one (a branch's
+        // true side, a loop body) comes right after its block in the order
+        const std::vector<BlockId>& succs = blocks[b].succs;
+        if (next < succs.size()) {
+            BlockId s = succs[succs.size() - 1 - next++];
+            if (!state[s]) {
+                state[s] = 1;
+                stack.push_back({s, 0});
+            }
+            continue;
+        }
+        state[b] = 2;
+        order.push_back(b);
+        stack.pop_back();
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+// ---------- analyses ----------
+std::vector<BlockId> dominators(const Function& fn) {
+    std::vector<BlockId> rpo = fn.reversePostorder();
+    std::vector<uint32_t> index(fn.blocks.size(), NONE);
+    for (size_t i = 0; i < rpo.size(); i++) index[rpo[i]] = uint32_t(i);
+    std::vector<BlockId> idom(fn.blocks.size(), NONE);
+    idom[0] = 0;
+    auto intersect = [&](BlockId a, BlockId b) {
+        while (a != b) {
+            while (index[a] > index[b]) a = idom[a];
+            while (index[b] > index[a]) b = idom[b];
+        }
+        return a;
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = 1; i < rpo.size(); i++) {
+            BlockId b = rpo[i];
+            BlockId next = NONE;
+            for (BlockId p : fn.blocks[b].preds) {
+                if (idom[p] == NONE) continue;
+                next = next == NONE ? p : intersect(p, next);
+            }
+            if (next != idom[b]) {
+                idom[b] = next;
+                changed = true;
+            }
+        }
+    }
+    idom[0] = NONE;
+    return idom;
+}
+
+bool dominates(const std::vector<BlockId>& idom, BlockId a, BlockId b) {
+    for (BlockId at = b; at != NONE; at = idom[at])
+        if (at == a) return true;
+    return false;
+}
+
+std::vector<Loop> findLoops(const Function& fn, const std::vector<BlockId>& idom) {
+    std::vector<Loop> loops;
+    for (BlockId h : fn.reversePostorder()) {
+        Loop loop;
+        loop.header = h;
+        for (BlockId p : fn.blocks[h].preds)
+            if (dominates(idom, h, p)) loop.latches.push_back(p);
+        if (loop.latches.empty()) continue;
+
+        loop.contains.assign(fn.blocks.size(), false);
+        loop.contains[h] = true;
+        std::vector<BlockId> work = loop.latches;
+        while (!work.empty()) {
+            BlockId b = work.back();
+            work.pop_back();
+            if (loop.contains[b]) continue;
+            loop.contains[b] = true;
+            for (BlockId p : fn.blocks[b].preds) work.push_back(p);
+        }
+        BlockId outside = NONE;
+        int outsideCount = 0;
+        for (BlockId p : fn.blocks[h].preds)
+            if (!loop.contains[p]) {
+                outside = p;
+                outsideCount++;
+            }
+        if (outsideCount == 1 && fn.blocks[outside].succs.size() == 1) loop.preheader = outside;
+        loops.push_back(std::move(loop));
+    }
+    auto size = [](const Loop& l) { return std::count(l.contains.begin(), l.contains.end(), true); };
+    std::stable_sort(loops.begin(), loops.end(), [&](const Loop& a, const Loop& b) { return size(a) < size(b); });
+    return loops;
+}
+
+std::string constantKey(const Value& v) {
+    std::string key(1, char(v.type));
+    if (v.type == Value::Type::Str) key += starText(v);
+    else if (v.type == Value::Type::Bool) key += char(v.b);
+    else if (v.type != Value::Type::Nil) key.append(reinterpret_cast<const char*>(&v.i), sizeof v.i);
+    return key;
+}
+
+// ---------- types ----------
+Type join(Type a, Type b) {
+    if (a == Type::Unset) return b;
+    if (b == Type::Unset || a == b) return a;
+    return Type::Any;
+}
+
+bool isNumeric(Type t) { return t == Type::Int || t == Type::Float; }
+
+namespace {
+
+bool maybeNumeric(Type t) { return isNumeric(t) || t == Type::Any; }
+bool maybeStar(Type t) { return t == Type::Str || t == Type::Any; }
+
+Type constantType(const Value& v) {
+    switch (v.type) {
+        case Value::Type::Nil: return Type::Nil;
+        case Value::Type::Int: return Type::Int;
+        case Value::Type::Float: return Type::Float;
+        case Value::Type::Bool: return Type::Bool;
+        case Value::Type::Str: return Type::Str;
+    }
+    return Type::Any;
+}
+
+} // namespace
+
+Type resultType(const Function& fn, const Inst& inst) {
+    auto arg = [&](size_t i) { return fn[inst.args[i]].type; };
+    switch (inst.op) {
+        case Opcode::Const: return constantType(inst.constant);
+        case Opcode::Phi: {
+            Type t = Type::Unset;
+            for (ValueId a : inst.args) t = join(t, fn[a].type);
+            return t;
+        }
+        case Opcode::ToInt: return isNumeric(arg(0)) ? Type::Int : arg(0);
+        case Opcode::ToFloat: return isNumeric(arg(0)) ? Type::Float : arg(0);
+        case Opcode::Neg: return maybeNumeric(arg(0)) ? arg(0) : Type::Unset;
+        case Opcode::Not:
+        case Opcode::ToBool: return arg(0) == Type::Unset ? Type::Unset : Type::Bool;
+        case Opcode::Param: return inst.index < fn.paramTypes.size() ? fn.paramTypes[inst.index] : Type::Any;
+        case Opcode::GetGlobal:
+            return fn.program && inst.index < fn.program->globalTypes.size() ? fn.program->globalTypes[inst.index]
+                                                                             : Type::Any;
+        case Opcode::Call: {
+            for (ValueId a : inst.args)
+                if (fn[a].type == Type::Unset) return Type::Unset;
+            return fn.program ? fn.program->functions[inst.index].returnType : Type::Any;
+        }
+        case Opcode::Print:
+        case Opcode::SetGlobal:
+        case Opcode::Jump:
+        case Opcode::Branch:
+        case Opcode::Return:
+        case Opcode::TailCall: return Type::Unset;
+        default: break;
+    }
+    Type l = arg(0), r = arg(1);
+    if (l == Type::Unset || r == Type::Unset) return Type::Unset;
+    if (isArithmetic(inst.op)) {
+        if (l == Type::Int && r == Type::Int) return Type::Int;
+        if (isNumeric(l) && isNumeric(r)) return Type::Float;
+        if (inst.op == Opcode::Add && maybeStar(l) && maybeStar(r))
+            return l == Type::Str && r == Type::Str ? Type::Str : Type::Any;
+        return maybeNumeric(l) && maybeNumeric(r) ? Type::Any : Type::Unset;
+    }
+    if (inst.op == Opcode::Eq || inst.op == Opcode::Ne) return Type::Bool;
+    if (isComparison(inst.op)) {
+        if (maybeNumeric(l) && maybeNumeric(r)) return Type::Bool;
+        bool strings = maybeStar(l) && maybeStar(r);
+        return strings ? Type::Bool : Type::Unset;
+    }
+    // bitwise
+    return (l == Type::Int || l == Type::Any) && (r == Type::Int || r == Type::Any) ? Type::Int : Type::Unset;
+}
+
+bool canFail(const Function& fn, const Inst& inst) {
+    auto arg = [&](size_t i) { return fn[inst.args[i]].type; };
+    switch (inst.op) {
+        case Opcode::Add:
+            if (arg(0) == Type::Str && arg(1) == Type::Str) return false; // concatenation
+            return !(isNumeric(arg(0)) && isNumeric(arg(1)));
+        case Opcode::Sub:
+        case Opcode::Mul: return !(isNumeric(arg(0)) && isNumeric(arg(1)));
+        case Opcode::Div:
+        case Opcode::Mod: {
+            if (!(isNumeric(arg(0)) && isNumeric(arg(1)))) return true;
+            if (arg(0) != Type::Int || arg(1) != Type::Int) return false; // float division
+            const Inst& divisor = fn[inst.args[1]];
+            return divisor.op != Opcode::Const || divisor.constant.i == 0;
+        }
+        case Opcode::Lt:
+        case Opcode::Le:
+        case Opcode::Gt:
+        case Opcode::Ge:
+            return !((isNumeric(arg(0)) && isNumeric(arg(1))) || (arg(0) == Type::Str && arg(1) == Type::Str));
+        case Opcode::BAnd:
+        case Opcode::BOr:
+        case Opcode::BXor: return !(arg(0) == Type::Int && arg(1) == Type::Int);
+        case Opcode::Neg: return !isNumeric(arg(0));
+        case Opcode::Call: return true; // anything the callee does, or a stack overflow
+        default: return false;
+    }
+}
+
+// ---------- listing ----------
+namespace {
+
+std::string constantText(const Value& v) {
+    if (v.type != Value::Type::Str) return valueToString(v);
+    return "\"" + std::string(starText(v)) + "\"";
+}
+
+std::string calleeName(const Function& fn, const Inst& inst) {
+    if (!fn.program) return "#" + std::to_string(inst.index);
+    return fn.program->functions[inst.index].name;
+}
+
+std::string globalName(const Function& fn, const Inst& inst) {
+    if (!fn.program) return "#" + std::to_string(inst.index);
+    return fn.program->globals[inst.index];
+}
+
+} // namespace
+
+void print(const Function& fn, const LineTable& lines, std::ostream& out) {
+    size_t live = 0;
+    for (const Inst& inst : fn.values)
+        if (!inst.dead && inst.block != NONE) live++;
+    std::vector<BlockId> order = fn.reversePostorder();
+    out << "== " << fn.name << " IR (" << live << " instructions, " << order.size() << " blocks) ==\n";
+    for (BlockId b : order) {
+        const Block& block = fn.blocks[b];
+        out << "block" << b << ":";
+        if (!block.preds.empty()) {
+            out << "  ; preds";
+            for (BlockId p : block.preds) out << " block" << p;
+        }
+        out << "\n";
+        for (ValueId v : block.insts) {
+            const Inst& inst = fn[v];
+            std::ostringstream line;
+            switch (inst.op) {
+                case Opcode::Jump: line << "jump block" << block.succs[0]; break;
+                case Opcode::Branch:
+                    line << "branch v" << inst.args[0] << " ? block" << block.succs[0] << " : block" << block.succs[1];
+                    break;
+                case Opcode::Return:
+                    line << "return";
+                    for (size_t i = 0; i < inst.args.size(); i++) {
+                        line << (i ? ", " : " ");
+                        if (i < fn.exported.size()) line << fn.exported[i] << "=";
+                        line << "v" << inst.args[i];
+                    }
+                    break;
+                case Opcode::TailCall:
+                    line << "tailcall " << calleeName(fn, inst);
+                    for (size_t i = 0; i < inst.args.size(); i++) line << (i ? ", v" : " v") << inst.args[i];
+                    break;
+                case Opcode::SetGlobal: line << "setglobal " << globalName(fn, inst) << ", v" << inst.args[0]; break;
+                case Opcode::Print:
+                    line << "print";
+                    for (size_t i = 0; i < inst.args.size(); i++) line << (i ? ", v" : " v") << inst.args[i];
+                    break;
+                default:
+                    line << "v" << v << ": " << typeName(inst.type) << " = " << opcodeName(inst.op);
+                    if (inst.op == Opcode::Const) line << " " << constantText(inst.constant);
+                    if (inst.op == Opcode::Param) line << " " << inst.index;
+                    if (inst.op == Opcode::GetGlobal) line << " " << globalName(fn, inst);
+                    if (inst.op == Opcode::Call) line << " " << calleeName(fn, inst);
+                    for (size_t i = 0; i < inst.args.size(); i++) {
+                        line << (i ? ", v" : " v") << inst.args[i];
+                        if (inst.op == Opcode::Phi) line << " (block" << block.preds[i] << ")";
+                    }
+            }
+            std::string text = line.str();
+            out << "    " << text;
+            bool failing = canFail(fn, inst) || inst.op == Opcode::Print || inst.op == Opcode::TailCall;
+            if (failing || !inst.name.empty()) {
+                out << std::string(text.size() < 44 ? 44 - text.size() : 1, ' ') << ";";
+                if (!inst.name.empty()) out << " " << inst.name;
+                if (failing) out << " line " << lines.line(inst.offset);
+            }
+            out << "\n";
+        }
+    }
+}
+
+void print(const Program& program, const LineTable& lines, std::ostream& out) {
+    for (const Function& fn : program.functions) print(fn, lines, out);
+}
+
+} // namespace ir
@@ -0,0 +1,195 @@
+#ifndef IR_H
+#define IR_H
+
+#include "../source/linetable.h"
+#include "../vm/star.h"
+#include "../vm/value.h"
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------- SSA IR ----------
+// A control-flow graph of basic blocks whose instructions define each value
+// exactly once (SSA). Values are numbered densely per Function; an
+// instruction is the value it defines. Phis sit at the top of their block,
+// with one argument per predecessor in `preds` order, and every block ends in
+// exactly one terminator (jump, branch, return or tail call). Passes never
+// renumber: removed instructions and blocks are only marked dead, and
+// compact() drops them from the block lists.
+// A Program is the script plus one Function per declared function. The
+// script's variables that functions use are not SSA values: they live in
+// global slots, read and written with getglobal / setglobal everywhere,
+// since any call may change them.
+namespace ir {
+
+using ValueId = uint32_t;
+using BlockId = uint32_t;
+constexpr uint32_t NONE = UINT32_MAX;
+
+// static type of a value. Unset: no value reaches it (unreachable code, or
+// an operation that can only fail); Any: the type varies at run time
+enum class Type : uint8_t { Unset, Int, Float, Bool, Str, Nil, Any };
+
+#define ASTERVOID_IR_OPS(OP) \
+    OP(Const,  "const")  /* constant                                  */ \
+    OP(Phi,    "phi")    /* one argument per predecessor              */ \
+    OP(ToInt,  "toint")  /* value stored into a mass variable         */ \
+    OP(ToFloat,"tofloat")/* value stored into a flux variable         */ \
+    OP(Add,    "add")    \
+    OP(Sub,    "sub")    \
+    OP(Mul,    "mul")    \
+    OP(Div,    "div")    \
+    OP(Mod,    "mod")    \
+    OP(Eq,     "eq")     \
+    OP(Ne,     "ne")     \
+    OP(Lt,     "lt")     \
+    OP(Le,     "le")     \
+    OP(Gt,     "gt")     \
+    OP(Ge,     "ge")     \
+    OP(BAnd,   "band")   \
+    OP(BOr,    "bor")    \
+    OP(BXor,   "bxor")   \
+    OP(Neg,    "neg")    \
+    OP(Not,    "not")    \
+    OP(ToBool, "tobool") \
+    OP(Print,  "print")  /* shine(args...); defines no value         */ \
+    OP(Param,  "param")  /* parameter `index` as the caller passed it */ \
+    OP(GetGlobal, "getglobal") /* global slot `index`                 */ \
+    OP(SetGlobal, "setglobal") /* slot `index` = args[0]; no value    */ \
+    OP(Call,   "call")   /* function `index` of the Program (args)    */ \
+    OP(Jump,   "jump")   /* terminators from here on                  */ \
+    OP(Branch, "branch") /* on the truth of args[0]: succs[0] if true */ \
+    OP(Return, "return") /* script: the exported top-level variables; \
+                            function: its result, args[0]             */ \
+    OP(TailCall, "tailcall") /* return function `index`(args)         */
+
+enum class Opcode : uint8_t {
+#define IR_OP_ENUM(name, text) name,
+    ASTERVOID_IR_OPS(IR_OP_ENUM)
+#undef IR_OP_ENUM
+};
+
+const char* opcodeName(Opcode op);
+const char* typeName(Type type);
+
+inline bool isTerminator(Opcode op) { return op >= Opcode::Jump; }
+inline bool isArithmetic(Opcode op) { return op >= Opcode::Add && op <= Opcode::Mod; }
+inline bool isComparison(Opcode op) { return op >= Opcode::Eq && op <= Opcode::Ge; }
+inline bool isBitwise(Opcode op) { return op >= Opcode::BAnd && op <= Opcode::BXor; }
+// changes what the program does beyond its value: kept in place, never
+// merged or removed (a call may print or assign globals)
+inline bool hasEffect(Opcode op) { return op == Opcode::Print || op == Opcode::SetGlobal || op == Opcode::Call; }
+// Add only on numbers (star + star concatenates): check the result type too
+inline bool isCommutative(Opcode op) {
+    return op == Opcode::Add || op == Opcode::Mul || op == Opcode::Eq || op == Opcode::Ne || isBitwise(op);
+}
+
+struct Inst {
+    Opcode op;
+    Type type = Type::Unset;
+    bool dead = false;
+    BlockId block = NONE;
+    uint32_t offset = 0;       // source offset, for runtime errors
+    uint32_t index = 0;        // Param: which one; GetGlobal, SetGlobal: the slot; Call, TailCall: the callee
+    std::vector<ValueId> args;
+    Value constant;            // Const only
+    std::string_view name;     // the variable a phi merges, or the parameter, for listings
+};
+
+struct Block {
+    std::vector<ValueId> insts; // phis first, the terminator last
+    std::vector<BlockId> preds;
+    std::vector<BlockId> succs; // Jump: 1, Branch: 2 (true, false), Return and TailCall: 0
+    bool dead = false;
+
+    ValueId terminator() const { return insts.empty() ? NONE : insts.back(); }
+};
+
+struct Program;
+
+// the script, or one declared function
+struct Function {
+    std::string name;
+    uint32_t numParams = 0;
+    std::vector<Inst> values;
+    std::vector<Block> blocks; // blocks[0] is the entry
+    std::vector<std::string> exported; // script: top-level variables, in Return argument order
+    StarHeap strings;                  // storage behind Str constants
+    // what reaches each parameter and what the function returns, over the
+    // whole program (inferTypes(Program&)); Any until then
+    std::vector<Type> paramTypes;
+    Type returnType = Type::Any;
+    const Program* program = nullptr; // for the callees' return types and global types
+
+    Inst& operator[](ValueId v) { return values[v]; }
+    const Inst& operator[](ValueId v) const { return values[v]; }
+
+    BlockId newBlock();
+    // a new instruction, not yet placed in any block
+    ValueId make(Opcode op, std::vector<ValueId> args, uint32_t offset = 0);
+    ValueId makeConst(const Value& v);
+    void append(BlockId block, ValueId inst);
+    void addEdge(BlockId from, BlockId to);
+    // drop the edge from -> to, with the phi arguments that came along it
+    void removeEdge(BlockId from, BlockId to);
+    // every use of `from` now reads `to`
+    void replaceUses(ValueId from, ValueId to);
+    // drop dead instructions from the block lists, and edges of dead blocks
+    void compact();
+    // blocks in reverse postorder from the entry; unreachable ones are left out
+    std::vector<BlockId> reversePostorder() const;
+};
+
+// functions[0] is the script, functions[i] proto i of the lowered module:
+// Call and TailCall name their callee by that index
+struct Program {
+    std::deque<Function> functions;   // added functions stay where they are
+    std::vector<std::string> globals; // by slot: the script variable's name
+    std::vector<Type> globalTypes;    // by slot: joined over every setglobal; Any until inferred
+
+    Function& add(std::string name);
+};
+
+// ---------- analyses ----------
+// immediate dominators (Cooper, Harvey & Kennedy); NONE for the entry and for
+// unreachable blocks
+std::vector<BlockId> dominators(const Function& fn);
+bool dominates(const std::vector<BlockId>& idom, BlockId a, BlockId b);
+
+// a natural loop: the header and every block that reaches a back-edge
+// source without passing through it
+struct Loop {
+    BlockId header;
+    BlockId preheader = NONE; // the single outside predecessor, if it jumps only to the header
+    std::vector<BlockId> latches;
+    std::vector<bool> contains; // by BlockId
+};
+// innermost first
+std::vector<Loop> findLoops(const Function& fn, const std::vector<BlockId>& idom);
+
+// identity of a constant for deduplication: type tag plus payload (string text for stars)
+std::string constantKey(const Value& v);
+
+Type join(Type a, Type b);
+bool isNumeric(Type t);
+// type of an instruction from the types of its arguments
+Type resultType(const Function& fn, const Inst& inst);
+// whether executing the instruction could raise a runtime error, given the
+// argument types. Printing counts as an effect, not as a failure
+bool canFail(const Function& fn, const Inst& inst);
+// neither fails nor has an effect, and reads no global (a call may change
+// it), so it may be removed, merged or moved
+inline bool isPure(const Function& fn, const Inst& inst) {
+    return !hasEffect(inst.op) && inst.op != Opcode::GetGlobal && !isTerminator(inst.op) && !canFail(fn, inst);
+}
+
+// ---------- listing ----------
+void print(const Function& fn, const LineTable& lines, std::ostream& out);
+void print(const Program& program, const LineTable& lines, std::ostream& out);
+
+} // namespace ir
+
+#endif
@@ -0,0 +1,533 @@
+#include "lower.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace ir {
+
+namespace {
+
+constexpr int MAX_REGISTERS = 250;
+
+// live range of a value in doubled positions: an instruction at position p
+// reads its operands at 2p and writes its result at 2p + 1, so a value whose
+// last read is at p can share a register with the one p defines
+using Range = std::pair<uint32_t, uint32_t>;
+using Ranges = std::vector<Range>; // sorted, disjoint
+
+bool overlap(const Ranges& a, const Ranges& b) {
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (a[i].second < b[j].first) i++;
+        else if (b[j].second < a[i].first) j++;
+        else return true;
+    }
+    return false;
+}
+
+Ranges merge(const Ranges& a, const Ranges& b) {
+    Ranges out(a.size() + b.size());
+    std::merge(a.begin(), a.end(), b.begin(), b.end(), out.begin());
+    return out;
+}
+
+Op bytecodeOp(Opcode op) {
+    switch (op) {
+        case Opcode::Add: return Op::ADD;
+        case Opcode::Sub: return Op::SUB;
+        case Opcode::Mul: return Op::MUL;
+        case Opcode::Div: return Op::DIV;
+        case Opcode::Mod: return Op::MOD;
+        case Opcode::Eq: return Op::EQ;
+        case Opcode::Ne: return Op::NE;
+        case Opcode::Lt: return Op::LT;
+        case Opcode::Le: return Op::LE;
+        case Opcode::Gt: return Op::GT;
+        case Opcode::Ge: return Op::GE;
+        case Opcode::BAnd: return Op::BAND;
+        case Opcode::BOr: return Op::BOR;
+        case Opcode::BXor: return Op::BXOR;
+        case Opcode::Neg: return Op::NEG;
+        case Opcode::Not: return Op::NOT;
+        case Opcode::ToBool: return Op::TOBOOL;
+        default: throw std::runtime_error("No bytecode for IR opcode");
+    }
+}
+
+bool hasConstantForm(Op op) { return op >= Op::ADD && op <= Op::GE; }
+
+Op constantForm(Op op) {
+    if (op >= Op::ADD && op <= Op::MOD) return Op(int(op) + (int(Op::ADDK) - int(Op::ADD)));
+    return Op(int(op) + (int(Op::EQK) - int(Op::EQ)));
+}
+
+// operator to use with the operands swapped, or COUNT when not symmetric
+// (ADD on a star constant is not: it concatenates)
+Op swappedForm(Op op) {
+    switch (op) {
+        case Op::ADD: case Op::MUL: case Op::EQ: case Op::NE: return op;
+        case Op::LT: return Op::GT;
+        case Op::LE: return Op::GE;
+        case Op::GT: return Op::LT;
+        case Op::GE: return Op::LE;
+        default: return Op::COUNT;
+    }
+}
+
+class Lowering {
+public:
+    Lowering(const Program& program, Function& fn, Module& module) : program(program), fn(fn), module(module) {}
+    void run();
+
+private:
+    // the copies that stand for the phis of a block's single successor
+    struct Copies {
+        std::vector<std::pair<ValueId, ValueId>> moves; // (phi, incoming value)
+        bool twoPhase = false; // some incoming value is itself one of the phis: go through scratch
+        uint32_t at = 0;       // position of the first copy
+    };
+
+    const Program& program;
+    Function& fn;
+    Module& module;
+    bool script = false;
+    Proto* proto = nullptr;
+    std::vector<BlockId> order;
+    std::vector<Copies> copies;         // by block
+    std::vector<uint32_t> blockStart;   // doubled positions, by block
+    std::vector<uint32_t> blockEnd;
+    std::vector<uint32_t> position;     // by value: position of its instruction
+    std::vector<int> reg;               // by value; -1 without a register
+    int homes = 0;                      // registers below the allocated ones
+    int globals = 0;                    // the script's register of global slot 0
+    int scratch = 0;                    // first scratch register
+    uint32_t offset = 0;
+
+    void splitEdges();
+    void number();
+    std::vector<Ranges> liveRanges();
+    void allocate(std::vector<Ranges> ranges);
+    void emitCode();
+
+    bool isConst(ValueId v) const { return fn[v].op == Opcode::Const; }
+    int emit(Instr instr);
+    int constant(const Value& v);
+    void load(unsigned dst, ValueId v);
+    unsigned operand(ValueId v, unsigned scratchReg);
+    void instruction(ValueId v);
+    void copy(const Copies& group);
+};
+
+// the script keeps its exported variables, then its global slots, in the
+// registers at the bottom of its frame, where functions reach the globals;
+// a function keeps its parameters in the registers the caller passed them in
+void Lowering::run() {
+    script = &fn == &program.functions[0];
+    module.protos.emplace_back();
+    proto = &module.protos.back();
+    proto->name = fn.name;
+    proto->numParams = int(fn.numParams);
+    globals = int(program.functions[0].exported.size());
+    homes = script ? globals + int(program.globals.size()) : int(fn.numParams);
+    splitEdges();
+    order = fn.reversePostorder();
+    number();
+    allocate(liveRanges());
+    emitCode();
+    if (script)
+        for (size_t i = 0; i < fn.exported.size(); i++) module.topLevel.push_back({fn.exported[i], uint8_t(i)});
+}
+
+// an edge out of a branch into a block with phis gets a block of its own
+// for the copies
+void Lowering::splitEdges() {
+    size_t count = fn.blocks.size();
+    for (BlockId p = 0; p < count; p++) {
+        if (fn.blocks[p].dead || fn.blocks[p].succs.size() < 2) continue;
+        for (size_t i = 0; i < fn.blocks[p].succs.size(); i++) {
+            BlockId s = fn.blocks[p].succs[i];
+            const std::vector<ValueId>& insts = fn.blocks[s].insts;
+            if (insts.empty() || fn[insts[0]].op != Opcode::Phi) continue;
+            BlockId mid = fn.newBlock();
+            fn.append(mid, fn.make(Opcode::Jump, {}));
+            fn.blocks[p].succs[i] = mid;
+            std::vector<BlockId>& preds = fn.blocks[s].preds;
+            *std::find(preds.begin(), preds.end(), p) = mid;
+            fn.blocks[mid].preds.push_back(p);
+            fn.blocks[mid].succs.push_back(s);
+        }
+    }
+}
+
+// positions in layout order: the instructions of a block, its copies, then
+// its terminator
+void Lowering::number() {
+    copies.assign(fn.blocks.size(), Copies());
+    blockStart.assign(fn.blocks.size(), 0);
+    blockEnd.assign(fn.blocks.size(), 0);
+    position.assign(fn.values.size(), NONE);
+    uint32_t at = 0;
+    for (BlockId b : order) {
+        const Block& block = fn.blocks[b];
+        blockStart[b] = 2 * at;
+        for (ValueId v : block.insts) {
+            const Inst& inst = fn[v];
+            if (inst.op == Opcode::Phi || inst.op == Opcode::Const || isTerminator(inst.op)) continue;
+            position[v] = at++;
+        }
+        if (block.succs.size() == 1) {
+            BlockId s = block.succs[0];
+            size_t edge = size_t(std::find(fn.blocks[s].preds.begin(), fn.blocks[s].preds.end(), b) -
+                                 fn.blocks[s].preds.begin());
+            Copies& group = copies[b];
+            for (ValueId phi : fn.blocks[s].insts) {
+                if (fn[phi].op != Opcode::Phi) break;
+                ValueId in = fn[phi].args[edge];
+                if (in == phi) continue;
+                if (fn[in].op == Opcode::Phi && fn[in].block == s) group.twoPhase = true;
+                group.moves.push_back({phi, in});
+            }
+            group.at = at;
+            at += group.twoPhase ? 2 : uint32_t(group.moves.size());
+        }
+        position[block.terminator()] = at++;
+        blockEnd[b] = 2 * at - 1;
+    }
+}
+
+// SSA liveness by walking up from each use to the definition, then one
+// range per block the value is live in
+std::vector<Ranges> Lowering::liveRanges() {
+    struct Site {
+        BlockId block;
+        uint32_t at;
+    };
+    std::vector<std::vector<Site>> uses(fn.values.size()), defs(fn.values.size());
+    for (BlockId b : order) {
+        for (ValueId v : fn.blocks[b].insts) {
+            const Inst& inst = fn[v];
+            if (inst.op == Opcode::Phi || inst.op == Opcode::Const) continue;
+            for (ValueId a : inst.args)
+                if (!isConst(a)) uses[a].push_back({b, 2 * position[v]});
+            if (!isTerminator(inst.op) && inst.op != Opcode::Print && inst.op != Opcode::SetGlobal &&
+                inst.op != Opcode::Param)
+                defs[v].push_back({b, 2 * position[v] + 1});
+        }
+        const Copies& group = copies[b];
+        for (size_t i = 0; i < group.moves.size(); i++) {
+            auto [phi, in] = group.moves[i];
+            uint32_t read = group.twoPhase ? group.at : group.at + uint32_t(i);
+            uint32_t write = group.twoPhase ? group.at + 1 : group.at + uint32_t(i);
+            if (!isConst(in)) uses[in].push_back({b, 2 * read});
+            defs[phi].push_back({b, 2 * write + 1});
+        }
+    }
+
+    std::vector<Ranges> ranges(fn.values.size());
+    std::vector<uint32_t> liveIn(fn.blocks.size(), NONE), seen(fn.blocks.size(), NONE);
+    auto defAt = [&](ValueId v, BlockId b) {
+        for (const Site& d : defs[v])
+            if (d.block == b) return d.at;
+        return NONE;
+    };
+    for (ValueId v = 0; v < fn.values.size(); v++) {
+        if (defs[v].empty()) continue;
+        std::vector<BlockId> work;
+        for (const Site& u : uses[v]) {
+            if (defAt(v, u.block) < u.at || liveIn[u.block] == v) continue;
+            liveIn[u.block] = v;
+            work.push_back(u.block);
+        }
+        std::vector<BlockId> live = work;
+        while (!work.empty()) {
+            BlockId b = work.back();
+            work.pop_back();
+            for (BlockId p : fn.blocks[b].preds) {
+                if (defAt(v, p) != NONE || liveIn[p] == v) continue;
+                liveIn[p] = v;
+                work.push_back(p);
+                live.push_back(p);
+            }
+        }
+
+        std::vector<BlockId> blocks = live;
+        for (const Site& s : defs[v]) blocks.push_back(s.block);
+        for (const Site& s : uses[v]) blocks.push_back(s.block);
+        Ranges& out = ranges[v];
+        for (BlockId b : blocks) {
+            if (seen[b] == v) continue;
+            seen[b] = v;
+            bool in = liveIn[b] == v;
+            bool liveOut = false;
+            for (BlockId s : fn.blocks[b].succs) liveOut |= liveIn[s] == v;
+            uint32_t def = defAt(v, b), lastUse = 0, lastUseBeforeDef = 0;
+            bool used = false, usedBeforeDef = false;
+            for (const Site& u : uses[v]) {
+                if (u.block != b) continue;
+                used = true;
+                lastUse = std::max(lastUse, u.at);
+                if (def != NONE && u.at < def) {
+                    usedBeforeDef = true;
+                    lastUseBeforeDef = std::max(lastUseBeforeDef, u.at);
+                }
+            }
+            uint32_t end = liveOut ? blockEnd[b] : used ? lastUse : def;
+            if (def == NONE) {
+                out.push_back({blockStart[b], end});
+            } else if (!in) {
+                out.push_back({def, std::max(end, def)});
+            } else {
+                // a phi read at the top of a block that also writes it (a loop latch)
+                if (usedBeforeDef) out.push_back({blockStart[b], lastUseBeforeDef});
+                out.push_back({def, liveOut ? blockEnd[b] : def});
+            }
+        }
+        std::sort(out.begin(), out.end());
+    }
+    return ranges;
+}
+
+// phis share a register with the incoming values they do not interfere
+// with; then first fit over the registers, in order of first definition
+void Lowering::allocate(std::vector<Ranges> ranges) {
+    std::vector<ValueId> leader(fn.values.size());
+    for (ValueId v = 0; v < leader.size(); v++) leader[v] = v;
+    auto find = [&](ValueId v) {
+        while (leader[v] != v) v = leader[v] = leader[leader[v]];
+        return v;
+    };
+    for (BlockId b : order)
+        for (auto [phi, in] : copies[b].moves) {
+            if (isConst(in) || fn[in].op == Opcode::Param) continue;
+            ValueId x = find(phi), y = find(in);
+            if (x == y || overlap(ranges[x], ranges[y])) continue;
+            ranges[x] = merge(ranges[x], ranges[y]);
+            ranges[y].clear();
+            leader[y] = x;
+        }
+
+    std::vector<ValueId> classes;
+    for (ValueId v = 0; v < fn.values.size(); v++)
+        if (find(v) == v && !ranges[v].empty()) classes.push_back(v);
+    std::sort(classes.begin(), classes.end(),
+              [&](ValueId a, ValueId b) { return ranges[a][0] < ranges[b][0]; });
+
+    std::vector<int> classReg(fn.values.size(), -1);
+    std::vector<std::map<uint32_t, uint32_t>> taken; // by register - homes: start -> end
+    auto fits = [&](const std::map<uint32_t, uint32_t>& used, const Ranges& want) {
+        for (const Range& r : want) {
+            auto after = used.upper_bound(r.second);
+            if (after != used.begin() && std::prev(after)->second >= r.first) return false;
+        }
+        return true;
+    };
+    for (ValueId c : classes) {
+        size_t r = 0;
+        while (r < taken.size() && !fits(taken[r], ranges[c])) r++;
+        if (r == taken.size()) taken.emplace_back();
+        for (const Range& range : ranges[c]) taken[r].emplace(range.first, range.second);
+        classReg[c] = homes + int(r);
+    }
+    reg.assign(fn.values.size(), -1);
+    for (ValueId v = 0; v < fn.values.size(); v++)
+        reg[v] = fn[v].op == Opcode::Param ? int(fn[v].index) : classReg[find(v)];
+    scratch = homes + int(taken.size());
+
+    // scratch: two constant operands, or the arguments of a print or a call
+    // (whose frame starts there), or a round of phi copies
+    size_t needed = 2;
+    for (BlockId b : order) {
+        for (ValueId v : fn.blocks[b].insts)
+            if (fn[v].op == Opcode::Print || fn[v].op == Opcode::Call || fn[v].op == Opcode::TailCall)
+                needed = std::max(needed, fn[v].args.size());
+        if (copies[b].twoPhase) needed = std::max(needed, copies[b].moves.size());
+    }
+    proto->numRegs = scratch + int(needed);
+    if (proto->numRegs > MAX_REGISTERS)
+        throw std::runtime_error("Too many registers needed (expression or scope too large)");
+}
+
+// ---------- emission ----------
+int Lowering::emit(Instr instr) {
+    proto->code.push_back(instr);
+    proto->offsets.push_back(offset);
+    return int(proto->code.size()) - 1;
+}
+
+int Lowering::constant(const Value& v) {
+    Value k = v.type == Value::Type::Str ? module.strings.intern(starText(v)) : v;
+    for (size_t i = 0; i < proto->constants.size(); i++) {
+        const Value& c = proto->constants[i];
+        if (c.type != k.type) continue;
+        if (k.type == Value::Type::Str ? starText(c) == starText(k) : c.i == k.i) return int(i);
+    }
+    proto->constants.push_back(k);
+    return int(proto->constants.size() - 1);
+}
+
+void Lowering::load(unsigned dst, ValueId v) {
+    if (!isConst(v)) {
+        if (unsigned(reg[v]) != dst) emit(encodeABC(Op::MOVE, dst, unsigned(reg[v]), 0));
+        return;
+    }
+    const Value& k = fn[v].constant;
+    if (k.isInt() && k.i >= INT16_MIN && k.i <= INT16_MAX) {
+        emit(encodeAsBx(Op::LOADI, dst, int(k.i)));
+    } else if (k.type == Value::Type::Bool) {
+        emit(encodeABC(Op::LOADBOOL, dst, k.b ? 1 : 0, 0));
+    } else if (k.type == Value::Type::Nil) {
+        emit(encodeABC(Op::LOADNIL, dst, 0, 0));
+    } else {
+        int index = constant(k);
+        if (index > UINT16_MAX) throw std::runtime_error("Too many constants in one function");
+        emit(encodeAsBx(Op::LOADK, dst, index));
+    }
+}
+
+// the register holding v, loading a constant into scratchReg first
+unsigned Lowering::operand(ValueId v, unsigned scratchReg) {
+    if (!isConst(v)) return unsigned(reg[v]);
+    load(scratchReg, v);
+    return scratchReg;
+}
+
+void Lowering::instruction(ValueId v) {
+    const Inst& inst = fn[v];
+    unsigned dst = unsigned(reg[v]);
+    unsigned s0 = unsigned(scratch), s1 = unsigned(scratch + 1);
+    switch (inst.op) {
+        case Opcode::ToInt:
+        case Opcode::ToFloat:
+            load(dst, inst.args[0]);
+            emit(encodeABC(inst.op == Opcode::ToInt ? Op::TOINT : Op::TOFLOAT, dst, 0, 0));
+            return;
+        case Opcode::Neg:
+        case Opcode::Not:
+        case Opcode::ToBool:
+            emit(encodeABC(bytecodeOp(inst.op), dst, operand(inst.args[0], s0), 0));
+            return;
+        case Opcode::Print: {
+            for (size_t i = 0; i < inst.args.size(); i++) load(unsigned(scratch) + unsigned(i), inst.args[i]);
+            emit(encodeABC(Op::PRINT, s0, unsigned(inst.args.size()), 0));
+            return;
+        }
+        case Opcode::Param: return; // already where the caller put it
+        case Opcode::Call: {
+            // the callee's frame starts at the first argument, above every
+            // register in use here, and its result comes back there
+            for (size_t i = 0; i < inst.args.size(); i++) load(unsigned(scratch) + unsigned(i), inst.args[i]);
+            emit(encodeAsBx(Op::CALL, s0, int(inst.index)));
+            if (dst != s0) emit(encodeABC(Op::MOVE, dst, s0, 0));
+            return;
+        }
+        case Opcode::GetGlobal: {
+            unsigned slot = unsigned(globals) + inst.index;
+            if (script) emit(encodeABC(Op::MOVE, dst, slot, 0));
+            else emit(encodeAsBx(Op::GETGLOBAL, dst, int(slot)));
+            return;
+        }
+        case Opcode::SetGlobal: {
+            unsigned slot = unsigned(globals) + inst.index;
+            if (script) load(slot, inst.args[0]);
+            else emit(encodeAsBx(Op::SETGLOBAL, operand(inst.args[0], s0), int(slot)));
+            return;
+        }
+        default: break;
+    }
+    Op op = bytecodeOp(inst.op);
+    ValueId left = inst.args[0], right = inst.args[1];
+    // like the bytecode compiler: only numbers swap, so errors keep the source order
+    if (isConst(left) && !isConst(right) && swappedForm(op) != Op::COUNT && isNumeric(fn[left].type) &&
+        isNumeric(fn[right].type)) {
+        std::swap(left, right);
+        op = swappedForm(op);
+    }
+    if (isConst(right) && hasConstantForm(op)) {
+        int k = constant(fn[right].constant);
+        if (k <= UINT8_MAX) {
+            emit(encodeABC(constantForm(op), dst, operand(left, s0), unsigned(k)));
+            return;
+        }
+    }
+    emit(encodeABC(op, dst, operand(left, s0), operand(right, s1)));
+}
+
+void Lowering::copy(const Copies& group) {
+    if (!group.twoPhase) {
+        for (auto [phi, in] : group.moves) load(unsigned(reg[phi]), in);
+        return;
+    }
+    for (size_t i = 0; i < group.moves.size(); i++)
+        if (!isConst(group.moves[i].second)) load(unsigned(scratch) + unsigned(i), group.moves[i].second);
+    for (size_t i = 0; i < group.moves.size(); i++) {
+        auto [phi, in] = group.moves[i];
+        if (isConst(in)) load(unsigned(reg[phi]), in);
+        else emit(encodeABC(Op::MOVE, unsigned(reg[phi]), unsigned(scratch) + unsigned(i), 0));
+    }
+}
+
+void Lowering::emitCode() {
+    std::vector<int> start(fn.blocks.size(), -1);
+    std::vector<std::pair<int, BlockId>> jumps;
+    auto jumpTo = [&](Op op, unsigned a, BlockId target) { jumps.push_back({emit(encodeAsBx(op, a, 0)), target}); };
+
+    for (size_t i = 0; i < order.size(); i++) {
+        BlockId b = order[i];
+        BlockId next = i + 1 < order.size() ? order[i + 1] : NONE;
+        start[b] = int(proto->code.size());
+        const Block& block = fn.blocks[b];
+        for (ValueId v : block.insts) {
+            const Inst& inst = fn[v];
+            if (inst.op == Opcode::Phi || inst.op == Opcode::Const) continue;
+            if (inst.offset) offset = inst.offset;
+            switch (inst.op) {
+                case Opcode::Jump:
+                    copy(copies[b]);
+                    if (block.succs[0] != next) jumpTo(Op::JMP, 0, block.succs[0]);
+                    break;
+                case Opcode::Branch: {
+                    unsigned cond = operand(inst.args[0], unsigned(scratch));
+                    BlockId ifTrue = block.succs[0], ifFalse = block.succs[1];
+                    if (ifTrue == next) {
+                        jumpTo(Op::JMPF, cond, ifFalse);
+                    } else if (ifFalse == next) {
+                        jumpTo(Op::JMPT, cond, ifTrue);
+                    } else {
+                        jumpTo(Op::JMPF, cond, ifFalse);
+                        jumpTo(Op::JMP, 0, ifTrue);
+                    }
+                    break;
+                }
+                case Opcode::Return:
+                    if (!script) {
+                        emit(encodeABC(Op::RETURN, operand(inst.args[0], unsigned(scratch)), 1, 0));
+                        break;
+                    }
+                    for (size_t e = 0; e < inst.args.size(); e++) load(unsigned(e), inst.args[e]);
+                    emit(encodeABC(Op::RETURN, 0, 0, 0));
+                    break;
+                case Opcode::TailCall:
+                    for (size_t e = 0; e < inst.args.size(); e++) load(unsigned(scratch) + unsigned(e), inst.args[e]);
+                    emit(encodeAsBx(Op::TAILCALL, unsigned(scratch), int(inst.index)));
+                    break;
+                default: instruction(v);
+            }
+        }
+    }
+    for (auto [at, target] : jumps) {
+        int distance = start[target] - (at + 1);
+        if (distance < INT16_MIN || distance > INT16_MAX)
+            throw std::runtime_error("Jump too far (function body too large)");
+        Instr& instr = proto->code[size_t(at)];
+        instr = encodeAsBx(opOf(instr), argA(instr), distance);
+    }
+}
+
+} // namespace
+
+void lower(Program& program, Module& module, const LineTable& lines) {
+    module.lines = &lines;
+    for (Function& fn : program.functions) Lowering(program, fn, module).run();
+}
+
+} // namespace ir
@@ -0,0 +1,31 @@
+#ifndef IR_LOWER_H
+#define IR_LOWER_H
+
+#include "../vm/bytecode.h"
+#include "ir.h"
+
+// ---------- SSA -> register bytecode ----------
+// Lays the blocks out in reverse postorder, splits the edges phis need
+// copies on, and turns each phi into copies at the end of its predecessors.
+// Registers come from the live ranges of the values (with the holes a loop
+// variable has between its last read and its next definition), and a phi
+// shares its register with any incoming value whose ranges do not overlap,
+// so `i = i + 1` in a loop stays a single in-place add. Constants never get a
+// register of their own: they become *K operands or are loaded into scratch
+// registers above the allocated ones. Exported variables end up in
+// registers 0..n-1 at every return, which the module lists as its top level.
+// Each function becomes the proto of the same index; the script's global
+// slots get fixed registers, which the functions reach with GETGLOBAL and
+// SETGLOBAL, and a call's arguments go to scratch registers, where the
+// callee's frame starts.
+namespace ir {
+
+// appends the program's functions to the module as its protos (the script
+// first); splits edges along the way. Throws std::runtime_error like the
+// Compiler when a function needs more registers or constants than the
+// bytecode can address
+void lower(Program& program, Module& module, const LineTable& lines);
+
+} // namespace ir
+
+#endif
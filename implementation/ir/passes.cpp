@@ -0,0 +1,504 @@
+#include "passes.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace ir {
+
+namespace {
+
+// values replaced during a pass; uses are rewritten once at the end
+struct Forwarding {
+    std::vector<ValueId> to;
+
+    explicit Forwarding(const Function& fn) : to(fn.values.size(), NONE) {}
+
+    ValueId resolve(ValueId v) const {
+        while (v < to.size() && to[v] != NONE) v = to[v];
+        return v;
+    }
+    void replace(Function& fn, ValueId from, ValueId with) {
+        if (from >= to.size()) to.resize(from + 1, NONE); // made after the pass started
+        to[from] = with;
+        fn[from].dead = true;
+    }
+    void apply(Function& fn) const {
+        for (Inst& inst : fn.values)
+            if (!inst.dead)
+                for (ValueId& a : inst.args) a = resolve(a);
+    }
+};
+
+// constants created by a pass join the existing ones at the top of the entry block
+class Constants {
+public:
+    explicit Constants(Function& fn) : fn(fn) {
+        for (ValueId v : fn.blocks[0].insts)
+            if (fn[v].op == Opcode::Const && !fn[v].dead) index.emplace(constantKey(fn[v].constant), v);
+    }
+    ValueId get(const Value& v) {
+        std::string key = constantKey(v);
+        auto found = index.find(key);
+        if (found != index.end()) return found->second;
+        Value k = v;
+        if (v.type == Value::Type::Str) k = fn.strings.intern(starText(v));
+        ValueId id = fn.makeConst(k);
+        fn[id].block = 0;
+        fn[id].type = resultType(fn, fn[id]);
+        added.push_back(id);
+        index.emplace(std::move(key), id);
+        return id;
+    }
+    ~Constants() {
+        std::vector<ValueId>& insts = fn.blocks[0].insts;
+        insts.insert(insts.begin(), added.begin(), added.end());
+    }
+
+private:
+    Function& fn;
+    std::unordered_map<std::string, ValueId> index;
+    std::vector<ValueId> added;
+};
+
+bool isConst(const Function& fn, ValueId v) { return fn[v].op == Opcode::Const; }
+
+bool isIntConst(const Function& fn, ValueId v, int64_t value) {
+    const Inst& inst = fn[v];
+    return inst.op == Opcode::Const && inst.constant.isInt() && inst.constant.i == value;
+}
+
+// the value of an instruction whose arguments are all constants and which
+// cannot fail (so evaluating it here cannot throw); a concatenation's star
+// is built in fn.strings
+Value fold(Function& fn, const Inst& inst) {
+    auto arg = [&](size_t i) -> const Value& { return fn[inst.args[i]].constant; };
+    switch (inst.op) {
+        case Opcode::ToInt: return coerceToDeclared(TokenType::MASS, arg(0));
+        case Opcode::ToFloat: return coerceToDeclared(TokenType::FLUX, arg(0));
+        case Opcode::Neg: return negate(arg(0));
+        case Opcode::Not: return Value::makeBool(!isTruthy(arg(0)));
+        case Opcode::ToBool: return Value::makeBool(isTruthy(arg(0)));
+        default: break;
+    }
+    if (isArithmetic(inst.op))
+        return arithmetic(ArithOp(int(inst.op) - int(Opcode::Add)), arg(0), arg(1), &fn.strings);
+    if (isComparison(inst.op)) return compare(CompareOp(int(inst.op) - int(Opcode::Eq)), arg(0), arg(1));
+    return bitwise(BitOp(int(inst.op) - int(Opcode::BAnd)), arg(0), arg(1));
+}
+
+bool foldable(Opcode op) {
+    return op == Opcode::ToInt || op == Opcode::ToFloat || (op >= Opcode::Add && op <= Opcode::ToBool);
+}
+
+// the value an instruction reduces to without computing anything, or NONE
+ValueId identity(const Function& fn, const Inst& inst, ValueId self) {
+    switch (inst.op) {
+        case Opcode::Phi: {
+            ValueId same = NONE;
+            for (ValueId a : inst.args) {
+                if (a == self || a == same) continue;
+                if (same != NONE) return NONE;
+                same = a;
+            }
+            return same;
+        }
+        // coercions only change flux to mass and back
+        case Opcode::ToInt: {
+            Type t = fn[inst.args[0]].type;
+            return t != Type::Float && t != Type::Any && t != Type::Unset ? inst.args[0] : NONE;
+        }
+        case Opcode::ToFloat: {
+            Type t = fn[inst.args[0]].type;
+            return t != Type::Int && t != Type::Any && t != Type::Unset ? inst.args[0] : NONE;
+        }
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul: {
+            // x + 0, x - 0, x * 1 and x * 0 on masses (for flux, -0.0 + 0 is
+            // not -0.0 and nan * 0 is not 0)
+            if (inst.type != Type::Int) return NONE;
+            if (inst.op == Opcode::Mul) {
+                if (isIntConst(fn, inst.args[0], 0)) return inst.args[0];
+                if (isIntConst(fn, inst.args[1], 0)) return inst.args[1];
+            }
+            int64_t unit = inst.op == Opcode::Mul ? 1 : 0;
+            if (isIntConst(fn, inst.args[1], unit)) return inst.args[0];
+            if (inst.op != Opcode::Sub && isIntConst(fn, inst.args[0], unit)) return inst.args[1];
+            return NONE;
+        }
+        default: return NONE;
+    }
+}
+
+// dominator tree children, for preorder walks
+std::vector<std::vector<BlockId>> dominatorTree(const Function& fn, const std::vector<BlockId>& idom) {
+    std::vector<std::vector<BlockId>> children(fn.blocks.size());
+    for (BlockId b : fn.reversePostorder())
+        if (idom[b] != NONE) children[idom[b]].push_back(b);
+    return children;
+}
+
+bool definedOutside(const Function& fn, const Loop& loop, ValueId v) {
+    BlockId b = fn[v].block;
+    return b == NONE || !loop.contains[b];
+}
+
+// place an instruction just before the terminator of a block
+void insertBeforeTerminator(Function& fn, BlockId block, ValueId v) {
+    std::vector<ValueId>& insts = fn.blocks[block].insts;
+    insts.insert(insts.end() - 1, v);
+    fn[v].block = block;
+}
+
+ValueId makeTyped(Function& fn, Opcode op, std::vector<ValueId> args) {
+    ValueId v = fn.make(op, std::move(args));
+    fn[v].type = resultType(fn, fn[v]);
+    return v;
+}
+
+} // namespace
+
+// ---------- unreachable blocks ----------
+void removeUnreachable(Function& fn) {
+    std::vector<bool> reached(fn.blocks.size(), false);
+    for (BlockId b : fn.reversePostorder()) reached[b] = true;
+    for (BlockId b = 0; b < fn.blocks.size(); b++)
+        if (!reached[b]) fn.blocks[b].dead = true;
+    fn.compact();
+}
+
+// ---------- types ----------
+void inferTypes(Function& fn) {
+    for (Inst& inst : fn.values) inst.type = Type::Unset;
+    std::vector<BlockId> order = fn.reversePostorder();
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (BlockId b : order)
+            for (ValueId v : fn.blocks[b].insts) {
+                Type t = resultType(fn, fn[v]);
+                if (t != fn[v].type) {
+                    fn[v].type = t;
+                    changed = true;
+                }
+            }
+    }
+}
+
+// what reaches each parameter, each function returns and each global holds,
+// joined over the whole program; starting from nothing, so a recursive
+// function's result type comes from its other returns. Whatever nothing
+// reaches (a function never called, one that never returns) is then Any,
+// for the code that does not run to be typed all the same
+void inferTypes(Program& program) {
+    for (Function& fn : program.functions) {
+        fn.paramTypes.assign(fn.numParams, Type::Unset);
+        fn.returnType = Type::Unset;
+    }
+    program.globalTypes.assign(program.globals.size(), Type::Unset);
+    auto widen = [](Type& to, Type t) {
+        Type joined = join(to, t);
+        if (joined == to) return false;
+        to = joined;
+        return true;
+    };
+    for (bool unreached = true; unreached;) {
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t f = 0; f < program.functions.size(); f++) {
+                Function& fn = program.functions[f];
+                inferTypes(fn);
+                for (const Block& block : fn.blocks)
+                    for (ValueId v : block.insts) {
+                        const Inst& inst = fn[v];
+                        if (inst.op == Opcode::Call || inst.op == Opcode::TailCall) {
+                            Function& callee = program.functions[inst.index];
+                            for (size_t i = 0; i < inst.args.size(); i++)
+                                changed |= widen(callee.paramTypes[i], fn[inst.args[i]].type);
+                            if (inst.op == Opcode::TailCall) changed |= widen(fn.returnType, callee.returnType);
+                        } else if (inst.op == Opcode::Return && f > 0) {
+                            changed |= widen(fn.returnType, fn[inst.args[0]].type);
+                        } else if (inst.op == Opcode::SetGlobal) {
+                            changed |= widen(program.globalTypes[inst.index], fn[inst.args[0]].type);
+                        }
+                    }
+            }
+        }
+        unreached = false;
+        auto settle = [&](Type& t) {
+            if (t != Type::Unset) return;
+            t = Type::Any;
+            unreached = true;
+        };
+        for (Function& fn : program.functions) {
+            for (Type& t : fn.paramTypes) settle(t);
+            settle(fn.returnType);
+        }
+        for (Type& t : program.globalTypes) settle(t);
+    }
+}
+
+// ---------- simplification ----------
+size_t simplify(Function& fn) {
+    size_t count = 0;
+    Forwarding forward(fn);
+    {
+        Constants constants(fn);
+        for (BlockId b : fn.reversePostorder()) {
+            for (ValueId v : fn.blocks[b].insts) {
+                Inst& inst = fn[v];
+                if (inst.dead) continue;
+                for (ValueId& a : inst.args) a = forward.resolve(a);
+
+                if (inst.op == Opcode::Branch && isConst(fn, inst.args[0])) {
+                    // the branch always goes one way
+                    bool taken = isTruthy(fn[inst.args[0]].constant);
+                    BlockId other = fn.blocks[b].succs[taken ? 1 : 0];
+                    fn.removeEdge(b, other);
+                    inst.op = Opcode::Jump;
+                    inst.args.clear();
+                    count++;
+                    continue;
+                }
+                ValueId same = identity(fn, inst, v);
+                if (same != NONE) {
+                    forward.replace(fn, v, same);
+                    count++;
+                    continue;
+                }
+                if (!foldable(inst.op) || canFail(fn, inst)) continue;
+                bool constant = std::all_of(inst.args.begin(), inst.args.end(),
+                                            [&](ValueId a) { return isConst(fn, a); });
+                if (constant) {
+                    forward.replace(fn, v, constants.get(fold(fn, inst)));
+                    count++;
+                }
+            }
+        }
+    }
+    forward.apply(fn);
+    removeUnreachable(fn);
+    return count;
+}
+
+// ---------- common subexpressions ----------
+size_t eliminateCommonSubexpressions(Function& fn) {
+    std::vector<BlockId> idom = dominators(fn);
+    std::vector<std::vector<BlockId>> children = dominatorTree(fn, idom);
+    Forwarding forward(fn);
+    std::unordered_map<std::string, ValueId> available;
+    std::vector<std::string> scope; // keys added, popped when the walk leaves a subtree
+    size_t count = 0;
+
+    auto key = [&](ValueId v) {
+        const Inst& inst = fn[v];
+        std::vector<ValueId> args = inst.args;
+        if (isCommutative(inst.op) && (inst.op != Opcode::Add || isNumeric(inst.type)))
+            std::sort(args.begin(), args.end());
+        std::string k(1, char(inst.op));
+        k.append(reinterpret_cast<const char*>(&inst.index), sizeof inst.index);
+        if (inst.op == Opcode::Phi) k.append(reinterpret_cast<const char*>(&inst.block), sizeof inst.block);
+        k.append(reinterpret_cast<const char*>(args.data()), args.size() * sizeof(ValueId));
+        return k;
+    };
+
+    // (block, scope size on entry); NONE marks the exit of a subtree
+    std::vector<std::pair<BlockId, size_t>> stack{{0, 0}};
+    while (!stack.empty()) {
+        auto [b, mark] = stack.back();
+        stack.pop_back();
+        if (b == NONE) {
+            while (scope.size() > mark) {
+                available.erase(scope.back());
+                scope.pop_back();
+            }
+            continue;
+        }
+        stack.push_back({NONE, scope.size()});
+        for (ValueId v : fn.blocks[b].insts) {
+            Inst& inst = fn[v];
+            for (ValueId& a : inst.args) a = forward.resolve(a);
+            // an earlier copy that may fail dominates this one: if it failed
+            // we never get here, and if it did not, neither will this one
+            if (inst.op == Opcode::Const || hasEffect(inst.op) || inst.op == Opcode::GetGlobal || isTerminator(inst.op))
+                continue;
+            std::string k = key(v);
+            auto found = available.find(k);
+            if (found != available.end()) {
+                forward.replace(fn, v, found->second);
+                count++;
+            } else {
+                available.emplace(k, v);
+                scope.push_back(std::move(k));
+            }
+        }
+        for (auto c = children[b].rbegin(); c != children[b].rend(); ++c) stack.push_back({*c, 0});
+    }
+    forward.apply(fn);
+    fn.compact();
+    return count;
+}
+
+// ---------- loop-invariant code motion ----------
+size_t hoistLoopInvariants(Function& fn) {
+    std::vector<BlockId> idom = dominators(fn);
+    std::vector<BlockId> order = fn.reversePostorder();
+    size_t count = 0;
+    // innermost first, so an invariant can climb out of several loops
+    for (const Loop& loop : findLoops(fn, idom)) {
+        if (loop.preheader == NONE) continue;
+        for (BlockId b : order) {
+            if (!loop.contains[b]) continue;
+            std::vector<ValueId>& insts = fn.blocks[b].insts;
+            std::vector<ValueId> kept;
+            for (ValueId v : insts) {
+                const Inst& inst = fn[v];
+                bool invariant = inst.op != Opcode::Phi && isPure(fn, inst) &&
+                                 std::all_of(inst.args.begin(), inst.args.end(),
+                                             [&](ValueId a) { return definedOutside(fn, loop, a); });
+                if (!invariant) {
+                    kept.push_back(v);
+                    continue;
+                }
+                insertBeforeTerminator(fn, loop.preheader, v);
+                count++;
+            }
+            insts = std::move(kept);
+        }
+    }
+    return count;
+}
+
+// ---------- strength reduction ----------
+size_t reduceStrength(Function& fn) {
+    std::vector<BlockId> idom = dominators(fn);
+    std::vector<BlockId> order = fn.reversePostorder();
+    Forwarding forward(fn);
+    // the start and stride products put into an inner loop's preheader are
+    // part of the outer loop too; only the values that were there before are candidates
+    size_t existing = fn.values.size();
+    size_t count = 0;
+    for (const Loop& loop : findLoops(fn, idom)) {
+        const Block& header = fn.blocks[loop.header];
+        if (loop.preheader == NONE || loop.latches.size() != 1 || header.preds.size() != 2) continue;
+        BlockId latch = loop.latches[0];
+        size_t entryIndex = header.preds[0] == loop.preheader ? 0 : 1;
+        auto invariantInt = [&](ValueId v) { return definedOutside(fn, loop, v) && fn[v].type == Type::Int; };
+
+        for (size_t h = 0; h < fn.blocks[loop.header].insts.size(); h++) {
+            ValueId phi = fn.blocks[loop.header].insts[h];
+            if (fn[phi].op != Opcode::Phi) break;
+            if (phi >= existing || fn[phi].dead || fn[phi].type != Type::Int) continue;
+            // basic induction variable: i = phi(init, i +/- step)
+            ValueId init = fn[phi].args[entryIndex];
+            const Inst& next = fn[fn[phi].args[1 - entryIndex]];
+            if (next.op != Opcode::Add && next.op != Opcode::Sub) continue;
+            ValueId step;
+            if (next.args[0] == phi) step = next.args[1];
+            else if (next.op == Opcode::Add && next.args[1] == phi) step = next.args[0];
+            else continue;
+            if (!invariantInt(step)) continue;
+            Opcode stepOp = next.op;
+
+            // collected first: the rewrite below inserts into the loop's blocks
+            std::vector<std::pair<ValueId, ValueId>> multiplies; // (mul, invariant factor)
+            for (BlockId b : order) {
+                if (!loop.contains[b]) continue;
+                for (ValueId m : fn.blocks[b].insts) {
+                    if (m >= existing) continue;
+                    const Inst& mul = fn[m];
+                    if (mul.dead || mul.op != Opcode::Mul || mul.type != Type::Int) continue;
+                    ValueId factor;
+                    if (mul.args[0] == phi && mul.args[1] != phi) factor = mul.args[1];
+                    else if (mul.args[1] == phi && mul.args[0] != phi) factor = mul.args[0];
+                    else continue;
+                    if (invariantInt(factor)) multiplies.push_back({m, factor});
+                }
+            }
+            for (auto [m, factor] : multiplies) {
+                // j = phi(init * k, j +/- step * k) tracks i * k
+                ValueId start = makeTyped(fn, Opcode::Mul, {init, factor});
+                ValueId stride = makeTyped(fn, Opcode::Mul, {step, factor});
+                insertBeforeTerminator(fn, loop.preheader, start);
+                insertBeforeTerminator(fn, loop.preheader, stride);
+                ValueId derived = fn.make(Opcode::Phi, {});
+                ValueId advance = fn.make(stepOp, {derived, stride});
+                fn[derived].args = entryIndex == 0 ? std::vector<ValueId>{start, advance}
+                                                   : std::vector<ValueId>{advance, start};
+                fn[derived].type = Type::Int;
+                fn[advance].type = Type::Int;
+                std::vector<ValueId>& headerInsts = fn.blocks[loop.header].insts;
+                headerInsts.insert(headerInsts.begin(), derived);
+                fn[derived].block = loop.header;
+                h++;
+                insertBeforeTerminator(fn, latch, advance);
+                forward.replace(fn, m, derived);
+                count++;
+            }
+        }
+    }
+    forward.apply(fn);
+    fn.compact();
+    return count;
+}
+
+// ---------- dead code ----------
+size_t eliminateDeadCode(Function& fn) {
+    std::vector<bool> live(fn.values.size(), false);
+    std::vector<ValueId> work;
+    for (const Block& block : fn.blocks)
+        for (ValueId v : block.insts) {
+            const Inst& inst = fn[v];
+            if (hasEffect(inst.op) || isTerminator(inst.op) || canFail(fn, inst)) {
+                live[v] = true;
+                work.push_back(v);
+            }
+        }
+    while (!work.empty()) {
+        ValueId v = work.back();
+        work.pop_back();
+        for (ValueId a : fn[v].args)
+            if (!live[a]) {
+                live[a] = true;
+                work.push_back(a);
+            }
+    }
+    size_t count = 0;
+    for (const Block& block : fn.blocks)
+        for (ValueId v : block.insts)
+            if (!live[v]) {
+                fn[v].dead = true;
+                if (fn[v].op != Opcode::Const) count++;
+            }
+    fn.compact();
+    return count;
+}
+
+// ---------- pipeline ----------
+void optimize(Function& fn, PassStats& stats) {
+    removeUnreachable(fn);
+    auto settle = [&] {
+        for (int round = 0; round < 8; round++) {
+            inferTypes(fn);
+            size_t n = simplify(fn);
+            stats.folded += n;
+            if (!n) break;
+        }
+        inferTypes(fn);
+    };
+    settle();
+    stats.merged += eliminateCommonSubexpressions(fn);
+    stats.hoisted += hoistLoopInvariants(fn);
+    stats.strengthReduced += reduceStrength(fn);
+    settle(); // folds the constant strides strength reduction left in preheaders
+    stats.merged += eliminateCommonSubexpressions(fn);
+    stats.removed += eliminateDeadCode(fn);
+}
+
+void optimize(Program& program, PassStats& stats) {
+    for (Function& fn : program.functions) removeUnreachable(fn);
+    inferTypes(program);
+    for (Function& fn : program.functions) optimize(fn, stats);
+    // what the passes folded away may narrow the types across calls
+    inferTypes(program);
+}
+
+} // namespace ir
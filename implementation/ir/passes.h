@@ -0,0 +1,48 @@
+#ifndef IR_PASSES_H
+#define IR_PASSES_H
+
+#include "ir.h"
+#include <cstddef>
+
+// ---------- IR optimization passes ----------
+// Each pass keeps the function in SSA form with types up to date, and only
+// touches instructions the types prove cannot fail (isPure): anything that
+// may raise a runtime error or prints stays where it is, so the optimized
+// program fails at the same point with the same message. Every pass returns
+// how many instructions it changed.
+namespace ir {
+
+struct PassStats {
+    size_t folded = 0;          // constants folded, coercions and trivial phis removed, branches decided
+    size_t merged = 0;          // common subexpressions replaced by an earlier, dominating copy
+    size_t hoisted = 0;         // loop-invariant instructions moved to a loop preheader
+    size_t strengthReduced = 0; // induction-variable multiplies turned into additions
+    size_t removed = 0;         // dead instructions deleted
+};
+
+// the whole pipeline, to a fixed point where it matters
+void optimize(Function& fn, PassStats& stats);
+// every function of a program, with the types across calls inferred first
+void optimize(Program& program, PassStats& stats);
+
+// blocks the entry cannot reach go away, with their edges and phi arguments
+void removeUnreachable(Function& fn);
+// forward type inference to a fixed point (phis make it iterative)
+void inferTypes(Function& fn);
+// the same over a whole program, with the parameter, return and global types
+// that calls and global slots carry between its functions
+void inferTypes(Program& program);
+size_t simplify(Function& fn);
+// global value numbering over the dominator tree
+size_t eliminateCommonSubexpressions(Function& fn);
+size_t hoistLoopInvariants(Function& fn);
+// in a loop with one latch, i * k for a basic induction variable i (i = i +/- c
+// each iteration) and an invariant mass k becomes a second induction variable
+// stepped by c * k
+size_t reduceStrength(Function& fn);
+// mark and sweep from the instructions that print, branch, return or may fail
+size_t eliminateDeadCode(Function& fn);
+
+} // namespace ir
+
+#endif
@@ -0,0 +1,541 @@
+#include "jit.h"
+#include "x64.h"
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define ASTERVOID_JIT 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace jit {
+
+#ifdef ASTERVOID_JIT
+
+namespace {
+
+using namespace x64;
+
+static_assert(sizeof(Value) == 16, "the JIT indexes registers and constants in 16-byte steps");
+
+constexpr Reg BASE = RDI;    // register window (first argument)
+constexpr Reg KONST = RSI;   // constant table (second argument)
+constexpr Reg TARGET = RDX;  // entry address (third argument)
+constexpr Reg CONTEXT = RBX; // the Context (fourth argument); callee-saved, so hooks keep it
+constexpr int32_t TYPE = int32_t(offsetof(Value, type));
+constexpr int32_t PAYLOAD = int32_t(offsetof(Value, i));
+
+// what a native RETURN hands the native CALL it returns to, instead of a pc
+constexpr uint32_t RETURNED = UINT32_MAX;
+
+Mem context(size_t field) { return {CONTEXT, int32_t(field)}; }
+
+constexpr uint8_t tag(Value::Type t) { return uint8_t(t); }
+
+// a B or C operand: a register, or a constant for the *K forms
+struct Operand {
+    Reg table;
+    unsigned index;
+    Mem type() const { return {table, int32_t(index * sizeof(Value)) + TYPE}; }
+    Mem payload() const { return {table, int32_t(index * sizeof(Value)) + PAYLOAD}; }
+};
+
+Operand reg(unsigned r) { return {BASE, r}; }
+
+class Translator {
+public:
+    explicit Translator(const Proto& proto) : proto(proto), at(proto.code.size()), exits(proto.code.size()) {}
+
+    // returns the machine code; entries[pc] is where instruction pc starts,
+    // callOffset where a native CALL enters
+    const std::vector<uint8_t>& translate(std::vector<uint32_t>& entries, uint32_t& callOffset) {
+        for (Label& label : at) label = a.newLabel();
+        leave = a.newLabel();
+        // the entry trampoline: the caller passes the address to start at.
+        // rbx is saved under it, which leaves the stack 16-byte aligned at
+        // every instruction boundary, as the hooks need it
+        a.push(CONTEXT);
+        a.mov(CONTEXT, RCX);
+        a.jmp(TARGET);
+        // a native CALL comes in here, with the context in rbx already
+        callOffset = uint32_t(a.size());
+        a.push(CONTEXT);
+        a.jmp(at[0]);
+        entries.resize(proto.code.size());
+        for (size_t pc = 0; pc < proto.code.size(); pc++) {
+            a.bind(at[pc]);
+            entries[pc] = uint32_t(a.size());
+            instruction(uint32_t(pc), proto.code[pc]);
+        }
+        // side exits, out of line: hand the pc back to the interpreter, and
+        // the frame it is in
+        for (size_t pc = 0; pc < exits.size(); pc++) {
+            if (!exits[pc].valid()) continue;
+            a.bind(exits[pc]);
+            a.movImm(RAX, uint32_t(pc));
+            a.jmp(leave);
+        }
+        a.bind(leave);
+        a.mov(context(offsetof(Context, exitBase)), BASE);
+        a.movImm64(RCX, address(&proto));
+        a.mov(context(offsetof(Context, exitProto)), RCX);
+        a.pop(CONTEXT);
+        a.ret();
+        // a callee's side exit leaves every native frame under it as well,
+        // with its pc in eax
+        if (unwind.valid()) {
+            a.bind(unwind);
+            a.pop(CONTEXT);
+            a.ret();
+        }
+        return a.finish();
+    }
+
+private:
+    const Proto& proto;
+    Assembler a;
+    std::vector<Label> at;    // start of each instruction
+    std::vector<Label> exits; // side exit per pc, created on first use
+    Label leave;              // the common tail of the side exits
+    Label unwind;             // created on first use
+
+    Label exitAt(uint32_t pc) {
+        if (!exits[pc].valid()) exits[pc] = a.newLabel();
+        return exits[pc];
+    }
+
+    static uint64_t address(const void* p) { return uint64_t(reinterpret_cast<uintptr_t>(p)); }
+
+    Operand rhs(Instr i, bool constant) const { return constant ? Operand{KONST, argC(i)} : reg(argC(i)); }
+
+    // the type of a constant operand is known now; a register's only at run time
+    static bool known(const Operand& o, const Proto& p, Value::Type& type) {
+        if (o.table != KONST) return false;
+        type = p.constants[o.index].type;
+        return true;
+    }
+
+    void store(Operand dst, Reg value, Value::Type type) {
+        a.mov(dst.payload(), value);
+        a.movByte(dst.type(), tag(type));
+    }
+
+    void storeFlag(Operand dst) { // al -> a truth value
+        a.movzxByte(RAX, RAX);
+        store(dst, RAX, Value::Type::Bool);
+    }
+
+    // the call or tailCall hook for the instruction at pc, leaving the
+    // callee's window and constants in place of ours; exits when it declines,
+    // so our own are kept across it (two pushes keep the stack aligned)
+    void hook(uint32_t pc, size_t field) {
+        a.push(BASE);
+        a.push(KONST);
+        a.mov(RCX, BASE);
+        a.mov(RDI, CONTEXT);
+        a.movImm64(RSI, address(&proto));
+        a.movImm(RDX, pc);
+        a.call(context(field));
+        a.pop(KONST);
+        a.pop(BASE);
+        a.test(RAX, RAX);
+        a.jcc(E, exitAt(pc));
+        a.mov(BASE, context(offsetof(Context, calleeBase)));
+        a.mov(KONST, context(offsetof(Context, calleeK)));
+    }
+
+    // a call into compiled code, on the machine stack. The caller's frame
+    // is pushed here when the callee is compiled and everything fits, else
+    // by the call hook; back here the callee's result is in place and the
+    // frame is popped, unless the callee left for the interpreter
+    void call(uint32_t pc, Instr i) {
+        Label slow = a.newLabel(), enter = a.newLabel();
+        int32_t callee = int32_t(argBx(i) * sizeof(NativeProto));
+        int32_t window = int32_t(argA(i) * sizeof(Value));
+        a.mov(RAX, context(offsetof(Context, natives)));
+        a.mov(RCX, Mem{RAX, callee + int32_t(offsetof(NativeProto, entry))});
+        a.test(RCX, RCX);
+        a.jcc(E, slow);
+        a.mov(RDX, context(offsetof(Context, depth)));
+        a.alu(Alu::Cmp, RDX, context(offsetof(Context, maxDepth)));
+        a.jcc(AE, slow);
+        a.mov(RDX, BASE);
+        a.alu(Alu::Add, RDX, Mem{RAX, callee + int32_t(offsetof(NativeProto, frameBytes))});
+        a.addImm(RDX, window);
+        a.alu(Alu::Cmp, RDX, context(offsetof(Context, regsEnd)));
+        a.jcc(A, slow);
+        a.mov(RDX, context(offsetof(Context, frameTop)));
+        a.alu(Alu::Cmp, RDX, context(offsetof(Context, frameEnd)));
+        a.jcc(AE, slow);
+        a.mov(KONST, Mem{RAX, callee + int32_t(offsetof(NativeProto, K))});
+        a.movImm64(RAX, address(&proto));
+        a.mov(Mem{RDX, int32_t(offsetof(CallFrame, proto))}, RAX);
+        a.movImm64(RAX, address(proto.code.data() + pc + 1));
+        a.mov(Mem{RDX, int32_t(offsetof(CallFrame, ip))}, RAX);
+        a.mov(RAX, BASE);
+        a.alu(Alu::Sub, RAX, context(offsetof(Context, globals)));
+        a.shr(RAX, 4);
+        a.mov(Mem{RDX, int32_t(offsetof(CallFrame, base))}, RAX);
+        a.addImm(context(offsetof(Context, frameTop)), int8_t(sizeof(CallFrame)));
+        a.addImm(context(offsetof(Context, depth)), 1);
+        a.addImm(context(offsetof(Context, calls)), 1);
+        a.addImm(BASE, window);
+        a.jmp(enter);
+        a.bind(slow);
+        hook(pc, offsetof(Context, call));
+        a.mov(RCX, context(offsetof(Context, calleeEntry)));
+        a.bind(enter);
+        a.call(RCX);
+        if (!unwind.valid()) unwind = a.newLabel();
+        a.cmpImm32(RAX, RETURNED);
+        a.jcc(NE, unwind);
+        a.addImm(context(offsetof(Context, frameTop)), int8_t(-int(sizeof(CallFrame))));
+        a.addImm(context(offsetof(Context, depth)), -1);
+        a.mov(RDX, context(offsetof(Context, frameTop)));
+        a.mov(RAX, Mem{RDX, int32_t(offsetof(CallFrame, base))});
+        a.shl(RAX, 4);
+        a.alu(Alu::Add, RAX, context(offsetof(Context, globals)));
+        a.mov(BASE, RAX);
+        a.movImm64(KONST, address(proto.constants.data()));
+    }
+
+    // the callee takes over this frame and this native call
+    void tailCall(uint32_t pc) {
+        hook(pc, offsetof(Context, tailCall));
+        a.mov(RAX, context(offsetof(Context, calleeEntry)));
+        a.jmp(RAX);
+    }
+
+    // only to a native CALL: the frame the interpreter entered returns through it
+    void ret(uint32_t pc, Instr i) {
+        a.cmpImm(context(offsetof(Context, depth)), 0);
+        a.jcc(E, exitAt(pc));
+        Mem result{BASE, 0};
+        if (argB(i)) {
+            a.movdqu(XMM0, Mem{BASE, int32_t(argA(i) * sizeof(Value))});
+            a.movdqu(result, XMM0);
+        } else {
+            a.movQword(Mem{BASE, PAYLOAD}, 0);
+            a.movByte(Mem{BASE, TYPE}, tag(Value::Type::Nil));
+        }
+        a.pop(CONTEXT);
+        a.movImm(RAX, RETURNED);
+        a.ret();
+    }
+
+    // jump to `otherwise` unless both operands have type t
+    void guardBoth(Operand b, Operand c, Value::Type t, Label otherwise) {
+        a.cmpByte(b.type(), tag(t));
+        a.jcc(NE, otherwise);
+        Value::Type ct;
+        if (known(c, proto, ct)) {
+            if (ct != t) a.jmp(otherwise);
+            return;
+        }
+        a.cmpByte(c.type(), tag(t));
+        a.jcc(NE, otherwise);
+    }
+
+    // mass op mass, then flux op flux; any other mix leaves. Either path may
+    // be absent (exits instead), e.g. flux % flux goes through fmod in value.cpp
+    template <typename IntPath, typename FloatPath>
+    void numeric(uint32_t pc, Operand b, Operand c, bool hasInt, bool hasFloat, IntPath intPath, FloatPath floatPath) {
+        Label exit = exitAt(pc);
+        Value::Type ct;
+        if (known(c, proto, ct)) {
+            // a constant fixes the only path that can apply
+            hasInt = hasInt && ct == Value::Type::Int;
+            hasFloat = hasFloat && ct == Value::Type::Float;
+        }
+        if (!hasInt && !hasFloat) {
+            a.jmp(exit);
+            return;
+        }
+        Label done = a.newLabel();
+        if (hasInt) {
+            Label notInt = hasFloat ? a.newLabel() : exit;
+            guardBoth(b, c, Value::Type::Int, notInt);
+            intPath();
+            if (hasFloat) {
+                a.jmp(done);
+                a.bind(notInt);
+            }
+        }
+        if (hasFloat) {
+            guardBoth(b, c, Value::Type::Float, exit);
+            floatPath();
+        }
+        a.bind(done);
+    }
+
+    void arithmetic(uint32_t pc, Instr i, ArithOp op, bool constant) {
+        Operand d = reg(argA(i)), b = reg(argB(i)), c = rhs(i, constant);
+        Label exit = exitAt(pc);
+        auto intPath = [&] {
+            if (op == ArithOp::Div || op == ArithOp::Mod) {
+                // zero raises and -1 may overflow: both are the interpreter's business
+                a.cmpImm(c.payload(), 0);
+                a.jcc(E, exit);
+                a.cmpImm(c.payload(), -1);
+                a.jcc(E, exit);
+                a.mov(RAX, b.payload());
+                a.cqo();
+                a.idiv(c.payload());
+                store(d, op == ArithOp::Div ? RAX : RDX, Value::Type::Int);
+                return;
+            }
+            a.mov(RAX, b.payload());
+            if (op == ArithOp::Mul) a.imul(RAX, c.payload());
+            else a.alu(op == ArithOp::Add ? Alu::Add : Alu::Sub, RAX, c.payload());
+            store(d, RAX, Value::Type::Int);
+        };
+        auto floatPath = [&] {
+            static const Sse ops[] = {Sse::Add, Sse::Sub, Sse::Mul, Sse::Div};
+            a.movsd(XMM0, b.payload());
+            a.sse(ops[int(op)], XMM0, c.payload());
+            a.movsd(d.payload(), XMM0);
+            a.movByte(d.type(), tag(Value::Type::Float));
+        };
+        numeric(pc, b, c, true, op != ArithOp::Mod, intPath, floatPath);
+    }
+
+    void comparison(uint32_t pc, Instr i, CompareOp op, bool constant) {
+        Operand d = reg(argA(i)), b = reg(argB(i)), c = rhs(i, constant);
+        auto intPath = [&] {
+            static const Cond conds[] = {E, NE, L, LE, G, GE};
+            a.mov(RAX, b.payload());
+            a.alu(Alu::Cmp, RAX, c.payload());
+            a.setcc(conds[int(op)], RAX);
+            storeFlag(d);
+        };
+        // ucomisd leaves ZF, PF and CF all set for an unordered (NaN) pair;
+        // every condition below comes out false for it, except !=
+        auto floatPath = [&] {
+            bool swap = op == CompareOp::Lt || op == CompareOp::Le; // x < y is y > x
+            a.movsd(XMM0, swap ? c.payload() : b.payload());
+            a.ucomisd(XMM0, swap ? b.payload() : c.payload());
+            switch (op) {
+                case CompareOp::Eq:
+                    a.setcc(E, RAX);
+                    a.setcc(NP, RCX);
+                    a.aluByte(Alu::And, RAX, RCX);
+                    break;
+                case CompareOp::Ne:
+                    a.setcc(NE, RAX);
+                    a.setcc(P, RCX);
+                    a.aluByte(Alu::Or, RAX, RCX);
+                    break;
+                case CompareOp::Lt:
+                case CompareOp::Gt: a.setcc(A, RAX); break;
+                case CompareOp::Le:
+                case CompareOp::Ge: a.setcc(AE, RAX); break;
+            }
+            storeFlag(d);
+        };
+        numeric(pc, b, c, true, true, intPath, floatPath);
+    }
+
+    void bitwise(uint32_t pc, Instr i, Alu op) {
+        Operand d = reg(argA(i)), b = reg(argB(i)), c = reg(argC(i));
+        auto intPath = [&] {
+            a.mov(RAX, b.payload());
+            a.alu(op, RAX, c.payload());
+            store(d, RAX, Value::Type::Int);
+        };
+        numeric(pc, b, c, true, false, intPath, [] {});
+    }
+
+    // jump when the truth value of R[A] is `when`; bool and mass only
+    void branch(uint32_t pc, Instr i, bool when) {
+        Operand v = reg(argA(i));
+        Label target = at[size_t(int(pc) + 1 + argSBx(i))];
+        Label notBool = a.newLabel(), next = a.newLabel();
+        a.cmpByte(v.type(), tag(Value::Type::Bool));
+        a.jcc(NE, notBool);
+        a.cmpByte(v.payload(), 0);
+        a.jcc(when ? NE : E, target);
+        a.jmp(next);
+        a.bind(notBool);
+        a.cmpByte(v.type(), tag(Value::Type::Int));
+        a.jcc(NE, exitAt(pc));
+        a.cmpImm(v.payload(), 0);
+        a.jcc(when ? NE : E, target);
+        a.bind(next);
+    }
+
+    void instruction(uint32_t pc, Instr i) {
+        Operand d = reg(argA(i)), b = reg(argB(i));
+        switch (opOf(i)) {
+            case Op::MOVE:
+                a.movdqu(XMM0, Mem{BASE, int32_t(argB(i) * sizeof(Value))});
+                a.movdqu(Mem{BASE, int32_t(argA(i) * sizeof(Value))}, XMM0);
+                return;
+            case Op::LOADK:
+                a.movdqu(XMM0, Mem{KONST, int32_t(argBx(i) * sizeof(Value))});
+                a.movdqu(Mem{BASE, int32_t(argA(i) * sizeof(Value))}, XMM0);
+                return;
+            case Op::LOADI:
+                a.movQword(d.payload(), argSBx(i));
+                a.movByte(d.type(), tag(Value::Type::Int));
+                return;
+            case Op::LOADBOOL:
+                a.movQword(d.payload(), argB(i) != 0);
+                a.movByte(d.type(), tag(Value::Type::Bool));
+                return;
+            case Op::LOADNIL:
+                a.movQword(d.payload(), 0);
+                a.movByte(d.type(), tag(Value::Type::Nil));
+                return;
+            case Op::TOINT: { // only a flux changes
+                Label done = a.newLabel();
+                a.cmpByte(d.type(), tag(Value::Type::Float));
+                a.jcc(NE, done);
+                a.cvttsd2si(RAX, d.payload());
+                // NaN and out-of-range give INT64_MIN, the one value neg
+                // overflows on; the interpreter saturates those (and -2^63 itself)
+                a.neg(RAX);
+                a.jcc(O, exitAt(pc));
+                a.neg(RAX);
+                store(d, RAX, Value::Type::Int);
+                a.bind(done);
+                return;
+            }
+            case Op::TOFLOAT: { // only a mass changes
+                Label done = a.newLabel();
+                a.cmpByte(d.type(), tag(Value::Type::Int));
+                a.jcc(NE, done);
+                a.cvtsi2sd(XMM0, d.payload());
+                a.movsd(d.payload(), XMM0);
+                a.movByte(d.type(), tag(Value::Type::Float));
+                a.bind(done);
+                return;
+            }
+            case Op::ADD: return arithmetic(pc, i, ArithOp::Add, false);
+            case Op::SUB: return arithmetic(pc, i, ArithOp::Sub, false);
+            case Op::MUL: return arithmetic(pc, i, ArithOp::Mul, false);
+            case Op::DIV: return arithmetic(pc, i, ArithOp::Div, false);
+            case Op::MOD: return arithmetic(pc, i, ArithOp::Mod, false);
+            case Op::ADDK: return arithmetic(pc, i, ArithOp::Add, true);
+            case Op::SUBK: return arithmetic(pc, i, ArithOp::Sub, true);
+            case Op::MULK: return arithmetic(pc, i, ArithOp::Mul, true);
+            case Op::DIVK: return arithmetic(pc, i, ArithOp::Div, true);
+            case Op::MODK: return arithmetic(pc, i, ArithOp::Mod, true);
+            case Op::EQ: return comparison(pc, i, CompareOp::Eq, false);
+            case Op::NE: return comparison(pc, i, CompareOp::Ne, false);
+            case Op::LT: return comparison(pc, i, CompareOp::Lt, false);
+            case Op::LE: return comparison(pc, i, CompareOp::Le, false);
+            case Op::GT: return comparison(pc, i, CompareOp::Gt, false);
+            case Op::GE: return comparison(pc, i, CompareOp::Ge, false);
+            case Op::EQK: return comparison(pc, i, CompareOp::Eq, true);
+            case Op::NEK: return comparison(pc, i, CompareOp::Ne, true);
+            case Op::LTK: return comparison(pc, i, CompareOp::Lt, true);
+            case Op::LEK: return comparison(pc, i, CompareOp::Le, true);
+            case Op::GTK: return comparison(pc, i, CompareOp::Gt, true);
+            case Op::GEK: return comparison(pc, i, CompareOp::Ge, true);
+            case Op::BAND: return bitwise(pc, i, Alu::And);
+            case Op::BOR: return bitwise(pc, i, Alu::Or);
+            case Op::BXOR: return bitwise(pc, i, Alu::Xor);
+            case Op::NEG: {
+                Label notInt = a.newLabel(), done = a.newLabel();
+                a.cmpByte(b.type(), tag(Value::Type::Int));
+                a.jcc(NE, notInt);
+                a.mov(RAX, b.payload());
+                a.neg(RAX);
+                store(d, RAX, Value::Type::Int);
+                a.jmp(done);
+                a.bind(notInt);
+                a.cmpByte(b.type(), tag(Value::Type::Float));
+                a.jcc(NE, exitAt(pc));
+                a.mov(RAX, b.payload());
+                a.btcSign(RAX);
+                store(d, RAX, Value::Type::Float);
+                a.bind(done);
+                return;
+            }
+            case Op::NOT:
+                a.cmpByte(b.type(), tag(Value::Type::Bool));
+                a.jcc(NE, exitAt(pc));
+                a.movzxByte(RAX, b.payload());
+                a.xorImm(RAX, 1);
+                store(d, RAX, Value::Type::Bool);
+                return;
+            case Op::TOBOOL: {
+                Label notBool = a.newLabel(), done = a.newLabel();
+                a.cmpByte(b.type(), tag(Value::Type::Bool));
+                a.jcc(NE, notBool);
+                a.movzxByte(RAX, b.payload());
+                store(d, RAX, Value::Type::Bool);
+                a.jmp(done);
+                a.bind(notBool);
+                a.cmpByte(b.type(), tag(Value::Type::Int));
+                a.jcc(NE, exitAt(pc));
+                a.cmpImm(b.payload(), 0);
+                a.setcc(NE, RAX);
+                storeFlag(d);
+                a.bind(done);
+                return;
+            }
+            case Op::JMP: a.jmp(at[size_t(int(pc) + 1 + argSBx(i))]); return;
+            case Op::JMPF: return branch(pc, i, false);
+            case Op::JMPT: return branch(pc, i, true);
+            case Op::GETGLOBAL:
+                a.mov(RAX, context(offsetof(Context, globals)));
+                a.movdqu(XMM0, Mem{RAX, int32_t(argBx(i) * sizeof(Value))});
+                a.movdqu(Mem{BASE, int32_t(argA(i) * sizeof(Value))}, XMM0);
+                return;
+            case Op::SETGLOBAL:
+                a.mov(RAX, context(offsetof(Context, globals)));
+                a.movdqu(XMM0, Mem{BASE, int32_t(argA(i) * sizeof(Value))});
+                a.movdqu(Mem{RAX, int32_t(argBx(i) * sizeof(Value))}, XMM0);
+                return;
+            case Op::CALL: return call(pc, i);
+            case Op::TAILCALL: return tailCall(pc);
+            case Op::RETURN: return ret(pc, i);
+            default: // PRINT
+                a.jmp(exitAt(pc));
+                return;
+        }
+    }
+};
+
+} // namespace
+
+bool available() { return true; }
+
+Code::~Code() {
+    if (memory) munmap(memory, mapped);
+}
+
+std::unique_ptr<Code> compile(const Proto& proto) {
+    std::unique_ptr<Code> code(new Code());
+    Translator translator(proto);
+    const std::vector<uint8_t>& bytes = translator.translate(code->entries, code->callOffset);
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    size_t mapped = (bytes.size() + page - 1) / page * page;
+    // written while writable, then flipped to read+execute: never both at once
+    void* memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return nullptr;
+    std::memcpy(memory, bytes.data(), bytes.size());
+    if (mprotect(memory, mapped, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, mapped);
+        return nullptr;
+    }
+    code->memory = static_cast<uint8_t*>(memory);
+    code->mapped = mapped;
+    code->bytes = bytes.size();
+    code->entryFn = reinterpret_cast<Code::EntryFn>(memory);
+    return code;
+}
+
+#else
+
+bool available() { return false; }
+
+Code::~Code() {}
+
+std::unique_ptr<Code> compile(const Proto&) { return nullptr; }
+
+#endif
+
+} // namespace jit
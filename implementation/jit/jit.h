@@ -0,0 +1,126 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "../vm/bytecode.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// ---------- Baseline JIT (Linux x86-64) ----------
+// Translates a whole Proto to machine code once it is hot: after
+// Options::threshold calls (and returns into it), or that many loop
+// back-edges. The native code works directly on the VM's register file
+// (the frame of the call it runs for), one bytecode
+// instruction at a time, so any pc is a valid entry and every value is in
+// memory between instructions. Type guards pick the int or float path for
+// arithmetic, comparisons and branches. Script variables are read and
+// written in place. A call to a proto that is compiled too is made natively:
+// the caller's frame goes on the VM's call stack exactly as the interpreter
+// would push it, and the callee's code runs on the machine stack until
+// it returns (a tail call jumps to the callee's code instead). Anything else
+// leaves through a side exit: the native code returns the pc of the
+// instruction it could not handle (a string, a mixed mass/flux operand, a
+// division by zero, shine, a call to a proto still interpreted, the return
+// of the frame the interpreter entered ...) and the interpreter runs it and
+// everything after it, in the innermost frame the native code reached, until
+// the next back-edge, call or return enters native code again. So the two
+// tiers never disagree, and errors are raised by the interpreter with its
+// own messages.
+// Elsewhere available() is false and the VM only interprets.
+namespace jit {
+
+struct Options {
+    bool enabled = true;        // --jit / --no-jit; ignored where !available()
+    uint32_t threshold = 1000;  // calls, returns or loop back-edges before a proto is compiled
+};
+
+struct Stats {
+    size_t compiled = 0;    // protos translated
+    size_t failed = 0;      // protos that could not get executable memory
+    size_t codeBytes = 0;   // machine code emitted
+    size_t entries = 0;     // interpreter -> native transfers
+    size_t exits = 0;       // native -> interpreter side exits (returns included)
+    size_t nativeCalls = 0; // calls and tail calls made without leaving native code
+};
+
+bool available();
+
+// calls native code may nest on the machine stack (16 bytes each); a deeper
+// one leaves for the interpreter, which starts over from an empty stack
+constexpr uint64_t MAX_NATIVE_DEPTH = 16384;
+
+// a compiled proto as native CALLs see it; entry is null until it is compiled
+struct NativeProto {
+    const uint8_t* entry = nullptr; // Code::callEntry()
+    const Value* K = nullptr;
+    uint64_t frameBytes = 0; // numRegs * sizeof(Value)
+};
+
+// what native code shares with the VM running it. Standard layout: the
+// machine code addresses the fields by offset. A native CALL pushes the
+// caller's CallFrame itself when the callee is compiled and everything fits
+// (frames, registers, MAX_NATIVE_DEPTH), and asks the call hook otherwise
+struct Context {
+    Value* globals = nullptr;             // the script's registers, i.e. the whole register file
+    const Value* regsEnd = nullptr;       // its end; both move when the VM's stack grows
+    CallFrame* frameTop = nullptr;        // the VM's call stack: next free frame
+    const CallFrame* frameEnd = nullptr;  // no room from here
+    const NativeProto* natives = nullptr; // per proto of the module
+    uint64_t depth = 0;                   // native calls made and not yet returned from
+    uint64_t maxDepth = MAX_NATIVE_DEPTH;
+    uint64_t calls = 0;                   // native calls and tail calls, for Stats
+    // where the last side exit left: the interpreter resumes in this frame
+    const Proto* exitProto = nullptr;
+    Value* exitBase = nullptr;
+    // the callee's window, constants and code, set by the hooks
+    Value* calleeBase = nullptr;
+    const Value* calleeK = nullptr;
+    const uint8_t* calleeEntry = nullptr;
+    // the CALL or TAILCALL at caller->code[pc] with the caller's window at
+    // base, the way the interpreter makes it: pushes the frame (call) or
+    // moves the arguments down (tailCall), and returns non-null; null with
+    // nothing changed when the callee is not compiled or does not fit
+    const uint8_t* (*call)(Context* context, const Proto* caller, uint32_t pc, Value* base) = nullptr;
+    const uint8_t* (*tailCall)(Context* context, const Proto* caller, uint32_t pc, Value* base) = nullptr;
+    void* vm = nullptr; // for the hooks
+};
+
+// machine code for one Proto, in its own read+execute mapping
+class Code {
+public:
+    ~Code();
+    Code(const Code&) = delete;
+    Code& operator=(const Code&) = delete;
+
+    // run from instruction `pc` until a side exit; returns the pc the
+    // interpreter resumes at, in context->exitProto and ->exitBase. base is
+    // the proto's register window, K its constants
+    uint32_t run(Value* base, const Value* K, uint32_t pc, Context* context) const {
+        return entryFn(base, K, memory + entries[pc], context);
+    }
+    size_t size() const { return bytes; }
+    // where a native CALL enters the proto (at pc 0, through its own prologue)
+    const uint8_t* callEntry() const { return memory + callOffset; }
+    // the code of instruction pc, which a native TAILCALL jumps to
+    const uint8_t* at(uint32_t pc) const { return memory + entries[pc]; }
+
+private:
+    friend std::unique_ptr<Code> compile(const Proto& proto);
+    using EntryFn = uint32_t (*)(Value* base, const Value* K, const uint8_t* at, Context* context);
+
+    Code() = default;
+    uint8_t* memory = nullptr;
+    size_t mapped = 0;
+    size_t bytes = 0;
+    EntryFn entryFn = nullptr;
+    uint32_t callOffset = 0;
+    std::vector<uint32_t> entries; // code offset per bytecode pc
+};
+
+// nullptr when the JIT is unavailable or no executable memory can be mapped
+std::unique_ptr<Code> compile(const Proto& proto);
+
+} // namespace jit
+
+#endif
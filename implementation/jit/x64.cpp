@@ -0,0 +1,100 @@
+#include "x64.h"
+#include <stdexcept>
+
+namespace jit::x64 {
+
+Label Assembler::newLabel() {
+    labels.push_back(-1);
+    return Label{int(labels.size() - 1)};
+}
+
+void Assembler::bind(Label label) { labels[size_t(label.id)] = int64_t(bytes.size()); }
+
+void Assembler::dword(uint32_t v) {
+    for (int k = 0; k < 4; k++) byte(uint8_t(v >> (8 * k)));
+}
+
+void Assembler::modrm(unsigned reg, Mem m) {
+    if (m.base == RSP) throw std::logic_error("x64: [rsp + disp] needs a SIB byte");
+    byte(uint8_t(0x80 | (reg << 3) | m.base));
+    dword(uint32_t(m.disp));
+}
+
+void Assembler::rel32(Label target) {
+    fixups.push_back({bytes.size(), target.id});
+    dword(0);
+}
+
+// ---------- integer ----------
+void Assembler::mov(Reg dst, Mem src) { rexW(); byte(0x8B); modrm(dst, src); }
+void Assembler::mov(Mem dst, Reg src) { rexW(); byte(0x89); modrm(src, dst); }
+void Assembler::mov(Reg dst, Reg src) { rexW(); byte(0x8B); modrmReg(dst, src); }
+void Assembler::movImm(Reg dst, uint32_t imm) { byte(uint8_t(0xB8 + dst)); dword(imm); }
+
+void Assembler::movImm64(Reg dst, uint64_t imm) {
+    rexW();
+    byte(uint8_t(0xB8 + dst));
+    dword(uint32_t(imm));
+    dword(uint32_t(imm >> 32));
+}
+
+void Assembler::movByte(Mem dst, uint8_t imm) { byte(0xC6); modrm(0, dst); byte(imm); }
+void Assembler::movQword(Mem dst, int32_t imm) { rexW(); byte(0xC7); modrm(0, dst); dword(uint32_t(imm)); }
+void Assembler::movzxByte(Reg dst, Mem src) { byte(0x0F); byte(0xB6); modrm(dst, src); }
+void Assembler::movzxByte(Reg dst, Reg src) { byte(0x0F); byte(0xB6); modrmReg(dst, src); }
+void Assembler::alu(Alu op, Reg dst, Mem src) { rexW(); byte(uint8_t(op)); modrm(dst, src); }
+
+void Assembler::aluByte(Alu op, Reg dst, Reg src) {
+    // the r/m8, r8 form is the r64, r/m64 opcode minus 3
+    byte(uint8_t(uint8_t(op) - 3));
+    modrmReg(src, dst);
+}
+
+void Assembler::xorImm(Reg dst, int8_t imm) { rexW(); byte(0x83); modrmReg(6, dst); byte(uint8_t(imm)); }
+void Assembler::addImm(Reg dst, int32_t imm) { rexW(); byte(0x81); modrmReg(0, dst); dword(uint32_t(imm)); }
+void Assembler::addImm(Mem dst, int8_t imm) { rexW(); byte(0x83); modrm(0, dst); byte(uint8_t(imm)); }
+void Assembler::shl(Reg dst, uint8_t count) { rexW(); byte(0xC1); modrmReg(4, dst); byte(count); }
+void Assembler::shr(Reg dst, uint8_t count) { rexW(); byte(0xC1); modrmReg(5, dst); byte(count); }
+void Assembler::cmpByte(Mem lhs, uint8_t imm) { byte(0x80); modrm(7, lhs); byte(imm); }
+void Assembler::cmpImm(Mem lhs, int8_t imm) { rexW(); byte(0x83); modrm(7, lhs); byte(uint8_t(imm)); }
+void Assembler::cmpImm32(Reg lhs, uint32_t imm) { byte(0x81); modrmReg(7, lhs); dword(imm); }
+void Assembler::test(Reg a, Reg b) { rexW(); byte(0x85); modrmReg(b, a); }
+void Assembler::imul(Reg dst, Mem src) { rexW(); byte(0x0F); byte(0xAF); modrm(dst, src); }
+void Assembler::neg(Reg dst) { rexW(); byte(0xF7); modrmReg(3, dst); }
+void Assembler::cqo() { rexW(); byte(0x99); }
+void Assembler::idiv(Mem divisor) { rexW(); byte(0xF7); modrm(7, divisor); }
+void Assembler::btcSign(Reg dst) { rexW(); byte(0x0F); byte(0xBA); modrmReg(7, dst); byte(63); }
+void Assembler::setcc(Cond cond, Reg dst) { byte(0x0F); byte(uint8_t(0x90 + cond)); modrmReg(0, dst); }
+
+// ---------- scalar doubles ----------
+void Assembler::movsd(Xmm dst, Mem src) { byte(0xF2); byte(0x0F); byte(0x10); modrm(dst, src); }
+void Assembler::movsd(Mem dst, Xmm src) { byte(0xF2); byte(0x0F); byte(0x11); modrm(src, dst); }
+void Assembler::sse(Sse op, Xmm dst, Mem src) { byte(0xF2); byte(0x0F); byte(uint8_t(op)); modrm(dst, src); }
+void Assembler::ucomisd(Xmm lhs, Mem rhs) { byte(0x66); byte(0x0F); byte(0x2E); modrm(lhs, rhs); }
+void Assembler::cvtsi2sd(Xmm dst, Mem src) { byte(0xF2); rexW(); byte(0x0F); byte(0x2A); modrm(dst, src); }
+void Assembler::cvttsd2si(Reg dst, Mem src) { byte(0xF2); rexW(); byte(0x0F); byte(0x2C); modrm(dst, src); }
+void Assembler::movdqu(Xmm dst, Mem src) { byte(0xF3); byte(0x0F); byte(0x6F); modrm(dst, src); }
+void Assembler::movdqu(Mem dst, Xmm src) { byte(0xF3); byte(0x0F); byte(0x7F); modrm(src, dst); }
+
+// ---------- control flow ----------
+void Assembler::jmp(Label target) { byte(0xE9); rel32(target); }
+void Assembler::jcc(Cond cond, Label target) { byte(0x0F); byte(uint8_t(0x80 + cond)); rel32(target); }
+void Assembler::jmp(Reg target) { byte(0xFF); modrmReg(4, target); }
+void Assembler::call(Reg target) { byte(0xFF); modrmReg(2, target); }
+void Assembler::call(Mem target) { byte(0xFF); modrm(2, target); }
+void Assembler::push(Reg r) { byte(uint8_t(0x50 + r)); }
+void Assembler::pop(Reg r) { byte(uint8_t(0x58 + r)); }
+void Assembler::ret() { byte(0xC3); }
+
+const std::vector<uint8_t>& Assembler::finish() {
+    for (const Fixup& f : fixups) {
+        int64_t target = labels[size_t(f.label)];
+        if (target < 0) throw std::logic_error("x64: jump to an unbound label");
+        int64_t rel = target - int64_t(f.at + 4);
+        for (int k = 0; k < 4; k++) bytes[f.at + size_t(k)] = uint8_t(uint64_t(rel) >> (8 * k));
+    }
+    fixups.clear();
+    return bytes;
+}
+
+} // namespace jit::x64
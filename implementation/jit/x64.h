@@ -0,0 +1,116 @@
+#ifndef X64_H
+#define X64_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ---------- x86-64 assembler ----------
+// Just enough of the instruction set for the JIT (jit.h): 64-bit integer ALU,
+// scalar double SSE2, compares, setcc, rel32 jumps and indirect calls. Every memory operand is
+// [base + disp32] with a base that needs no SIB byte (not rsp or r12), and
+// only the eight legacy registers are used, so REX is needed for REX.W alone.
+namespace jit::x64 {
+
+enum Reg : uint8_t { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7 };
+enum Xmm : uint8_t { XMM0 = 0, XMM1 = 1 };
+
+// condition codes, as encoded in Jcc / SETcc
+enum Cond : uint8_t {
+    O = 0x0, NO = 0x1, B = 0x2, AE = 0x3, E = 0x4, NE = 0x5, BE = 0x6, A = 0x7,
+    S = 0x8, NS = 0x9, P = 0xA, NP = 0xB, L = 0xC, GE = 0xD, LE = 0xE, G = 0xF,
+};
+
+// two-operand integer ops of the form `op r64, r/m64`; the value is the opcode
+enum class Alu : uint8_t { Add = 0x03, Or = 0x0B, And = 0x23, Sub = 0x2B, Xor = 0x33, Cmp = 0x3B };
+// scalar double ops of the form `op xmm, xmm/m64` (F2 0F xx)
+enum class Sse : uint8_t { Add = 0x58, Mul = 0x59, Sub = 0x5C, Div = 0x5E };
+
+struct Mem {
+    Reg base;
+    int32_t disp;
+};
+
+struct Label {
+    int id = -1;
+    bool valid() const { return id >= 0; }
+};
+
+class Assembler {
+public:
+    Label newLabel();
+    void bind(Label label);
+    size_t size() const { return bytes.size(); }
+
+    // integer moves and arithmetic
+    void mov(Reg dst, Mem src);             // mov r64, [m]
+    void mov(Mem dst, Reg src);             // mov [m], r64
+    void mov(Reg dst, Reg src);             // mov r64, r64
+    void movImm(Reg dst, uint32_t imm);     // mov r32, imm32 (zero-extends)
+    void movImm64(Reg dst, uint64_t imm);   // mov r64, imm64 (addresses)
+    void movByte(Mem dst, uint8_t imm);     // mov byte [m], imm8
+    void movQword(Mem dst, int32_t imm);    // mov qword [m], simm32
+    void movzxByte(Reg dst, Mem src);       // movzx r32, byte [m]
+    void movzxByte(Reg dst, Reg src);       // movzx r32, r8 (al, cl, dl, bl only)
+    void alu(Alu op, Reg dst, Mem src);
+    void aluByte(Alu op, Reg dst, Reg src); // op r8, r8 (And, Or, Xor)
+    void xorImm(Reg dst, int8_t imm);       // xor r64, simm8
+    void addImm(Reg dst, int32_t imm);      // add r64, simm32
+    void addImm(Mem dst, int8_t imm);       // add qword [m], simm8
+    void shl(Reg dst, uint8_t count);       // shl r64, imm8
+    void shr(Reg dst, uint8_t count);       // shr r64, imm8
+    void cmpByte(Mem lhs, uint8_t imm);     // cmp byte [m], imm8
+    void cmpImm(Mem lhs, int8_t imm);       // cmp qword [m], simm8
+    void cmpImm32(Reg lhs, uint32_t imm);   // cmp r32, imm32
+    void test(Reg a, Reg b);
+    void imul(Reg dst, Mem src);
+    void neg(Reg dst);
+    void cqo();
+    void idiv(Mem divisor);                 // rdx:rax / [m] -> rax, rdx
+    void btcSign(Reg dst);                  // btc r64, 63
+    void setcc(Cond cond, Reg dst);         // low byte of dst (al, cl, dl, bl only)
+
+    // scalar doubles
+    void movsd(Xmm dst, Mem src);
+    void movsd(Mem dst, Xmm src);
+    void sse(Sse op, Xmm dst, Mem src);
+    void ucomisd(Xmm lhs, Mem rhs);
+    void cvtsi2sd(Xmm dst, Mem src);   // from a qword in memory
+    void cvttsd2si(Reg dst, Mem src);  // truncating, to r64
+    void movdqu(Xmm dst, Mem src);     // 16-byte copies of whole values
+    void movdqu(Mem dst, Xmm src);
+
+    // control flow
+    void jmp(Label target);
+    void jcc(Cond cond, Label target);
+    void jmp(Reg target);
+    void call(Reg target);
+    void call(Mem target);                 // call qword [m]
+    void push(Reg r);
+    void pop(Reg r);
+    void ret();
+
+    // patch every jump to its label; all used labels must be bound
+    const std::vector<uint8_t>& finish();
+
+private:
+    struct Fixup {
+        size_t at; // of the rel32
+        int label;
+    };
+
+    std::vector<uint8_t> bytes;
+    std::vector<int64_t> labels; // bound position, or -1
+    std::vector<Fixup> fixups;
+
+    void byte(uint8_t b) { bytes.push_back(b); }
+    void dword(uint32_t v);
+    void rexW() { byte(0x48); }
+    void modrm(unsigned reg, Mem m);       // mod=10: [base + disp32]
+    void modrmReg(unsigned reg, unsigned rm) { byte(uint8_t(0xC0 | (reg << 3) | rm)); }
+    void rel32(Label target);
+};
+
+} // namespace jit::x64
+
+#endif
@@ -0,0 +1,379 @@
+#include "fold.h"
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+size_t countNodes(Expr* expr);
+size_t countNodes(Stmt* stmt);
+
+size_t countNodes(Expr* expr) {
+    if (!expr) return 0;
+    switch (expr->kind) {
+        case ExprKind::Binary: {
+            auto* b = static_cast<BinaryExpr*>(expr);
+            return 1 + countNodes(b->left) + countNodes(b->right);
+        }
+        case ExprKind::Assign: return 1 + countNodes(static_cast<AssignExpr*>(expr)->value);
+        case ExprKind::Unary: return 1 + countNodes(static_cast<UnaryExpr*>(expr)->operand);
+        case ExprKind::Logical: {
+            auto* l = static_cast<LogicalExpr*>(expr);
+            return 1 + countNodes(l->left) + countNodes(l->right);
+        }
+        case ExprKind::Call: {
+            size_t n = 1;
+            for (Expr* arg : static_cast<CallExpr*>(expr)->args) n += countNodes(arg);
+            return n;
+        }
+        default: return 1;
+    }
+}
+
+size_t countList(const StmtList& list) {
+    size_t n = 0;
+    for (Stmt* s : list) n += countNodes(s);
+    return n;
+}
+
+size_t countNodes(Stmt* stmt) {
+    if (!stmt) return 0;
+    switch (stmt->kind) {
+        case StmtKind::VarDecl: return 1 + countNodes(static_cast<VarDecl*>(stmt)->initializer);
+        case StmtKind::FuncDecl: return 1 + countList(static_cast<FuncDecl*>(stmt)->body);
+        case StmtKind::Block: return 1 + countList(static_cast<BlockStmt*>(stmt)->statements);
+        case StmtKind::Expression: return 1 + countNodes(static_cast<ExprStmt*>(stmt)->expression);
+        case StmtKind::If: {
+            auto* s = static_cast<IfStmt*>(stmt);
+            return 1 + countNodes(s->condition) + countNodes(s->thenBranch) + countNodes(s->elseBranch);
+        }
+        case StmtKind::While: {
+            auto* s = static_cast<WhileStmt*>(stmt);
+            return 1 + countNodes(s->condition) + countNodes(s->body);
+        }
+        case StmtKind::For: {
+            auto* s = static_cast<ForStmt*>(stmt);
+            return 1 + countNodes(s->initializer) + countNodes(s->condition) + countNodes(s->increment) +
+                   countNodes(s->body);
+        }
+        case StmtKind::Return: return 1 + countNodes(static_cast<ReturnStmt*>(stmt)->value);
+        default: return 1;
+    }
+}
+
+bool isLiteral(Expr* expr) { return expr && expr->kind == ExprKind::Literal; }
+
+// value of a literal node, or false for literals the folder does not evaluate (star)
+bool literalValue(Expr* expr, Value& out) {
+    const auto* literal = static_cast<LiteralExpr*>(expr);
+    switch (literal->type) {
+        case LiteralExpr::Type::Int: out = Value::makeInt(literal->integer); return true;
+        case LiteralExpr::Type::Float: out = Value::makeFloat(literal->real); return true;
+        case LiteralExpr::Type::Bool: out = Value::makeBool(literal->boolean); return true;
+        default: return false;
+    }
+}
+
+bool isNumber(Expr* expr, int64_t whole) {
+    Value v;
+    if (!isLiteral(expr) || !literalValue(expr, v)) return false;
+    return v.isInt() ? v.i == whole : (v.isFloat() && v.f == double(whole));
+}
+
+bool isIntNumber(Expr* expr, int64_t whole) {
+    Value v;
+    return isLiteral(expr) && literalValue(expr, v) && v.isInt() && v.i == whole;
+}
+
+bool hasSideEffects(Expr* expr) {
+    if (!expr) return false;
+    switch (expr->kind) {
+        case ExprKind::Assign:
+        case ExprKind::Call:
+            return true;
+        case ExprKind::Binary: {
+            auto* b = static_cast<BinaryExpr*>(expr);
+            return hasSideEffects(b->left) || hasSideEffects(b->right);
+        }
+        case ExprKind::Logical: {
+            auto* l = static_cast<LogicalExpr*>(expr);
+            return hasSideEffects(l->left) || hasSideEffects(l->right);
+        }
+        case ExprKind::Unary: return hasSideEffects(static_cast<UnaryExpr*>(expr)->operand);
+        default: return false;
+    }
+}
+
+} // namespace
+
+ConstantFolder::ConstantFolder(AstArena& arena) : arena(arena) {}
+
+void ConstantFolder::run(StmtList& program) {
+    scope.clear();
+    foldList(program);
+}
+
+void ConstantFolder::declare(const Token& type, const Token& name) {
+    scope.push(Binding{name.symbol(), type.type});
+}
+
+// fold every statement and compact the list over removed ones
+void ConstantFolder::foldList(StmtList& list) {
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < list.count; i++) {
+        Stmt* folded = foldStmt(list.items[i]);
+        if (folded) list.items[out++] = folded;
+    }
+    list.count = out;
+}
+
+Stmt* ConstantFolder::emptyBlock() { return arena.make<BlockStmt>(); }
+
+Stmt* ConstantFolder::foldStmt(Stmt* stmt) {
+    switch (stmt->kind) {
+        case StmtKind::VarDecl: {
+            auto* decl = static_cast<VarDecl*>(stmt);
+            if (decl->initializer) decl->initializer = foldExpr(decl->initializer);
+            declare(decl->type, decl->name);
+            return stmt;
+        }
+        case StmtKind::FuncDecl: {
+            auto* func = static_cast<FuncDecl*>(stmt);
+            size_t mark = scope.size();
+            for (const Param& param : func->params) declare(param.type, param.name);
+            foldList(func->body);
+            scope.truncate(mark);
+            return stmt;
+        }
+        case StmtKind::Block: {
+            size_t mark = scope.size();
+            foldList(static_cast<BlockStmt*>(stmt)->statements);
+            scope.truncate(mark);
+            return stmt;
+        }
+        case StmtKind::Expression: {
+            auto* s = static_cast<ExprStmt*>(stmt);
+            s->expression = foldExpr(s->expression);
+            // a bare literal statement does nothing
+            if (isLiteral(s->expression)) {
+                counts.nodesEliminated += 2;
+                return nullptr;
+            }
+            return stmt;
+        }
+        case StmtKind::If: {
+            auto* s = static_cast<IfStmt*>(stmt);
+            s->condition = foldExpr(s->condition);
+            Value cond;
+            if (isLiteral(s->condition) && literalValue(s->condition, cond)) {
+                counts.branchesRemoved++;
+                counts.nodesEliminated += 2; // the phase itself and its condition
+                Stmt* live = isTruthy(cond) ? s->thenBranch : s->elseBranch;
+                Stmt* dead = isTruthy(cond) ? s->elseBranch : s->thenBranch;
+                counts.nodesEliminated += countNodes(dead);
+                return live ? foldStmt(live) : nullptr;
+            }
+            s->thenBranch = foldStmt(s->thenBranch);
+            if (!s->thenBranch) s->thenBranch = emptyBlock();
+            if (s->elseBranch) s->elseBranch = foldStmt(s->elseBranch);
+            return stmt;
+        }
+        case StmtKind::While: {
+            auto* s = static_cast<WhileStmt*>(stmt);
+            s->condition = foldExpr(s->condition);
+            Value cond;
+            if (isLiteral(s->condition) && literalValue(s->condition, cond) && !isTruthy(cond)) {
+                counts.branchesRemoved++;
+                counts.nodesEliminated += countNodes(stmt);
+                return nullptr;
+            }
+            s->body = foldStmt(s->body);
+            if (!s->body) s->body = emptyBlock();
+            return stmt;
+        }
+        case StmtKind::For: {
+            auto* s = static_cast<ForStmt*>(stmt);
+            size_t mark = scope.size();
+            if (s->initializer) s->initializer = foldStmt(s->initializer);
+            if (s->condition) s->condition = foldExpr(s->condition);
+            if (s->increment) s->increment = foldExpr(s->increment);
+            s->body = foldStmt(s->body);
+            if (!s->body) s->body = emptyBlock();
+            scope.truncate(mark);
+            return stmt;
+        }
+        case StmtKind::Return: {
+            auto* s = static_cast<ReturnStmt*>(stmt);
+            if (s->value) s->value = foldExpr(s->value);
+            return stmt;
+        }
+        default:
+            return stmt;
+    }
+}
+
+Expr* ConstantFolder::foldExpr(Expr* expr) {
+    switch (expr->kind) {
+        case ExprKind::Assign: {
+            auto* a = static_cast<AssignExpr*>(expr);
+            a->value = foldExpr(a->value);
+            return expr;
+        }
+        case ExprKind::Binary: {
+            auto* b = static_cast<BinaryExpr*>(expr);
+            b->left = foldExpr(b->left);
+            b->right = foldExpr(b->right);
+            return foldBinary(b);
+        }
+        case ExprKind::Unary: {
+            auto* u = static_cast<UnaryExpr*>(expr);
+            u->operand = foldExpr(u->operand);
+            Value v;
+            if (!isLiteral(u->operand) || !literalValue(u->operand, v)) return expr;
+            if (u->op.type == TokenType::BANG) {
+                v = Value::makeBool(!isTruthy(v));
+            } else {
+                if (!v.isNumber()) return expr; // type error: left to runtime
+                v = negate(v);
+            }
+            counts.expressionsFolded++;
+            counts.nodesEliminated += 1;
+            return makeLiteral(v, u->op);
+        }
+        case ExprKind::Logical: {
+            // only the left operand decides statically: a known left either
+            // short-circuits or leaves the truth of the right operand
+            auto* l = static_cast<LogicalExpr*>(expr);
+            l->left = foldExpr(l->left);
+            l->right = foldExpr(l->right);
+            Value a, b;
+            if (!isLiteral(l->left) || !literalValue(l->left, a)) return expr;
+            bool shortCircuit = l->op.type == TokenType::AND ? !isTruthy(a) : isTruthy(a);
+            if (shortCircuit) {
+                counts.expressionsFolded++;
+                counts.nodesEliminated += countNodes(expr) - 1;
+                return makeLiteral(Value::makeBool(isTruthy(a)), l->op);
+            }
+            if (!isLiteral(l->right) || !literalValue(l->right, b)) return expr;
+            counts.expressionsFolded++;
+            counts.nodesEliminated += 2;
+            return makeLiteral(Value::makeBool(isTruthy(b)), l->op);
+        }
+        case ExprKind::Call:
+            for (Expr*& arg : static_cast<CallExpr*>(expr)->args) arg = foldExpr(arg);
+            return expr;
+        default:
+            return expr;
+    }
+}
+
+Expr* ConstantFolder::foldBinary(BinaryExpr* expr) {
+    TokenType op = expr->op.type;
+    Expr* left = expr->left;
+    Expr* right = expr->right;
+
+    // literal op literal: evaluate now with the engines' own semantics
+    Value a, b;
+    if (isLiteral(left) && isLiteral(right) && literalValue(left, a) && literalValue(right, b)) {
+        Value result;
+        try {
+            if (!applyOperator(op, a, b, result)) return expr;
+        } catch (const std::runtime_error&) {
+            return expr; // leave the error to runtime, where it gets a line number
+        }
+        if (result.isFloat() && !std::isfinite(result.f)) return expr;
+        counts.expressionsFolded++;
+        counts.nodesEliminated += 2; // two operands + operator become one literal
+        return makeLiteral(result, expr->op);
+    }
+
+    // identities; `keep` is the surviving operand
+    StaticType lt = staticType(left), rt = staticType(right);
+    Expr* keep = nullptr;
+    switch (op) {
+        case TokenType::STARR:
+            if (isNumber(right, 1) && lt != StaticType::Unknown && (lt == StaticType::Float || isIntNumber(right, 1))) keep = left;
+            else if (isNumber(left, 1) && rt != StaticType::Unknown && (rt == StaticType::Float || isIntNumber(left, 1))) keep = right;
+            else if (isIntNumber(right, 0) && lt == StaticType::Int && !hasSideEffects(left)) keep = right;
+            else if (isIntNumber(left, 0) && rt == StaticType::Int && !hasSideEffects(right)) keep = left;
+            break;
+        case TokenType::SLASH:
+            if (isNumber(right, 1) && lt != StaticType::Unknown && (lt == StaticType::Float || isIntNumber(right, 1))) keep = left;
+            break;
+        case TokenType::PLUS:
+            // x + 0.0 is not exact for flux (-0.0 + 0.0 == +0.0), so mass only
+            if (isIntNumber(right, 0) && lt == StaticType::Int) keep = left;
+            else if (isIntNumber(left, 0) && rt == StaticType::Int) keep = right;
+            break;
+        case TokenType::MINUS:
+            if (isIntNumber(right, 0) && lt == StaticType::Int) keep = left;
+            else if (isNumber(right, 0) && lt == StaticType::Float) keep = left;
+            break;
+        default:
+            break;
+    }
+    if (!keep) return expr;
+    counts.identitiesApplied++;
+    counts.nodesEliminated += countNodes(expr) - countNodes(keep);
+    return keep;
+}
+
+Expr* ConstantFolder::makeLiteral(const Value& v, const Token& at) {
+    // the result is stored decoded, so it needs no text of its own
+    LiteralExpr* literal;
+    switch (v.type) {
+        case Value::Type::Bool:
+            literal = arena.make<LiteralExpr>(LiteralExpr::Type::Bool, at.offset);
+            literal->boolean = v.b;
+            break;
+        case Value::Type::Int:
+            literal = arena.make<LiteralExpr>(LiteralExpr::Type::Int, at.offset);
+            literal->integer = v.i;
+            break;
+        default:
+            literal = arena.make<LiteralExpr>(LiteralExpr::Type::Float, at.offset);
+            literal->real = v.f;
+            break;
+    }
+    return literal;
+}
+
+ConstantFolder::StaticType ConstantFolder::staticType(Expr* expr) const {
+    switch (expr->kind) {
+        case ExprKind::Literal: {
+            LiteralExpr::Type type = static_cast<LiteralExpr*>(expr)->type;
+            if (type == LiteralExpr::Type::Int) return StaticType::Int;
+            if (type == LiteralExpr::Type::Float) return StaticType::Float;
+            return StaticType::Unknown;
+        }
+        case ExprKind::Variable:
+        case ExprKind::Assign: {
+            symbols::Symbol name = expr->kind == ExprKind::Variable ? static_cast<VariableExpr*>(expr)->name.symbol()
+                                                                    : static_cast<AssignExpr*>(expr)->name.symbol();
+            const Binding* binding = scope.find(name);
+            if (!binding) return StaticType::Unknown;
+            if (binding->type == TokenType::MASS) return StaticType::Int;
+            if (binding->type == TokenType::FLUX) return StaticType::Float;
+            return StaticType::Unknown;
+        }
+        case ExprKind::Binary: {
+            auto* b = static_cast<BinaryExpr*>(expr);
+            TokenType op = b->op.type;
+            bool arith = op == TokenType::PLUS || op == TokenType::MINUS || op == TokenType::STARR ||
+                         op == TokenType::SLASH || op == TokenType::PERCENT;
+            bool bits = op == TokenType::BIT_AND || op == TokenType::BIT_OR || op == TokenType::XOR;
+            if (!arith && !bits) return StaticType::Unknown;
+            StaticType l = staticType(b->left), r = staticType(b->right);
+            if (l == StaticType::Unknown || r == StaticType::Unknown) return StaticType::Unknown;
+            if (l == StaticType::Int && r == StaticType::Int) return StaticType::Int;
+            return bits ? StaticType::Unknown : StaticType::Float;
+        }
+        case ExprKind::Unary: {
+            auto* u = static_cast<UnaryExpr*>(expr);
+            return u->op.type == TokenType::MINUS ? staticType(u->operand) : StaticType::Unknown;
+        }
+        case ExprKind::Logical:
+        case ExprKind::Call:
+            return StaticType::Unknown;
+    }
+    return StaticType::Unknown;
+}
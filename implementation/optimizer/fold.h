@@ -0,0 +1,55 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "../parser/parser.h"
+#include "../symbols/symbolmap.h"
+#include "../vm/value.h"
+#include <cstddef>
+
+// ---------- Constant folding ----------
+// Optimization pass between parsing and execution. Rewrites the arena AST in
+// place:
+//  - arithmetic and comparisons over literals are evaluated once, with the
+//    same semantics as the engines (anything that would fail at runtime,
+//    e.g. division by zero, is left alone)
+//  - algebraic identities: x*1, x/1, x+0, x-0 -> x and x*0 -> 0, but only
+//    when the declared type of x makes them exact (mass for +0 and *0)
+//  - phase/orbit statements whose condition is constant lose their dead arm
+// New literals are allocated from the same arena as the tree.
+struct FoldStats {
+    size_t nodesEliminated = 0;   // AST nodes no longer reachable from the program
+    size_t expressionsFolded = 0; // constant expressions replaced by a literal
+    size_t identitiesApplied = 0; // algebraic simplifications
+    size_t branchesRemoved = 0;   // dead phase/eclipse arms and never-entered orbits
+};
+
+class ConstantFolder {
+public:
+    explicit ConstantFolder(AstArena& arena);
+    void run(StmtList& program);
+    const FoldStats& stats() const { return counts; }
+
+private:
+    enum class StaticType : uint8_t { Unknown, Int, Float };
+
+    struct Binding {
+        symbols::Symbol name;
+        TokenType type;
+    };
+
+    AstArena& arena;
+    FoldStats counts;
+    // declared type of every variable in scope
+    ScopeStack<Binding> scope;
+
+    void foldList(StmtList& list);
+    Stmt* foldStmt(Stmt* stmt); // nullptr: statement removed entirely
+    Stmt* emptyBlock();
+    Expr* foldExpr(Expr* expr);
+    Expr* foldBinary(BinaryExpr* expr);
+    Expr* makeLiteral(const Value& v, const Token& at);
+    StaticType staticType(Expr* expr) const;
+    void declare(const Token& type, const Token& name);
+};
+
+#endif
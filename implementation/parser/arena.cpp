@@ -0,0 +1,49 @@
+#include "arena.h"
+
+AstArena::AstArena(size_t firstChunkBytes) : nextChunkBytes(firstChunkBytes < 1024 ? 1024 : firstChunkBytes) {}
+
+AstArena::~AstArena() { release(); }
+
+AstArena::AstArena(AstArena&& other) noexcept : nextChunkBytes(other.nextChunkBytes) { *this = std::move(other); }
+
+AstArena& AstArena::operator=(AstArena&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    head = other.head;
+    cursor = other.cursor;
+    limit = other.limit;
+    nextChunkBytes = other.nextChunkBytes;
+    nodes = other.nodes;
+    used = other.used;
+    reserved = other.reserved;
+    other.head = nullptr;
+    other.cursor = other.limit = nullptr;
+    other.nodes = other.used = other.reserved = 0;
+    return *this;
+}
+
+void* AstArena::allocateSlow(size_t size, size_t align) {
+    // chunks double up to 1 MiB; an oversized request gets a chunk of its own
+    size_t want = size + align;
+    size_t bytes = nextChunkBytes > want ? nextChunkBytes : want;
+    if (nextChunkBytes < (size_t(1) << 20)) nextChunkBytes *= 2;
+
+    Chunk* chunk = static_cast<Chunk*>(::operator new(sizeof(Chunk) + bytes));
+    chunk->next = head;
+    chunk->size = bytes;
+    head = chunk;
+    reserved += bytes;
+    cursor = reinterpret_cast<char*>(chunk + 1);
+    limit = cursor + bytes;
+    return allocate(size, align);
+}
+
+// one pass over the chunk list frees the whole tree
+void AstArena::release() {
+    while (head) {
+        Chunk* next = head->next;
+        ::operator delete(head);
+        head = next;
+    }
+    cursor = limit = nullptr;
+}
@@ -0,0 +1,89 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// ---------- AST Arena ----------
+// Bump allocator that owns every AST node of one compilation unit. Nodes are
+// carved out of large chunks back to back (so tree walks touch contiguous
+// memory) and are all released at once when the arena dies; no per-node
+// destructor ever runs, so everything placed here must be trivially destructible.
+class AstArena {
+public:
+    explicit AstArena(size_t firstChunkBytes = 64 * 1024);
+    ~AstArena();
+    AstArena(AstArena&& other) noexcept;
+    AstArena& operator=(AstArena&& other) noexcept;
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    void* allocate(size_t size, size_t align);
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "arena objects are never destroyed individually");
+        nodes++;
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // copy n trivially-copyable items into the arena (used to freeze node lists)
+    template <typename T>
+    T* copyArray(const T* items, size_t n) {
+        static_assert(std::is_trivially_copyable<T>::value, "arena arrays are copied bytewise");
+        if (n == 0) return nullptr;
+        T* out = static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+        for (size_t i = 0; i < n; i++) out[i] = items[i];
+        return out;
+    }
+
+    size_t nodeCount() const { return nodes; }   // objects created with make()
+    size_t bytesUsed() const { return used; }     // bytes handed out
+    size_t bytesReserved() const { return reserved; } // bytes held in chunks
+
+private:
+    struct Chunk {
+        Chunk* next;
+        size_t size; // usable bytes after the header
+    };
+
+    Chunk* head = nullptr;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t nextChunkBytes;
+    size_t nodes = 0;
+    size_t used = 0;
+    size_t reserved = 0;
+
+    void* allocateSlow(size_t size, size_t align);
+    void release();
+};
+
+inline void* AstArena::allocate(size_t size, size_t align) {
+    uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + (align - 1)) & ~uintptr_t(align - 1);
+    if (cursor && p + size <= reinterpret_cast<uintptr_t>(limit)) {
+        cursor = reinterpret_cast<char*>(p + size);
+        used += size;
+        return reinterpret_cast<void*>(p);
+    }
+    return allocateSlow(size, align);
+}
+
+// A list of nodes frozen into the arena (replaces std::vector inside nodes).
+template <typename T>
+struct AstList {
+    T* items = nullptr;
+    uint32_t count = 0;
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) const { return items[i]; }
+};
+
+#endif
@@ -1,47 +1,247 @@
-#include "Parser.h"
+#include "parser.h"
+#include "../profile/trace.h"
+#include <array>
 #include <stdexcept>
 #include <iostream>
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens) {}
+namespace {
+
+constexpr size_t TOKEN_TYPES = size_t(TokenType::ERROR) + 1;
+
+// ---------- Token classes ----------
+// one byte of flags per TokenType, so "is this a type keyword?" is one load
+// instead of a comparison per candidate
+enum : uint8_t {
+    TC_TYPE = 1,      // vacuum mass flux quantum: starts a declaration
+    TC_STATEMENT = 2, // keywords recovery stops in front of
+};
+
+constexpr std::array<uint8_t, TOKEN_TYPES> TOKEN_CLASSES = [] {
+    std::array<uint8_t, TOKEN_TYPES> c{};
+    for (TokenType t : {TokenType::VACUUM, TokenType::MASS, TokenType::FLUX, TokenType::QUANTUM})
+        c[size_t(t)] |= TC_TYPE | TC_STATEMENT;
+    for (TokenType t : {TokenType::PHASE, TokenType::ORBIT, TokenType::ROTATE, TokenType::BLACKHOLE,
+                        TokenType::DARKMATTER, TokenType::WARP})
+        c[size_t(t)] |= TC_STATEMENT;
+    return c;
+}();
+
+// binding power of infix operators, loosest first
+enum Precedence : uint8_t {
+    PREC_NONE,       // not an infix operator
+    PREC_ASSIGNMENT, // = += -= *= /= %=  (right associative)
+    PREC_OR,         // ||
+    PREC_AND,        // &&
+    PREC_BIT_OR,     // |
+    PREC_BIT_XOR,    // ^
+    PREC_BIT_AND,    // &
+    PREC_EQUALITY,   // == !=
+    PREC_COMPARISON, // < <= > >=
+    PREC_TERM,       // + -
+    PREC_FACTOR,     // * / %
+    PREC_UNARY,      // - !  (prefix)
+    PREC_CALL,       // f(...)
+};
+
+} // namespace
+
+std::string Diagnostic::toString(const LineTable& lines) const {
+    SourceLocation at = lines.locate(offset);
+    return "Line " + std::to_string(at.line) + ", col " + std::to_string(at.col) + ": " + message;
+}
+
+std::string Diagnostic::toString() const {
+    return "Byte " + std::to_string(offset) + ": " + message;
+}
+
+Parser::Parser(const std::vector<Token>& tokens, AstArena& arena) : Parser(tokens, 0, arena) {}
+
+Parser::Parser(Scanner& scanner, AstArena& arena) : scanner(&scanner), arena(arena) {
+    window[0] = pull();
+    filled = 1;
+}
+
+Parser::Parser(const std::vector<Token>& tokens, size_t first, AstArena& arena, size_t shiftFrom, uint32_t shift)
+    : tokens(&tokens), tokenPos(first), shiftFrom(shiftFrom), shift(shift), arena(arena) {
+    window[0] = pull();
+    windowIndex[0] = pulledIndex;
+    filled = 1;
+}
+
+// next grammar token from the source; repeats END_OF_FILE once it is reached
+Token Parser::pull() {
+    if (scanner) {
+        Token t;
+        if (scanTimer) scanTimer->begin();
+        do t = scanner->next(); while (t.type == TokenType::NEW_LINE);
+        if (scanTimer) scanTimer->end();
+        return t;
+    }
+    const std::vector<Token>& all = *tokens;
+    while (tokenPos < all.size() && all[tokenPos].type == TokenType::NEW_LINE) tokenPos++;
+    if (tokenPos >= all.size()) { // no END_OF_FILE in the vector: make one just after the last token
+        uint32_t end = all.empty() ? 0 : all.back().offset + uint32_t(all.back().lexeme.size());
+        return Token{TokenType::END_OF_FILE, NumberKind::None, end, {}, {}};
+    }
+    pulledIndex = tokenPos;
+    Token t = all[tokenPos];
+    if (tokenPos >= shiftFrom) t.offset += shift;
+    if (t.type != TokenType::END_OF_FILE) tokenPos++;
+    return t;
+}
 
 bool Parser::isAtEnd() const { return peek().type == TokenType::END_OF_FILE; }
-const Token& Parser::peek() const { return tokens[current]; }
-const Token& Parser::previous() const { return tokens[current - 1]; }
-const Token& Parser::advance() { if (!isAtEnd()) current++; return previous(); }
+const Token& Parser::peek() const { return window[current & (WINDOW - 1)]; }
+const Token& Parser::previous() const { return window[(current - 1) & (WINDOW - 1)]; }
+
+const Token& Parser::peekAhead(int distance) {
+    while (filled <= current + distance) {
+        window[filled & (WINDOW - 1)] = pull();
+        windowIndex[filled & (WINDOW - 1)] = pulledIndex;
+        filled++;
+    }
+    return window[(current + distance) & (WINDOW - 1)];
+}
+
+const Token& Parser::advance() {
+    if (!isAtEnd()) {
+        current++;
+        peekAhead(0);
+    }
+    return previous();
+}
 bool Parser::check(TokenType type) const { return !isAtEnd() && peek().type == type; }
 
-bool Parser::match(std::initializer_list<TokenType> types) {
-    for (auto type : types) if (check(type)) { advance(); return true; }
+bool Parser::match(TokenType type) {
+    if (!check(type)) return false;
+    advance();
+    return true;
+}
+
+bool Parser::matchClass(uint8_t tokenClass) {
+    if (isAtEnd() || !(TOKEN_CLASSES[size_t(peek().type)] & tokenClass)) return false;
+    advance();
+    return true;
+}
+
+bool Parser::consume(TokenType type, const char* message) {
+    if (match(type)) return true;
+    error(message);
     return false;
 }
 
-std::vector<std::unique_ptr<Stmt>> Parser::parseProgram() {
-    std::vector<std::unique_ptr<Stmt>> stmts;
-    while (!isAtEnd()) stmts.push_back(declaration());
-    return stmts;
+// ---------- Errors ----------
+void Parser::report(const Token& at, const std::string& message) {
+    errors.push_back(Diagnostic{message, at.offset});
+}
+
+void Parser::error(const char* message) {
+    if (panicking) return;
+    panicking = true;
+    // an ERROR token says more than whatever the grammar expected: it carries
+    // the scanner's message or is the stray character itself
+    const Token& at = peek();
+    if (at.type != TokenType::ERROR) report(at, message);
+    else if (at.message) report(at, at.message);
+    else report(at, "Unexpected character '" + std::string(at.lexeme) + "'");
+}
+
+void Parser::synchronize(int start) {
+    panicking = false;
+    if (current == start) advance(); // the statement stopped on its first token: step over it
+    while (!isAtEnd()) {
+        if (previous().type == TokenType::SEMICOLON) return;
+        if (peek().type == TokenType::RIGHT_BRACE && blockDepth > 0) return;
+        if (TOKEN_CLASSES[size_t(peek().type)] & TC_STATEMENT) return;
+        advance();
+    }
+}
+
+// move stmtScratch[base..] into the arena as one contiguous list
+StmtList Parser::freezeStatements(size_t base) {
+    StmtList list;
+    list.count = uint32_t(stmtScratch.size() - base);
+    list.items = arena.copyArray(stmtScratch.data() + base, list.count);
+    stmtScratch.resize(base);
+    return list;
+}
+
+ExprList Parser::freezeExpressions(size_t base) {
+    ExprList list;
+    list.count = uint32_t(exprScratch.size() - base);
+    list.items = arena.copyArray(exprScratch.data() + base, list.count);
+    exprScratch.resize(base);
+    return list;
+}
+
+ParseResult Parser::parse() {
+    ParseResult result;
+    size_t base = stmtScratch.size();
+    while (!isAtEnd()) {
+        Stmt* stmt = declaration();
+        stmtScratch.push_back(stmt);
+    }
+    result.program = freezeStatements(base);
+    result.diagnostics = std::move(errors);
+    errors.clear();
+    return result;
 }
 
-std::unique_ptr<Stmt> Parser::declaration() {
-    if (match({TokenType::VACUUM, TokenType::MASS, TokenType::FLUX, TokenType::QUANTUM})) {
+StmtList Parser::parseProgram() {
+    ParseResult result = parse();
+    if (!result.ok()) throw std::runtime_error(result.diagnostics.front().toString());
+    return result.program;
+}
+
+Stmt* Parser::parseDeclaration() {
+    return declaration();
+}
+
+Stmt* Parser::declaration() {
+    int start = current;
+    Stmt* stmt = declarationBody();
+    if (panicking) synchronize(start);
+    return stmt;
+}
+
+Stmt* Parser::declarationBody() {
+    if (matchClass(TC_TYPE)) {
         // ممكن تبقى function أو variable
         Token type = previous();
-        Token name = advance();
+        Token name = check(TokenType::IDENTIFIER) ? advance() : errorName();
 
-        if (match({TokenType::LEFT_PAREN})) {
-            // Function
-            auto func = std::make_unique<FuncDecl>();
+        if (match(TokenType::LEFT_PAREN)) {
+            // Function: typed parameters, `mass f(mass a, flux b) { ... }`
+            auto func = arena.make<FuncDecl>();
             func->returnType = type;
             func->name = name;
-            match({TokenType::RIGHT_PAREN}); // TODO: params later
-            func->body.push_back(block());
+            size_t first = paramScratch.size();
+            if (!check(TokenType::RIGHT_PAREN)) {
+                do {
+                    if (!matchClass(TC_TYPE)) { error("Expected parameter type"); break; }
+                    Param param;
+                    param.type = previous();
+                    if (!check(TokenType::IDENTIFIER)) { error("Expected parameter name"); break; }
+                    param.name = advance();
+                    paramScratch.push_back(param);
+                } while (match(TokenType::COMMA));
+            }
+            consume(TokenType::RIGHT_PAREN, "Expected ')' after parameters");
+            func->params.count = uint32_t(paramScratch.size() - first);
+            func->params.items = arena.copyArray(paramScratch.data() + first, func->params.count);
+            paramScratch.resize(first);
+            size_t base = stmtScratch.size();
+            Stmt* body = block();
+            stmtScratch.push_back(body);
+            func->body = freezeStatements(base);
             return func;
         } else {
             // Variable declaration
-            auto var = std::make_unique<VarDecl>();
+            auto var = arena.make<VarDecl>();
             var->type = type;
             var->name = name;
-            if (match({TokenType::EQUAL})) var->initializer = expression();
-            match({TokenType::SEMICOLON});
+            if (match(TokenType::EQUAL)) var->initializer = expression();
+            match(TokenType::SEMICOLON);
             return var;
         }
     }
@@ -49,185 +249,327 @@ std::unique_ptr<Stmt> Parser::declaration() {
     return statement();
 }
 
-std::unique_ptr<Stmt> Parser::block() {
-    auto block = std::make_unique<BlockStmt>();
-    if (!match({TokenType::LEFT_BRACE})) throw std::runtime_error("Expected '{'");
-    while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) block->statements.push_back(declaration());
-    match({TokenType::RIGHT_BRACE});
+Stmt* Parser::block() {
+    auto block = arena.make<BlockStmt>();
+    if (!consume(TokenType::LEFT_BRACE, "Expected '{'")) return block;
+    size_t base = stmtScratch.size();
+    blockDepth++;
+    while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+        Stmt* stmt = declaration();
+        stmtScratch.push_back(stmt);
+    }
+    blockDepth--;
+    block->statements = freezeStatements(base);
+    match(TokenType::RIGHT_BRACE);
     return block;
 }
 
-// Expressions
-std::unique_ptr<Expr> Parser::expression() {
-    return term();
+// ---------- Expressions ----------
+struct Parser::Rule {
+    Expr* (Parser::*prefix)();         // the token starts an expression
+    Expr* (Parser::*infix)(Expr* left); // the token continues one
+    Precedence precedence;             // of the infix use
+};
+
+const Parser::Rule& Parser::rule(TokenType type) {
+    static constexpr std::array<Rule, TOKEN_TYPES> table = [] {
+        std::array<Rule, TOKEN_TYPES> t{};
+        auto set = [&t](TokenType type, Expr* (Parser::*prefix)(), Expr* (Parser::*infix)(Expr*),
+                        Precedence precedence) { t[size_t(type)] = Rule{prefix, infix, precedence}; };
+        using T = TokenType;
+        set(T::LEFT_PAREN, &Parser::grouping, &Parser::call, PREC_CALL);
+        set(T::MINUS, &Parser::unary, &Parser::binary, PREC_TERM);
+        set(T::PLUS, nullptr, &Parser::binary, PREC_TERM);
+        set(T::STARR, nullptr, &Parser::binary, PREC_FACTOR);
+        set(T::SLASH, nullptr, &Parser::binary, PREC_FACTOR);
+        set(T::PERCENT, nullptr, &Parser::binary, PREC_FACTOR);
+        set(T::BANG, &Parser::unary, nullptr, PREC_NONE);
+        set(T::EQUAL_EQ, nullptr, &Parser::binary, PREC_EQUALITY);
+        set(T::BANG_EQ, nullptr, &Parser::binary, PREC_EQUALITY);
+        set(T::LESS, nullptr, &Parser::binary, PREC_COMPARISON);
+        set(T::LESS_EQ, nullptr, &Parser::binary, PREC_COMPARISON);
+        set(T::GREATER, nullptr, &Parser::binary, PREC_COMPARISON);
+        set(T::GREATER_EQ, nullptr, &Parser::binary, PREC_COMPARISON);
+        set(T::BIT_AND, nullptr, &Parser::binary, PREC_BIT_AND);
+        set(T::XOR, nullptr, &Parser::binary, PREC_BIT_XOR);
+        set(T::BIT_OR, nullptr, &Parser::binary, PREC_BIT_OR);
+        set(T::AND, nullptr, &Parser::logical, PREC_AND);
+        set(T::OR, nullptr, &Parser::logical, PREC_OR);
+        for (T op : {T::EQUAL, T::PLUS_EQ, T::MINUS_EQ, T::STARR_EQ, T::SLASH_EQ, T::PERCENT_EQ})
+            set(op, nullptr, &Parser::assignment, PREC_ASSIGNMENT);
+        for (T lit : {T::NUMBER, T::STAR, T::STARLIGHT, T::VOIDNESS})
+            set(lit, &Parser::literal, nullptr, PREC_NONE);
+        set(T::IDENTIFIER, &Parser::variable, nullptr, PREC_NONE);
+        set(T::SHINE, &Parser::builtinCall, nullptr, PREC_NONE);
+        return t;
+    }();
+    return table[size_t(type)];
 }
 
-std::unique_ptr<Expr> Parser::term() {
-    auto expr = factor();
-    while (match({TokenType::PLUS, TokenType::MINUS})) {
-        Token op = previous();
-        auto right = factor();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+Expr* Parser::expression() {
+    return parsePrecedence(PREC_ASSIGNMENT);
+}
+
+// parse one operand, then keep extending it with operators that bind at
+// least as tightly as minPrecedence
+Expr* Parser::parsePrecedence(int minPrecedence) {
+    auto prefix = rule(peek().type).prefix;
+    if (!prefix) return errorExpression();
+    advance();
+    Expr* left = (this->*prefix)();
+    for (;;) {
+        const Rule& next = rule(peek().type);
+        if (next.precedence < minPrecedence || !next.infix) return left;
+        advance();
+        left = (this->*next.infix)(left);
     }
-    return expr;
 }
 
-std::unique_ptr<Expr> Parser::factor() {
-    auto expr = primary();
-    while (match({TokenType::STARR, TokenType::SLASH})) {
-        Token op = previous();
-        auto right = primary();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op, std::move(right));
+Token Parser::errorName() {
+    error("Expected name after type");
+    // like errorExpression(): the declaration is finished around a nameless
+    // stand-in and the token is left for the rest of the rule and for
+    // synchronize() (it is often the ';' or '}' recovery stops at)
+    return Token{TokenType::ERROR, NumberKind::None, peek().offset, {}, {}};
+}
+
+Expr* Parser::errorExpression() {
+    error("Expected expression");
+    // stand-in so the caller can finish its node; the token is not consumed
+    auto* placeholder = arena.make<LiteralExpr>(LiteralExpr::Type::Bool, peek().offset);
+    placeholder->boolean = false;
+    return placeholder;
+}
+
+Expr* Parser::literal() {
+    const Token& token = previous();
+    LiteralExpr* expr;
+    switch (token.type) {
+        case TokenType::NUMBER:
+            if (token.number == NumberKind::Float) {
+                expr = arena.make<LiteralExpr>(LiteralExpr::Type::Float, token.offset);
+                expr->real = token.real;
+            } else {
+                expr = arena.make<LiteralExpr>(LiteralExpr::Type::Int, token.offset);
+                expr->integer = token.integer;
+            }
+            return expr;
+        case TokenType::STAR:
+            expr = arena.make<LiteralExpr>(LiteralExpr::Type::Str, token.offset);
+            expr->text = token.lexeme;
+            return expr;
+        default: // starlight, voidness
+            expr = arena.make<LiteralExpr>(LiteralExpr::Type::Bool, token.offset);
+            expr->boolean = token.type == TokenType::STARLIGHT;
+            return expr;
     }
-    return expr;
 }
 
+Expr* Parser::variable() { return arena.make<VariableExpr>(previous()); }
 
-std::unique_ptr<Expr> Parser::primary() {
-    if (match({TokenType::NUMBER, TokenType::STAR})) return std::make_unique<LiteralExpr>(previous());
-    throw std::runtime_error("Expected expression");
+Expr* Parser::grouping() {
+    auto expr = expression();
+    consume(TokenType::RIGHT_PAREN, "Expected ')' after expression");
+    return expr;
+}
+
+Expr* Parser::unary() {
+    Token op = previous();
+    auto operand = parsePrecedence(PREC_UNARY);
+    return arena.make<UnaryExpr>(op, operand);
 }
-// --- تأكدي إن الجزء الأعلى من الملف موجود (constructors, peek, advance, match, ...)
 
-std::unique_ptr<Stmt> Parser::statement() {
-    // if / else -> phase / eclipse
-    if (match({TokenType::PHASE})) return ifStatement();
+Expr* Parser::builtinCall() {
+    Token callee = previous();
+    if (!consume(TokenType::LEFT_PAREN, "Expected '(' after 'shine'")) return errorExpression();
+    return finishCall(callee);
+}
 
-    // for -> rotate
-    if (match({TokenType::ROTATE})) return forStatement();
+// left-associative: the right operand binds one level tighter
+Expr* Parser::binary(Expr* left) {
+    Token op = previous();
+    auto right = parsePrecedence(rule(op.type).precedence + 1);
+    return arena.make<BinaryExpr>(left, op, right);
+}
 
-    // while -> orbit
-    if (match({TokenType::ORBIT})) return whileStatement();
+Expr* Parser::logical(Expr* left) {
+    Token op = previous();
+    auto right = parsePrecedence(rule(op.type).precedence + 1);
+    return arena.make<LogicalExpr>(left, op, right);
+}
 
-    // return -> blackHole
-    if (match({TokenType::BLACKHOLE})) return returnStatement();
+// right-associative: a = b += c
+Expr* Parser::assignment(Expr* left) {
+    Token op = previous();
+    auto value = parsePrecedence(PREC_ASSIGNMENT);
+    if (left->kind == ExprKind::Variable)
+        return arena.make<AssignExpr>(static_cast<VariableExpr*>(left)->name, op, value);
+    // the parser is not lost, so no recovery is needed
+    if (!panicking) report(op, "Invalid assignment target");
+    return left;
+}
 
-    // break -> darkMatter
-    if (match({TokenType::DARKMATTER})) return breakStatement();
+Expr* Parser::call(Expr* left) {
+    Token paren = previous();
+    if (left->kind == ExprKind::Variable) return finishCall(static_cast<VariableExpr*>(left)->name);
+    Expr* expr = finishCall(paren);
+    if (!panicking) report(paren, "Only functions can be called, by name");
+    return expr;
+}
 
-    // continue -> warp
-    if (match({TokenType::WARP})) return continueStatement();
+// the '(' is consumed
+Expr* Parser::finishCall(const Token& callee) {
+    auto call = arena.make<CallExpr>();
+    call->callee = callee;
+    size_t base = exprScratch.size();
+    if (!check(TokenType::RIGHT_PAREN)) {
+        do {
+            Expr* arg = expression();
+            exprScratch.push_back(arg);
+        } while (match(TokenType::COMMA));
+    }
+    consume(TokenType::RIGHT_PAREN, "Expected ')' after arguments");
+    call->paren = previous();
+    call->args = freezeExpressions(base);
+    return call;
+}
 
-    // block
-    if (match({TokenType::LEFT_BRACE})) return block();
+// --- تأكدي إن الجزء الأعلى من الملف موجود (constructors, peek, advance, match, ...)
 
-    // expression statement (including shine(...) calls etc.)
-    return expressionStatement();
+Stmt* Parser::statement() {
+    switch (peek().type) {
+        // if / else -> phase / eclipse
+        case TokenType::PHASE: advance(); return ifStatement();
+        // for -> rotate
+        case TokenType::ROTATE: advance(); return forStatement();
+        // while -> orbit
+        case TokenType::ORBIT: advance(); return whileStatement();
+        // return -> blackHole
+        case TokenType::BLACKHOLE: advance(); return returnStatement();
+        // break -> darkMatter
+        case TokenType::DARKMATTER: advance(); return breakStatement();
+        // continue -> warp
+        case TokenType::WARP: advance(); return continueStatement();
+        // block (block() consumes the '{' itself)
+        case TokenType::LEFT_BRACE: return block();
+        // expression statement (including shine(...) calls etc.)
+        default: return expressionStatement();
+    }
 }
 
-std::unique_ptr<Stmt> Parser::ifStatement() {
+Stmt* Parser::ifStatement() {
     // we already consumed PHASE
-    if (!match({TokenType::LEFT_PAREN})) throw std::runtime_error("Expected '(' after 'phase'");
+    consume(TokenType::LEFT_PAREN, "Expected '(' after 'phase'");
     auto condition = expression();
-    if (!match({TokenType::RIGHT_PAREN})) throw std::runtime_error("Expected ')' after condition");
+    consume(TokenType::RIGHT_PAREN, "Expected ')' after condition");
     auto thenBranch = statement();
 
-    std::unique_ptr<Stmt> elseBranch = nullptr;
-    if (match({TokenType::ECLIPSE})) {
+    Stmt* elseBranch = nullptr;
+    if (match(TokenType::ECLIPSE)) {
         elseBranch = statement();
     }
 
-    auto stmt = std::make_unique<IfStmt>();
-    stmt->condition = std::move(condition);
-    stmt->thenBranch = std::move(thenBranch);
-    stmt->elseBranch = std::move(elseBranch);
+    auto stmt = arena.make<IfStmt>();
+    stmt->condition = condition;
+    stmt->thenBranch = thenBranch;
+    stmt->elseBranch = elseBranch;
     return stmt;
 }
 
-std::unique_ptr<Stmt> Parser::whileStatement() {
+Stmt* Parser::whileStatement() {
     // consumed ORBIT
-    if (!match({TokenType::LEFT_PAREN})) throw std::runtime_error("Expected '(' after 'orbit'");
+    consume(TokenType::LEFT_PAREN, "Expected '(' after 'orbit'");
     auto condition = expression();
-    if (!match({TokenType::RIGHT_PAREN})) throw std::runtime_error("Expected ')' after condition");
+    consume(TokenType::RIGHT_PAREN, "Expected ')' after condition");
     auto body = statement();
 
-    auto stmt = std::make_unique<WhileStmt>();
-    stmt->condition = std::move(condition);
-    stmt->body = std::move(body);
+    auto stmt = arena.make<WhileStmt>();
+    stmt->condition = condition;
+    stmt->body = body;
     return stmt;
 }
 
-std::unique_ptr<Stmt> Parser::forStatement() {
+Stmt* Parser::forStatement() {
     // consumed ROTATE
-    if (!match({TokenType::LEFT_PAREN})) throw std::runtime_error("Expected '(' after 'rotate'");
+    consume(TokenType::LEFT_PAREN, "Expected '(' after 'rotate'");
 
     // initializer: could be variable declaration or expression or ';'
-    std::unique_ptr<Stmt> initializer = nullptr;
-    if (!match({TokenType::SEMICOLON})) {
+    Stmt* initializer = nullptr;
+    if (!match(TokenType::SEMICOLON)) {
         // try var decl
-        if (match({TokenType::MASS, TokenType::FLUX, TokenType::QUANTUM, TokenType::VACUUM})) {
+        if (matchClass(TC_TYPE)) {
             // rollback one token? we consumed the type; we need to let varDeclaration handle it.
             // simpler: construct varDeclaration manually
             Token type = previous();
-            Token name = advance();
-            auto var = std::make_unique<VarDecl>();
+            Token name = check(TokenType::IDENTIFIER) ? advance() : errorName();
+            auto var = arena.make<VarDecl>();
             var->type = type;
             var->name = name;
-            if (match({TokenType::EQUAL})) var->initializer = expression();
-            if (!match({TokenType::SEMICOLON})) throw std::runtime_error("Expected ';' after for initializer");
-            initializer = std::move(var);
+            if (match(TokenType::EQUAL)) var->initializer = expression();
+            consume(TokenType::SEMICOLON, "Expected ';' after for initializer");
+            initializer = var;
         } else {
             // expression statement as initializer
             // parse expression then require semicolon
             auto expr = expression();
-            if (!match({TokenType::SEMICOLON})) throw std::runtime_error("Expected ';' after for initializer");
-            initializer = std::make_unique<ExprStmt>(std::move(expr));
+            consume(TokenType::SEMICOLON, "Expected ';' after for initializer");
+            initializer = arena.make<ExprStmt>(expr);
         }
     }
 
     // condition
-    std::unique_ptr<Expr> condition = nullptr;
+    Expr* condition = nullptr;
     if (!check(TokenType::SEMICOLON)) {
         condition = expression();
     }
-    if (!match({TokenType::SEMICOLON})) throw std::runtime_error("Expected ';' after loop condition");
+    consume(TokenType::SEMICOLON, "Expected ';' after loop condition");
 
     // increment
-    std::unique_ptr<Expr> increment = nullptr;
+    Expr* increment = nullptr;
     if (!check(TokenType::RIGHT_PAREN)) {
         increment = expression();
     }
-    if (!match({TokenType::RIGHT_PAREN})) throw std::runtime_error("Expected ')' after for clauses");
+    consume(TokenType::RIGHT_PAREN, "Expected ')' after for clauses");
 
     // body
     auto body = statement();
 
-    auto stmt = std::make_unique<ForStmt>();
-    stmt->initializer = std::move(initializer);
-    stmt->condition = std::move(condition);
-    stmt->increment = std::move(increment);
-    stmt->body = std::move(body);
+    auto stmt = arena.make<ForStmt>();
+    stmt->initializer = initializer;
+    stmt->condition = condition;
+    stmt->increment = increment;
+    stmt->body = body;
     return stmt;
 }
 
-std::unique_ptr<Stmt> Parser::returnStatement() {
+Stmt* Parser::returnStatement() {
     // consumed BLACKHOLE
-    std::unique_ptr<Expr> value = nullptr;
+    Expr* value = nullptr;
     if (!check(TokenType::SEMICOLON)) {
         value = expression();
     }
-    if (!match({TokenType::SEMICOLON})) throw std::runtime_error("Expected ';' after return");
-    auto stmt = std::make_unique<ReturnStmt>();
-    stmt->value = std::move(value);
+    consume(TokenType::SEMICOLON, "Expected ';' after return");
+    auto stmt = arena.make<ReturnStmt>();
+    stmt->value = value;
     return stmt;
 }
 
-std::unique_ptr<Stmt> Parser::breakStatement() {
+Stmt* Parser::breakStatement() {
     // consumed DARKMATTER
-    if (!match({TokenType::SEMICOLON})) throw std::runtime_error("Expected ';' after break");
-    return std::make_unique<BreakStmt>();
+    consume(TokenType::SEMICOLON, "Expected ';' after break");
+    return arena.make<BreakStmt>();
 }
 
-std::unique_ptr<Stmt> Parser::continueStatement() {
+Stmt* Parser::continueStatement() {
     // consumed WARP
-    if (!match({TokenType::SEMICOLON})) throw std::runtime_error("Expected ';' after continue");
-    return std::make_unique<ContinueStmt>();
+    consume(TokenType::SEMICOLON, "Expected ';' after continue");
+    return arena.make<ContinueStmt>();
 }
 
-std::unique_ptr<Stmt> Parser::expressionStatement() {
+Stmt* Parser::expressionStatement() {
     auto expr = expression();
-    if (!match({TokenType::SEMICOLON})) throw std::runtime_error("Expected ';' after expression");
-    return std::make_unique<ExprStmt>(std::move(expr));
+    consume(TokenType::SEMICOLON, "Expected ';' after expression");
+    return arena.make<ExprStmt>(expr);
 }
 
 
@@ -1,130 +1,321 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include "../Scanner/Scanner.h"
-#include <memory>
+#include "../scanner/scanner.h"
+#include "arena.h"
+#include <cstdint>
 #include <vector>
 #include <string>
 
+namespace profile { class Accumulator; }
+
 // ---------- AST Nodes ----------
+// Nodes live in an AstArena owned by the compilation unit; the Stmt* / Expr*
+// handles the parser returns stay valid exactly as long as that arena. Nodes
+// carry a kind tag instead of a vtable and are never destroyed one by one.
+enum class StmtKind : uint8_t {
+    VarDecl, FuncDecl, Block, Expression, If, While, For, Return, Break, Continue
+};
+
+enum class ExprKind : uint8_t {
+    Binary, Literal, Variable, Assign, Unary, Logical, Call
+};
+
 struct Stmt {
-    virtual ~Stmt() = default;
+    StmtKind kind;
+    explicit Stmt(StmtKind k) : kind(k) {}
 };
 
 struct Expr {
-    virtual ~Expr() = default;
+    ExprKind kind;
+    explicit Expr(ExprKind k) : kind(k) {}
+};
+
+using StmtList = AstList<Stmt*>;
+using ExprList = AstList<Expr*>;
+
+// where a variable lives, filled in by the Resolver: `slot` in the frame
+// `depth` function levels out from the code that names it (0: the frame of
+// the function or script the reference is in, 1: the script's frame seen
+// from inside a function)
+struct VarSlot {
+    static constexpr uint16_t UNRESOLVED = UINT16_MAX;
+    uint16_t depth = UNRESOLVED;
+    uint32_t slot = 0;
 };
 
 struct VarDecl : Stmt {
     Token type;
     Token name;
-    std::unique_ptr<Expr> initializer;
+    Expr* initializer = nullptr;
+    uint32_t slot = 0; // in the enclosing function's (or the script's) frame; set by the Resolver
+    VarDecl() : Stmt(StmtKind::VarDecl) {}
+};
+
+struct Param {
+    Token type;
+    Token name;
 };
 
 struct FuncDecl : Stmt {
     Token returnType;
     Token name;
-    std::vector<Token> params;
-    std::vector<std::unique_ptr<Stmt>> body;
+    AstList<Param> params; // frame slots 0..n-1
+    StmtList body;
+    uint32_t frameSize = 0; // slots for the parameters and every local; set by the Resolver
+    FuncDecl() : Stmt(StmtKind::FuncDecl) {}
 };
 
 struct BlockStmt : Stmt {
-    std::vector<std::unique_ptr<Stmt>> statements;
+    StmtList statements;
+    // slots the block and the blocks inside it need on top of those in use
+    // when it starts; they are free again when it ends. Set by the Resolver
+    uint32_t frameSize = 0;
+    BlockStmt() : Stmt(StmtKind::Block) {}
 };
 
 struct ExprStmt : Stmt {
-    std::unique_ptr<Expr> expression;
-    ExprStmt(std::unique_ptr<Expr> expr) : expression(std::move(expr)) {}
+    Expr* expression;
+    ExprStmt(Expr* expr) : Stmt(StmtKind::Expression), expression(expr) {}
 };
 
 struct IfStmt : Stmt {
-    std::unique_ptr<Expr> condition;
-    std::unique_ptr<Stmt> thenBranch;
-    std::unique_ptr<Stmt> elseBranch; // nullable
+    Expr* condition = nullptr;
+    Stmt* thenBranch = nullptr;
+    Stmt* elseBranch = nullptr; // nullable
+    IfStmt() : Stmt(StmtKind::If) {}
 };
 
 struct WhileStmt : Stmt {
-    std::unique_ptr<Expr> condition;
-    std::unique_ptr<Stmt> body;
+    Expr* condition = nullptr;
+    Stmt* body = nullptr;
+    WhileStmt() : Stmt(StmtKind::While) {}
 };
 
 struct ForStmt : Stmt {
     // we'll keep these simple: optional init (as Stmt), condition (Expr), increment (Expr), body (Stmt)
-    std::unique_ptr<Stmt> initializer; // usually VarDecl or ExprStmt
-    std::unique_ptr<Expr> condition;
-    std::unique_ptr<Expr> increment;
-    std::unique_ptr<Stmt> body;
+    Stmt* initializer = nullptr; // usually VarDecl or ExprStmt
+    Expr* condition = nullptr;
+    Expr* increment = nullptr;
+    Stmt* body = nullptr;
+    ForStmt() : Stmt(StmtKind::For) {}
 };
 
 struct ReturnStmt : Stmt {
-    std::unique_ptr<Expr> value; // nullable
+    Expr* value = nullptr; // nullable
+    ReturnStmt() : Stmt(StmtKind::Return) {}
 };
 
-struct BreakStmt : Stmt {};
-struct ContinueStmt : Stmt {};
+struct BreakStmt : Stmt { BreakStmt() : Stmt(StmtKind::Break) {} };
+struct ContinueStmt : Stmt { ContinueStmt() : Stmt(StmtKind::Continue) {} };
 
 struct BinaryExpr : Expr {
-    std::unique_ptr<Expr> left;
+    Expr* left;
     Token op;
-    std::unique_ptr<Expr> right;
-    BinaryExpr(std::unique_ptr<Expr> l, Token o, std::unique_ptr<Expr> r)
-        : left(std::move(l)), op(o), right(std::move(r)) {}
+    Expr* right;
+    BinaryExpr(Expr* l, Token o, Expr* r)
+        : Expr(ExprKind::Binary), left(l), op(o), right(r) {}
 };
 
+// a constant, already decoded: numbers by the scanner, starlight/voidness by
+// the parser, results by the constant folder. Nothing downstream looks at
+// literal text again
 struct LiteralExpr : Expr {
-    Token value;
-    LiteralExpr(Token v) : value(v) {}
+    enum class Type : uint8_t { Bool, Int, Float, Str };
+
+    Type type;
+    uint32_t offset; // byte offset of the literal in the source
+    union {
+        bool boolean;
+        int64_t integer;
+        double real;
+    };
+    std::string_view text; // Str only: the contents, a slice of the source like Token::lexeme
+
+    LiteralExpr(Type t, uint32_t at) : Expr(ExprKind::Literal), type(t), offset(at), integer(0) {}
 };
 
 struct VariableExpr : Expr {
     Token name;
-    VariableExpr(Token n) : name(n) {}
+    VarSlot var;
+    VariableExpr(Token n) : Expr(ExprKind::Variable), name(n) {}
 };
 
+// `name = value`, or a compound `name op= value` (op is PLUS_EQ, ...; EQUAL
+// for plain assignment)
 struct AssignExpr : Expr {
     Token name;
-    std::unique_ptr<Expr> value;
-    AssignExpr(Token n, std::unique_ptr<Expr> v) : name(n), value(std::move(v)) {}
+    Token op;
+    Expr* value;
+    VarSlot var;
+    AssignExpr(Token n, Token o, Expr* v) : Expr(ExprKind::Assign), name(n), op(o), value(v) {}
+};
+
+struct UnaryExpr : Expr {
+    Token op; // MINUS or BANG
+    Expr* operand;
+    UnaryExpr(Token o, Expr* e) : Expr(ExprKind::Unary), op(o), operand(e) {}
+};
+
+// && and ||: short-circuit, the result is a truth value
+struct LogicalExpr : Expr {
+    Expr* left;
+    Token op;
+    Expr* right;
+    LogicalExpr(Expr* l, Token o, Expr* r)
+        : Expr(ExprKind::Logical), left(l), op(o), right(r) {}
+};
+
+// calls are by name only; `shine` is the built-in print
+struct CallExpr : Expr {
+    Token callee; // IDENTIFIER or SHINE
+    Token paren;  // the closing ')', for error lines
+    ExprList args;
+    // index of the callee among the program's functions in declaration
+    // order (Resolution::functions); NO_FUNCTION for shine. Set by the Resolver
+    static constexpr uint32_t NO_FUNCTION = UINT32_MAX;
+    uint32_t function = NO_FUNCTION;
+    CallExpr() : Expr(ExprKind::Call) {}
+};
+
+// ---------- Diagnostics ----------
+// A syntax error at the start of a token. Only the byte offset is kept; the
+// line and column are looked up when the error is printed.
+struct Diagnostic {
+    std::string message;
+    uint32_t offset = 0;
+    std::string toString(const LineTable& lines) const; // "Line 3, col 7: Expected ';' after expression"
+    std::string toString() const;                        // "Byte 41: ...", without the source at hand
+    bool operator==(const Diagnostic& other) const {
+        return message == other.message && offset == other.offset;
+    }
+};
+
+// The program and every syntax error found on the way. With errors the tree
+// is only good for looking at: broken expressions are stood in for by literals
+// and it must not be folded, compiled or run.
+struct ParseResult {
+    StmtList program;
+    std::vector<Diagnostic> diagnostics;
+    bool ok() const { return diagnostics.empty(); }
 };
 
 // ---------- Parser Class ----------
+// Expressions are parsed by precedence climbing (Pratt) over a static table
+// indexed by TokenType: one loop handles every binary operator level, the
+// table says how a token starts an expression and how it continues one.
+// Tokens reach the parser through a small ring buffer, either copied from a
+// materialized token vector or pulled on demand from a Scanner. In streaming
+// mode the parser's token memory is bounded by the window, whatever the file
+// size. NEW_LINE tokens are not part of the grammar and are dropped on the way in.
+// Syntax errors never throw: each one is recorded, the parser skips to the
+// next statement boundary (after a ';', before a '}' that closes a block, or
+// before a keyword that starts a statement or declaration) and carries on,
+// so one pass reports every error. Errors found while skipping are not
+// reported; they are almost always echoes of the first.
 class Parser {
 public:
-    explicit Parser(const std::vector<Token>& tokens);
-    std::vector<std::unique_ptr<Stmt>> parseProgram();
+    Parser(const std::vector<Token>& tokens, AstArena& arena);
+    Parser(Scanner& scanner, AstArena& arena); // streaming: pulls tokens as it goes
+    // start at tokens[first] instead of the beginning (incremental reparsing);
+    // tokens from shiftFrom on are taken to start `shift` bytes further on
+    // than their offset says (unsigned: wraps around for a negative shift)
+    Parser(const std::vector<Token>& tokens, size_t first, AstArena& arena, size_t shiftFrom = size_t(-1),
+           uint32_t shift = 0);
+    ParseResult parse();
+    // for callers that want the first error as an exception
+    // (throws std::runtime_error with Diagnostic::toString(), i.e. a byte offset)
+    StmtList parseProgram();
+
+    // one top-level declaration at a time, for callers that stitch programs
+    // together themselves (see IncrementalDocument)
+    Stmt* parseDeclaration();
+    bool isAtEnd() const;
+    const std::vector<Diagnostic>& diagnostics() const { return errors; }
+    // streaming mode: time the scanner's share of the parse (see profile::Accumulator)
+    void timeScanning(profile::Accumulator* timer) { scanTimer = timer; }
+    // token-vector mode only: index of the current token, and the highest
+    // index the parser has looked at so far (its lookahead horizon)
+    size_t tokenIndex() const { return windowIndex[current & (WINDOW - 1)]; }
+    size_t lookaheadIndex() const { return pulledIndex; }
 
 private:
-    const std::vector<Token>& tokens;
-    int current = 0;
+    static constexpr int WINDOW = 4; // previous + current + lookahead; power of two
 
-    bool isAtEnd() const;
+    const std::vector<Token>* tokens = nullptr;
+    size_t tokenPos = 0; // next index to read from tokens
+    size_t pulledIndex = 0; // index of the token pull() returned last
+    size_t shiftFrom = size_t(-1);
+    uint32_t shift = 0;
+    size_t windowIndex[WINDOW] = {};
+    Scanner* scanner = nullptr;
+    profile::Accumulator* scanTimer = nullptr;
+    Token window[WINDOW];
+    int current = 0; // grammar tokens consumed so far
+    int filled = 0;  // grammar tokens pulled into the window so far
+
+    AstArena& arena;
+    std::vector<Stmt*> stmtScratch; // lists under construction, frozen into the arena when done
+    std::vector<Expr*> exprScratch;
+    std::vector<Param> paramScratch;
+    std::vector<Diagnostic> errors;
+    bool panicking = false; // after an error, until the next statement boundary
+    int blockDepth = 0;     // a '}' only ends the skipping inside a block
+
+    StmtList freezeStatements(size_t base);
+    ExprList freezeExpressions(size_t base);
+
+    Token pull();
     const Token& peek() const;
+    const Token& peekAhead(int distance); // 0 == peek(); distance < WINDOW - 1
     const Token& previous() const;
     const Token& advance();
-    bool match(std::initializer_list<TokenType> types);
+    bool match(TokenType type);
+    bool matchClass(uint8_t tokenClass); // any token of a class (see parser.cpp)
     bool check(TokenType type) const;
+    bool consume(TokenType type, const char* message); // false (and an error) if missing
+
+    // Errors
+    void error(const char* message); // at peek(); silent while panicking
+    void report(const Token& at, const std::string& message);
+    void synchronize(int start); // start: value of current when the statement began
 
     // Parsing
-    std::unique_ptr<Stmt> declaration();
-    std::unique_ptr<Stmt> function();
-    std::unique_ptr<Stmt> varDeclaration();
-    std::unique_ptr<Stmt> statement();
-    std::unique_ptr<Stmt> block();
+    Stmt* declaration(); // one declaration, then recovery if it had an error
+    Stmt* declarationBody();
+    Stmt* function();
+    Stmt* varDeclaration();
+    Stmt* statement();
+    Stmt* block();
 
     // specific statements
-    std::unique_ptr<Stmt> ifStatement();
-    std::unique_ptr<Stmt> whileStatement();
-    std::unique_ptr<Stmt> forStatement();
-    std::unique_ptr<Stmt> returnStatement();
-    std::unique_ptr<Stmt> breakStatement();
-    std::unique_ptr<Stmt> continueStatement();
-    std::unique_ptr<Stmt> expressionStatement();
+    Stmt* ifStatement();
+    Stmt* whileStatement();
+    Stmt* forStatement();
+    Stmt* returnStatement();
+    Stmt* breakStatement();
+    Stmt* continueStatement();
+    Stmt* expressionStatement();
 
     // Expressions
-    std::unique_ptr<Expr> expression();
-    std::unique_ptr<Expr> term();
-    std::unique_ptr<Expr> factor();
-    std::unique_ptr<Expr> primary();
+    struct Rule;
+    static const Rule& rule(TokenType type);
+    Expr* expression();
+    Expr* parsePrecedence(int minPrecedence);
+    Expr* errorExpression(); // stand-in after "Expected expression"
+    Token errorName(); // stand-in after "Expected name after type"
+    // prefix rules (the token is already consumed)
+    Expr* literal();
+    Expr* variable();
+    Expr* grouping();
+    Expr* unary();
+    Expr* builtinCall();
+    // infix rules (the operator is already consumed)
+    Expr* binary(Expr* left);
+    Expr* logical(Expr* left);
+    Expr* assignment(Expr* left);
+    Expr* call(Expr* left);
+    Expr* finishCall(const Token& callee);
 };
 
 #endif
@@ -0,0 +1,132 @@
+#include "memory.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#include <cstdio>
+#include <cstring>
+#endif
+#ifdef _WIN32
+#include <malloc.h> // _aligned_malloc
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+thread_local memory::AllocCounters counters; // trivially constructible: safe inside operator new
+} // namespace
+
+memory::AllocCounters memory::threadCounters() { return counters; }
+
+size_t memory::peakRssBytes() {
+#ifdef __linux__
+    // VmHWM honours resetPeakRss(); ru_maxrss does not
+    if (std::FILE* f = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        size_t kb = 0;
+        while (std::fgets(line, sizeof line, f))
+            if (std::strncmp(line, "VmHWM:", 6) == 0) {
+                kb = std::strtoull(line + 6, nullptr, 10);
+                break;
+            }
+        std::fclose(f);
+        if (kb) return kb * 1024;
+    }
+#endif
+#ifndef _WIN32
+    struct rusage usage {};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return size_t(usage.ru_maxrss); // bytes on macOS
+#else
+        return size_t(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return 0;
+}
+
+bool memory::resetPeakRss() {
+#ifdef __linux__
+    if (std::FILE* f = std::fopen("/proc/self/clear_refs", "w")) {
+        bool ok = std::fputs("5", f) >= 0;
+        return std::fclose(f) == 0 && ok;
+    }
+#endif
+    return false;
+}
+
+// ---------- counting global allocator ----------
+// every form is replaced, not just the ones the others fall through to, so
+// each new is paired with the matching delete and all of them are counted
+
+namespace {
+
+void* allocate(std::size_t size) noexcept {
+    counters.allocations++;
+    counters.bytes += size;
+    return std::malloc(size ? size : 1);
+}
+
+void* allocateAligned(std::size_t size, std::align_val_t align) noexcept {
+    counters.allocations++;
+    counters.bytes += size;
+    std::size_t alignment = std::max(std::size_t(align), sizeof(void*));
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, alignment);
+#else
+    void* p = nullptr;
+    return posix_memalign(&p, alignment, size ? size : 1) == 0 ? p : nullptr;
+#endif
+}
+
+void releaseAligned(void* p) noexcept {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    if (void* p = allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+    if (void* p = allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    if (void* p = allocateAligned(size, align)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t align) {
+    if (void* p = allocateAligned(size, align)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return allocateAligned(size, align);
+}
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return allocateAligned(size, align);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept { releaseAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { releaseAligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { releaseAligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { releaseAligned(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { releaseAligned(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { releaseAligned(p); }
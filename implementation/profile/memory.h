@@ -0,0 +1,29 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+
+// ---------- Memory accounting ----------
+// The global operator new/delete are replaced (memory.cpp) to count heap
+// allocations. Counters are per thread, so they cost one thread-local
+// increment per allocation and a phase measured on one thread is not
+// disturbed by the others; take a snapshot before and after and subtract.
+namespace memory {
+
+struct AllocCounters {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0; // requested bytes, frees are not subtracted
+};
+
+AllocCounters threadCounters();
+
+// process peak resident set size in bytes (0 where unsupported)
+size_t peakRssBytes();
+// best effort: restart peak RSS tracking from the current RSS (Linux
+// /proc/self/clear_refs); false when the platform does not allow it
+bool resetPeakRss();
+
+} // namespace memory
+
+#endif
@@ -0,0 +1,202 @@
+#include "trace.h"
+#include "memory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Event {
+    const char* name;
+    std::string detail;
+    uint64_t start; // ns since enable()
+    uint64_t duration;
+    uint64_t allocations;
+    uint64_t allocBytes;
+    uint64_t tokens;
+    uint64_t nodes;
+};
+
+struct ThreadLog {
+    uint32_t tid;
+    std::vector<Event> events;
+};
+
+Clock::time_point epoch;
+std::mutex registryLock;
+std::vector<std::unique_ptr<ThreadLog>> registry;
+thread_local ThreadLog* threadLog = nullptr;
+
+uint64_t now() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count());
+}
+
+ThreadLog& log() {
+    if (!threadLog) {
+        std::lock_guard<std::mutex> guard(registryLock);
+        registry.push_back(std::make_unique<ThreadLog>());
+        registry.back()->tid = uint32_t(registry.size());
+        threadLog = registry.back().get();
+    }
+    return *threadLog;
+}
+
+void jsonString(std::ostream& out, std::string_view text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof buf, "\\u%04x", c);
+            out << buf;
+        } else out << c;
+    }
+    out << '"';
+}
+
+} // namespace
+
+namespace profile {
+
+bool enabled = false;
+
+void enable() {
+    epoch = Clock::now();
+    enabled = true;
+}
+
+Phase::Phase(const char* phaseName, std::string_view phaseDetail) : name(phaseName), active(enabled) {
+    if (!active) return;
+    detail = phaseDetail;
+    memory::AllocCounters c = memory::threadCounters();
+    allocations = c.allocations;
+    allocBytes = c.bytes;
+    start = now();
+}
+
+Phase::~Phase() {
+    if (!active) return;
+    uint64_t end = now();
+    memory::AllocCounters c = memory::threadCounters();
+    log().events.push_back(Event{name, std::move(detail), start, end - start, c.allocations - allocations,
+                                 c.bytes - allocBytes, tokenCount, nodeCount});
+}
+
+Accumulator::Accumulator(const char* accumulatorName) : name(accumulatorName), active(enabled) {
+    if (!active) return;
+    // what one timed interval costs with nothing in it, taken off every sample
+    overhead = UINT64_MAX;
+    for (int i = 0; i < 64; i++) {
+        uint64_t a = now();
+        overhead = std::min(overhead, now() - a);
+    }
+}
+
+void Accumulator::beginInterval() {
+    memory::AllocCounters c = memory::threadCounters();
+    markAllocations = c.allocations;
+    markBytes = c.bytes;
+    if ((intervals & (SAMPLE - 1)) == 0) {
+        mark = now();
+        if (intervals == 0) first = mark;
+    }
+}
+
+void Accumulator::endInterval() {
+    if ((intervals & (SAMPLE - 1)) == 0) {
+        uint64_t d = now() - mark;
+        sampledDuration += d > overhead ? d - overhead : 0;
+        sampled++;
+    }
+    intervals++;
+    memory::AllocCounters c = memory::threadCounters();
+    allocations += c.allocations - markAllocations;
+    allocBytes += c.bytes - markBytes;
+}
+
+Accumulator::~Accumulator() {
+    if (!active || intervals == 0) return;
+    uint64_t duration = uint64_t(double(sampledDuration) * double(intervals) / double(sampled));
+    log().events.push_back(Event{name, {}, first, duration, allocations, allocBytes, tokenCount, 0});
+}
+
+void writeSummary(std::ostream& out) {
+    struct Total {
+        const char* name;
+        uint64_t calls = 0, ns = 0, allocations = 0, allocBytes = 0, tokens = 0, nodes = 0;
+        uint64_t first = UINT64_MAX;
+    };
+    std::vector<Total> totals;
+    for (const auto& thread : registry)
+        for (const Event& e : thread->events) {
+            auto it = std::find_if(totals.begin(), totals.end(),
+                                   [&](const Total& t) { return std::string_view(t.name) == e.name; });
+            if (it == totals.end()) it = totals.insert(totals.end(), Total{e.name});
+            it->calls++, it->ns += e.duration, it->allocations += e.allocations;
+            it->allocBytes += e.allocBytes, it->tokens += e.tokens, it->nodes += e.nodes;
+            it->first = std::min(it->first, e.start);
+        }
+    std::sort(totals.begin(), totals.end(), [](const Total& a, const Total& b) { return a.first < b.first; });
+
+    char line[256];
+    std::snprintf(line, sizeof line, "%-12s %8s %12s %10s %12s %12s %12s %10s\n", "phase", "calls", "total ms",
+                  "mean ms", "tokens", "nodes", "allocs", "alloc MB");
+    out << line;
+    for (const Total& t : totals) {
+        std::snprintf(line, sizeof line, "%-12s %8llu %12.3f %10.4f %12llu %12llu %12llu %10.2f\n", t.name,
+                      (unsigned long long)t.calls, t.ns / 1e6, t.ns / 1e6 / double(t.calls),
+                      (unsigned long long)t.tokens, (unsigned long long)t.nodes,
+                      (unsigned long long)t.allocations, t.allocBytes / 1e6);
+        out << line;
+    }
+    std::snprintf(line, sizeof line, "wall %.3f ms on %zu thread(s), peak RSS %.1f MB\n", now() / 1e6,
+                  registry.size(), memory::peakRssBytes() / 1e6);
+    out << line;
+}
+
+bool writeTrace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    char buf[256];
+    for (const auto& thread : registry) {
+        std::snprintf(buf, sizeof buf,
+                      "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                      "\"args\": {\"name\": \"thread %u\"}}",
+                      first ? "" : ",\n", thread->tid, thread->tid);
+        out << buf;
+        first = false;
+        for (const Event& e : thread->events) {
+            out << ",\n{\"name\": ";
+            jsonString(out, e.name);
+            std::snprintf(buf, sizeof buf,
+                          ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": {"
+                          "\"allocations\": %llu, \"alloc_bytes\": %llu",
+                          thread->tid, e.start / 1e3, e.duration / 1e3, (unsigned long long)e.allocations,
+                          (unsigned long long)e.allocBytes);
+            out << buf;
+            if (e.tokens) out << ", \"tokens\": " << e.tokens;
+            if (e.nodes) out << ", \"nodes\": " << e.nodes;
+            if (!e.detail.empty()) {
+                out << ", \"detail\": ";
+                jsonString(out, e.detail);
+            }
+            out << "}}";
+        }
+    }
+    std::snprintf(buf, sizeof buf,
+                  ",\n{\"name\": \"peak RSS\", \"ph\": \"C\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, "
+                  "\"args\": {\"MB\": %.1f}}",
+                  now() / 1e3, memory::peakRssBytes() / 1e6);
+    out << buf << "\n]}\n";
+    return bool(out);
+}
+
+} // namespace profile
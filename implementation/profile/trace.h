@@ -0,0 +1,84 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// ---------- Phase timing and tracing ----------
+// Scoped timers around the compiler's phases, for --time-phases and
+// --trace. A Phase records its wall time, the heap allocations made on its
+// thread while it ran, and whatever token / node counts the caller reports.
+// Events go to a per-thread log (no locking on the hot path) and are merged
+// when the summary or trace is written, after the worker threads are done.
+// Disabled, a Phase is one test of a global flag.
+namespace profile {
+
+extern bool enabled; // set by enable(), before any worker thread starts
+
+void enable();
+
+class Phase {
+public:
+    explicit Phase(const char* name, std::string_view detail = {});
+    ~Phase();
+    Phase(const Phase&) = delete;
+    Phase& operator=(const Phase&) = delete;
+
+    void tokens(uint64_t n) { tokenCount = n; }
+    void nodes(uint64_t n) { nodeCount = n; }
+
+private:
+    const char* name;
+    std::string detail;
+    uint64_t start = 0;
+    uint64_t allocations = 0;
+    uint64_t allocBytes = 0;
+    uint64_t tokenCount = 0;
+    uint64_t nodeCount = 0;
+    bool active;
+};
+
+// Many short intervals inside an enclosing Phase, recorded as one event: the
+// scanner's share of a streaming parse, where tokens are pulled one at a
+// time. Reading the clock around every interval would cost about as much as
+// the work measured, so only one interval in SAMPLE is timed (less the cost
+// of the clock itself) and the total is scaled up; allocations are counted in every interval. The event starts
+// where the first interval did, so it nests inside the enclosing phase in a
+// trace. Disabled, begin() and end() are one test of a flag each.
+class Accumulator {
+public:
+    static constexpr uint64_t SAMPLE = 16; // power of two
+
+    explicit Accumulator(const char* name);
+    ~Accumulator();
+    Accumulator(const Accumulator&) = delete;
+    Accumulator& operator=(const Accumulator&) = delete;
+
+    void begin() { if (active) beginInterval(); }
+    void end() { if (active) endInterval(); }
+    void tokens(uint64_t n) { tokenCount = n; }
+
+private:
+    const char* name;
+    uint64_t intervals = 0, sampled = 0;
+    uint64_t first = 0;
+    uint64_t overhead = 0; // ns, of reading the clock twice
+    uint64_t mark = 0, markAllocations = 0, markBytes = 0;
+    uint64_t sampledDuration = 0, allocations = 0, allocBytes = 0;
+    uint64_t tokenCount = 0;
+    bool active;
+
+    void beginInterval();
+    void endInterval();
+};
+
+// per-phase totals, wall time and peak memory
+void writeSummary(std::ostream& out);
+// Chrome trace-event JSON (chrome://tracing, Perfetto); one track per thread
+bool writeTrace(const std::string& path);
+
+} // namespace profile
+
+#endif
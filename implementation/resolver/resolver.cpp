@@ -0,0 +1,221 @@
+#include "resolver.h"
+#include <algorithm>
+#include <string>
+
+namespace {
+
+std::string quoted(const Token& name) { return "'" + std::string(name.lexeme) + "'"; }
+
+} // namespace
+
+Resolution Resolver::resolve(const StmtList& program) {
+    result = Resolution();
+    locals.clear();
+    functionIndex.clear();
+    scopeDepth = function = 0;
+    nextSlot = highWater = 0;
+
+    // functions are visible everywhere, including before their declaration
+    for (Stmt* stmt : program) {
+        if (stmt->kind != StmtKind::FuncDecl) continue;
+        auto* decl = static_cast<FuncDecl*>(stmt);
+        if (functionIndex.find(decl->name.symbol())) {
+            error(decl->name, "function " + quoted(decl->name) + " already declared");
+            continue;
+        }
+        functionIndex.set(decl->name.symbol(), uint32_t(result.functions.size()));
+        result.functions.push_back(decl);
+    }
+    for (Stmt* stmt : program) statement(stmt);
+    endScope(0, 0);
+    result.frameSize = highWater;
+    std::stable_sort(result.warnings.begin(), result.warnings.end(),
+                     [](const Diagnostic& a, const Diagnostic& b) { return a.offset < b.offset; });
+    return std::move(result);
+}
+
+void Resolver::error(const Token& at, const std::string& message) {
+    result.errors.push_back({message, at.offset});
+}
+
+void Resolver::warning(const Token& at, const std::string& message) {
+    result.warnings.push_back({message, at.offset});
+}
+
+// ---------- scopes ----------
+void Resolver::declare(const Token& name, bool parameter, uint32_t& slot) {
+    if (const Local* same = locals.find(name.symbol())) {
+        if (same->depth == scopeDepth && same->function == function)
+            error(name, "variable " + quoted(name) + " already declared in this scope");
+        else
+            warning(name, (parameter ? "parameter " : "variable ") + quoted(name) + " shadows an outer variable");
+    }
+    slot = nextSlot++;
+    highWater = std::max(highWater, nextSlot);
+    locals.push({name.symbol(), slot, scopeDepth, function, parameter, false, name});
+}
+
+void Resolver::bind(const Token& name, VarSlot& var, bool read) {
+    Local* local = locals.find(name.symbol());
+    if (!local) {
+        error(name, "undefined variable " + quoted(name));
+        return;
+    }
+    var.depth = uint16_t(function - local->function);
+    var.slot = local->slot;
+    if (read) local->read = true;
+}
+
+void Resolver::beginScope() { scopeDepth++; }
+
+// drop the scope's variables (warning about the ones nothing read) and give
+// their slots back
+void Resolver::endScope(size_t mark, uint32_t firstSlot) {
+    while (locals.size() > mark) {
+        const Local& local = locals.back();
+        if (!local.read)
+            warning(local.token, (local.parameter ? "parameter " : "variable ") + quoted(local.token) +
+                                     " is never read");
+        locals.pop_back();
+    }
+    nextSlot = firstSlot;
+    if (scopeDepth > 0) scopeDepth--;
+}
+
+// ---------- statements ----------
+void Resolver::statement(Stmt* stmt) {
+    switch (stmt->kind) {
+        case StmtKind::VarDecl: {
+            auto* decl = static_cast<VarDecl*>(stmt);
+            // declared after the initializer, so `mass x = x;` sees an outer x
+            if (decl->initializer) expression(decl->initializer);
+            declare(decl->name, false, decl->slot);
+            break;
+        }
+        case StmtKind::FuncDecl: {
+            auto* decl = static_cast<FuncDecl*>(stmt);
+            if (scopeDepth > 0 || function > 0) {
+                error(decl->name, "functions can only be declared at the top level");
+                break;
+            }
+            functionDeclaration(decl);
+            break;
+        }
+        case StmtKind::Block: {
+            auto* block = static_cast<BlockStmt*>(stmt);
+            size_t mark = locals.size();
+            uint32_t first = nextSlot, outerHigh = highWater;
+            highWater = nextSlot;
+            beginScope();
+            for (Stmt* s : block->statements) statement(s);
+            block->frameSize = highWater - first;
+            highWater = std::max(outerHigh, highWater);
+            endScope(mark, first);
+            break;
+        }
+        case StmtKind::Expression: expression(static_cast<ExprStmt*>(stmt)->expression); break;
+        case StmtKind::If: {
+            auto* s = static_cast<IfStmt*>(stmt);
+            expression(s->condition);
+            statement(s->thenBranch);
+            if (s->elseBranch) statement(s->elseBranch);
+            break;
+        }
+        case StmtKind::While: {
+            auto* s = static_cast<WhileStmt*>(stmt);
+            expression(s->condition);
+            statement(s->body);
+            break;
+        }
+        case StmtKind::For: {
+            // the initializer's variable is scoped to the loop
+            auto* s = static_cast<ForStmt*>(stmt);
+            size_t mark = locals.size();
+            uint32_t first = nextSlot;
+            beginScope();
+            if (s->initializer) statement(s->initializer);
+            if (s->condition) expression(s->condition);
+            statement(s->body);
+            if (s->increment) expression(s->increment);
+            endScope(mark, first);
+            break;
+        }
+        case StmtKind::Return: {
+            auto* s = static_cast<ReturnStmt*>(stmt);
+            if (s->value) expression(s->value);
+            break;
+        }
+        case StmtKind::Break:
+        case StmtKind::Continue: break;
+    }
+}
+
+// a frame of its own: parameters in slots 0..n-1, then the locals
+void Resolver::functionDeclaration(FuncDecl* decl) {
+    uint32_t outerNext = nextSlot, outerHigh = highWater;
+    size_t mark = locals.size();
+    function++;
+    nextSlot = highWater = 0;
+    beginScope();
+    for (const Param& param : decl->params) {
+        uint32_t slot;
+        declare(param.name, true, slot);
+    }
+    for (Stmt* s : decl->body) statement(s);
+    decl->frameSize = highWater;
+    endScope(mark, 0);
+    function--;
+    nextSlot = outerNext;
+    highWater = outerHigh;
+}
+
+// ---------- expressions ----------
+void Resolver::expression(Expr* expr) {
+    switch (expr->kind) {
+        case ExprKind::Literal: break;
+        case ExprKind::Variable: {
+            auto* e = static_cast<VariableExpr*>(expr);
+            bind(e->name, e->var, true);
+            break;
+        }
+        case ExprKind::Assign: {
+            // a compound assignment reads the variable too
+            auto* e = static_cast<AssignExpr*>(expr);
+            expression(e->value);
+            bind(e->name, e->var, e->op.type != TokenType::EQUAL);
+            break;
+        }
+        case ExprKind::Binary: {
+            auto* e = static_cast<BinaryExpr*>(expr);
+            expression(e->left);
+            expression(e->right);
+            break;
+        }
+        case ExprKind::Logical: {
+            auto* e = static_cast<LogicalExpr*>(expr);
+            expression(e->left);
+            expression(e->right);
+            break;
+        }
+        case ExprKind::Unary: expression(static_cast<UnaryExpr*>(expr)->operand); break;
+        case ExprKind::Call: {
+            auto* e = static_cast<CallExpr*>(expr);
+            for (Expr* arg : e->args) expression(arg);
+            if (e->callee.type == TokenType::SHINE) break;
+            const uint32_t* index = functionIndex.find(e->callee.symbol());
+            if (!index) {
+                error(e->callee, "undefined function " + quoted(e->callee));
+                break;
+            }
+            const FuncDecl* callee = result.functions[*index];
+            if (callee->params.size() != e->args.size()) {
+                error(e->callee, "function " + quoted(e->callee) + " expects " +
+                                     std::to_string(callee->params.size()) + " arguments but got " +
+                                     std::to_string(e->args.size()));
+                break;
+            }
+            e->function = *index;
+            break;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "../parser/parser.h"
+#include "../symbols/symbolmap.h"
+#include <vector>
+
+// ---------- Name resolution ----------
+// One pass over a parsed (and folded) program, before anything runs it. Every
+// variable reference gets the frame slot of its declaration (VarSlot), every
+// declaration its slot, every function and block its frame size, and every
+// call the function it calls; executors then index frames instead of looking
+// names up. Slots are handed out like a stack: a block's variables take the
+// next free slots of the enclosing function's frame and give them back when
+// the block ends. Functions are declared at the top level and are visible
+// everywhere; inside one, the script's outermost variables declared before
+// it are reachable one frame out.
+//
+// Like the parser, the resolver never throws: it records every error and
+// carries on. Errors use the bytecode compiler's wording.
+struct Resolution {
+    uint32_t frameSize = 0;                 // slots the script's own frame needs
+    std::vector<FuncDecl*> functions;       // in declaration order; CallExpr::function indexes this
+    std::vector<Diagnostic> errors;         // undefined or redeclared names, bad calls
+    std::vector<Diagnostic> warnings;       // shadowed and never-read variables
+    bool ok() const { return errors.empty(); }
+};
+
+class Resolver {
+public:
+    Resolution resolve(const StmtList& program);
+
+private:
+    struct Local {
+        symbols::Symbol name;
+        uint32_t slot;
+        int depth;          // lexical scope depth (0: the script's outermost scope)
+        int function;       // 0: the script, 1: inside a function
+        bool parameter;
+        bool read;
+        Token token;
+    };
+
+    Resolution result;
+    ScopeStack<Local> locals;
+    SymbolMap<uint32_t> functionIndex; // index into result.functions
+    int scopeDepth = 0;
+    int function = 0;        // function nesting of the code being resolved
+    uint32_t nextSlot = 0;   // first free slot of the current frame
+    uint32_t highWater = 0;  // slots the current frame needs so far
+
+    void error(const Token& at, const std::string& message);
+    void warning(const Token& at, const std::string& message);
+
+    void declare(const Token& name, bool parameter, uint32_t& slot);
+    void bind(const Token& name, VarSlot& var, bool read);
+    void beginScope();
+    void endScope(size_t mark, uint32_t firstSlot);
+
+    void statement(Stmt* stmt);
+    void functionDeclaration(FuncDecl* decl);
+    void expression(Expr* expr);
+};
+
+#endif
@@ -1,9 +1,53 @@
 #ifndef TOKENTYPE_H
 #define TOKENTYPE_H
 
+#include <cstdint>
 #include <string>
 
-enum class TokenType {
+// THE ONE KEYWORD LIST: EVERY KEYWORD TOKEN AND ITS SPELLING. THE KEYWORD
+// ENUMERATORS BELOW, THE SCANNER'S PERFECT-HASH TABLE (keywords.h) AND
+// tokenTypeToString ARE ALL GENERATED FROM IT
+#define ASTERVOID_KEYWORDS(KW) \
+    KW(LAUNCH, "launch") \
+    KW(BIGBANG, "bigbang") \
+    KW(MILKYWAY, "milkyway") \
+    KW(MASS, "mass") \
+    KW(FLUX, "flux") \
+    KW(QUANTUM, "quantum") \
+    KW(NEBULA, "nebula") \
+    KW(TRUTH, "truth") \
+    KW(STARLIGHT, "starlight") /* true */ \
+    KW(VOIDNESS, "voidness")   /* false */ \
+    KW(VACUUM, "vacuum") \
+    KW(BLACKHOLE, "blackHole") \
+    KW(DARKMATTER, "darkMatter") \
+    KW(WARP, "warp") \
+    KW(ROTATE, "rotate") \
+    KW(ORBIT, "orbit") \
+    KW(PHASE, "phase") \
+    KW(ECLIPSE, "eclipse") \
+    KW(SUPERNOVA, "supernova") \
+    KW(STARPATH, "starPath") \
+    KW(BLACKVOID, "blackVoid") \
+    KW(MOON, "moon") \
+    KW(SHINE, "shine") \
+    KW(GALAXY, "galaxy") \
+    KW(EARTH, "earth") \
+    KW(CONSTELLATION, "constellation") \
+    KW(CONSTRUCT, "construct") \
+    KW(DEORBIT, "deorbit") \
+    KW(SHIELD, "shield") \
+    KW(RECOVER, "recover") \
+    KW(EJECT, "eject") \
+    KW(OPEN, "open") \
+    KW(CORE, "core") \
+    KW(ORBITSHIELD, "orbitshield")
+
+// RESERVED SPELLINGS THAT SCAN AS A NON-KEYWORD TOKEN TYPE
+#define ASTERVOID_KEYWORD_ALIASES(KW) \
+    KW(STAR, "star")
+
+enum class TokenType : uint8_t {
     // SINGLE CHAR
     LEFT_PAREN, RIGHT_PAREN, LEFT_BRACE, RIGHT_BRACE,
     COMMA, DOT, SEMICOLON, COLON, HASH,
@@ -19,11 +63,9 @@ enum class TokenType {
     IDENTIFIER, STAR, NUMBER,
 
     // KEYWORDS
-    LAUNCH, BIGBANG, MILKYWAY, MASS, FLUX, QUANTUM, NEBULA, TRUTH, STARLIGHT,
-    VOIDNESS, VACUUM, BLACKHOLE, DARKMATTER, WARP, ROTATE,
-    ORBIT, PHASE, ECLIPSE, SUPERNOVA, STARPATH, BLACKVOID,
-    MOON, SHINE, GALAXY, EARTH, CONSTELLATION, CONSTRUCT,
-    DEORBIT, SHIELD, RECOVER, EJECT, OPEN, CORE, ORBITSHIELD,
+#define KW_ENUM(name, text) name,
+    ASTERVOID_KEYWORDS(KW_ENUM)
+#undef KW_ENUM
 
     // SPECIAL
     END_OF_FILE, NEW_LINE, ERROR
@@ -0,0 +1,311 @@
+#include "charscan.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHARSCAN_X86 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define CHARSCAN_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+namespace charscan {
+namespace {
+
+// ---------- Scalar ----------
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+inline bool isIdent(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || isDigit(c) || c == '_';
+}
+
+const char* skipBlanksScalar(const char* p, const char* end) {
+    while (p < end && isBlank(*p)) p++;
+    return p;
+}
+
+const char* findNewlineScalar(const char* p, const char* end) {
+    const void* hit = std::memchr(p, '\n', end - p);
+    return hit ? static_cast<const char*>(hit) : end;
+}
+
+const char* findTripleStarScalar(const char* p, const char* end) {
+    for (; end - p >= 3; p++)
+        if (p[0] == '*' && p[1] == '*' && p[2] == '*') return p;
+    return end;
+}
+
+const char* skipIdentCharsScalar(const char* p, const char* end) {
+    while (p < end && isIdent(*p)) p++;
+    return p;
+}
+
+const char* skipDigitsScalar(const char* p, const char* end) {
+    while (p < end && isDigit(*p)) p++;
+    return p;
+}
+
+size_t countNewlinesScalar(const char* p, const char* end) {
+    size_t n = 0;
+    for (; p < end; p++) n += *p == '\n';
+    return n;
+}
+
+size_t lineStartsScalar(const char* p, const char* end, uint32_t base, uint32_t* out) {
+    size_t n = 0;
+    for (uint32_t i = 0; p + i < end; i++)
+        if (p[i] == '\n') out[n++] = base + i + 1;
+    return n;
+}
+
+#ifdef CHARSCAN_X86
+inline unsigned ctz(unsigned x) {
+#if defined(__GNUC__)
+    return __builtin_ctz(x);
+#else
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return i;
+#endif
+}
+
+inline unsigned popcount(unsigned x) {
+#if defined(__GNUC__)
+    return __builtin_popcount(x);
+#else
+    return __popcnt(x);
+#endif
+}
+
+// ---------- SSE2 (16 bytes per step) ----------
+// BYTES WITH c - lo (MOD 256) <= span, I.E. c IN [lo, lo + span]
+inline __m128i inRange16(__m128i v, char lo, char span) {
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(span)), t);
+}
+
+inline __m128i blankMask16(__m128i v) {
+    return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+}
+
+inline __m128i identMask16(__m128i v) {
+    // c | 0x20 FOLDS 'A'..'Z' ONTO 'a'..'z' AND MAPS NOTHING ELSE INTO THAT RANGE
+    __m128i alpha = inRange16(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 25);
+    __m128i digit = inRange16(v, '0', 9);
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+const char* skipBlanksSse2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned miss = ~unsigned(_mm_movemask_epi8(blankMask16(v))) & 0xFFFFu;
+        if (miss) return p + ctz(miss);
+    }
+    return skipBlanksScalar(p, end);
+}
+
+const char* findNewlineSse2(const char* p, const char* end) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned hit = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+        if (hit) return p + ctz(hit);
+    }
+    return findNewlineScalar(p, end);
+}
+
+const char* findTripleStarSse2(const char* p, const char* end) {
+    const __m128i star = _mm_set1_epi8('*');
+    // LOADS AT p, p+1, p+2: A SET BIT i MEANS p[i..i+2] == "***"
+    for (; end - p >= 18; p += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), star);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1)), star);
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2)), star);
+        unsigned hit = unsigned(_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c)));
+        if (hit) return p + ctz(hit);
+    }
+    return findTripleStarScalar(p, end);
+}
+
+const char* skipIdentCharsSse2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned miss = ~unsigned(_mm_movemask_epi8(identMask16(v))) & 0xFFFFu;
+        if (miss) return p + ctz(miss);
+    }
+    return skipIdentCharsScalar(p, end);
+}
+
+const char* skipDigitsSse2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned miss = ~unsigned(_mm_movemask_epi8(inRange16(v, '0', 9))) & 0xFFFFu;
+        if (miss) return p + ctz(miss);
+    }
+    return skipDigitsScalar(p, end);
+}
+
+size_t countNewlinesSse2(const char* p, const char* end) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t n = 0;
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        n += popcount(unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl))));
+    }
+    return n + countNewlinesScalar(p, end);
+}
+
+// ONE COMPARE PER 16 BYTES; THE MASK IS THEN WALKED BIT BY BIT, SO THE COST
+// FOLLOWS THE NUMBER OF LINES RATHER THAN THE NUMBER OF BYTES
+size_t lineStartsSse2(const char* p, const char* end, uint32_t base, uint32_t* out) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t n = 0;
+    for (; end - p >= 16; p += 16, base += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        for (unsigned hit = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl))); hit; hit &= hit - 1)
+            out[n++] = base + ctz(hit) + 1;
+    }
+    return n + lineStartsScalar(p, end, base, out + n);
+}
+#endif // CHARSCAN_X86
+
+#ifdef CHARSCAN_AVX2
+// ---------- AVX2 (32 bytes per step) ----------
+#define AVX2_FN __attribute__((target("avx2,popcnt")))
+
+AVX2_FN inline __m256i inRange32(__m256i v, char lo, char span) {
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(span)), t);
+}
+
+AVX2_FN inline __m256i load32(const char* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+AVX2_FN const char* skipBlanksAvx2(const char* p, const char* end) {
+    for (; end - p >= 32; p += 32) {
+        __m256i v = load32(p);
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                                     _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        unsigned miss = ~unsigned(_mm256_movemask_epi8(m));
+        if (miss) return p + __builtin_ctz(miss);
+    }
+    return skipBlanksSse2(p, end);
+}
+
+AVX2_FN const char* findNewlineAvx2(const char* p, const char* end) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        unsigned hit = unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(load32(p), nl)));
+        if (hit) return p + __builtin_ctz(hit);
+    }
+    return findNewlineSse2(p, end);
+}
+
+AVX2_FN const char* findTripleStarAvx2(const char* p, const char* end) {
+    const __m256i star = _mm256_set1_epi8('*');
+    for (; end - p >= 34; p += 32) {
+        __m256i a = _mm256_cmpeq_epi8(load32(p), star);
+        __m256i b = _mm256_cmpeq_epi8(load32(p + 1), star);
+        __m256i c = _mm256_cmpeq_epi8(load32(p + 2), star);
+        unsigned hit = unsigned(_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(a, b), c)));
+        if (hit) return p + __builtin_ctz(hit);
+    }
+    return findTripleStarSse2(p, end);
+}
+
+AVX2_FN const char* skipIdentCharsAvx2(const char* p, const char* end) {
+    for (; end - p >= 32; p += 32) {
+        __m256i v = load32(p);
+        __m256i alpha = inRange32(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 25);
+        __m256i digit = inRange32(v, '0', 9);
+        __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        unsigned miss = ~unsigned(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under)));
+        if (miss) return p + __builtin_ctz(miss);
+    }
+    return skipIdentCharsSse2(p, end);
+}
+
+AVX2_FN const char* skipDigitsAvx2(const char* p, const char* end) {
+    for (; end - p >= 32; p += 32) {
+        unsigned miss = ~unsigned(_mm256_movemask_epi8(inRange32(load32(p), '0', 9)));
+        if (miss) return p + __builtin_ctz(miss);
+    }
+    return skipDigitsSse2(p, end);
+}
+
+AVX2_FN size_t countNewlinesAvx2(const char* p, const char* end) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t n = 0;
+    for (; end - p >= 32; p += 32)
+        n += __builtin_popcount(unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(load32(p), nl))));
+    return n + countNewlinesSse2(p, end);
+}
+
+AVX2_FN size_t lineStartsAvx2(const char* p, const char* end, uint32_t base, uint32_t* out) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t n = 0;
+    for (; end - p >= 32; p += 32, base += 32) {
+        for (unsigned hit = unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(load32(p), nl))); hit; hit &= hit - 1)
+            out[n++] = base + __builtin_ctz(hit) + 1;
+    }
+    return n + lineStartsSse2(p, end, base, out + n);
+}
+#undef AVX2_FN
+#endif // CHARSCAN_AVX2
+
+const Kernels scalarKernels = {
+    "scalar", skipBlanksScalar, findNewlineScalar, findTripleStarScalar,
+    skipIdentCharsScalar, skipDigitsScalar, countNewlinesScalar, lineStartsScalar,
+};
+
+#ifdef CHARSCAN_X86
+const Kernels sse2Kernels = {
+    "sse2", skipBlanksSse2, findNewlineSse2, findTripleStarSse2,
+    skipIdentCharsSse2, skipDigitsSse2, countNewlinesSse2, lineStartsSse2,
+};
+#endif
+
+#ifdef CHARSCAN_AVX2
+const Kernels avx2Kernels = {
+    "avx2", skipBlanksAvx2, findNewlineAvx2, findTripleStarAvx2,
+    skipIdentCharsAvx2, skipDigitsAvx2, countNewlinesAvx2, lineStartsAvx2,
+};
+#endif
+
+const Kernels& select() {
+    const char* forced = std::getenv("ASTERVOID_SIMD");
+    bool hasAvx2 = false;
+#ifdef CHARSCAN_AVX2
+    __builtin_cpu_init();
+    hasAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#endif
+    if (forced && std::strcmp(forced, "scalar") == 0) return scalarKernels;
+#ifdef CHARSCAN_X86
+    if (forced && std::strcmp(forced, "sse2") == 0) return sse2Kernels;
+#endif
+#ifdef CHARSCAN_AVX2
+    if (hasAvx2) return avx2Kernels;
+#endif
+#ifdef CHARSCAN_X86
+    return sse2Kernels; // SSE2 IS PART OF THE x86-64 BASELINE
+#else
+    (void)hasAvx2;
+    return scalarKernels;
+#endif
+}
+
+} // namespace
+
+const Kernels& kernels() {
+    static const Kernels& active = select();
+    return active;
+}
+
+} // namespace charscan
@@ -0,0 +1,40 @@
+#ifndef CHARSCAN_H
+#define CHARSCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+// ---------- Bulk character scanning ----------
+// Kernels the scanner uses to consume long runs of "boring" bytes (blanks,
+// comment bodies, identifier and digit runs) 16 or 32 bytes at a time instead
+// of one peek()/advance() per byte. Every kernel works on the half-open range
+// [p, end), never reads outside it, and returns a pointer into [p, end].
+// The implementation (AVX2, SSE2 or scalar) is chosen once at runtime from the
+// CPU features; ASTERVOID_SIMD=scalar|sse2|avx2 forces one for comparison runs.
+namespace charscan {
+
+struct Kernels {
+    const char* name;
+    // FIRST BYTE THAT IS NOT ' ', '\t' OR '\r'
+    const char* (*skipBlanks)(const char* p, const char* end);
+    // FIRST '\n' (END OF A ** LINE COMMENT)
+    const char* (*findNewline)(const char* p, const char* end);
+    // START OF THE FIRST "***" (END OF A *** BLOCK COMMENT ***)
+    const char* (*findTripleStar)(const char* p, const char* end);
+    // FIRST BYTE THAT IS NOT [A-Za-z0-9_]
+    const char* (*skipIdentChars)(const char* p, const char* end);
+    // FIRST BYTE THAT IS NOT [0-9]
+    const char* (*skipDigits)(const char* p, const char* end);
+    // NUMBER OF '\n' BYTES (POPCOUNT OVER NEWLINE MASKS)
+    size_t (*countNewlines)(const char* p, const char* end);
+    // FOR EVERY '\n' AT p[i] STORE base + i + 1 (THE START OF THE NEXT LINE)
+    // INTO out, IN ORDER; out NEEDS ROOM FOR countNewlines(p, end). RETURNS
+    // THE NUMBER STORED. BUILDS THE LINE TABLE (source/linetable.h)
+    size_t (*lineStarts)(const char* p, const char* end, uint32_t base, uint32_t* out);
+};
+
+const Kernels& kernels();
+
+} // namespace charscan
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include "TokenType.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// COMPILE-TIME PERFECT HASH OVER THE KEYWORD LIST IN TokenType.h.
+// lookup() WORKS ON A CHARACTER RANGE (NO ALLOCATION): ONE HASH, ONE TABLE
+// LOAD AND AT MOST ONE LENGTH CHECK + COMPARE PER IDENTIFIER.
+namespace keywords {
+
+struct Entry {
+    std::string_view text;
+    TokenType type;
+};
+
+#define KW_ENTRY(name, text) Entry{text, TokenType::name},
+inline constexpr Entry list[] = {
+    ASTERVOID_KEYWORDS(KW_ENTRY)
+    ASTERVOID_KEYWORD_ALIASES(KW_ENTRY)
+};
+#undef KW_ENTRY
+
+inline constexpr size_t count = sizeof(list) / sizeof(list[0]);
+inline constexpr size_t tableBits = 7;
+inline constexpr size_t tableSize = size_t(1) << tableBits;
+static_assert(count < tableSize, "keyword table too small");
+
+constexpr size_t minLength() {
+    size_t n = list[0].text.size();
+    for (const Entry& e : list) if (e.text.size() < n) n = e.text.size();
+    return n;
+}
+
+constexpr size_t maxLength() {
+    size_t n = 0;
+    for (const Entry& e : list) if (e.text.size() > n) n = e.text.size();
+    return n;
+}
+
+inline constexpr size_t minLen = minLength();
+inline constexpr size_t maxLen = maxLength();
+static_assert(minLen >= 2, "hash reads the first two characters");
+
+// MIXES THE LENGTH, THE FIRST TWO AND THE LAST CHARACTER; THE SEED IS CHOSEN
+// AT COMPILE TIME SO THAT NO TWO KEYWORDS SHARE A SLOT
+constexpr uint32_t hash(const char* s, size_t n, uint32_t seed) {
+    uint32_t h = seed ^ (uint32_t(n) * 0x9E3779B1u);
+    h = (h ^ (unsigned char)s[0]) * 0x01000193u;
+    h = (h ^ (unsigned char)s[1]) * 0x01000193u;
+    h = (h ^ (unsigned char)s[n - 1]) * 0x01000193u;
+    h ^= h >> 15;
+    return h & uint32_t(tableSize - 1);
+}
+
+constexpr bool collisionFree(uint32_t seed) {
+    bool used[tableSize] = {};
+    for (const Entry& e : list) {
+        uint32_t slot = hash(e.text.data(), e.text.size(), seed);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t findSeed() {
+    for (uint32_t seed = 1; seed < 100000; seed++)
+        if (collisionFree(seed)) return seed;
+    return 0;
+}
+
+inline constexpr uint32_t seed = findSeed();
+static_assert(seed != 0, "no perfect-hash seed for the keyword list; widen tableBits");
+
+// SLOT -> INDEX INTO list PLUS ONE (0 = EMPTY)
+constexpr std::array<uint8_t, tableSize> buildTable() {
+    std::array<uint8_t, tableSize> table{};
+    for (size_t i = 0; i < count; i++)
+        table[hash(list[i].text.data(), list[i].text.size(), seed)] = uint8_t(i + 1);
+    return table;
+}
+
+inline constexpr std::array<uint8_t, tableSize> table = buildTable();
+
+constexpr TokenType lookup(std::string_view s) {
+    if (s.size() < minLen || s.size() > maxLen) return TokenType::IDENTIFIER;
+    uint8_t idx = table[hash(s.data(), s.size(), seed)];
+    if (idx == 0) return TokenType::IDENTIFIER;
+    const Entry& e = list[idx - 1];
+    return e.text == s ? e.type : TokenType::IDENTIFIER;
+}
+
+static_assert(lookup("orbitshield") == TokenType::ORBITSHIELD, "keyword table broken");
+static_assert(lookup("star") == TokenType::STAR, "keyword table broken");
+static_assert(lookup("orbits") == TokenType::IDENTIFIER, "keyword table broken");
+
+} // namespace keywords
+
+#endif
@@ -0,0 +1,84 @@
+#include "parallel.h"
+#include "../concurrency/threadpool.h"
+#include "../profile/trace.h"
+#include <algorithm>
+#include <cstring>
+#include <optional>
+
+namespace {
+
+struct Chunk {
+    size_t begin = 0;
+    size_t end = 0;                 // BEGIN OF THE NEXT CHUNK
+    std::optional<Scanner> scanner; // KEPT SO A REPAIR CAN RESUME IT
+    std::vector<Token> tokens;
+    size_t outOffset = 0;           // INDEX OF THE FIRST TOKEN IN THE RESULT
+};
+
+// CUT POINTS LIE JUST AFTER A NEWLINE, ROUGHLY chunkBytes APART
+std::vector<size_t> cutPoints(std::string_view source, size_t chunkBytes) {
+    std::vector<size_t> cuts{0};
+    size_t at = chunkBytes;
+    while (at < source.size()) {
+        const void* nl = std::memchr(source.data() + at, '\n', source.size() - at);
+        if (!nl) break;
+        size_t cut = size_t(static_cast<const char*>(nl) - source.data()) + 1;
+        if (cut >= source.size()) break;
+        cuts.push_back(cut);
+        at = cut + chunkBytes;
+    }
+    cuts.push_back(source.size());
+    return cuts;
+}
+
+} // namespace
+
+std::vector<Token> scanTokensParallel(std::string_view source, ThreadPool& pool,
+                                      const ParallelLexOptions& options, ParallelLexStats* stats) {
+    std::vector<size_t> cuts = cutPoints(source, options.chunkBytes ? options.chunkBytes : 1);
+    size_t n = cuts.size() - 1;
+    if (stats) *stats = ParallelLexStats{n, 0};
+    if (n <= 1) return Scanner(source).scanTokens();
+
+    std::vector<Chunk> chunks(n);
+    for (size_t i = 0; i < n; i++) chunks[i].begin = cuts[i], chunks[i].end = cuts[i + 1];
+
+    // SPECULATIVE PASS: EVERY CHUNK ASSUMES IT STARTS BETWEEN TOKENS
+    pool.parallelFor(n, [&](size_t i) {
+        profile::Phase phase("lex-chunk");
+        Chunk& c = chunks[i];
+        c.scanner.emplace(source, c.begin);
+        c.tokens.reserve((c.end - c.begin) / 4);
+        c.scanner->scanUntil(c.end, c.tokens);
+        phase.tokens(c.tokens.size());
+    });
+
+    // VALIDATE LEFT TO RIGHT. THE GUESS FOR CHUNK i HOLDS IFF THE SCAN THAT
+    // COVERS THE TEXT BEFORE IT STOPPED EXACTLY ON ITS START; OTHERWISE THAT
+    // SCANNER (WHICH HAS THE TRUE STATE) IS RESUMED OVER CHUNK i
+    size_t owner = 0;
+    for (size_t i = 1; i < n; i++) {
+        Chunk& o = chunks[owner];
+        if (o.scanner->position() == chunks[i].begin) {
+            owner = i;
+            continue;
+        }
+        chunks[i].tokens = std::vector<Token>();
+        chunks[i].scanner.reset();
+        if (stats) stats->repaired++;
+        if (o.scanner->position() < chunks[i].end) o.scanner->scanUntil(chunks[i].end, o.tokens);
+    }
+    chunks[owner].tokens.push_back(chunks[owner].scanner->next()); // END_OF_FILE
+
+    // STITCH: COPY EVERY CHUNK TO ITS PLACE, IN PARALLEL. TOKEN OFFSETS ARE
+    // ALREADY ABSOLUTE (EVERY SCANNER RUNS OVER THE WHOLE SOURCE)
+    size_t total = 0;
+    for (Chunk& c : chunks) c.outOffset = total, total += c.tokens.size();
+    std::vector<Token> out(total);
+    pool.parallelFor(n, [&](size_t i) {
+        profile::Phase phase("lex-stitch");
+        const Chunk& c = chunks[i];
+        std::copy(c.tokens.begin(), c.tokens.end(), out.begin() + c.outOffset);
+    });
+    return out;
+}
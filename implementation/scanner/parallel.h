@@ -0,0 +1,32 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "scanner.h"
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+class ThreadPool;
+
+// CHUNKED PARALLEL LEXING OF ONE LARGE SOURCE.
+// THE SOURCE IS CUT JUST AFTER NEWLINES AND EVERY CHUNK IS SCANNED
+// SPECULATIVELY ON THE POOL AS IF IT STARTED A FILE. A CHUNK'S GUESS IS RIGHT
+// EXACTLY WHEN ITS PREDECESSOR'S LAST TOKEN ENDS ON THE CHUNK START; WHEN A
+// "***" COMMENT OR A STRING CROSSES THE CUT THE PREDECESSOR'S SCANNER IS
+// SIMPLY RESUMED OVER THE CHUNK INSTEAD. TOKENS CARRY BYTE OFFSETS, NOT
+// LINES, SO STITCHING IS A PLAIN COPY. THE RESULT IS TOKEN-FOR-TOKEN
+// IDENTICAL TO Scanner::scanTokens()
+struct ParallelLexOptions {
+    size_t chunkBytes = size_t(1) << 20; // TARGET CHUNK SIZE; SMALLER SOURCES SCAN SEQUENTIALLY
+};
+
+struct ParallelLexStats {
+    size_t chunks = 0;   // CHUNKS SCANNED SPECULATIVELY
+    size_t repaired = 0; // CHUNKS WHOSE GUESS WAS WRONG AND WERE RESCANNED
+};
+
+std::vector<Token> scanTokensParallel(std::string_view source, ThreadPool& pool,
+                                      const ParallelLexOptions& options = {},
+                                      ParallelLexStats* stats = nullptr);
+
+#endif //PARALLEL_H
@@ -1,34 +1,51 @@
-#include "Scanner.h"
-#include <unordered_map>
+#include "scanner.h"
+#include "keywords.h"
+#include <charconv>
 #include <iostream>
 
-Scanner::Scanner(const std::string& sourceCode) : source(sourceCode) {}
+Scanner::Scanner(std::string_view sourceCode) : source(sourceCode), simd(charscan::kernels()) {}
 
+Scanner::Scanner(std::string_view sourceCode, size_t begin) : Scanner(sourceCode) {
+    start = current = int(begin);
+}
+
+
+Token Scanner::next() {
+    skipWhitespace();
+    start = current;
+    if(isAtEnd()) return makeToken(TokenType::END_OF_FILE);
+    emitted++;
+    return scanToken();
+}
 
 std::vector<Token> Scanner::scanTokens() {
-    // std::cout << "Starting scanner...\n";
-    while(!isAtEnd()) {
-        skipWhitespace();
-        start = current;
-        startCol = col;
-        // std::cout << "Scanning token at line " << line << ", col " << col << "\n";
-        Token token = scanToken();
-        tokens.push_back(token);
+    std::vector<Token> tokens;
+    while(true) {
+        tokens.push_back(next());
+        if(tokens.back().type == TokenType::END_OF_FILE) break;
     }
-    tokens.push_back(makeToken(TokenType::END_OF_FILE, "", ""));
-    // std::cout << "Finished. Tokens: " << tokens.size() << "\n";
     return tokens;
 }
 
+void Scanner::scanUntil(size_t limit, std::vector<Token>& out) {
+    while(current < (int)limit) {
+        Token token = next();
+        if(token.type == TokenType::END_OF_FILE) break;
+        out.push_back(token);
+    }
+}
+
 bool Scanner::isAtEnd() const {
-    return current > source.length();
+    return current >= (int)source.length();
 }
 
 char Scanner::advance() { // GIVE ME THE CURRENT CHAR AND MOVE FORWARD
-    char ch =  source[current++];
-    if(ch == '\n') line++, col = 1;
-    else col++;
-    return ch;
+    return source[current++];
+}
+
+// BULK ADVANCE TO stop (FOUND BY ONE OF THE simd KERNELS)
+void Scanner::skipRun(const char* stop) {
+    current += int(stop - cursor());
 }
 
 char Scanner::peek() const {
@@ -37,12 +54,12 @@ char Scanner::peek() const {
 }
 
 char Scanner::peekNext() const {
-    if(current + 1 >= source.length()) return '\0';
+    if(current + 1 >= (int)source.length()) return '\0';
     return source[current + 1];
 }
 
 char Scanner::peekThird() const{
-    if (current + 2 >= source.length()) return '\0';
+    if (current + 2 >= (int)source.length()) return '\0';
     return source[current + 2];
 }
 
@@ -51,12 +68,27 @@ char Scanner::peekThird() const{
 bool Scanner::match(char expected) {
     if(isAtEnd()) return false;
     if(source[current] != expected) return false;
-    current++, col++;
+    current++;
     return true;
 }
 
-Token Scanner::makeToken(TokenType type, const std::string &lexeme, const std::string &literal) {
-    return Token{type, lexeme, literal,line,col};
+// THE TEXT BETWEEN start AND current, AS A VIEW INTO THE SOURCE (NO COPY)
+std::string_view Scanner::currentLexeme() const {
+    return source.substr(start, current - start);
+}
+
+Token Scanner::makeToken(TokenType type) {
+    return makeToken(type, currentLexeme());
+}
+
+Token Scanner::makeToken(TokenType type, std::string_view lexeme) {
+    return Token{type, NumberKind::None, uint32_t(start), lexeme, {}};
+}
+
+Token Scanner::errorToken(const char* message) {
+    Token token = makeToken(TokenType::ERROR);
+    token.message = message;
+    return token;
 }
 
 Token Scanner::scanToken() {
@@ -64,79 +96,56 @@ Token Scanner::scanToken() {
     char ch = advance();
     switch(ch) {
         // SINGLE CHAR
-        case '(': return makeToken(TokenType::LEFT_PAREN, "(");
-        case ')': return makeToken(TokenType::RIGHT_PAREN, ")");
-        case '{': return makeToken(TokenType::LEFT_BRACE, "{");
-        case '}': return makeToken(TokenType::RIGHT_BRACE, "}");
-        case ',': return makeToken(TokenType::COMMA, ",");
-        case '.': return makeToken(TokenType::DOT, ".");
-        case ';': return makeToken(TokenType::SEMICOLON, ";");
-        case ':': return makeToken(TokenType::COLON, ":");
-        case '#': return makeToken(TokenType::HASH, "#");
+        case '(': return makeToken(TokenType::LEFT_PAREN);
+        case ')': return makeToken(TokenType::RIGHT_PAREN);
+        case '{': return makeToken(TokenType::LEFT_BRACE);
+        case '}': return makeToken(TokenType::RIGHT_BRACE);
+        case ',': return makeToken(TokenType::COMMA);
+        case '.': return makeToken(TokenType::DOT);
+        case ';': return makeToken(TokenType::SEMICOLON);
+        case ':': return makeToken(TokenType::COLON);
+        case '#': return makeToken(TokenType::HASH);
 
         // ONE OR TWO CHAR TOKENS
         case '+':
-            if(match('+')) return makeToken(TokenType::PLUS_PLUS, "++");
-            if(match('=')) return makeToken(TokenType::PLUS_EQ, "+=");
-            return makeToken(TokenType::PLUS, "+");
+            if(match('+')) return makeToken(TokenType::PLUS_PLUS);
+            if(match('=')) return makeToken(TokenType::PLUS_EQ);
+            return makeToken(TokenType::PLUS);
         case '-':
-            if(match('-')) return makeToken(TokenType::MINUS_MINUS, "--");
-            if(match('=')) return makeToken(TokenType::MINUS_EQ, "-=");
-            return makeToken(TokenType::MINUS, "-");
+            if(match('-')) return makeToken(TokenType::MINUS_MINUS);
+            if(match('=')) return makeToken(TokenType::MINUS_EQ);
+            return makeToken(TokenType::MINUS);
         case '*':
-            // *** ***
-                // **
-            if(match('*') && match('*')) {
-                while (!(peek() == '*' && peekNext() == '*' && peekThird() == '*') && !isAtEnd()) {
-                    if (peek() == '\n') {
-                        line++;
-                        col = 1;
-                    }
-                    advance();
-                }
-                // If we reached *** , consume them
-                if (!isAtEnd()) {
-                    advance(); // *
-                    advance(); // *
-                    advance(); // *
-                }
-                //return makeToken(TokenType::BLOCK_COMMENT, "***");
-                return scanToken();
-            }
-            if(match('*')) {
-               while(peek() != '\n' && !isAtEnd()) advance();
-                return scanToken();
-            }
-            if(match('=')) return makeToken(TokenType::STARR_EQ, "*=");
-            return makeToken(TokenType::STARR, "*");
+            if(match('=')) return makeToken(TokenType::STARR_EQ);
+            return makeToken(TokenType::STARR);
         case '/':
             if(match('=')) {
-                return makeToken(TokenType::SLASH_EQ, "/=");
+                return makeToken(TokenType::SLASH_EQ);
             }
-            return makeToken(TokenType::SLASH, "/");
+            return makeToken(TokenType::SLASH);
         case '=':
-            if(match('=')) return makeToken(TokenType::EQUAL_EQ, "=");
-            return makeToken(TokenType::EQUAL, "=");
+            if(match('=')) return makeToken(TokenType::EQUAL_EQ);
+            return makeToken(TokenType::EQUAL);
         case '>':
-            if(match('=')) return makeToken(TokenType::GREATER_EQ, ">=");
-            return makeToken(TokenType::GREATER, ">");
+            if(match('=')) return makeToken(TokenType::GREATER_EQ);
+            return makeToken(TokenType::GREATER);
         case '<':
-            if(match('=')) return makeToken(TokenType::LESS_EQ, "<=");
-            return makeToken(TokenType::LESS, "<");
+            if(match('=')) return makeToken(TokenType::LESS_EQ);
+            return makeToken(TokenType::LESS);
         case '%':
-            if(match('=')) return makeToken(TokenType::PERCENT_EQ, "%=");
-            return makeToken(TokenType::PERCENT, "%");
+            if(match('=')) return makeToken(TokenType::PERCENT_EQ);
+            return makeToken(TokenType::PERCENT);
         case '!':
-            if(match('=')) return makeToken(TokenType::BANG_EQ, "!=");
-            return makeToken(TokenType::BANG, "!");
+            if(match('=')) return makeToken(TokenType::BANG_EQ);
+            return makeToken(TokenType::BANG);
         case '&':
-            if(match('&')) return makeToken(TokenType::AND, "&&");
-            return makeToken(TokenType::BIT_AND, "&");
+            if(match('&')) return makeToken(TokenType::AND);
+            return makeToken(TokenType::BIT_AND);
         case '|':
-            if(match('|')) return makeToken(TokenType::OR, "||");
-            return makeToken(TokenType::BIT_OR, "|");
+            if(match('|')) return makeToken(TokenType::OR);
+            return makeToken(TokenType::BIT_OR);
         case '^':
-            return makeToken(TokenType::XOR, "^");
+            return makeToken(TokenType::XOR);
 
         // LITERALS
         case '"': return stringLiteral();
@@ -146,21 +155,18 @@ Token Scanner::scanToken() {
         // case '\t':
         //     advance();
         case '\n':
-            return makeToken(TokenType::NEW_LINE, "\n");
+            return makeToken(TokenType::NEW_LINE);
         default:
             if(isDigit(ch)) return number();
             if(isAlpha(ch)) return identifier();
-            return makeToken(TokenType::ERROR, std::string(1, ch));
+            return makeToken(TokenType::ERROR);
     }
 }
 
 Token Scanner::stringLiteral() {
-    while (peek() != '"' && !isAtEnd()) {
-        if (peek() == '\n') { line++; col = 1; }
-        advance();
-    }
+    while (peek() != '"' && !isAtEnd()) advance();
 
-    if (isAtEnd()) return makeToken(TokenType::ERROR, "Unterminated string.");
+    if (isAtEnd()) return errorToken("Unterminated string.");
 
     // LOSING QUOTE
     advance();
@@ -168,29 +174,51 @@ Token Scanner::stringLiteral() {
     // std::string value = source.substr(start + 1, current - start - 2);
     int len = current - start - 2;
     if (len < 0) len = 0;
-    std::string value = source.substr(start + 1, len);
-    return makeToken(TokenType::STAR, value, value);
+    std::string_view value = source.substr(start + 1, len);
+    return makeToken(TokenType::STAR, value);
 }
 
+// DECODE THE LITERAL HERE, ONCE, SO NOTHING DOWNSTREAM RE-PARSES ITS TEXT
 Token Scanner::number() {
-    while (isDigit(peek())) advance();
+    skipRun(simd.skipDigits(cursor(), sourceEnd()));
 
     // LOOK FOR FRATIONAL PART
+    bool fraction = false;
     if (peek() == '.' && isDigit(peekNext())) {
         advance(); // ONSUME '.'
-        while (isDigit(peek())) advance();
+        skipRun(simd.skipDigits(cursor(), sourceEnd()));
+        fraction = true;
     }
 
-    std::string value = source.substr(start, current - start);
-    return makeToken(TokenType::NUMBER, value, value);
+    Token token = makeToken(TokenType::NUMBER);
+    const char* first = token.lexeme.data();
+    const char* last = first + token.lexeme.size();
+    if (fraction) {
+        if (std::from_chars(first, last, token.real).ec != std::errc())
+            return errorToken("Number literal out of range.");
+        token.number = NumberKind::Float;
+    } else if (token.lexeme.size() <= 18) {
+        // FAST PATH: 18 DIGITS ALWAYS FIT IN A mass, SO NO OVERFLOW CHECKS
+        uint64_t v = 0;
+        for (const char* p = first; p != last; p++) v = v * 10 + uint64_t(*p - '0');
+        token.integer = int64_t(v);
+        token.number = NumberKind::Int;
+    } else {
+        if (std::from_chars(first, last, token.integer).ec != std::errc())
+            return errorToken("Number literal out of range.");
+        token.number = NumberKind::Int;
+    }
+    return token;
 }
 
 Token Scanner::identifier() {
-    while (isAlpha(peek()) || isDigit(peek())) advance();
+    skipRun(simd.skipIdentChars(cursor(), sourceEnd()));
 
-    std::string text = source.substr(start, current - start);
+    std::string_view text = currentLexeme();
     TokenType type = identifierType(text);
-    return makeToken(type, text);
+    Token token = makeToken(type, text);
+    if (type == TokenType::IDENTIFIER) token.interned = symbols::intern(text); // LATER STAGES COMPARE SYMBOLS, NOT TEXT
+    return token;
 }
 
 bool Scanner::isDigit(char ch) const {
@@ -203,48 +231,9 @@ bool Scanner::isAlpha(char ch) const {
             ch == '_';
 }
 
-TokenType Scanner::identifierType(const std::string &s) {
-    static const std::unordered_map<std::string, TokenType> keywords = {
-        {"launch", TokenType::LAUNCH},
-        {"bigbang", TokenType::BIGBANG},
-        {"milkyway", TokenType::MILKYWAY},
-        {"mass", TokenType::MASS},
-        {"flux", TokenType::FLUX},
-        {"quantum", TokenType::QUANTUM},
-        {"nebula", TokenType::NEBULA},
-        {"star", TokenType::STAR},
-        {"truth", TokenType::TRUTH},
-        {"starlight", TokenType::TRUTH},   // true
-        {"voidness", TokenType::VOIDNESS}, // false
-        {"vacuum", TokenType::VACUUM},
-        {"blackHole", TokenType::BLACKHOLE},
-        {"darkMatter", TokenType::DARKMATTER},
-        {"warp", TokenType::WARP},
-        {"rotate", TokenType::ROTATE},
-        {"orbit", TokenType::ORBIT},
-        {"phase", TokenType::PHASE},
-        {"eclipse", TokenType::ECLIPSE},
-        {"supernova", TokenType::SUPERNOVA},
-        {"starPath", TokenType::STARPATH},
-        {"blackVoid", TokenType::BLACKVOID},
-        {"moon", TokenType::MOON},
-        {"shine", TokenType::SHINE},
-        {"galaxy", TokenType::GALAXY},
-        {"earth", TokenType::EARTH},
-        {"constellation", TokenType::CONSTELLATION},
-        {"construct", TokenType::CONSTRUCT},
-        {"deorbit", TokenType::DEORBIT},
-        {"shield", TokenType::SHIELD},
-        {"recover", TokenType::RECOVER},
-        {"eject", TokenType::EJECT},
-        {"open", TokenType::OPEN},
-        {"core", TokenType::CORE},
-        {"orbitshield", TokenType::ORBITSHIELD}
-    };
-
-    auto it = keywords.find(s);
-    if (it != keywords.end()) return it->second;
-    return TokenType::IDENTIFIER;
+// KEYWORDS ARE RECOGNIZED BY THE CONSTEXPR PERFECT HASH IN keywords.h
+TokenType Scanner::identifierType(std::string_view s) {
+    return keywords::lookup(s);
 }
 
 void Scanner::skipWhitespace() {
@@ -254,9 +243,29 @@ void Scanner::skipWhitespace() {
             case ' ':
             case '\r':
             case '\t':
-                advance();
+                skipRun(simd.skipBlanks(cursor(), sourceEnd()));
             break;
 
+            case '*':
+                // *** BLOCK COMMENT ***
+                if(peekNext() == '*' && peekThird() == '*') {
+                    advance(); advance(); advance();
+                    skipRun(simd.findTripleStar(cursor(), sourceEnd()));
+                    // If we reached *** , consume them
+                    if (!isAtEnd()) {
+                        advance(); // *
+                        advance(); // *
+                        advance(); // *
+                    }
+                    break;
+                }
+                // ** LINE COMMENT
+                if(peekNext() == '*') {
+                    skipRun(simd.findNewline(cursor(), sourceEnd()));
+                    break;
+                }
+                return;
+
             default:
                 return;  // STOP SKIPPING
         }
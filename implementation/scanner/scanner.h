@@ -2,49 +2,93 @@
 #define SCANNER_H
 
 #include "TokenType.h"
+#include "charscan.h"
+#include "../source/linetable.h"
+#include "../symbols/interner.h"
+#include <cassert>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// TOKENS DO NOT OWN THEIR TEXT: lexeme IS A SLICE OF THE SOURCE BUFFER, WHICH
+// IS OWNED BY THE COMPILATION AND MUST OUTLIVE EVERY TOKEN (AND EVERY AST NODE
+// THAT COPIES ONE). A TOKEN KNOWS ONLY ITS BYTE OFFSET; LINE AND COLUMN COME
+// FROM THE FILE'S LineTable (source/linetable.h) WHEN SOMETHING IS REPORTED.
+// THE SCANNER DECODES NUMBER LITERALS ONCE; THE VALUE SHARES ITS 8 BYTES WITH
+// THE INTERNED NAME OF AN IDENTIFIER, SO A TOKEN STAYS AT 32 BYTES
+enum class NumberKind : uint8_t { None, Int, Float };
+
 struct Token {
     TokenType type;
-    std::string lexeme; // THE EXACT SUBSTRING FROM SOURCE
-    std::string literal;// VALUE
-    int line;// LINE NUMBER WHERE TOKEN STARTS
-    int col;// COLUMN NUMBER WHERE TOKEN STARTS
+    NumberKind number = NumberKind::None; // WHICH PAYLOAD A NUMBER TOKEN CARRIES
+    uint32_t offset = 0;     // BYTE OFFSET OF THE FIRST CHARACTER IN THE SOURCE
+    std::string_view lexeme; // THE TEXT: THE EXACT SOURCE SUBSTRING, A STRING'S CONTENTS WITHOUT QUOTES
+    union {
+        symbols::Symbol interned; // INTERNED NAME, IDENTIFIER TOKENS ONLY; READ IT THROUGH symbol()
+        int64_t integer = 0;      // NUMBER TOKENS WITH NumberKind::Int
+        double real;              // NUMBER TOKENS WITH NumberKind::Float
+        const char* message;      // ERROR TOKENS: THE SCANNER'S MESSAGE, NULL FOR A STRAY CHARACTER
+    };
+
+    // ON ANY OTHER TOKEN THESE BYTES ARE A NUMBER'S VALUE OR NOTHING AT ALL
+    symbols::Symbol symbol() const {
+        assert(type == TokenType::IDENTIFIER);
+        return interned;
+    }
 
-    std::string toString() const {
-        return "[" + std::to_string(line) + ":" + std::to_string(col) + "] " + lexeme;
+    std::string toString(const LineTable& lines) const {
+        SourceLocation at = lines.locate(offset);
+        return "[" + std::to_string(at.line) + ":" + std::to_string(at.col) + "] " + std::string(lexeme);
     }
 };
 
 class Scanner {
 public:
-    Scanner(const std::string &source);
+    explicit Scanner(std::string_view source);
+    // RESUME AT begin, WHICH MUST BE A TOKEN BOUNDARY (0, JUST AFTER A '\n', OR
+    // THE END OF A TOKEN). USED BY THE CHUNKED PARALLEL LEXER (parallel.h) AND
+    // INCREMENTAL RE-LEXING
+    Scanner(std::string_view source, size_t begin);
+    // PULL ONE TOKEN; KEEPS RETURNING END_OF_FILE ONCE THE SOURCE IS EXHAUSTED
+    Token next();
+    // MATERIALIZE THE WHOLE STREAM (UP TO AND INCLUDING END_OF_FILE)
     std::vector<Token> scanTokens();
+    // NUMBER OF TOKENS SCANNED SO FAR, END_OF_FILE EXCLUDED (FOR THROUGHPUT STATS)
+    size_t tokenCount() const { return emitted; }
+    // APPEND TOKENS UNTIL ONE ENDS AT OR PAST limit OR THE SOURCE RUNS OUT
+    // (END_OF_FILE IS NOT APPENDED). A TOKEN STARTING BEFORE limit IS ALWAYS
+    // FINISHED, SO position() MAY END UP BEYOND IT
+    void scanUntil(size_t limit, std::vector<Token>& out);
+    size_t position() const { return size_t(current); }
 
 private:
-    std::string source;
-    std::vector<Token> tokens;
+    std::string_view source;
     int start = 0;// WHERE THE CURRENT TOKEN STARTS
     int current = 0;// WHERE YOU ARE NOW IN THE TEXT
-    int line = 1;// CURRENT LINE NUMBER
-    int col = 1;// COLUMN OF THE CURRENT CHAR
-    int startCol = 1;// COLUMN AT TOKEN START (CURRENT LINE)
+    size_t emitted = 0;// TOKENS SCANNED BY next()
+    const charscan::Kernels& simd;// BULK SKIPPING (AVX2 / SSE2 / SCALAR)
 
     bool isAtEnd() const;
     char advance();
+    const char* cursor() const { return source.data() + current; }
+    const char* sourceEnd() const { return source.data() + source.size(); }
+    void skipRun(const char* stop);
     char peek() const;
     char peekNext() const;
     char peekThird() const;
     bool match(char expected);
-    Token makeToken(TokenType type, const std::string &lexeme, const std::string &literal = "");
+    std::string_view currentLexeme() const;
+    Token makeToken(TokenType type);
+    Token makeToken(TokenType type, std::string_view lexeme);
+    Token errorToken(const char* message); // SPANS WHAT WAS CONSUMED, LIKE ANY OTHER TOKEN
     Token scanToken();
     Token stringLiteral();
     Token number();
     Token identifier();
     bool isDigit(char c) const;
     bool isAlpha(char c) const;
-    TokenType identifierType(const std::string &s);
+    TokenType identifierType(std::string_view s);
     void skipWhitespace();
 };
 
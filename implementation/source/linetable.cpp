@@ -0,0 +1,20 @@
+#include "linetable.h"
+#include "../scanner/charscan.h"
+#include <algorithm>
+
+void LineTable::build() const {
+    const charscan::Kernels& simd = charscan::kernels();
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    starts.resize(1 + simd.countNewlines(begin, end));
+    starts[0] = 0;
+    simd.lineStarts(begin, end, 0, starts.data() + 1);
+}
+
+SourceLocation LineTable::locate(uint32_t offset) const {
+    std::call_once(built, [this] { build(); });
+    offset = std::min<uint32_t>(offset, uint32_t(text.size()));
+    // last line start at or before the offset
+    size_t line = size_t(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin());
+    return SourceLocation{int(line), int(offset - starts[line - 1]) + 1};
+}
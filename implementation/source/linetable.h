@@ -0,0 +1,38 @@
+#ifndef LINETABLE_H
+#define LINETABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// ---------- Line table ----------
+// Turns byte offsets into one source text into 1-based line and column
+// numbers. Tokens and AST nodes carry only offsets; the table of line starts
+// is built on the first query (one SIMD pass over the text) and answers every
+// query by binary search, so a file that compiles cleanly never builds it.
+// Columns count bytes. Queries are thread-safe; the text must outlive the table.
+struct SourceLocation {
+    int line = 1;
+    int col = 1;
+};
+
+class LineTable {
+public:
+    explicit LineTable(std::string_view text) : text(text) {}
+    LineTable(const LineTable&) = delete;
+    LineTable& operator=(const LineTable&) = delete;
+
+    SourceLocation locate(uint32_t offset) const; // offsets past the end clamp to it
+    int line(uint32_t offset) const { return locate(offset).line; }
+
+private:
+    std::string_view text;
+    mutable std::once_flag built;
+    mutable std::vector<uint32_t> starts; // offset of the first byte of every line
+
+    void build() const;
+};
+
+#endif
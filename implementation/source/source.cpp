@@ -0,0 +1,132 @@
+#include "source.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::runtime_error ioError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " '" + path + "': " + std::strerror(errno));
+}
+
+std::runtime_error tooLarge(const std::string& path) {
+    return std::runtime_error("Source file '" + path + "' is too large (the limit is " +
+                              std::to_string(MAX_SOURCE_BYTES) + " bytes)");
+}
+
+#ifndef _WIN32
+// read() UNTIL EOF; USED FOR PIPES, TTYS AND ANYTHING mmap REFUSES
+void readAll(int fd, const std::string& path, std::string& out) {
+    char chunk[64 * 1024];
+    while (true) {
+        ssize_t n = ::read(fd, chunk, sizeof chunk);
+        if (n == 0) return;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw ioError("Could not read", path);
+        }
+        out.append(chunk, (size_t)n);
+        if (out.size() > MAX_SOURCE_BYTES) throw tooLarge(path);
+    }
+}
+#endif
+
+} // namespace
+
+SourceFile SourceFile::open(const std::string& path) {
+    SourceFile file;
+    file.filePath = path;
+
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw ioError("Could not open", path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    file.buffer = ss.str();
+    if (file.buffer.size() > MAX_SOURCE_BYTES) throw tooLarge(path);
+#else
+    bool fromStdin = path == "-";
+    int fd = fromStdin ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw ioError("Could not open", path);
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        std::runtime_error failed = ioError("Could not stat", path); // BEFORE close() CAN CHANGE errno
+        if (!fromStdin) ::close(fd);
+        throw failed;
+    }
+
+    if (S_ISREG(st.st_mode) && uint64_t(st.st_size) > MAX_SOURCE_BYTES) {
+        if (!fromStdin) ::close(fd);
+        throw tooLarge(path);
+    }
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            ::madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL); // THE SCANNER READS FRONT TO BACK
+#endif
+            file.data = static_cast<const char*>(p);
+            file.size = (size_t)st.st_size;
+            file.mapped = true;
+        }
+    }
+
+    if (!file.mapped) {
+        try {
+            readAll(fd, path, file.buffer);
+        } catch (...) {
+            if (!fromStdin) ::close(fd);
+            throw;
+        }
+    }
+    // THE MAPPING STAYS VALID AFTER THE DESCRIPTOR IS CLOSED
+    if (!fromStdin) ::close(fd);
+#endif
+
+    if (!file.mapped) {
+        file.data = file.buffer.data();
+        file.size = file.buffer.size();
+    }
+    return file;
+}
+
+SourceFile::SourceFile(SourceFile&& other) noexcept { *this = std::move(other); }
+
+SourceFile& SourceFile::operator=(SourceFile&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    filePath = std::move(other.filePath);
+    mapped = other.mapped;
+    size = other.size;
+    buffer = std::move(other.buffer);
+    // A MOVED std::string MAY HAVE MOVED ITS BYTES (SMALL BUFFER), SO RE-POINT
+    data = mapped ? other.data : buffer.data();
+    other.data = nullptr;
+    other.size = 0;
+    other.mapped = false;
+    return *this;
+}
+
+SourceFile::~SourceFile() { release(); }
+
+void SourceFile::release() {
+#ifndef _WIN32
+    if (mapped && data) ::munmap(const_cast<char*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+    mapped = false;
+}
@@ -0,0 +1,42 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// ---------- Source loading ----------
+// Owns the bytes of one input file for the whole compilation. Regular files are
+// memory-mapped read-only so the scanner runs directly over the page cache;
+// pipes, ttys and stdin ("-") fall back to read() into an owned buffer.
+// Tokens and AST nodes hold views into text(), so a SourceFile must outlive them.
+// The scanner's position is an int and token offsets are 32-bit, so anything
+// larger than MAX_SOURCE_BYTES is refused when it is opened.
+constexpr size_t MAX_SOURCE_BYTES = 0x7fffffff; // 2 GiB - 1
+
+class SourceFile {
+public:
+    static SourceFile open(const std::string& path); // throws std::runtime_error
+
+    SourceFile() = default;
+    SourceFile(SourceFile&& other) noexcept;
+    SourceFile& operator=(SourceFile&& other) noexcept;
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+    ~SourceFile();
+
+    const std::string& path() const { return filePath; }
+    std::string_view text() const { return {data, size}; }
+    bool isMapped() const { return mapped; }
+
+private:
+    std::string filePath;
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string buffer; // used when the input could not be mapped
+
+    void release();
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include "interner.h"
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace symbols {
+namespace {
+
+constexpr int SHARD_BITS = 4;                  // 16 shards
+constexpr int CHUNK_BITS = 12;                 // 4096 names per directory chunk
+constexpr size_t MAX_CHUNKS = size_t(1) << 14; // 64M symbols
+constexpr size_t BLOCK_SIZE = 4096;             // name storage block
+
+uint64_t load64(const char* p) {
+    uint64_t w;
+    std::memcpy(&w, p, 8);
+    return w;
+}
+
+uint64_t load32(const char* p) {
+    uint32_t w;
+    std::memcpy(&w, p, 4);
+    return w;
+}
+
+// eight bytes at a time, with overlapping loads for the tail so that short
+// names (most of them) take no loop and no byte-by-byte copy
+uint64_t hashName(std::string_view text) {
+    constexpr uint64_t K = 0xd6e8feb86659fd93ull;
+    const char* p = text.data();
+    size_t n = text.size();
+    uint64_t h = n * 0x9e3779b97f4a7c15ull;
+    if (n >= 8) {
+        for (; n > 8; n -= 8, p += 8) {
+            h = (h ^ load64(p)) * K;
+            h ^= h >> 32;
+        }
+        h ^= load64(p + n - 8); // the last eight bytes, overlapping the previous word
+    } else if (n >= 4) {
+        h ^= (load32(p) << 32) | load32(p + n - 4);
+    } else if (n > 0) {
+        h ^= (uint64_t(uint8_t(p[0])) << 16) | (uint64_t(uint8_t(p[n >> 1])) << 8) | uint8_t(p[n - 1]);
+    }
+    h *= K;
+    h ^= h >> 32;
+    h *= K;
+    return h ^ (h >> 29);
+}
+
+// open-addressing table of one shard. A slot packs {hash tag, symbol} into
+// one word so a reader sees either nothing or a complete entry
+struct SlotTable {
+    explicit SlotTable(size_t size) : mask(size - 1), slots(new std::atomic<uint64_t>[size]) {
+        for (size_t i = 0; i < size; i++) slots[i].store(0, std::memory_order_relaxed);
+    }
+    size_t mask;
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+};
+
+uint64_t pack(uint32_t tag, Symbol id) { return (uint64_t(tag) << 32) | id; }
+
+// Lookups never lock: they read the current table and compare names.
+// Inserts take the shard lock, look again and publish the new slot (or a
+// grown table) with a release store. Replaced tables are kept until exit, as
+// a reader may still be probing one.
+struct Shard {
+    std::mutex lock;
+    std::atomic<SlotTable*> table{nullptr};
+    std::vector<std::unique_ptr<SlotTable>> tables; // current one last
+    size_t used = 0;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* cursor = nullptr;
+    size_t left = 0;
+
+    const char* store(std::string_view text) {
+        if (text.size() > left) {
+            size_t size = text.size() > BLOCK_SIZE / 4 ? text.size() : BLOCK_SIZE;
+            blocks.emplace_back(new char[size]);
+            cursor = blocks.back().get();
+            left = size;
+        }
+        char* at = cursor;
+        if (!text.empty()) std::memcpy(at, text.data(), text.size());
+        cursor += text.size();
+        left -= text.size();
+        return at;
+    }
+};
+
+// id -> name. Chunks are created on demand and never move, so readers only
+// need the acquire load of the chunk pointer; the entry itself was written
+// before the id was published
+struct Table {
+    std::array<Shard, size_t(1) << SHARD_BITS> shards;
+    std::array<std::atomic<std::string_view*>, MAX_CHUNKS> directory{};
+    std::atomic<Symbol> next{1};
+
+    ~Table() {
+        for (auto& chunk : directory) delete[] chunk.load();
+    }
+
+    std::string_view* chunkFor(Symbol id) {
+        std::atomic<std::string_view*>& slot = directory[id >> CHUNK_BITS];
+        std::string_view* chunk = slot.load(std::memory_order_acquire);
+        if (chunk) return chunk;
+        std::string_view* fresh = new std::string_view[size_t(1) << CHUNK_BITS];
+        if (slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel)) return fresh;
+        delete[] fresh; // another shard created it first
+        return chunk;
+    }
+};
+
+Table& table() {
+    static Table instance;
+    return instance;
+}
+
+Symbol find(const SlotTable* slots, std::string_view text, uint32_t tag) {
+    if (!slots) return NO_SYMBOL;
+    for (size_t i = tag & slots->mask;; i = (i + 1) & slots->mask) {
+        uint64_t slot = slots->slots[i].load(std::memory_order_acquire);
+        if (slot == 0) return NO_SYMBOL;
+        if (uint32_t(slot >> 32) == tag && name(Symbol(slot)) == text) return Symbol(slot);
+    }
+}
+
+void place(SlotTable& slots, uint64_t entry) {
+    size_t i = uint32_t(entry >> 32) & slots.mask;
+    while (slots.slots[i].load(std::memory_order_relaxed) != 0) i = (i + 1) & slots.mask;
+    slots.slots[i].store(entry, std::memory_order_release);
+}
+
+Symbol insert(Table& t, Shard& shard, std::string_view text, uint32_t tag) {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    SlotTable* slots = shard.table.load(std::memory_order_relaxed);
+    if (Symbol id = find(slots, text, tag)) return id; // lost a race for this name
+
+    Symbol id = t.next.fetch_add(1, std::memory_order_relaxed);
+    if ((id >> CHUNK_BITS) >= MAX_CHUNKS) throw std::runtime_error("Too many distinct identifiers.");
+    t.chunkFor(id)[id & ((1u << CHUNK_BITS) - 1)] = std::string_view(shard.store(text), text.size());
+
+    if (!slots || (shard.used + 1) * 2 > slots->mask + 1) { // keep it at most half full
+        auto grown = std::make_unique<SlotTable>(slots ? (slots->mask + 1) * 2 : 256);
+        if (slots) {
+            for (size_t i = 0; i <= slots->mask; i++) {
+                uint64_t entry = slots->slots[i].load(std::memory_order_relaxed);
+                if (entry) place(*grown, entry);
+            }
+        }
+        place(*grown, pack(tag, id));
+        shard.table.store(grown.get(), std::memory_order_release);
+        shard.tables.push_back(std::move(grown));
+    } else {
+        place(*slots, pack(tag, id));
+    }
+    shard.used++;
+    return id;
+}
+
+} // namespace
+
+Symbol intern(std::string_view text) {
+    uint64_t hash = hashName(text);
+    Table& t = table();
+    Shard& shard = t.shards[hash >> (64 - SHARD_BITS)];
+    uint32_t tag = uint32_t(hash);
+    if (Symbol id = find(shard.table.load(std::memory_order_acquire), text, tag)) return id;
+    return insert(t, shard, text, tag);
+}
+
+std::string_view name(Symbol symbol) {
+    if (symbol == NO_SYMBOL) return {};
+    const std::string_view* chunk = table().directory[symbol >> CHUNK_BITS].load(std::memory_order_acquire);
+    return chunk[symbol & ((1u << CHUNK_BITS) - 1)];
+}
+
+size_t count() {
+    return table().next.load(std::memory_order_relaxed) - 1;
+}
+
+} // namespace symbols
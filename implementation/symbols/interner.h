@@ -0,0 +1,30 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// ---------- Symbol interner ----------
+// Process-wide table that maps every identifier spelling to a dense 32-bit
+// symbol, so name resolution compares and hashes integers instead of text.
+// The scanner interns each IDENTIFIER token once (Token::symbol); every later
+// stage keys its scopes by symbol (see symbolmap.h).
+//  - ids are dense, start at 1 and are never reused; 0 means "no symbol"
+//  - intern() is thread-safe: the table is split into shards by hash; finding
+//    a known name takes no lock, only adding a new one locks its shard
+//  - name() needs no lock and its view stays valid for the whole process
+// Symbols are only meaningful inside the process that made them: anything
+// persisted (the AST cache) stores text and re-interns it on load.
+namespace symbols {
+
+using Symbol = uint32_t;
+constexpr Symbol NO_SYMBOL = 0;
+
+Symbol intern(std::string_view name);
+std::string_view name(Symbol symbol);
+size_t count(); // symbols created so far
+
+} // namespace symbols
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef SYMBOLMAP_H
+#define SYMBOLMAP_H
+
+#include "interner.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// ---------- Symbol-keyed tables ----------
+// SymbolMap: open-addressing hash map from symbol to V with linear probing
+// and backward-shift deletion (no tombstones). Symbols are dense, so a
+// multiplicative hash spreads them well. The map is one flat array of
+// {symbol, value} slots; NO_SYMBOL marks an empty slot and is not a valid key.
+template <typename V>
+class SymbolMap {
+public:
+    V* find(symbols::Symbol key) {
+        if (slots.empty()) return nullptr;
+        for (size_t i = home(key);; i = (i + 1) & mask()) {
+            if (slots[i].key == key) return &slots[i].value;
+            if (slots[i].key == symbols::NO_SYMBOL) return nullptr;
+        }
+    }
+    const V* find(symbols::Symbol key) const { return const_cast<SymbolMap*>(this)->find(key); }
+
+    // insert or overwrite
+    V& set(symbols::Symbol key, V value) {
+        if ((count + 1) * 4 > slots.size() * 3) grow();
+        size_t i = home(key);
+        while (slots[i].key != symbols::NO_SYMBOL && slots[i].key != key) i = (i + 1) & mask();
+        if (slots[i].key == symbols::NO_SYMBOL) count++;
+        slots[i].key = key;
+        slots[i].value = std::move(value);
+        return slots[i].value;
+    }
+
+    bool erase(symbols::Symbol key) {
+        if (slots.empty()) return false;
+        size_t i = home(key);
+        while (slots[i].key != key) {
+            if (slots[i].key == symbols::NO_SYMBOL) return false;
+            i = (i + 1) & mask();
+        }
+        // shift later members of the probe run back into the hole
+        for (size_t j = (i + 1) & mask(); slots[j].key != symbols::NO_SYMBOL; j = (j + 1) & mask()) {
+            size_t want = home(slots[j].key);
+            bool movable = i <= j ? (want <= i || want > j) : (want <= i && want > j);
+            if (movable) {
+                slots[i] = std::move(slots[j]);
+                i = j;
+            }
+        }
+        slots[i] = Slot();
+        count--;
+        return true;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    void clear() {
+        slots.clear();
+        count = 0;
+    }
+
+private:
+    struct Slot {
+        symbols::Symbol key = symbols::NO_SYMBOL;
+        V value = V();
+    };
+
+    std::vector<Slot> slots; // size is zero or a power of two
+    size_t count = 0;
+
+    size_t mask() const { return slots.size() - 1; }
+    size_t home(symbols::Symbol key) const { return size_t(key * 0x9E3779B1u) & mask(); }
+
+    void grow() {
+        std::vector<Slot> old = std::move(slots);
+        slots.assign(old.empty() ? 16 : old.size() * 2, Slot());
+        for (Slot& s : old) {
+            if (s.key == symbols::NO_SYMBOL) continue;
+            size_t i = home(s.key);
+            while (slots[i].key != symbols::NO_SYMBOL) i = (i + 1) & mask();
+            slots[i] = std::move(s);
+        }
+    }
+};
+
+// ScopeStack: the bindings of nested lexical scopes as one stack (innermost
+// last) plus a SymbolMap to the innermost binding of each name, so lookups
+// are O(1) however many names are in scope. V needs a `symbols::Symbol name`
+// member. Popping a binding brings back the one it shadowed.
+template <typename V>
+class ScopeStack {
+public:
+    void push(const V& binding) {
+        uint32_t* top = innermost.find(binding.name);
+        entries.push_back(Entry{binding, top ? *top : 0});
+        innermost.set(binding.name, uint32_t(entries.size())); // index + 1
+    }
+
+    void pop_back() {
+        const Entry& e = entries.back();
+        if (e.shadowed) innermost.set(e.binding.name, e.shadowed);
+        else innermost.erase(e.binding.name);
+        entries.pop_back();
+    }
+
+    void truncate(size_t size) {
+        while (entries.size() > size) pop_back();
+    }
+
+    void clear() {
+        entries.clear();
+        innermost.clear();
+    }
+
+    // innermost binding of a name, or nullptr
+    V* find(symbols::Symbol name) {
+        const uint32_t* at = innermost.find(name);
+        return at ? &entries[*at - 1].binding : nullptr;
+    }
+    const V* find(symbols::Symbol name) const { return const_cast<ScopeStack*>(this)->find(name); }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    V& back() { return entries.back().binding; }
+    const V& operator[](size_t i) const { return entries[i].binding; }
+
+private:
+    struct Entry {
+        V binding;
+        uint32_t shadowed; // index + 1 of the binding this one hides; 0 if none
+    };
+
+    std::vector<Entry> entries;
+    SymbolMap<uint32_t> innermost; // index + 1 into entries
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "bytecode.h"
+#include <iomanip>
+
+const char* opName(Op op) {
+    static const char* names[] = {
+#define OP_NAME(name) #name,
+        ASTERVOID_OPCODES(OP_NAME)
+#undef OP_NAME
+    };
+    return op < Op::COUNT ? names[int(op)] : "???";
+}
+
+namespace {
+
+bool isJump(Op op) { return op == Op::JMP || op == Op::JMPF || op == Op::JMPT; }
+
+bool usesConstC(Op op) {
+    return (op >= Op::ADDK && op <= Op::MODK) || (op >= Op::EQK && op <= Op::GEK);
+}
+
+} // namespace
+
+void disassemble(const Proto& proto, const LineTable& lines, std::ostream& out) {
+    out << "== " << proto.name << " (" << proto.code.size() << " instructions, "
+        << proto.numRegs << " registers, " << proto.constants.size() << " constants) ==\n";
+    for (size_t pc = 0; pc < proto.code.size(); pc++) {
+        Instr i = proto.code[pc];
+        Op op = opOf(i);
+        out << std::setw(5) << pc << "  [" << std::setw(4) << lines.line(proto.offsets[pc]) << "]  "
+            << std::left << std::setw(9) << opName(op) << std::right;
+        if (isJump(op)) {
+            if (op != Op::JMP) out << " r" << argA(i);
+            out << " -> " << int(pc) + 1 + argSBx(i);
+        } else if (op == Op::LOADK) {
+            out << " r" << argA(i) << " K" << argBx(i) << " (" << valueToString(proto.constants[argBx(i)]) << ")";
+        } else if (op == Op::CALL || op == Op::TAILCALL) {
+            out << " r" << argA(i) << " P" << argBx(i);
+        } else if (op == Op::GETGLOBAL || op == Op::SETGLOBAL) {
+            out << " r" << argA(i) << " S" << argBx(i);
+        } else if (op == Op::LOADI) {
+            out << " r" << argA(i) << " " << argSBx(i);
+        } else if (op == Op::LOADBOOL || op == Op::RETURN || op == Op::PRINT) {
+            out << " r" << argA(i) << " " << argB(i);
+        } else if (op == Op::LOADNIL || op == Op::TOINT || op == Op::TOFLOAT) {
+            out << " r" << argA(i);
+        } else if (op == Op::MOVE || op == Op::NEG || op == Op::NOT || op == Op::TOBOOL) {
+            out << " r" << argA(i) << " r" << argB(i);
+        } else {
+            out << " r" << argA(i) << " r" << argB(i);
+            if (usesConstC(op)) out << " K" << argC(i) << " (" << valueToString(proto.constants[argC(i)]) << ")";
+            else out << " r" << argC(i);
+        }
+        out << "\n";
+    }
+}
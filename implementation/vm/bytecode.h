@@ -0,0 +1,125 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "../source/linetable.h"
+#include "star.h"
+#include "value.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------- Register bytecode ----------
+// 32-bit instructions, Lua style:  | op:8 | A:8 | B:8 | C:8 |  or  | op:8 | A:8 | sBx:16 |
+// A is always the destination / tested register. B and C are registers, or a
+// constant index for the *K forms. Jumps are relative to the next instruction.
+// P[Bx] is proto Bx of the module, n its parameter count; a call's frame
+// starts at the caller's R[A], where the arguments already are and the
+// result is left. S is the script's register file (proto 0's frame), which
+// functions reach its outermost variables through.
+#define ASTERVOID_OPCODES(OP) \
+    OP(MOVE)     /* R[A] = R[B]                         */ \
+    OP(LOADK)    /* R[A] = K[Bx]                        */ \
+    OP(LOADI)    /* R[A] = sBx (small int)              */ \
+    OP(LOADBOOL) /* R[A] = B != 0                       */ \
+    OP(LOADNIL)  /* R[A] = vacuum                       */ \
+    OP(TOINT)    /* R[A] = (mass) R[A]                  */ \
+    OP(TOFLOAT)  /* R[A] = (flux) R[A]                  */ \
+    OP(ADD)      /* R[A] = R[B] + R[C]                  */ \
+    OP(SUB)      \
+    OP(MUL)      \
+    OP(DIV)      \
+    OP(MOD)      \
+    OP(ADDK)     /* R[A] = R[B] + K[C]                  */ \
+    OP(SUBK)     \
+    OP(MULK)     \
+    OP(DIVK)     \
+    OP(MODK)     \
+    OP(EQ)       /* R[A] = R[B] == R[C]                 */ \
+    OP(NE)       \
+    OP(LT)       \
+    OP(LE)       \
+    OP(GT)       \
+    OP(GE)       \
+    OP(EQK)      /* R[A] = R[B] == K[C]                 */ \
+    OP(NEK)      \
+    OP(LTK)      \
+    OP(LEK)      \
+    OP(GTK)      \
+    OP(GEK)      \
+    OP(BAND)     /* R[A] = R[B] & R[C]                  */ \
+    OP(BOR)      \
+    OP(BXOR)     \
+    OP(NEG)      /* R[A] = -R[B]                        */ \
+    OP(NOT)      /* R[A] = !R[B]                        */ \
+    OP(TOBOOL)   /* R[A] = truth value of R[B]          */ \
+    OP(JMP)      /* pc += sBx                           */ \
+    OP(JMPF)     /* if !R[A] then pc += sBx             */ \
+    OP(JMPT)     /* if R[A] then pc += sBx              */ \
+    OP(RETURN)   /* return B ? R[A] : vacuum            */ \
+    OP(PRINT)    /* shine R[A] .. R[A+B-1]              */ \
+    OP(CALL)     /* R[A] = P[Bx](R[A] .. R[A+n-1])      */ \
+    OP(TAILCALL) /* return P[Bx](R[A] .. R[A+n-1])      */ \
+    OP(GETGLOBAL) /* R[A] = S[Bx]                        */ \
+    OP(SETGLOBAL) /* S[Bx] = R[A]                        */
+
+enum class Op : uint8_t {
+#define OP_ENUM(name) name,
+    ASTERVOID_OPCODES(OP_ENUM)
+#undef OP_ENUM
+    COUNT
+};
+
+using Instr = uint32_t;
+
+inline Instr encodeABC(Op op, unsigned a, unsigned b, unsigned c) {
+    return uint32_t(op) | (a << 8) | (b << 16) | (c << 24);
+}
+inline Instr encodeAsBx(Op op, unsigned a, int sbx) {
+    return uint32_t(op) | (a << 8) | (uint32_t(uint16_t(int16_t(sbx))) << 16);
+}
+inline Op opOf(Instr i) { return Op(i & 0xFF); }
+inline unsigned argA(Instr i) { return (i >> 8) & 0xFF; }
+inline unsigned argB(Instr i) { return (i >> 16) & 0xFF; }
+inline unsigned argC(Instr i) { return i >> 24; }
+inline unsigned argBx(Instr i) { return i >> 16; }
+inline int argSBx(Instr i) { return int16_t(uint16_t(i >> 16)); }
+
+const char* opName(Op op);
+
+// one compiled function (the top-level script is proto 0)
+struct Proto {
+    std::string name;
+    std::vector<Instr> code;
+    std::vector<uint32_t> offsets; // source offset per instruction, for runtime errors and listings
+    std::vector<Value> constants;
+    int numRegs = 0;
+    int numParams = 0; // arrive in registers 0..numParams-1
+};
+
+// a named register the outermost scope of the script left behind
+struct TopLevelVar {
+    std::string name;
+    uint8_t reg;
+};
+
+struct Module {
+    std::vector<Proto> protos; // the script, then the functions in declaration order
+    std::vector<TopLevelVar> topLevel;
+    StarHeap strings; // storage behind Str constants, interned across all protos
+    const LineTable* lines = nullptr; // turns Proto::offsets into lines; set by the Compiler
+};
+
+// a caller to resume, on the VM's call stack (which native code pushes and
+// pops too: see jit::Context); the callee's frame starts where its CALL put
+// the arguments
+struct CallFrame {
+    const Proto* proto;
+    const Instr* ip;
+    size_t base; // into the register file
+};
+
+void disassemble(const Proto& proto, const LineTable& lines, std::ostream& out);
+
+#endif
@@ -0,0 +1,642 @@
+#include "compiler.h"
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr int MAX_REGISTERS = 250;
+
+// + - * / % and their compound assignment forms
+bool isArithmetic(TokenType t) {
+    switch (t) {
+        case TokenType::PLUS: case TokenType::MINUS: case TokenType::STARR:
+        case TokenType::SLASH: case TokenType::PERCENT:
+        case TokenType::PLUS_EQ: case TokenType::MINUS_EQ: case TokenType::STARR_EQ:
+        case TokenType::SLASH_EQ: case TokenType::PERCENT_EQ:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isBitwise(TokenType t) {
+    return t == TokenType::BIT_AND || t == TokenType::BIT_OR || t == TokenType::XOR;
+}
+
+// register-register opcode for a binary (or compound assignment) operator token
+Op binaryOp(TokenType t) {
+    switch (t) {
+        case TokenType::PLUS: case TokenType::PLUS_EQ: return Op::ADD;
+        case TokenType::MINUS: case TokenType::MINUS_EQ: return Op::SUB;
+        case TokenType::STARR: case TokenType::STARR_EQ: return Op::MUL;
+        case TokenType::SLASH: case TokenType::SLASH_EQ: return Op::DIV;
+        case TokenType::PERCENT: case TokenType::PERCENT_EQ: return Op::MOD;
+        case TokenType::BIT_AND: return Op::BAND;
+        case TokenType::BIT_OR: return Op::BOR;
+        case TokenType::XOR: return Op::BXOR;
+        case TokenType::EQUAL_EQ: return Op::EQ;
+        case TokenType::BANG_EQ: return Op::NE;
+        case TokenType::LESS: return Op::LT;
+        case TokenType::LESS_EQ: return Op::LE;
+        case TokenType::GREATER: return Op::GT;
+        case TokenType::GREATER_EQ: return Op::GE;
+        default: throw std::runtime_error("Unsupported binary operator");
+    }
+}
+
+bool hasConstantForm(Op op) { return op >= Op::ADD && op <= Op::GE; }
+
+// the *K form of a register-register opcode
+Op constantForm(Op op) {
+    if (op >= Op::ADD && op <= Op::MOD) return Op(int(op) + (int(Op::ADDK) - int(Op::ADD)));
+    return Op(int(op) + (int(Op::EQK) - int(Op::EQ)));
+}
+
+// operator to use when the operands are swapped (constant on the left), or
+// COUNT when the operator is not symmetric (ADD on a star literal is not: it
+// concatenates)
+Op swappedForm(Op op) {
+    switch (op) {
+        case Op::ADD: case Op::MUL: case Op::EQ: case Op::NE: return op;
+        case Op::LT: return Op::GT;
+        case Op::LE: return Op::GE;
+        case Op::GT: return Op::LT;
+        case Op::GE: return Op::LE;
+        default: return Op::COUNT;
+    }
+}
+
+bool hasAssignment(Expr* expr) {
+    if (!expr) return false;
+    switch (expr->kind) {
+        case ExprKind::Assign: return true;
+        case ExprKind::Binary: {
+            auto* b = static_cast<BinaryExpr*>(expr);
+            return hasAssignment(b->left) || hasAssignment(b->right);
+        }
+        case ExprKind::Logical: {
+            auto* l = static_cast<LogicalExpr*>(expr);
+            return hasAssignment(l->left) || hasAssignment(l->right);
+        }
+        case ExprKind::Unary: return hasAssignment(static_cast<UnaryExpr*>(expr)->operand);
+        case ExprKind::Call: {
+            // a function may assign the script's variables
+            auto* call = static_cast<CallExpr*>(expr);
+            if (call->callee.type != TokenType::SHINE) return true;
+            for (Expr* arg : call->args)
+                if (hasAssignment(arg)) return true;
+            return false;
+        }
+        default: return false;
+    }
+}
+
+// whether expr is a number whenever evaluating it does not fail. A variable
+// declared mass or flux is not: coercion leaves a truth, a star or vacuum as is
+bool alwaysNumeric(Expr* expr) {
+    switch (expr->kind) {
+        case ExprKind::Literal: {
+            LiteralExpr::Type type = static_cast<LiteralExpr*>(expr)->type;
+            return type == LiteralExpr::Type::Int || type == LiteralExpr::Type::Float;
+        }
+        case ExprKind::Binary: {
+            // star + star concatenates; with a number on either side it is a sum
+            auto* b = static_cast<BinaryExpr*>(expr);
+            if (b->op.type == TokenType::PLUS) return alwaysNumeric(b->left) || alwaysNumeric(b->right);
+            return isArithmetic(b->op.type) || isBitwise(b->op.type);
+        }
+        case ExprKind::Unary: return static_cast<UnaryExpr*>(expr)->op.type == TokenType::MINUS;
+        default: return false;
+    }
+}
+
+} // namespace
+
+Compiler::Compiler(Module& module, const LineTable& lines) : module(module), lines(lines) {
+    module.lines = &lines;
+}
+
+void Compiler::compileProgram(const StmtList& program) {
+    // functions are visible everywhere, including before their declaration;
+    // every proto exists up front so that calls can name them
+    for (Stmt* stmt : program) {
+        if (stmt->kind != StmtKind::FuncDecl) continue;
+        auto* decl = static_cast<FuncDecl*>(stmt);
+        if (functionIndex.find(decl->name.symbol()))
+            error(decl->name.offset, "function '" + std::string(decl->name.lexeme) + "' already declared");
+        if (functions.size() >= UINT16_MAX) throw std::runtime_error("Too many functions");
+        functionIndex.set(decl->name.symbol(), uint32_t(functions.size()));
+        functions.push_back(decl);
+    }
+    module.protos.resize(1 + functions.size());
+    module.protos[0].name = "<script>";
+    for (size_t i = 0; i < functions.size(); i++) {
+        module.protos[1 + i].name = std::string(functions[i]->name.lexeme);
+        module.protos[1 + i].numParams = int(functions[i]->params.size());
+    }
+    proto = &module.protos[0];
+
+    for (Stmt* stmt : program) statement(stmt);
+    emit(encodeABC(Op::RETURN, 0, 0, 0));
+
+    for (size_t i = 0; i < locals.size(); i++)
+        module.topLevel.push_back({std::string(symbols::name(locals[i].name)), locals[i].reg});
+}
+
+// ---------- emission ----------
+int Compiler::emit(Instr instr) {
+    proto->code.push_back(instr);
+    proto->offsets.push_back(offset);
+    return here() - 1;
+}
+
+int Compiler::emitJump(Op op, unsigned a) { return emit(encodeAsBx(op, a, 0)); }
+
+void Compiler::patchJump(int at, int target) {
+    int offset = target - (at + 1);
+    if (offset < INT16_MIN || offset > INT16_MAX) throw std::runtime_error("Jump too far (function body too large)");
+    Instr& instr = proto->code[at];
+    instr = encodeAsBx(opOf(instr), argA(instr), offset);
+}
+
+uint8_t Compiler::allocReg() {
+    if (freeReg >= MAX_REGISTERS) throw std::runtime_error("Too many registers needed (expression or scope too large)");
+    int reg = freeReg++;
+    if (freeReg > proto->numRegs) proto->numRegs = freeReg;
+    return uint8_t(reg);
+}
+
+int Compiler::constant(const Value& v) {
+    for (size_t i = 0; i < proto->constants.size(); i++) {
+        const Value& k = proto->constants[i];
+        if (k.type != v.type) continue;
+        if (v.type == Value::Type::Str ? starText(k) == starText(v) : k.i == v.i) return int(i);
+    }
+    proto->constants.push_back(v);
+    return int(proto->constants.size() - 1);
+}
+
+Value Compiler::literalValue(const LiteralExpr& literal) {
+    switch (literal.type) {
+        case LiteralExpr::Type::Bool: return Value::makeBool(literal.boolean);
+        case LiteralExpr::Type::Int: return Value::makeInt(literal.integer);
+        case LiteralExpr::Type::Float: return Value::makeFloat(literal.real);
+        case LiteralExpr::Type::Str: return module.strings.intern(literal.text);
+    }
+    throw std::runtime_error("Unsupported literal");
+}
+
+// ---------- scopes ----------
+void Compiler::beginScope() { scopeDepth++; }
+
+void Compiler::endScope() {
+    scopeDepth--;
+    while (!locals.empty() && locals.back().depth > scopeDepth) locals.pop_back();
+    freeReg = localCount();
+}
+
+void Compiler::error(uint32_t at, const std::string& message) const {
+    throw std::runtime_error("Line " + std::to_string(lines.line(at)) + ": " + message);
+}
+
+const Compiler::Local* Compiler::resolve(symbols::Symbol name) const {
+    return locals.find(name);
+}
+
+// ---------- statements ----------
+void Compiler::statement(Stmt* stmt) {
+    switch (stmt->kind) {
+        case StmtKind::VarDecl: varDeclaration(static_cast<VarDecl*>(stmt)); break;
+        case StmtKind::FuncDecl: functionDeclaration(static_cast<FuncDecl*>(stmt)); break;
+        case StmtKind::Block:
+            beginScope();
+            for (Stmt* s : static_cast<BlockStmt*>(stmt)->statements) statement(s);
+            endScope();
+            break;
+        case StmtKind::Expression: {
+            int saved = freeReg;
+            expression(static_cast<ExprStmt*>(stmt)->expression);
+            freeReg = saved;
+            break;
+        }
+        case StmtKind::If: ifStatement(static_cast<IfStmt*>(stmt)); break;
+        case StmtKind::While: whileStatement(static_cast<WhileStmt*>(stmt)); break;
+        case StmtKind::For: forStatement(static_cast<ForStmt*>(stmt)); break;
+        case StmtKind::Return: returnStatement(static_cast<ReturnStmt*>(stmt)); break;
+        case StmtKind::Break:
+        case StmtKind::Continue: {
+            bool isBreak = stmt->kind == StmtKind::Break;
+            if (loops.empty())
+                throw std::runtime_error(std::string(isBreak ? "'darkMatter'" : "'warp'") + " outside of a loop");
+            int jump = emitJump(Op::JMP, 0);
+            (isBreak ? loops.back().breaks : loops.back().continues).push_back(jump);
+            break;
+        }
+    }
+}
+
+void Compiler::varDeclaration(VarDecl* decl) {
+    offset = decl->name.offset;
+    const Local* same = resolve(decl->name.symbol());
+    if (same && same->depth == scopeDepth)
+        error(offset, "variable '" + std::string(decl->name.lexeme) + "' already declared in this scope");
+
+    uint8_t reg = allocReg();
+    TokenType declType = decl->type.type;
+    if (decl->initializer) {
+        expression(decl->initializer, reg);
+        coerce(declType, staticType(decl->initializer), reg);
+    } else if (declType == TokenType::MASS) {
+        emit(encodeAsBx(Op::LOADI, reg, 0));
+    } else if (declType == TokenType::FLUX) {
+        emit(encodeAsBx(Op::LOADK, reg, constant(Value::makeFloat(0.0))));
+    } else {
+        emit(encodeABC(Op::LOADNIL, reg, 0, 0));
+    }
+    // declared after the initializer, so `mass x = x;` sees an outer x
+    locals.push({decl->name.symbol(), reg, declType, scopeDepth, function == nullptr});
+    freeReg = localCount();
+}
+
+// compiled into its own proto where it stands; the script's variables
+// declared before it stay visible
+void Compiler::functionDeclaration(FuncDecl* decl) {
+    offset = decl->name.offset;
+    if (scopeDepth > 0 || function) error(offset, "functions can only be declared at the top level");
+
+    Proto* outerProto = proto;
+    int outerFree = freeReg;
+    std::vector<Loop> outerLoops;
+    std::swap(loops, outerLoops);
+    proto = &module.protos[1 + *functionIndex.find(decl->name.symbol())];
+    function = decl;
+    frameLocals = locals.size();
+    freeReg = 0;
+
+    beginScope();
+    for (const Param& param : decl->params) {
+        offset = param.name.offset;
+        const Local* same = resolve(param.name.symbol());
+        if (same && same->depth == scopeDepth && !same->script)
+            error(offset, "variable '" + std::string(param.name.lexeme) + "' already declared in this scope");
+        locals.push({param.name.symbol(), allocReg(), param.type.type, scopeDepth, false});
+    }
+    // the caller passes the arguments as they are; a tail call jumps here too
+    for (size_t i = 0; i < decl->params.size(); i++) coerce(decl->params[i].type.type, StaticType::Unknown, uint8_t(i));
+    for (Stmt* s : decl->body) statement(s);
+    // falling off the end returns vacuum
+    emit(encodeABC(Op::RETURN, 0, 0, 0));
+    endScope();
+
+    proto = outerProto;
+    function = nullptr;
+    frameLocals = 0;
+    freeReg = outerFree;
+    std::swap(loops, outerLoops);
+}
+
+void Compiler::ifStatement(IfStmt* stmt) {
+    int saved = freeReg;
+    uint8_t cond = expression(stmt->condition);
+    freeReg = saved;
+    int skipThen = emitJump(Op::JMPF, cond);
+    statement(stmt->thenBranch);
+    if (stmt->elseBranch) {
+        int skipElse = emitJump(Op::JMP, 0);
+        patchJump(skipThen, here());
+        statement(stmt->elseBranch);
+        patchJump(skipElse, here());
+    } else {
+        patchJump(skipThen, here());
+    }
+}
+
+void Compiler::whileStatement(WhileStmt* stmt) {
+    int start = here();
+    int saved = freeReg;
+    uint8_t cond = expression(stmt->condition);
+    freeReg = saved;
+    int exit = emitJump(Op::JMPF, cond);
+
+    loops.emplace_back();
+    statement(stmt->body);
+    patchJump(emitJump(Op::JMP, 0), start);
+
+    patchJump(exit, here());
+    for (int j : loops.back().breaks) patchJump(j, here());
+    for (int j : loops.back().continues) patchJump(j, start);
+    loops.pop_back();
+}
+
+void Compiler::forStatement(ForStmt* stmt) {
+    beginScope();
+    if (stmt->initializer) statement(stmt->initializer);
+
+    int start = here();
+    int exit = -1;
+    if (stmt->condition) {
+        int saved = freeReg;
+        uint8_t cond = expression(stmt->condition);
+        freeReg = saved;
+        exit = emitJump(Op::JMPF, cond);
+    }
+
+    loops.emplace_back();
+    statement(stmt->body);
+    int continueTarget = here();
+    if (stmt->increment) {
+        int saved = freeReg;
+        expression(stmt->increment);
+        freeReg = saved;
+    }
+    patchJump(emitJump(Op::JMP, 0), start);
+
+    if (exit >= 0) patchJump(exit, here());
+    for (int j : loops.back().breaks) patchJump(j, here());
+    for (int j : loops.back().continues) patchJump(j, continueTarget);
+    loops.pop_back();
+    endScope();
+}
+
+void Compiler::returnStatement(ReturnStmt* stmt) {
+    if (!stmt->value) {
+        emit(encodeABC(Op::RETURN, 0, 0, 0));
+        return;
+    }
+    int saved = freeReg;
+    if (function && stmt->value->kind == ExprKind::Call) {
+        auto* call = static_cast<CallExpr*>(stmt->value);
+        const uint32_t* index = functionIndex.find(call->callee.symbol());
+        if (call->callee.type != TokenType::SHINE && index &&
+            tailCallKeepsResult(function->returnType.type, functions[*index]->returnType.type)) {
+            int first = arguments(call);
+            offset = call->callee.offset;
+            emit(encodeAsBx(Op::TAILCALL, unsigned(first), int(callee(call)) + 1));
+            freeReg = saved;
+            return;
+        }
+    }
+    uint8_t reg = expression(stmt->value);
+    // a function's result becomes its declared type; converting in place is
+    // fine even in a variable's register, as nothing runs after the return
+    if (function) coerce(function->returnType.type, staticType(stmt->value), reg);
+    freeReg = saved;
+    emit(encodeABC(Op::RETURN, reg, 1, 0));
+}
+
+// ---------- expressions ----------
+uint8_t Compiler::expression(Expr* expr, int dst) {
+    switch (expr->kind) {
+        case ExprKind::Literal: return literal(static_cast<LiteralExpr*>(expr), dst);
+        case ExprKind::Binary: return binary(static_cast<BinaryExpr*>(expr), dst);
+        case ExprKind::Assign: return assign(static_cast<AssignExpr*>(expr), dst);
+        case ExprKind::Unary: return unary(static_cast<UnaryExpr*>(expr), dst);
+        case ExprKind::Logical: return logical(static_cast<LogicalExpr*>(expr), dst);
+        case ExprKind::Call: return call(static_cast<CallExpr*>(expr), dst);
+        case ExprKind::Variable: {
+            const Token& name = static_cast<VariableExpr*>(expr)->name;
+            offset = name.offset;
+            const Local* local = resolve(name.symbol());
+            if (!local)
+                error(offset, "undefined variable '" + std::string(name.lexeme) + "'");
+            if (function && local->script) {
+                uint8_t target = dst >= 0 ? uint8_t(dst) : allocReg();
+                emit(encodeAsBx(Op::GETGLOBAL, target, local->reg));
+                return target;
+            }
+            if (dst < 0 || dst == local->reg) return local->reg;
+            emit(encodeABC(Op::MOVE, dst, local->reg, 0));
+            return uint8_t(dst);
+        }
+    }
+    throw std::runtime_error("Unsupported expression");
+}
+
+uint8_t Compiler::literal(LiteralExpr* expr, int dst) {
+    offset = expr->offset;
+    Value v = literalValue(*expr);
+    uint8_t reg = dst >= 0 ? uint8_t(dst) : allocReg();
+    if (v.isInt() && v.i >= INT16_MIN && v.i <= INT16_MAX) {
+        emit(encodeAsBx(Op::LOADI, reg, int(v.i)));
+    } else if (v.type == Value::Type::Bool) {
+        emit(encodeABC(Op::LOADBOOL, reg, v.b ? 1 : 0, 0));
+    } else {
+        int k = constant(v);
+        if (k > UINT16_MAX) throw std::runtime_error("Too many constants in one function");
+        emit(encodeAsBx(Op::LOADK, reg, k));
+    }
+    return reg;
+}
+
+bool Compiler::constantOperand(Expr* expr, int& index) {
+    if (expr->kind != ExprKind::Literal) return false;
+    int k = constant(literalValue(*static_cast<LiteralExpr*>(expr)));
+    if (k > UINT8_MAX) return false;
+    index = k;
+    return true;
+}
+
+uint8_t Compiler::binary(BinaryExpr* expr, int dst) {
+    Op op = binaryOp(expr->op.type);
+    Expr* left = expr->left;
+    Expr* right = expr->right;
+
+    // constant on the left of a symmetric operator: swap so the *K form applies.
+    // Only between numbers: those cannot fail, and a type error names the
+    // operands in source order (star + star concatenates in that order too)
+    if (left->kind == ExprKind::Literal && right->kind != ExprKind::Literal && swappedForm(op) != Op::COUNT &&
+        alwaysNumeric(left) && alwaysNumeric(right)) {
+        std::swap(left, right);
+        op = swappedForm(op);
+    }
+
+    int saved = freeReg;
+    uint8_t lhs = expression(left);
+    // `x + (x = 5)` must add the old x: pin it in a temporary first
+    if (lhs < saved && hasAssignment(right)) {
+        uint8_t copy = allocReg();
+        emit(encodeABC(Op::MOVE, copy, lhs, 0));
+        lhs = copy;
+    }
+
+    int k;
+    if (hasConstantForm(op) && constantOperand(right, k)) {
+        offset = expr->op.offset;
+        freeReg = saved;
+        uint8_t target = dst >= 0 ? uint8_t(dst) : allocReg();
+        emit(encodeABC(constantForm(op), target, lhs, unsigned(k)));
+        return target;
+    }
+
+    uint8_t rhs = expression(right);
+    offset = expr->op.offset;
+    freeReg = saved;
+    uint8_t target = dst >= 0 ? uint8_t(dst) : allocReg();
+    emit(encodeABC(op, target, lhs, rhs));
+    return target;
+}
+
+uint8_t Compiler::assign(AssignExpr* expr, int dst) {
+    offset = expr->name.offset;
+    const Local* local = resolve(expr->name.symbol());
+    if (!local)
+        error(offset, "undefined variable '" + std::string(expr->name.lexeme) + "'");
+    // a script variable assigned in a function: worked on in a temporary and stored back
+    bool global = function && local->script;
+    uint8_t variable = local->reg;
+    int temporary = freeReg;
+    uint8_t reg = global ? allocReg() : variable;
+    TokenType declType = local->declType;
+    if (expr->op.type == TokenType::EQUAL) {
+        expression(expr->value, reg);
+        coerce(declType, staticType(expr->value), reg);
+    } else {
+        // x op= v: the variable is read after v is evaluated, like x = x op v
+        Op op = binaryOp(expr->op.type);
+        StaticType have = resultType(expr->op.type, staticType(expr), staticType(expr->value));
+        int saved = freeReg;
+        int k;
+        if (constantOperand(expr->value, k)) {
+            if (global) emit(encodeAsBx(Op::GETGLOBAL, reg, variable));
+            offset = expr->op.offset;
+            emit(encodeABC(constantForm(op), reg, reg, unsigned(k)));
+        } else {
+            uint8_t rhs = expression(expr->value);
+            if (global) emit(encodeAsBx(Op::GETGLOBAL, reg, variable));
+            offset = expr->op.offset;
+            emit(encodeABC(op, reg, reg, rhs));
+        }
+        freeReg = saved;
+        coerce(declType, have, reg);
+    }
+    if (global) {
+        offset = expr->name.offset;
+        emit(encodeAsBx(Op::SETGLOBAL, reg, variable));
+    }
+    if (dst < 0 || dst == reg) return reg;
+    emit(encodeABC(Op::MOVE, dst, reg, 0));
+    if (global) freeReg = temporary;
+    return uint8_t(dst);
+}
+
+uint8_t Compiler::unary(UnaryExpr* expr, int dst) {
+    int saved = freeReg;
+    uint8_t operand = expression(expr->operand);
+    offset = expr->op.offset;
+    freeReg = saved;
+    uint8_t target = dst >= 0 ? uint8_t(dst) : allocReg();
+    emit(encodeABC(expr->op.type == TokenType::BANG ? Op::NOT : Op::NEG, target, operand, 0));
+    return target;
+}
+
+// a && b:  t = a; JMPF t -> end; t = b; end: TOBOOL t
+uint8_t Compiler::logical(LogicalExpr* expr, int dst) {
+    int saved = freeReg;
+    // a variable as dst may still be read by the right operand: go through a temporary
+    bool direct = dst >= localCount();
+    uint8_t target = direct ? uint8_t(dst) : allocReg();
+    expression(expr->left, target);
+    int skip = emitJump(expr->op.type == TokenType::AND ? Op::JMPF : Op::JMPT, target);
+    expression(expr->right, target);
+    patchJump(skip, here());
+    offset = expr->op.offset;
+    emit(encodeABC(Op::TOBOOL, target, target, 0));
+    freeReg = saved;
+    if (direct) return target;
+    if (dst < 0) return allocReg(); // the same register as target
+    emit(encodeABC(Op::MOVE, dst, target, 0));
+    return uint8_t(dst);
+}
+
+// arguments go to consecutive registers: shine() prints them, a function's
+// frame starts at the first of them
+uint8_t Compiler::call(CallExpr* expr, int dst) {
+    offset = expr->callee.offset;
+    if (expr->callee.type != TokenType::SHINE) {
+        int saved = freeReg;
+        int first = arguments(expr);
+        offset = expr->callee.offset;
+        emit(encodeAsBx(Op::CALL, unsigned(first), int(callee(expr)) + 1));
+        freeReg = saved;
+        uint8_t target = dst >= 0 ? uint8_t(dst) : allocReg();
+        if (target != first) emit(encodeABC(Op::MOVE, target, unsigned(first), 0));
+        return target;
+    }
+    int saved = freeReg;
+    int first = freeReg;
+    for (Expr* arg : expr->args) expression(arg, allocReg());
+    offset = expr->paren.offset;
+    emit(encodeABC(Op::PRINT, unsigned(first) & 0xFF, unsigned(expr->args.size()), 0));
+    freeReg = saved;
+    uint8_t target = dst >= 0 ? uint8_t(dst) : allocReg();
+    emit(encodeABC(Op::LOADNIL, target, 0, 0));
+    return target;
+}
+
+// index of the function a call names, once its arguments are compiled (their
+// errors come first, as in the Resolver)
+uint32_t Compiler::callee(const CallExpr* expr) {
+    const uint32_t* index = functionIndex.find(expr->callee.symbol());
+    if (!index) error(expr->callee.offset, "undefined function '" + std::string(expr->callee.lexeme) + "'");
+    const FuncDecl* decl = functions[*index];
+    if (decl->params.size() != expr->args.size())
+        error(expr->callee.offset, "function '" + std::string(expr->callee.lexeme) + "' expects " +
+                                       std::to_string(decl->params.size()) + " arguments but got " +
+                                       std::to_string(expr->args.size()));
+    return *index;
+}
+
+// evaluates a user function call's arguments into the next free registers
+// (at least one: the result comes back in the first) and returns the first
+int Compiler::arguments(const CallExpr* expr) {
+    int first = freeReg;
+    for (Expr* arg : expr->args) expression(arg, allocReg());
+    if (expr->args.empty()) allocReg();
+    return first;
+}
+
+void Compiler::coerce(TokenType declType, StaticType have, uint8_t reg) {
+    if (declType == TokenType::MASS && have != StaticType::Int) emit(encodeABC(Op::TOINT, reg, 0, 0));
+    if (declType == TokenType::FLUX && have != StaticType::Float) emit(encodeABC(Op::TOFLOAT, reg, 0, 0));
+}
+
+Compiler::StaticType Compiler::staticType(Expr* expr) const {
+    switch (expr->kind) {
+        case ExprKind::Literal: {
+            LiteralExpr::Type type = static_cast<LiteralExpr*>(expr)->type;
+            if (type == LiteralExpr::Type::Int) return StaticType::Int;
+            if (type == LiteralExpr::Type::Float) return StaticType::Float;
+            return StaticType::Unknown;
+        }
+        case ExprKind::Variable:
+        case ExprKind::Assign: {
+            const Token& name = expr->kind == ExprKind::Variable ? static_cast<VariableExpr*>(expr)->name
+                                                                 : static_cast<AssignExpr*>(expr)->name;
+            const Local* local = resolve(name.symbol());
+            if (!local) return StaticType::Unknown;
+            if (local->declType == TokenType::MASS) return StaticType::Int;
+            if (local->declType == TokenType::FLUX) return StaticType::Float;
+            return StaticType::Unknown;
+        }
+        case ExprKind::Binary: {
+            auto* b = static_cast<BinaryExpr*>(expr);
+            return resultType(b->op.type, staticType(b->left), staticType(b->right));
+        }
+        case ExprKind::Unary: {
+            auto* u = static_cast<UnaryExpr*>(expr);
+            return u->op.type == TokenType::MINUS ? staticType(u->operand) : StaticType::Unknown;
+        }
+        case ExprKind::Logical:
+        case ExprKind::Call:
+            return StaticType::Unknown;
+    }
+    return StaticType::Unknown;
+}
+
+// static type of `left op right` (op may be a compound assignment operator)
+Compiler::StaticType Compiler::resultType(TokenType op, StaticType l, StaticType r) {
+    if (l == StaticType::Unknown || r == StaticType::Unknown) return StaticType::Unknown;
+    if (isBitwise(op)) return l == StaticType::Int && r == StaticType::Int ? StaticType::Int : StaticType::Unknown;
+    if (!isArithmetic(op)) return StaticType::Unknown;
+    return l == StaticType::Int && r == StaticType::Int ? StaticType::Int : StaticType::Float;
+}
@@ -0,0 +1,96 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "../parser/parser.h"
+#include "../symbols/symbolmap.h"
+#include "bytecode.h"
+#include <vector>
+
+// ---------- Bytecode compiler ----------
+// Lowers the parsed program to register bytecode. Locals live in fixed
+// registers for their whole scope; temporaries are stacked above them and
+// released after every statement. Each function becomes a proto of its own
+// (parameters in its first registers); a call puts the arguments in the
+// caller's next free registers, where the callee's frame then begins, and
+// `blackHole f(...)` becomes a tail call when the result needs no coercion
+// of the caller's. Throws std::runtime_error on programs the VM cannot run
+// (undefined variables, too many registers, ...).
+class Compiler {
+public:
+    // lines resolves offsets in compile errors; the module keeps a pointer to
+    // it for runtime errors and listings, so it must outlive the module
+    Compiler(Module& module, const LineTable& lines);
+    void compileProgram(const StmtList& program);
+
+private:
+    enum class StaticType : uint8_t { Unknown, Int, Float };
+
+    struct Local {
+        symbols::Symbol name;
+        uint8_t reg;
+        TokenType declType;
+        int depth;
+        bool script; // declared by the script, not a function (a function reads it with GETGLOBAL)
+    };
+
+    struct Loop {
+        std::vector<int> breaks;    // jumps to patch to the loop exit
+        std::vector<int> continues; // jumps to patch to the continue target
+    };
+
+    Module& module;
+    const LineTable& lines;
+    Proto* proto = nullptr;
+    ScopeStack<Local> locals;
+    SymbolMap<uint32_t> functionIndex;   // user function -> index; its proto is 1 + index
+    std::vector<const FuncDecl*> functions;
+    const FuncDecl* function = nullptr;  // being compiled; nullptr for the script
+    size_t frameLocals = 0;              // locals of enclosing protos (below the current one's)
+    std::vector<Loop> loops;
+    int scopeDepth = 0;
+    int freeReg = 0; // first register not holding a local or a live temporary
+    uint32_t offset = 0; // source offset attached to emitted instructions
+
+    // emission
+    int emit(Instr instr);
+    int emitJump(Op op, unsigned a);
+    void patchJump(int at, int target);
+    int here() const { return int(proto->code.size()); }
+    uint8_t allocReg();
+    int constant(const Value& v);
+    [[noreturn]] void error(uint32_t at, const std::string& message) const; // "Line N: message"
+
+    // scopes
+    void beginScope();
+    void endScope();
+    const Local* resolve(symbols::Symbol name) const;
+    int localCount() const { return int(locals.size() - frameLocals); } // registers the proto's locals hold
+
+    // statements
+    void statement(Stmt* stmt);
+    void varDeclaration(VarDecl* decl);
+    void functionDeclaration(FuncDecl* decl);
+    void ifStatement(IfStmt* stmt);
+    void whileStatement(WhileStmt* stmt);
+    void forStatement(ForStmt* stmt);
+    void returnStatement(ReturnStmt* stmt);
+
+    // expressions: return the register holding the result; with dst >= 0 the
+    // result is placed in dst
+    uint8_t expression(Expr* expr, int dst = -1);
+    uint8_t binary(BinaryExpr* expr, int dst);
+    uint8_t assign(AssignExpr* expr, int dst);
+    uint8_t unary(UnaryExpr* expr, int dst);
+    uint8_t logical(LogicalExpr* expr, int dst);
+    uint8_t call(CallExpr* expr, int dst);
+    uint32_t callee(const CallExpr* expr);
+    int arguments(const CallExpr* expr);
+    uint8_t literal(LiteralExpr* expr, int dst);
+    void coerce(TokenType declType, StaticType have, uint8_t reg);
+    StaticType staticType(Expr* expr) const;
+    static StaticType resultType(TokenType op, StaticType left, StaticType right);
+    bool constantOperand(Expr* expr, int& index);
+    Value literalValue(const LiteralExpr& literal);
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "star.h"
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <stdexcept>
+
+StarBuffer* StarHeap::allocate(size_t capacity, bool fromEnd) {
+    blocks.emplace_back(new char[sizeof(StarBuffer) + capacity]);
+    allocatedBytes += capacity;
+    auto* buffer = new (blocks.back().get()) StarBuffer;
+    buffer->used = 0;
+    buffer->capacity = uint32_t(capacity);
+    buffer->mark = 0; // no collection has marked it yet
+    buffer->fromEnd = fromEnd;
+    return buffer;
+}
+
+Value StarHeap::intern(std::string_view text) {
+    if (text.size() <= Value::SHORT_STAR) return Value::makeShortStr(text);
+    if (text.size() > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("Runtime error: star longer than 4 GiB");
+    auto found = interned.find(text);
+    if (found != interned.end()) return Value::makeStr(found->second, uint32_t(text.size()));
+    // full from the start, so concat never appends to a constant
+    StarBuffer* buffer = allocate(text.size(), false);
+    std::memcpy(buffer->bytes(), text.data(), text.size());
+    buffer->used = uint32_t(text.size());
+    buffer->mark = PERMANENT;
+    interned.emplace(std::string_view(buffer->bytes(), text.size()), buffer);
+    return Value::makeStr(buffer, buffer->used);
+}
+
+Value StarHeap::concat(const Value& a, const Value& b) {
+    std::string_view x = starText(a), y = starText(b);
+    size_t n = x.size() + y.size();
+    if (n <= Value::SHORT_STAR) {
+        char text[Value::SHORT_STAR];
+        std::memcpy(text, x.data(), x.size());
+        std::memcpy(text + x.size(), y.data(), y.size());
+        return Value::makeShortStr(std::string_view(text, n));
+    }
+    constexpr size_t limit = std::numeric_limits<uint32_t>::max();
+    if (n > limit) throw std::runtime_error("Runtime error: star longer than 4 GiB");
+    if (!a.small && !a.s->fromEnd) {
+        // a is a prefix of its buffer; nothing past it may change, but it may
+        // be extended when no other star covers those bytes yet, and reused
+        // when the one that does is exactly a + b already
+        auto* buffer = const_cast<StarBuffer*>(a.s);
+        if (buffer->used == a.length && buffer->capacity - buffer->used >= y.size()) {
+            std::memcpy(buffer->bytes() + buffer->used, y.data(), y.size());
+            buffer->used = uint32_t(n);
+            return Value::makeStr(buffer, uint32_t(n));
+        }
+        if (buffer->used - a.length >= y.size() && std::memcmp(buffer->bytes() + a.length, y.data(), y.size()) == 0)
+            return Value::makeStr(buffer, uint32_t(n));
+    }
+    if (!b.small && b.s->fromEnd) {
+        // the same at the front of a buffer b is a suffix of
+        auto* buffer = const_cast<StarBuffer*>(b.s);
+        char* end = buffer->bytes() + buffer->capacity;
+        if (buffer->used == b.length && buffer->capacity - buffer->used >= x.size()) {
+            std::memcpy(end - n, x.data(), x.size());
+            buffer->used = uint32_t(n);
+            return Value::makeStr(buffer, uint32_t(n));
+        }
+        if (buffer->used - b.length >= x.size() && std::memcmp(end - n, x.data(), x.size()) == 0)
+            return Value::makeStr(buffer, uint32_t(n));
+    }
+    // a buffer that can grow where the shorter operand went, as that is where
+    // a loop building one star adds to it
+    bool fromEnd = x.size() < y.size();
+    StarBuffer* buffer = allocate(std::min(std::max(2 * n, size_t(64)), limit), fromEnd);
+    char* start = fromEnd ? buffer->bytes() + (buffer->capacity - n) : buffer->bytes();
+    std::memcpy(start, x.data(), x.size());
+    std::memcpy(start + x.size(), y.data(), y.size());
+    buffer->used = uint32_t(n);
+    return Value::makeStr(buffer, uint32_t(n));
+}
+
+void StarHeap::sweep() {
+    size_t kept = 0;
+    allocatedBytes = 0;
+    for (size_t k = 0; k < blocks.size(); k++) {
+        auto* buffer = reinterpret_cast<const StarBuffer*>(blocks[k].get());
+        if (buffer->mark != epoch && buffer->mark != PERMANENT) {
+            blocks[k].reset();
+            continue;
+        }
+        allocatedBytes += buffer->capacity;
+        if (kept != k) blocks[kept] = std::move(blocks[k]);
+        kept++;
+    }
+    blocks.resize(kept);
+    collectAt = std::max(2 * allocatedBytes, MIN_COLLECT_AT);
+}
+
+void StarHeap::clear() {
+    blocks.clear();
+    interned.clear();
+    allocatedBytes = 0;
+    collectAt = MIN_COLLECT_AT;
+}
@@ -0,0 +1,70 @@
+#ifndef STAR_H
+#define STAR_H
+
+#include "value.h"
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// ---------- Star storage ----------
+// Owns the buffers behind long star values (short ones live in the Value).
+// Constants are interned: equal texts share one exactly-sized buffer, so a
+// program holds each distinct literal once however often it appears, until
+// clear() or the heap's destruction, which the engines do at the start of
+// each run.
+// Concatenation builds instead of copying: when the left operand is the whole
+// of its buffer's contents and the buffer has room, the right one is
+// appended in place, and buffers grow by doubling, so `s = s + x` in a loop
+// costs amortized O(|x|) rather than O(|s|). A buffer made for a short star
+// in front of a longer one grows at its front instead, which does the same
+// for `s = x + s`. (Stars that grow at both ends, or in the middle, are
+// still copied each time.)
+// Buffers built by concat() are garbage collected. The heap does not know
+// where its stars are held, so the engine collects at a point where every
+// star it still needs is in a place it can enumerate: when wantsCollection()
+// says enough has been allocated since the last time, it calls
+// beginCollection(), mark() on every such value and sweep(), which frees the
+// buffers no marked value points into.
+class StarHeap {
+public:
+    StarHeap() = default;
+    StarHeap(StarHeap&&) = default;
+    StarHeap& operator=(StarHeap&&) = default;
+    StarHeap(const StarHeap&) = delete;
+    StarHeap& operator=(const StarHeap&) = delete;
+
+    // a star with these bytes, shared with every other interned star equal to it
+    Value intern(std::string_view text);
+    // a + b (both stars); throws std::runtime_error past 4 GiB
+    Value concat(const Value& a, const Value& b);
+    void clear();
+    // bytes held in buffers
+    size_t allocated() const { return allocatedBytes; }
+
+    bool wantsCollection() const { return allocatedBytes >= collectAt; }
+    void beginCollection() {
+        if (++epoch == PERMANENT) epoch = 1; // 0 is left to new buffers
+    }
+    // v stays valid through the next sweep(); interned and other heaps'
+    // constant buffers are left alone
+    void mark(const Value& v) {
+        if (v.type == Value::Type::Str && !v.small && v.s->mark != PERMANENT)
+            const_cast<StarBuffer*>(v.s)->mark = epoch;
+    }
+    void sweep();
+
+private:
+    static constexpr uint32_t PERMANENT = UINT32_MAX; // mark of interned buffers
+    static constexpr size_t MIN_COLLECT_AT = size_t(1) << 20;
+
+    StarBuffer* allocate(size_t capacity, bool fromEnd);
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::unordered_map<std::string_view, const StarBuffer*> interned;
+    size_t allocatedBytes = 0;
+    size_t collectAt = MIN_COLLECT_AT; // allocatedBytes that asks for the next collection
+    uint32_t epoch = 0;
+};
+
+#endif
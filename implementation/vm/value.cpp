@@ -0,0 +1,197 @@
+#include "value.h"
+#include "star.h"
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <stdexcept>
+
+namespace {
+
+const char* typeName(Value::Type t) {
+    switch (t) {
+        case Value::Type::Nil: return "vacuum";
+        case Value::Type::Int: return "mass";
+        case Value::Type::Float: return "flux";
+        case Value::Type::Bool: return "truth";
+        case Value::Type::Str: return "star";
+    }
+    return "?";
+}
+
+[[noreturn]] void typeError(const char* what, const Value& a, const Value& b) {
+    throw std::runtime_error(std::string("Runtime error: cannot ") + what + " " +
+                             typeName(a.type) + " and " + typeName(b.type));
+}
+
+} // namespace
+
+Value arithmetic(ArithOp op, const Value& a, const Value& b, StarHeap* heap) {
+    if (op == ArithOp::Add && heap && a.type == Value::Type::Str && b.type == Value::Type::Str)
+        return heap->concat(a, b);
+    if (!a.isNumber() || !b.isNumber()) {
+        static const char* names[] = {"add", "subtract", "multiply", "divide", "take the remainder of"};
+        typeError(names[int(op)], a, b);
+    }
+    if (a.isInt() && b.isInt()) {
+        switch (op) {
+            case ArithOp::Add: return Value::makeInt(wrapAdd(a.i, b.i));
+            case ArithOp::Sub: return Value::makeInt(wrapSub(a.i, b.i));
+            case ArithOp::Mul: return Value::makeInt(wrapMul(a.i, b.i));
+            case ArithOp::Div:
+                if (b.i == 0) throw std::runtime_error("Runtime error: division by zero");
+                if (b.i == -1) return Value::makeInt(wrapSub(0, a.i)); // INT64_MIN / -1
+                return Value::makeInt(a.i / b.i);
+            case ArithOp::Mod:
+                if (b.i == 0) throw std::runtime_error("Runtime error: division by zero");
+                if (b.i == -1) return Value::makeInt(0);
+                return Value::makeInt(a.i % b.i);
+        }
+    }
+    double x = a.asFloat(), y = b.asFloat();
+    switch (op) {
+        case ArithOp::Add: return Value::makeFloat(x + y);
+        case ArithOp::Sub: return Value::makeFloat(x - y);
+        case ArithOp::Mul: return Value::makeFloat(x * y);
+        case ArithOp::Div: return Value::makeFloat(x / y);
+        case ArithOp::Mod: return Value::makeFloat(std::fmod(x, y));
+    }
+    return Value();
+}
+
+bool valuesEqual(const Value& a, const Value& b) {
+    if (a.isNumber() && b.isNumber()) {
+        if (a.isInt() && b.isInt()) return a.i == b.i;
+        return a.asFloat() == b.asFloat();
+    }
+    if (a.type != b.type) return false;
+    switch (a.type) {
+        case Value::Type::Nil: return true;
+        case Value::Type::Bool: return a.b == b.b;
+        case Value::Type::Str: return starText(a) == starText(b);
+        default: return false;
+    }
+}
+
+Value compare(CompareOp op, const Value& a, const Value& b) {
+    if (op == CompareOp::Eq) return Value::makeBool(valuesEqual(a, b));
+    if (op == CompareOp::Ne) return Value::makeBool(!valuesEqual(a, b));
+    int c;
+    if (a.isInt() && b.isInt()) {
+        c = a.i < b.i ? -1 : a.i > b.i ? 1 : 0;
+    } else if (a.isNumber() && b.isNumber()) {
+        double x = a.asFloat(), y = b.asFloat();
+        if (std::isnan(x) || std::isnan(y)) return Value::makeBool(false);
+        c = x < y ? -1 : x > y ? 1 : 0;
+    } else if (a.type == Value::Type::Str && b.type == Value::Type::Str) {
+        c = starText(a).compare(starText(b));
+    } else {
+        typeError("compare", a, b);
+    }
+    switch (op) {
+        case CompareOp::Lt: return Value::makeBool(c < 0);
+        case CompareOp::Le: return Value::makeBool(c <= 0);
+        case CompareOp::Gt: return Value::makeBool(c > 0);
+        case CompareOp::Ge: return Value::makeBool(c >= 0);
+        default: return Value::makeBool(false);
+    }
+}
+
+Value bitwise(BitOp op, const Value& a, const Value& b) {
+    if (!a.isInt() || !b.isInt()) {
+        static const char* names[] = {"bitwise-and", "bitwise-or", "bitwise-xor"};
+        typeError(names[int(op)], a, b);
+    }
+    switch (op) {
+        case BitOp::And: return Value::makeInt(a.i & b.i);
+        case BitOp::Or: return Value::makeInt(a.i | b.i);
+        case BitOp::Xor: return Value::makeInt(a.i ^ b.i);
+    }
+    return Value();
+}
+
+Value negate(const Value& v) {
+    if (v.isInt()) return Value::makeInt(wrapSub(0, v.i));
+    if (v.isFloat()) return Value::makeFloat(-v.f);
+    throw std::runtime_error(std::string("Runtime error: cannot negate ") + typeName(v.type));
+}
+
+bool applyOperator(TokenType op, const Value& a, const Value& b, Value& out, StarHeap* heap) {
+    switch (op) {
+        case TokenType::PLUS: case TokenType::PLUS_EQ: out = arithmetic(ArithOp::Add, a, b, heap); return true;
+        case TokenType::MINUS: case TokenType::MINUS_EQ: out = arithmetic(ArithOp::Sub, a, b); return true;
+        case TokenType::STARR: case TokenType::STARR_EQ: out = arithmetic(ArithOp::Mul, a, b); return true;
+        case TokenType::SLASH: case TokenType::SLASH_EQ: out = arithmetic(ArithOp::Div, a, b); return true;
+        case TokenType::PERCENT: case TokenType::PERCENT_EQ: out = arithmetic(ArithOp::Mod, a, b); return true;
+        case TokenType::EQUAL_EQ: out = compare(CompareOp::Eq, a, b); return true;
+        case TokenType::BANG_EQ: out = compare(CompareOp::Ne, a, b); return true;
+        case TokenType::LESS: out = compare(CompareOp::Lt, a, b); return true;
+        case TokenType::LESS_EQ: out = compare(CompareOp::Le, a, b); return true;
+        case TokenType::GREATER: out = compare(CompareOp::Gt, a, b); return true;
+        case TokenType::GREATER_EQ: out = compare(CompareOp::Ge, a, b); return true;
+        case TokenType::BIT_AND: out = bitwise(BitOp::And, a, b); return true;
+        case TokenType::BIT_OR: out = bitwise(BitOp::Or, a, b); return true;
+        case TokenType::XOR: out = bitwise(BitOp::Xor, a, b); return true;
+        default: return false;
+    }
+}
+
+bool isTruthy(const Value& v) {
+    switch (v.type) {
+        case Value::Type::Nil: return false;
+        case Value::Type::Int: return v.i != 0;
+        case Value::Type::Float: return v.f != 0.0;
+        case Value::Type::Bool: return v.b;
+        case Value::Type::Str: return v.small != 1;
+    }
+    return false;
+}
+
+int64_t truncateToMass(double f) {
+    if (f != f) return 0;
+    if (f >= 9223372036854775808.0) return INT64_MAX; // 2^63
+    if (f < -9223372036854775808.0) return INT64_MIN;
+    return int64_t(f);
+}
+
+Value coerceToDeclared(TokenType declType, const Value& v) {
+    if (declType == TokenType::MASS && v.isFloat()) return Value::makeInt(truncateToMass(v.f));
+    if (declType == TokenType::FLUX && v.isInt()) return Value::makeFloat(double(v.i));
+    return v;
+}
+
+Value defaultForDeclared(TokenType declType) {
+    if (declType == TokenType::MASS) return Value::makeInt(0);
+    if (declType == TokenType::FLUX) return Value::makeFloat(0.0);
+    return Value();
+}
+
+namespace {
+
+// text of a non-star value, in buf when it has to be formatted
+std::string_view scalarText(const Value& v, char (&buf)[32]) {
+    switch (v.type) {
+        case Value::Type::Int: return std::string_view(buf, size_t(std::snprintf(buf, sizeof buf, "%" PRId64, v.i)));
+        case Value::Type::Float:
+            // which NaN an operation returns (and so its sign) depends on the
+            // operand order the C++ compiler or the JIT picked; print them all alike
+            if (std::isnan(v.f)) return "nan";
+            return std::string_view(buf, size_t(std::snprintf(buf, sizeof buf, "%.17g", v.f)));
+        case Value::Type::Bool: return v.b ? "starlight" : "voidness";
+        default: return "vacuum";
+    }
+}
+
+} // namespace
+
+std::string valueToString(const Value& v) {
+    if (v.type == Value::Type::Str) return std::string(starText(v));
+    char buf[32];
+    return std::string(scalarText(v, buf));
+}
+
+void printValue(std::ostream& out, const Value& v) {
+    char buf[32];
+    std::string_view text = v.type == Value::Type::Str ? starText(v) : scalarText(v, buf);
+    out.write(text.data(), std::streamsize(text.size()));
+}
@@ -0,0 +1,135 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include "../scanner/TokenType.h"
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+// bytes of long star values (see StarHeap); a buffer holds one star and grows
+// at one end, so every star is one contiguous run of bytes: the first
+// `length` bytes of the buffer, or the last ones when it grows at its front
+struct StarBuffer {
+    uint32_t used;     // bytes written; the star spanning them may be extended in place
+    uint32_t capacity; // bytes allocated after the header
+    uint32_t mark;     // StarHeap's collections: the last one that found it reachable
+    bool fromEnd;      // written back to front, from bytes() + capacity down
+    char* bytes() { return reinterpret_cast<char*>(this + 1); }
+    const char* bytes() const { return reinterpret_cast<const char*>(this + 1); }
+};
+
+// ---------- Runtime values ----------
+// 16-byte tagged value shared by the bytecode VM and the tree-walking
+// evaluator. mass is a 64-bit integer, flux a double, starlight/voidness are
+// booleans. A star of up to SHORT_STAR bytes is kept in the value itself,
+// from byte 2 on (over inlineHead, length and the payload), with 1 + its
+// length in `small`; a longer one is the first `length` bytes of *s, in a
+// buffer owned by a StarHeap (the Module's for constants, the engine's for
+// the stars a run builds), and has small == 0; it is the last `length` bytes
+// instead when the buffer grows at its front.
+struct Value {
+    enum class Type : uint8_t { Nil, Int, Float, Bool, Str };
+    static constexpr size_t SHORT_STAR = 14;
+
+    Type type = Type::Nil;
+    uint8_t small = 0;
+    char inlineHead[2] = {};
+    uint32_t length = 0;
+    union {
+        int64_t i;
+        double f;
+        bool b;
+        const StarBuffer* s;
+    };
+
+    Value() : i(0) {}
+    static Value makeInt(int64_t v) { Value x; x.type = Type::Int; x.i = v; return x; }
+    static Value makeFloat(double v) { Value x; x.type = Type::Float; x.f = v; return x; }
+    static Value makeBool(bool v) { Value x; x.type = Type::Bool; x.b = v; return x; }
+    // text.size() <= SHORT_STAR
+    static Value makeShortStr(std::string_view text) {
+        Value x;
+        x.type = Type::Str;
+        x.small = uint8_t(1 + text.size());
+        std::memcpy(reinterpret_cast<char*>(&x) + 2, text.data(), text.size());
+        return x;
+    }
+    // `length` bytes of buffer, at its start or (fromEnd) its end; length > SHORT_STAR
+    static Value makeStr(const StarBuffer* buffer, uint32_t length) {
+        Value x;
+        x.type = Type::Str;
+        x.length = length;
+        x.s = buffer;
+        return x;
+    }
+
+    bool isInt() const { return type == Type::Int; }
+    bool isFloat() const { return type == Type::Float; }
+    bool isNumber() const { return type == Type::Int || type == Type::Float; }
+    double asFloat() const { return type == Type::Int ? double(i) : f; }
+};
+
+static_assert(sizeof(Value) == 16, "a short star fills bytes 2..15 of a value");
+
+// the bytes of a star value
+inline std::string_view starText(const Value& v) {
+    if (v.small) return {reinterpret_cast<const char*>(&v) + 2, size_t(v.small - 1)};
+    return {v.s->fromEnd ? v.s->bytes() + (v.s->capacity - v.length) : v.s->bytes(), v.length};
+}
+
+class StarHeap;
+
+enum class ArithOp : uint8_t { Add, Sub, Mul, Div, Mod };
+enum class CompareOp : uint8_t { Eq, Ne, Lt, Le, Gt, Ge };
+enum class BitOp : uint8_t { And, Or, Xor };
+
+// slow paths (mixed types, errors); both engines call these so they agree exactly.
+// Type errors and integer division by zero throw std::runtime_error.
+// star + star concatenates into heap; without one it throws like a type error
+// (so constant folders that pass none leave it to run time)
+Value arithmetic(ArithOp op, const Value& a, const Value& b, StarHeap* heap = nullptr);
+Value compare(CompareOp op, const Value& a, const Value& b);
+bool valuesEqual(const Value& a, const Value& b);
+bool isTruthy(const Value& v);
+Value bitwise(BitOp op, const Value& a, const Value& b); // mass operands only
+Value negate(const Value& v);                             // unary minus
+// apply the arithmetic, comparison or bitwise operator a token stands for
+// (a compound assignment like PLUS_EQ means its operator); false when the
+// token is not such an operator
+bool applyOperator(TokenType op, const Value& a, const Value& b, Value& out, StarHeap* heap = nullptr);
+
+// int fast paths: two's-complement wrap-around instead of signed-overflow UB
+inline int64_t wrapAdd(int64_t a, int64_t b) { return int64_t(uint64_t(a) + uint64_t(b)); }
+inline int64_t wrapSub(int64_t a, int64_t b) { return int64_t(uint64_t(a) - uint64_t(b)); }
+inline int64_t wrapMul(int64_t a, int64_t b) { return int64_t(uint64_t(a) * uint64_t(b)); }
+
+// flux -> mass: truncates toward zero and saturates, so NaN is 0 and anything
+// beyond the range of a mass (infinities too) becomes the nearest end of it.
+// The JIT and the C runtime convert the same way
+int64_t truncateToMass(double f);
+// value stored into a variable declared as `declType` (mass truncates to int,
+// flux widens to float; other declared types keep the value as is)
+Value coerceToDeclared(TokenType declType, const Value& v);
+// value of a declared-but-uninitialized variable
+Value defaultForDeclared(TokenType declType);
+// whether `blackHole g(...)` in a function returning `outer` may hand g's
+// frame its own: g's result then skips outer's coercion, so that must not
+// change it (outer coerces nothing, or the same way as g)
+inline bool tailCallKeepsResult(TokenType outer, TokenType inner) {
+    return (outer != TokenType::MASS && outer != TokenType::FLUX) || outer == inner;
+}
+
+// the VM keeps its frames and registers on the heap: calls nested deeper
+// than this, or a register stack bigger than VM_MAX_STACK_BYTES, fail with
+// "stack overflow" (the tree walker has its own, much lower limit); tail
+// calls reuse their frame and do not nest
+constexpr size_t VM_MAX_CALL_DEPTH = 1000000;
+constexpr size_t VM_MAX_STACK_BYTES = size_t(256) << 20;
+
+std::string valueToString(const Value& v);
+// writes valueToString(v) without building it (shine)
+void printValue(std::ostream& out, const Value& v);
+
+#endif
@@ -0,0 +1,327 @@
+#include "vm.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#if defined(__GNUC__) && !defined(ASTERVOID_SWITCH_DISPATCH)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+Value VM::run(const Module& module) {
+    const Proto& script = module.protos.at(0);
+    regs.assign(size_t(script.numRegs > 0 ? script.numRegs : 1), Value());
+    if (frames.empty()) frames.resize(64);
+    strings.clear();
+    lines = module.lines;
+    this->module = &module;
+    jitCounters = jit::Stats();
+    tiers.clear();
+    tiers.resize(jitOptions.enabled && jit::available() ? module.protos.size() : 0);
+    natives.assign(tiers.size(), jit::NativeProto());
+    context = jit::Context();
+    context.globals = regs.data();
+    context.regsEnd = regs.data() + regs.size();
+    context.frameTop = frames.data();
+    context.frameEnd = frames.data() + frames.size();
+    context.natives = natives.data();
+    context.call = nativeCall;
+    context.tailCall = nativeTailCall;
+    context.vm = this;
+    return execute(script);
+}
+
+Value* VM::frameAt(size_t at, int size) {
+    size_t end = at + size_t(size);
+    if (end > regs.size()) {
+        if (end > VM_MAX_STACK_BYTES / sizeof(Value)) throw std::runtime_error("stack overflow");
+        regs.resize(std::min(std::max(end, regs.size() * 2), VM_MAX_STACK_BYTES / sizeof(Value)));
+        context.globals = regs.data();
+        context.regsEnd = regs.data() + regs.size();
+    }
+    return regs.data() + at;
+}
+
+void VM::growFrames() {
+    size_t depth = callDepth();
+    frames.resize(std::min(frames.size() * 2, VM_MAX_CALL_DEPTH));
+    context.frameTop = frames.data() + depth;
+    context.frameEnd = frames.data() + frames.size();
+}
+
+// every value the program can still reach is in a register, so the registers
+// are the roots (the slots above the running frame too: what they hold is
+// dead, and kept only until it is overwritten)
+void VM::collectStars() {
+    strings.beginCollection();
+    for (const Value& v : regs) strings.mark(v);
+    strings.sweep();
+}
+
+const jit::Code* VM::hot(const Proto& proto) {
+    size_t index = size_t(&proto - module->protos.data());
+    Tier& tier = tiers[index];
+    if (tier.code) return tier.code.get();
+    if (tier.tried || ++tier.hotness < jitOptions.threshold) return nullptr;
+    tier.tried = true;
+    tier.code = jit::compile(proto);
+    if (!tier.code) {
+        jitCounters.failed++;
+        return nullptr;
+    }
+    jitCounters.compiled++;
+    jitCounters.codeBytes += tier.code->size();
+    natives[index] = {tier.code->callEntry(), proto.constants.data(), uint64_t(proto.numRegs) * sizeof(Value)};
+    return tier.code.get();
+}
+
+// a native CALL that native code could not make alone: the callee is not
+// compiled yet, or the frames or registers must grow first. Declined (the
+// interpreter makes the call) when the callee stays interpreted, or the call
+// would overflow the machine stack or the VM's, so that error comes from
+// the interpreter too
+const uint8_t* VM::nativeCall(jit::Context* context, const Proto* caller, uint32_t pc, Value* base) {
+    VM& vm = *static_cast<VM*>(context->vm);
+    Instr i = caller->code[pc];
+    const Proto& callee = vm.module->protos[argBx(i)];
+    size_t at = size_t(base - vm.regs.data());
+    if (context->depth >= jit::MAX_NATIVE_DEPTH || vm.callDepth() >= VM_MAX_CALL_DEPTH ||
+        at + argA(i) + size_t(callee.numRegs) > VM_MAX_STACK_BYTES / sizeof(Value))
+        return nullptr;
+    const jit::Code* native = vm.tiers[argBx(i)].code.get();
+    if (!native && !(native = vm.hot(callee))) return nullptr;
+    vm.pushFrame({caller, caller->code.data() + pc + 1, at});
+    context->calleeBase = vm.frameAt(at + argA(i), callee.numRegs);
+    context->calleeK = callee.constants.data();
+    context->calleeEntry = native->callEntry();
+    context->depth++;
+    context->calls++;
+    return context->calleeEntry;
+}
+
+// a native TAILCALL: the arguments become the parameters of this frame
+const uint8_t* VM::nativeTailCall(jit::Context* context, const Proto* caller, uint32_t pc, Value* base) {
+    VM& vm = *static_cast<VM*>(context->vm);
+    Instr i = caller->code[pc];
+    const Proto& callee = vm.module->protos[argBx(i)];
+    size_t at = size_t(base - vm.regs.data());
+    if (at + size_t(callee.numRegs) > VM_MAX_STACK_BYTES / sizeof(Value)) return nullptr;
+    const jit::Code* native = vm.tiers[argBx(i)].code.get();
+    if (!native && !(native = vm.hot(callee))) return nullptr;
+    for (int k = 0; k < callee.numParams; k++) base[k] = base[argA(i) + k];
+    context->calleeBase = vm.frameAt(at, callee.numRegs);
+    context->calleeK = callee.constants.data();
+    context->calleeEntry = native->at(0);
+    context->calls++;
+    return context->calleeEntry;
+}
+
+Value VM::execute(const Proto& script) {
+    // the running proto; calls and returns switch all four
+    const Proto* proto = &script;
+    const Instr* code = proto->code.data();
+    const Value* K = proto->constants.data();
+    Value* base = regs.data();
+    const Instr* ip = code;
+    Instr i;
+    const bool tiered = !tiers.empty();
+
+    // leave for native code at ip when the proto is hot; resume where it
+    // exits, which is in the frame of the last call it made when it made calls
+#define ENTER_NATIVE() \
+    do { \
+        if (const jit::Code* native = hot(*proto)) { \
+            jitCounters.entries++; \
+            uint32_t resume = native->run(base, K, uint32_t(ip - code), &context); \
+            jitCounters.exits++; \
+            jitCounters.nativeCalls = context.calls; \
+            context.depth = 0; \
+            if (context.exitProto != proto) SWITCH_TO(context.exitProto); \
+            base = context.exitBase; \
+            ip = code + resume; \
+        } \
+    } while (0)
+
+#define RA base[argA(i)]
+#define RB base[argB(i)]
+#define RC base[argC(i)]
+#define KC K[argC(i)]
+#define SWITCH_TO(p) \
+    do { \
+        proto = (p); \
+        code = proto->code.data(); \
+        K = proto->constants.data(); \
+    } while (0)
+
+    try {
+#ifdef VM_COMPUTED_GOTO
+    static void* const labels[] = {
+#define OP_LABEL(name) &&op_##name,
+        ASTERVOID_OPCODES(OP_LABEL)
+#undef OP_LABEL
+    };
+#define DISPATCH() do { i = *ip++; goto *labels[i & 0xFF]; } while (0)
+#define CASE(name) op_##name:
+    if (tiered) ENTER_NATIVE(); // the script starting
+    DISPATCH();
+#else
+#define DISPATCH() continue
+#define CASE(name) case Op::name:
+    if (tiered) ENTER_NATIVE(); // the script starting
+    for (;;) {
+        i = *ip++;
+        switch (opOf(i)) {
+#endif
+
+    CASE(MOVE) { RA = RB; DISPATCH(); }
+    CASE(LOADK) { RA = K[argBx(i)]; DISPATCH(); }
+    CASE(LOADI) { RA = Value::makeInt(argSBx(i)); DISPATCH(); }
+    CASE(LOADBOOL) { RA = Value::makeBool(argB(i) != 0); DISPATCH(); }
+    CASE(LOADNIL) { RA = Value(); DISPATCH(); }
+    CASE(TOINT) { RA = coerceToDeclared(TokenType::MASS, RA); DISPATCH(); }
+    CASE(TOFLOAT) { RA = coerceToDeclared(TokenType::FLUX, RA); DISPATCH(); }
+
+// int/int and float/float fast paths inline; everything else through value.cpp
+// (which may build a star, so the star heap collects first when it is due)
+#define ARITH(name, fastop, slowop, rhs) \
+    CASE(name) { \
+        const Value& b = RB; const Value& c = rhs; \
+        if (b.isInt() && c.isInt()) { RA = Value::makeInt(fastop(b.i, c.i)); DISPATCH(); } \
+        if (strings.wantsCollection()) collectStars(); \
+        RA = arithmetic(ArithOp::slowop, b, c, &strings); \
+        DISPATCH(); \
+    }
+    ARITH(ADD, wrapAdd, Add, RC)
+    ARITH(SUB, wrapSub, Sub, RC)
+    ARITH(MUL, wrapMul, Mul, RC)
+    ARITH(ADDK, wrapAdd, Add, KC)
+    ARITH(SUBK, wrapSub, Sub, KC)
+    ARITH(MULK, wrapMul, Mul, KC)
+#undef ARITH
+    CASE(DIV) { RA = arithmetic(ArithOp::Div, RB, RC); DISPATCH(); }
+    CASE(MOD) { RA = arithmetic(ArithOp::Mod, RB, RC); DISPATCH(); }
+    CASE(DIVK) { RA = arithmetic(ArithOp::Div, RB, KC); DISPATCH(); }
+    CASE(MODK) { RA = arithmetic(ArithOp::Mod, RB, KC); DISPATCH(); }
+
+#define COMPARE(name, cmpop, slowop, rhs) \
+    CASE(name) { \
+        const Value& b = RB; const Value& c = rhs; \
+        if (b.isInt() && c.isInt()) { RA = Value::makeBool(b.i cmpop c.i); DISPATCH(); } \
+        RA = compare(CompareOp::slowop, b, c); \
+        DISPATCH(); \
+    }
+    COMPARE(EQ, ==, Eq, RC)
+    COMPARE(NE, !=, Ne, RC)
+    COMPARE(LT, <, Lt, RC)
+    COMPARE(LE, <=, Le, RC)
+    COMPARE(GT, >, Gt, RC)
+    COMPARE(GE, >=, Ge, RC)
+    COMPARE(EQK, ==, Eq, KC)
+    COMPARE(NEK, !=, Ne, KC)
+    COMPARE(LTK, <, Lt, KC)
+    COMPARE(LEK, <=, Le, KC)
+    COMPARE(GTK, >, Gt, KC)
+    COMPARE(GEK, >=, Ge, KC)
+#undef COMPARE
+
+#define BITWISE(name, fastop, slowop) \
+    CASE(name) { \
+        const Value& b = RB; const Value& c = RC; \
+        if (b.isInt() && c.isInt()) { RA = Value::makeInt(b.i fastop c.i); DISPATCH(); } \
+        RA = bitwise(BitOp::slowop, b, c); \
+        DISPATCH(); \
+    }
+    BITWISE(BAND, &, And)
+    BITWISE(BOR, |, Or)
+    BITWISE(BXOR, ^, Xor)
+#undef BITWISE
+    CASE(NEG) {
+        const Value& b = RB;
+        RA = b.isInt() ? Value::makeInt(wrapSub(0, b.i)) : negate(b);
+        DISPATCH();
+    }
+    CASE(NOT) {
+        const Value& b = RB;
+        RA = Value::makeBool(b.type == Value::Type::Bool ? !b.b : !isTruthy(b));
+        DISPATCH();
+    }
+    CASE(TOBOOL) { RA = Value::makeBool(isTruthy(RB)); DISPATCH(); }
+
+    CASE(JMP) {
+        ip += argSBx(i);
+        if (tiered && argSBx(i) < 0) ENTER_NATIVE(); // a loop back-edge
+        DISPATCH();
+    }
+    CASE(JMPF) {
+        const Value& a = RA;
+        if (a.type == Value::Type::Bool ? !a.b : !isTruthy(a)) ip += argSBx(i);
+        DISPATCH();
+    }
+    CASE(JMPT) {
+        const Value& a = RA;
+        if (a.type == Value::Type::Bool ? a.b : isTruthy(a)) ip += argSBx(i);
+        DISPATCH();
+    }
+    CASE(RETURN) {
+        Value result = argB(i) ? RA : Value();
+        if (context.frameTop == frames.data()) return result;
+        // the frame began at the caller's R[A]: that is where the result goes
+        *base = result;
+        const CallFrame& caller = *--context.frameTop;
+        SWITCH_TO(caller.proto);
+        ip = caller.ip;
+        base = regs.data() + caller.base;
+        if (tiered) ENTER_NATIVE();
+        DISPATCH();
+    }
+    CASE(PRINT) {
+        for (unsigned k = 0; k < argB(i); k++) {
+            if (k) out->put(' ');
+            printValue(*out, base[argA(i) + k]);
+        }
+        out->put('\n');
+        DISPATCH();
+    }
+    CASE(CALL) {
+        if (callDepth() >= VM_MAX_CALL_DEPTH) throw std::runtime_error("stack overflow");
+        size_t at = size_t(base - regs.data());
+        pushFrame({proto, ip, at});
+        SWITCH_TO(&module->protos[argBx(i)]);
+        base = frameAt(at + argA(i), proto->numRegs);
+        ip = code;
+        if (tiered) ENTER_NATIVE();
+        DISPATCH();
+    }
+    CASE(TAILCALL) {
+        // the arguments become the parameters of the frame the caller had
+        const Proto& callee = module->protos[argBx(i)];
+        for (int k = 0; k < callee.numParams; k++) base[k] = base[argA(i) + k];
+        SWITCH_TO(&callee);
+        base = frameAt(size_t(base - regs.data()), proto->numRegs);
+        ip = code;
+        if (tiered) ENTER_NATIVE();
+        DISPATCH();
+    }
+    CASE(GETGLOBAL) { RA = regs[argBx(i)]; DISPATCH(); }
+    CASE(SETGLOBAL) { regs[argBx(i)] = RA; DISPATCH(); }
+
+#ifndef VM_COMPUTED_GOTO
+        default:
+            throw std::runtime_error("Invalid opcode");
+        }
+    }
+#endif
+    } catch (const std::runtime_error& e) {
+        size_t pc = size_t(ip - code) - 1;
+        throw std::runtime_error("Line " + std::to_string(lines->line(proto->offsets[pc])) + ": " + e.what());
+    }
+
+#undef ENTER_NATIVE
+#undef CASE
+#undef DISPATCH
+#undef RA
+#undef RB
+#undef RC
+#undef KC
+#undef SWITCH_TO
+    return Value();
+}
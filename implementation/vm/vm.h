@@ -0,0 +1,75 @@
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+#include "../jit/jit.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// ---------- Register VM ----------
+// Executes a compiled Module. Dispatch is threaded (computed goto) when the
+// compiler supports labels-as-values and a plain switch otherwise (or when
+// ASTERVOID_SWITCH_DISPATCH is defined). Runtime errors throw
+// std::runtime_error with the offending source line.
+// Calls do not recurse in C++: every frame is a window of one growable value
+// stack (the script's registers at the bottom), starting at the caller's
+// register that holds the first argument, so nothing is allocated per call
+// once the stack has grown to the deepest call. A tail call overwrites its
+// caller's frame, and runs in constant space however deep it recurses.
+// With the JIT enabled (jit/jit.h), a proto that gets hot is compiled to
+// machine code and entered at the next call or loop back-edge; it hands
+// control back to the interpreter for whatever it does not cover.
+class VM {
+public:
+    // where shine() prints
+    explicit VM(std::ostream& out = std::cout, const jit::Options& jit = {}) : out(&out), jitOptions(jit) {}
+    Value run(const Module& module);
+    // register file of the script after run() (and the stack above it); see
+    // Module::topLevel for names
+    const std::vector<Value>& registers() const { return regs; }
+    // JIT activity of the last run()
+    const jit::Stats& jitStats() const { return jitCounters; }
+
+private:
+    // per proto of the running module
+    struct Tier {
+        uint32_t hotness = 0; // calls, returns into it and loop back-edges so far
+        bool tried = false;   // compile() ran (its result may be null)
+        std::unique_ptr<jit::Code> code;
+    };
+
+    std::ostream* out;
+    std::vector<Value> regs;       // the value stack
+    std::vector<CallFrame> frames; // callers of the running proto, up to context.frameTop
+    std::vector<jit::NativeProto> natives; // per proto, for native calls
+    const LineTable* lines = nullptr; // of the running module
+    const Module* module = nullptr;
+    jit::Options jitOptions;
+    jit::Stats jitCounters;
+    jit::Context context; // shared with native code while it runs
+    std::vector<Tier> tiers;
+    StarHeap strings; // stars the last run() built (registers() may still show them)
+
+    Value execute(const Proto& script);
+    // pointer to a frame of `size` registers at regs[at], growing the stack
+    // (which moves it) when it is too small
+    Value* frameAt(size_t at, int size);
+    // frees the stars no register holds (between instructions only)
+    void collectStars();
+    // native code for proto once it has crossed the threshold, else null
+    const jit::Code* hot(const Proto& proto);
+    // the call stack lives in frames below context.frameTop, where native
+    // code pushes and pops frames too
+    size_t callDepth() const { return size_t(context.frameTop - frames.data()); }
+    void pushFrame(const CallFrame& frame) {
+        if (context.frameTop == context.frameEnd) growFrames();
+        *context.frameTop++ = frame;
+    }
+    void growFrames(); // callers check VM_MAX_CALL_DEPTH first
+    // jit::Context hooks: the CALLs and TAILCALLs native code cannot make alone
+    static const uint8_t* nativeCall(jit::Context* context, const Proto* caller, uint32_t pc, Value* base);
+    static const uint8_t* nativeTailCall(jit::Context* context, const Proto* caller, uint32_t pc, Value* base);
+};
+
+#endif
@@ -1,8 +1,24 @@
 #include <bits/stdc++.h>
 #include <iostream>
 
-#include "implementation/Scanner/Scanner.h"
-#include "implementation/Parser/Parser.h"
+#include "implementation/scanner/scanner.h"
+#include "implementation/scanner/parallel.h"
+#include "implementation/parser/parser.h"
+#include "implementation/source/source.h"
+#include "implementation/optimizer/fold.h"
+#include "implementation/resolver/resolver.h"
+#include "implementation/vm/compiler.h"
+#include "implementation/vm/vm.h"
+#include "implementation/interpreter/treewalk.h"
+#include "implementation/cgen/cemit.h"
+#include "implementation/ir/build.h"
+#include "implementation/ir/lower.h"
+#include "implementation/ir/passes.h"
+#include "implementation/bench/bench.h"
+#include "implementation/concurrency/threadpool.h"
+#include "implementation/incremental/document.h"
+#include "implementation/cache/astcache.h"
+#include "implementation/profile/trace.h"
 
 using namespace std;
 
@@ -34,6 +50,7 @@ std::string tokenTypeToString(TokenType type) {
         case TokenType::SLASH: return "SLASH";
         case TokenType::SLASH_EQ: return "SLASH_EQ";
         case TokenType::PERCENT: return "PERCENT";
+        case TokenType::PERCENT_EQ: return "PERCENT_EQ";
         case TokenType::BANG: return "BANG";
         case TokenType::BANG_EQ: return "BANG_EQ";
         case TokenType::EQUAL: return "EQUAL";
@@ -43,7 +60,9 @@ std::string tokenTypeToString(TokenType type) {
         case TokenType::LESS: return "LESS";
         case TokenType::LESS_EQ: return "LESS_EQ";
         case TokenType::AND: return "AND";
+        case TokenType::BIT_AND: return "BIT_AND";
         case TokenType::OR: return "OR";
+        case TokenType::BIT_OR: return "BIT_OR";
         case TokenType::XOR: return "XOR";
 
         // LITERALS
@@ -52,40 +71,9 @@ std::string tokenTypeToString(TokenType type) {
         case TokenType::NUMBER: return "NUMBER";
 
         // KEYWORDS
-        case TokenType::LAUNCH: return "LAUNCH";
-        case TokenType::MASS: return "MASS";
-        case TokenType::BIGBANG: return "BIGBANG";
-        case TokenType::MILKYWAY: return "MILKYWAY";
-        case TokenType::FLUX: return "FLUX";
-        case TokenType::QUANTUM: return "QUANTAM";
-        case TokenType::NEBULA: return "NEBULA";
-        case TokenType::TRUTH: return "TRUTH";
-        case TokenType::STARLIGHT: return "STARLIGHT";
-        case TokenType::VOIDNESS: return "VOIDNESS";
-        case TokenType::VACUUM: return "VACUUM";
-        case TokenType::BLACKHOLE: return "BLACKHOLE";
-        case TokenType::DARKMATTER: return "DARKMATTER";
-        case TokenType::WARP: return "WARP";
-        case TokenType::ROTATE: return "ROTATE";
-        case TokenType::ORBIT: return "ORBIT";
-        case TokenType::PHASE: return "PHASE";
-        case TokenType::ECLIPSE: return "ECLIPSE";
-        case TokenType::SUPERNOVA: return "SUPERNOVA";
-        case TokenType::STARPATH: return "STARPATH";
-        case TokenType::BLACKVOID: return "BLACKVOID";
-        case TokenType::MOON: return "MOON";
-        case TokenType::SHINE: return "SHINE";
-        case TokenType::GALAXY: return "GALAXY";
-        case TokenType::EARTH: return "EARTH";
-        case TokenType::CONSTELLATION: return "CONSTELLATION";
-        case TokenType::CONSTRUCT: return "CONSTRUCT";
-        case TokenType::DEORBIT: return "DEORBIT";
-        case TokenType::SHIELD: return "SHIELD";
-        case TokenType::RECOVER: return "RECOVER";
-        case TokenType::EJECT: return "EJECT";
-        case TokenType::OPEN: return "OPEN";
-        case TokenType::CORE: return "CORE";
-        case TokenType::ORBITSHIELD: return "ORBITSHIELD";
+#define KW_CASE(name, text) case TokenType::name: return #name;
+        ASTERVOID_KEYWORDS(KW_CASE)
+#undef KW_CASE
 
         // SPECIAL
         case TokenType::END_OF_FILE: return "END_OF_FILE";
@@ -97,65 +85,932 @@ std::string tokenTypeToString(TokenType type) {
     }
 }
 
-int main(int argc, char* argv[]) {
-    // std::vector<Token> tokens = {
-    //     {TokenType::VACUUM,    "vacuum", "vacuum", 1, 1},
-    //     {TokenType::IDENTIFIER,"x",      "x",      1, 1},
-    //     {TokenType::EQUAL,     "=",      "=",      1, 1},
-    //     {TokenType::NUMBER,    "5",      "5",      1, 1},
-    //     {TokenType::SEMICOLON, ";",      ";",      1, 1},
-    //     {TokenType::END_OF_FILE, "",     "",       1, 1}
-    // };
-    //
-
-
-    std::ifstream file("D:/ClionProjects/Compiler/implementation/scanner/test.astv");
-    if (!file) {
-        std::cerr << "Error: Could not open file!\n";
-        return 1;
+struct Options {
+    bool dumpTokens = false;
+    bool dumpBytecode = false;
+    bool emitC = false;      // --emit=c: print the program as C instead of running it
+    bool run = false;
+    bool treeWalker = false; // --engine=tree
+    bool jit = true;         // --no-jit keeps the VM interpreting
+    uint32_t jitThreshold = jit::Options().threshold;
+    bool verifyJit = false;  // run every program with and without the JIT and compare
+    bool ir = false;         // --ir: compile for the VM through the SSA IR and its optimizer
+    bool dumpIr = false;     // print the optimized IR (implies ir)
+    bool verifyIr = false;   // run every program compiled both ways and compare
+    bool dumpVars = false;
+    bool fold = true;        // --no-fold turns the constant folder off
+    bool warnings = false;   // resolve names up front and report shadowed and never-read variables
+    bool foldStats = false;
+    bool stats = false;      // per-file and aggregate throughput
+    unsigned jobs = 0;       // worker threads; 0 = one per core
+    bool parallelLex = false; // chunked lexing of each file on the pool
+    bool verifyLex = false;   // check the chunked lexer against scanTokens()
+    size_t lexChunk = 0;      // chunk size for parallelLex; 0 = default
+    bool verifyIncremental = false; // replay edits through IncrementalDocument
+    std::string cacheDir;     // token/AST cache; empty = no cache
+    bool timePhases = false;  // per-phase summary table on stderr
+    std::string tracePath;    // Chrome trace-event JSON; empty = none
+};
+
+// EVERYTHING ONE FILE PRODUCED; FILES ARE COMPILED CONCURRENTLY, SO OUTPUT IS
+// BUFFERED HERE AND PRINTED IN INPUT ORDER
+struct FileReport {
+    std::string path;
+    const char* source = nullptr; // a built-in input compiled instead of the file at path
+    const TextEdit* edit = nullptr; // with --verify-incremental: the one edit to check on source
+    std::string out;
+    std::string err;
+    bool ok = true;
+    size_t bytes = 0;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    double seconds = 0;
+    bool cacheHit = false;
+};
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options] <file|dir>...\n"
+              << "       " << prog << " --bench[=vm|calls|strings|frontend] [bench options]\n"
+              << "  -               read the source from stdin\n"
+              << "  <dir>           compile every .astv file below the directory\n"
+              << "  --tokens        print the token stream of each file\n"
+              << "  --run           execute each file after parsing\n"
+              << "  --engine=E      execution engine: vm (default) or tree\n"
+              << "  --dump-bytecode print the compiled bytecode\n"
+              << "  --emit=c        print each program as a self-contained C file, from the\n"
+              << "                  optimized IR, for a native build (cc -O2 prog.c -lm)\n"
+              << "  --jit, --no-jit compile hot code to x86-64 machine code (default on\n"
+              << "                  where supported) or only interpret it\n"
+              << "  --jit-threshold=N\n"
+              << "                  calls or loop iterations before code is compiled\n"
+              << "  --verify-jit    run each file in the tree walker, interpreted and with\n"
+              << "                  the JIT and compare output, variables and errors\n"
+              << "  --ir            compile for the VM through the SSA IR optimizer (dead\n"
+              << "                  code, common subexpressions, loop-invariant code\n"
+              << "                  motion, strength reduction), types inferred across calls\n"
+              << "  --dump-ir       print the optimized IR and what the passes did (implies --ir)\n"
+              << "  --verify-ir     run each file compiled directly and through the IR and\n"
+              << "                  compare output, variables and errors\n"
+              << "  --vars          print the top-level variables after --run\n"
+              << "  --warnings      resolve names before anything runs; report every undefined\n"
+              << "                  name and warn about shadowed and never-read variables\n"
+              << "  --no-fold       skip constant folding before execution\n"
+              << "  --fold-stats    report what constant folding removed\n"
+              << "  -j N, --jobs=N  compile N files at a time (default: one per core)\n"
+              << "  --stats         report per-file and aggregate throughput\n"
+              << "  --parallel-lex  split each file into chunks and lex them concurrently\n"
+              << "  --lex-chunk=N   chunk size in bytes for --parallel-lex\n"
+              << "  --verify-lex    compare the chunked lexer with the sequential one\n"
+              << "  --cache-dir=DIR reuse scanned and parsed files from DIR (created if missing)\n"
+              << "  --time-phases   print time, tokens, nodes and allocations per phase\n"
+              << "  --trace=F       write a Chrome trace-event file (chrome://tracing) to F\n"
+              << "  --verify-diagnostics\n"
+              << "                  parse built-in broken programs and check that every\n"
+              << "                  syntax error is reported exactly once (no files needed)\n"
+              << "  --verify-incremental\n"
+              << "                  replay random edits incrementally and compare each\n"
+              << "                  result with a full re-parse\n"
+              << "  --bench         run the built-in VM benchmark (same as --bench=vm)\n"
+              << "  --bench=calls   run the function call benchmark (calls per second)\n"
+              << "  --bench=strings run the star building and shine output benchmark\n"
+              << "  --bench=frontend\n"
+              << "                  scanner/parser throughput over generated corpora\n"
+              << "  --bench-bytes=N corpus size per shape (suffix K or M allowed)\n"
+              << "  --bench-shape=S only this shape (repeatable): comment-heavy,\n"
+              << "                  identifier-heavy, deep-nesting, arithmetic-chains, mixed\n"
+              << "  --bench-json=F  also write the results as JSON to F (- for stdout)\n";
+}
+
+// WHAT ONE VM RUN LEFT BEHIND: EVERYTHING IT PRINTED, THE TOP-LEVEL VARIABLES
+// AND THE ERROR IT STOPPED WITH, IF ANY
+static std::string runSnapshot(const Module& module, const jit::Options& jitOptions, jit::Stats* stats) {
+    std::ostringstream out;
+    VM vm(out, jitOptions);
+    try {
+        vm.run(module);
+    } catch (const std::runtime_error& e) {
+        out << "error: " << e.what() << "\n";
     }
+    for (const TopLevelVar& var : module.topLevel)
+        out << var.name << " = " << valueToString(vm.registers()[var.reg]) << "\n";
+    if (stats) *stats = vm.jitStats();
+    return out.str();
+}
+
+// THE SAME FOR THE TREE WALKER, THE REFERENCE BOTH VM TIERS ARE CHECKED AGAINST
+static std::string treeSnapshot(const StmtList& program, const LineTable& lines) {
+    std::ostringstream out;
+    TreeWalker walker(lines, out);
+    try {
+        walker.run(program);
+    } catch (const std::runtime_error& e) {
+        out << "error: " << e.what() << "\n";
+    }
+    for (const auto& var : walker.topLevel()) out << var.first << " = " << valueToString(var.second) << "\n";
+    return out.str();
+}
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string source = buffer.str();
+// OUTPUT LINE OF THE FIRST BYTE WHERE TWO SNAPSHOTS DIFFER
+static size_t firstDifference(const std::string& expected, const std::string& got) {
+    size_t at = 0;
+    while (at < got.size() && at < expected.size() && got[at] == expected[at]) at++;
+    return size_t(std::count(expected.begin(), expected.begin() + at, '\n')) + 1;
+}
+
+// OUTPUT AND THE ERROR LINE OF A SNAPSHOT; A FAILED RUN STOPS BEFORE THE IR
+// BUILD'S RETURN HANDS THE VARIABLES BACK, SO THEY ARE ONLY COMPARED AFTER A
+// CLEAN RUN
+static std::string comparableSnapshot(const std::string& snapshot) {
+    size_t error = snapshot.find("error: ");
+    if (error == std::string::npos || (error && snapshot[error - 1] != '\n')) return snapshot;
+    return snapshot.substr(0, snapshot.find('\n', error) + 1);
+}
+
+// WHETHER A VM SNAPSHOT AGREES WITH THE TREE WALKER'S. THE WALKER STOPS AT
+// TreeWalker::MAX_CALL_DEPTH, FAR BELOW THE VM'S LIMIT, SO AFTER ITS STACK
+// OVERFLOW ONLY THE OUTPUT PRINTED BEFORE IT CAN BE COMPARED
+static bool agreesWithTree(const std::string& reference, const std::string& got) {
+    if (got == reference) return true;
+    size_t error = reference.rfind("error: ");
+    if (error == std::string::npos || (error && reference[error - 1] != '\n')) return false;
+    const std::string overflow = "stack overflow\n";
+    if (reference.size() < overflow.size() ||
+        reference.compare(reference.size() - overflow.size(), overflow.size(), overflow) != 0)
+        return false;
+    return got.compare(0, error, reference, 0, error) == 0;
+}
+
+// RUN THE PROGRAM IN THE TREE WALKER, THE MODULE INTERPRETED, THEN WITH EVERY
+// PROTO COMPILED ON ITS FIRST CALL OR BACK-EDGE, AND THROW UNLESS ALL THREE
+// RUNS AGREE
+static void verifyJit(const std::string& path, const StmtList& program, const LineTable& lines,
+                      const Module& module, std::ostream& out) {
+    std::string expected = runSnapshot(module, jit::Options{false}, nullptr);
+    std::string reference = comparableSnapshot(treeSnapshot(program, lines));
+    if (!agreesWithTree(reference, comparableSnapshot(expected)))
+        throw std::runtime_error("interpreter run differs from the tree walker at output line " +
+                                 std::to_string(firstDifference(reference, comparableSnapshot(expected))));
+    if (!jit::available()) {
+        out << path << ": the JIT is not available on this platform; the interpreter matches the tree walker\n";
+        return;
+    }
+    jit::Stats stats;
+    std::string got = runSnapshot(module, jit::Options{true, 1}, &stats);
+    if (got != expected)
+        throw std::runtime_error("JIT run differs from the interpreter at output line " +
+                                 std::to_string(firstDifference(expected, got)));
+    out << path << ": JIT run matches the interpreter and the tree walker; " << stats.compiled << " protos compiled ("
+        << stats.codeBytes << " bytes), " << stats.entries << " native entries, " << stats.exits
+        << " side exits, " << stats.nativeCalls << " native calls\n";
+}
+
+// BUILD THE SSA IR FOR A PROGRAM AND OPTIMIZE IT; exportVars KEEPS THE
+// TOP-LEVEL VARIABLES ALIVE TO THE END FOR --vars
+static void buildIr(const StmtList& program, const LineTable& lines, bool exportVars, ir::Program& ir,
+                    ir::PassStats& stats) {
+    {
+        profile::Phase phase("ir-build");
+        ir::Builder(ir, lines, exportVars).build(program);
+    }
+    profile::Phase phase("ir-optimize");
+    ir::optimize(ir, stats);
+}
+
+// BUILD AND OPTIMIZE THE IR, THEN LOWER IT TO BYTECODE
+static void compileThroughIr(const StmtList& program, const LineTable& lines, bool exportVars, bool dump,
+                             Module& module, std::ostream& out, ir::PassStats* statsOut = nullptr) {
+    ir::Program ir;
+    ir::PassStats stats;
+    buildIr(program, lines, exportVars, ir, stats);
+    if (dump) {
+        ir::print(ir, lines, out);
+        out << "; optimizer: " << stats.folded << " folded, " << stats.merged << " merged, " << stats.hoisted
+            << " hoisted, " << stats.strengthReduced << " strength-reduced, " << stats.removed << " removed\n";
+    }
+    {
+        profile::Phase phase("ir-lower");
+        ir::lower(ir, module, lines);
+    }
+    if (statsOut) *statsOut = stats;
+}
 
-    Scanner scanner(source);
-    std::vector<Token> tokens = scanner.scanTokens();
-    for (const auto &token : tokens) {
-        std::cout << token.lexeme << "-----> (" << tokenTypeToString(token.type) << ")\n";
+// COMPILE THE PROGRAM DIRECTLY AND THROUGH THE IR, RUN BOTH INTERPRETED AND
+// THROW UNLESS THEY AGREE (A COMPILE ERROR MUST BE THE SAME ERROR)
+static void verifyIr(const std::string& path, const StmtList& program, const LineTable& lines, std::ostream& out) {
+    Module direct, optimized;
+    std::string expected, got;
+    try {
+        Compiler(direct, lines).compileProgram(program);
+        expected = comparableSnapshot(runSnapshot(direct, jit::Options{false}, nullptr));
+    } catch (const std::runtime_error& e) {
+        expected = std::string("compile error: ") + e.what() + "\n";
     }
+    ir::PassStats stats;
     try {
-        Parser parser(tokens);
-        auto program = parser.parseProgram();
-        std::cout << "Parsing successful!\n";
+        std::ostringstream unused;
+        compileThroughIr(program, lines, true, false, optimized, unused, &stats);
+        got = comparableSnapshot(runSnapshot(optimized, jit::Options{false}, nullptr));
+    } catch (const std::runtime_error& e) {
+        got = std::string("compile error: ") + e.what() + "\n";
+    }
+    if (got != expected)
+        throw std::runtime_error("IR run differs from the bytecode compiler at output line " +
+                                 std::to_string(firstDifference(expected, got)));
+    if (expected.rfind("compile error: ", 0) == 0) {
+        out << path << ": the IR build rejects the program like the bytecode compiler: "
+            << expected.substr(15);
+        return;
+    }
+    size_t before = 0, after = 0;
+    for (const Proto& proto : direct.protos) before += proto.code.size();
+    for (const Proto& proto : optimized.protos) after += proto.code.size();
+    out << path << ": IR run matches the bytecode compiler; " << after << " instructions (direct: " << before
+        << "); " << stats.folded << " folded, " << stats.merged << " merged, " << stats.hoisted << " hoisted, "
+        << stats.strengthReduced << " strength-reduced, " << stats.removed << " removed\n";
+}
+
+// EXECUTE A PARSED PROGRAM WITH THE SELECTED ENGINE
+static void runProgram(const std::string& path, const StmtList& program, const LineTable& lines,
+                       const Options& options, std::ostream& out) {
+    if (options.treeWalker) {
+        TreeWalker walker(lines, out);
+        {
+            profile::Phase phase("tree-walk");
+            walker.run(program);
+        }
+        if (options.dumpVars)
+            for (const auto& var : walker.topLevel())
+                out << var.first << " = " << valueToString(var.second) << "\n";
+        return;
+    }
+
+    if (options.verifyIr) {
+        profile::Phase phase("verify-ir");
+        verifyIr(path, program, lines, out);
+        return;
+    }
+    Module module;
+    if (options.ir || options.dumpIr) {
+        compileThroughIr(program, lines, options.dumpVars || options.verifyJit, options.dumpIr, module, out);
+    } else {
+        profile::Phase phase("compile");
+        Compiler(module, lines).compileProgram(program);
+    }
+    if (options.dumpBytecode)
+        for (const Proto& proto : module.protos) disassemble(proto, lines, out);
+    if (options.verifyJit) {
+        profile::Phase phase("verify-jit");
+        verifyJit(path, program, lines, module, out);
+        return;
+    }
+    if (!options.run) return;
+
+    jit::Options jitOptions;
+    jitOptions.enabled = options.jit;
+    jitOptions.threshold = options.jitThreshold;
+    VM vm(out, jitOptions);
+    {
+        profile::Phase phase("execute");
+        vm.run(module);
+    }
+    if (options.dumpVars)
+        for (const TopLevelVar& var : module.topLevel)
+            out << var.name << " = " << valueToString(vm.registers()[var.reg]) << "\n";
+}
+
+// LEX A WHOLE FILE IN CHUNKS ON THE POOL; WITH --verify-lex ALSO LEX IT
+// SEQUENTIALLY AND THROW ON THE FIRST TOKEN WHERE THE TWO DISAGREE
+static std::vector<Token> lexInParallel(std::string_view text, const Options& options,
+                                        ThreadPool& pool) {
+    ParallelLexOptions lexOptions;
+    if (options.lexChunk) lexOptions.chunkBytes = options.lexChunk;
+    std::vector<Token> tokens = scanTokensParallel(text, pool, lexOptions);
+    if (!options.verifyLex) return tokens;
+
+    std::vector<Token> expected = Scanner(text).scanTokens();
+    auto same = [](const Token& a, const Token& b) {
+        return a.type == b.type && a.lexeme.data() == b.lexeme.data() &&
+               a.lexeme.size() == b.lexeme.size() && a.offset == b.offset;
+    };
+    LineTable lines(text);
+    size_t n = std::min(tokens.size(), expected.size());
+    for (size_t i = 0; i <= n; i++) {
+        if (i < n && same(tokens[i], expected[i])) continue;
+        if (i == n && tokens.size() == expected.size()) break;
+        std::string got = i < tokens.size() ? tokens[i].toString(lines) : "<end>";
+        std::string want = i < expected.size() ? expected[i].toString(lines) : "<end>";
+        throw std::runtime_error("parallel lexer diverges at token " + std::to_string(i) + ": got " +
+                                 got + ", expected " + want);
+    }
+    return tokens;
+}
+
+// CHECK ONE VERSION OF AN IncrementalDocument AGAINST A FROM-SCRATCH SCAN AND
+// PARSE (SAME TOKENS, SAME TREE, SAME ERRORS); RETURNS WHETHER IT PARSES
+static bool checkIncremental(const IncrementalDocument& doc, const std::string& where) {
+    std::vector<Token> tokens = Scanner(doc.text()).scanTokens();
+    AstArena arena;
+    ParseResult full = Parser(tokens, arena).parse();
+
+    const std::vector<Token>& got = doc.tokens();
+    bool sameTokens = got.size() == tokens.size();
+    for (size_t i = 0; sameTokens && i < got.size(); i++)
+        sameTokens = got[i].type == tokens[i].type && got[i].lexeme == tokens[i].lexeme &&
+                     got[i].offset == tokens[i].offset;
+    if (!sameTokens)
+        throw std::runtime_error(where + ": " + std::to_string(got.size()) + " tokens differ from a full rescan (" +
+                                 std::to_string(tokens.size()) + ")");
+    if (doc.diagnostics() != full.diagnostics) {
+        LineTable lines(doc.text());
+        auto first = [&](const std::vector<Diagnostic>& d) {
+            return d.empty() ? std::string("none") : d.front().toString(lines);
+        };
+        throw std::runtime_error(where + ": " + std::to_string(doc.diagnostics().size()) + " errors (first: " +
+                                 first(doc.diagnostics()) + ") vs full parse " +
+                                 std::to_string(full.diagnostics.size()) + " (first: " +
+                                 first(full.diagnostics) + ")");
+    }
+    if (doc.hasTree() != full.ok())
+        throw std::runtime_error(where + ": tree kept or dropped unlike the full parse");
+    if (full.ok() && !sameTree(doc.program(), full.program))
+        throw std::runtime_error(where + ": tree differs from a full parse");
+    return full.ok();
+}
+
+// APPLY A FIXED PSEUDO-RANDOM SERIES OF SMALL EDITS TO THE FILE THROUGH
+// IncrementalDocument AND CHECK EVERY VERSION; THROWS ON THE FIRST MISMATCH
+static void verifyIncremental(const std::string& path, std::string_view text, std::ostream& out) {
+    // MOSTLY EDITS THAT KEEP THE FILE PARSEABLE, SO REUSE GETS EXERCISED TOO
+    static const char* inserts[] = {"\n", " ", "\t", "7", "x", "*** c ***", "*** a\nb ***", "** c\n",
+                                    "\"s\"", "\nmass q = 1;\n", "{", ";"};
+    std::mt19937 rng(12345);
+    auto doc = std::make_unique<IncrementalDocument>(std::string(text));
+    if (!doc->hasTree()) throw std::runtime_error("--verify-incremental needs a file that parses");
+    EditStats total;
+    const int EDITS = 200;
+    std::optional<TextEdit> undo; // AN EDIT THAT BROKE THE PARSE IS TAKEN BACK NEXT
+    for (int step = 0; step < EDITS; step++) {
+        const std::string& current = doc->text();
+        TextEdit edit;
+        if (undo) {
+            edit = *undo;
+            undo.reset();
+        } else {
+            edit.offset = current.empty() ? 0 : rng() % (current.size() + 1);
+            if (rng() % 6 == 0 && edit.offset < current.size()) edit.length = 1;
+            if (edit.length == 0 || rng() % 2) edit.replacement = inserts[rng() % std::size(inserts)];
+            undo = TextEdit{edit.offset, edit.replacement.size(), current.substr(edit.offset, edit.length)};
+        }
+
+        doc->apply(edit);
+        std::string where = "edit " + std::to_string(step) + " (offset " + std::to_string(edit.offset) + ")";
+        if (checkIncremental(*doc, where)) undo.reset();
+
+        const EditStats& st = doc->lastEdit();
+        total.tokensRescanned += st.tokensRescanned, total.tokensReused += st.tokensReused;
+        total.declsReparsed += st.declsReparsed, total.declsReused += st.declsReused;
+        total.nodesRebuilt += st.nodesRebuilt, total.nodesReused += st.nodesReused;
+    }
+    out << path << ": " << EDITS << " incremental edits match full reparses; tokens "
+        << total.tokensRescanned << " rescanned / " << total.tokensReused << " reused, declarations "
+        << total.declsReparsed << " reparsed / " << total.declsReused << " reused, nodes "
+        << total.nodesRebuilt << " rebuilt / " << total.nodesReused << " reused\n";
+}
+
+// APPLY ONE GIVEN EDIT AND CHECK THE DOCUMENT BEFORE AND AFTER IT; UNLIKE THE
+// RANDOM SERIES THE TEXT NEED NOT PARSE
+static void verifyEdit(const std::string& path, std::string_view text, const TextEdit& edit, std::ostream& out) {
+    IncrementalDocument doc{std::string(text)};
+    checkIncremental(doc, "before the edit");
+    doc.apply(edit);
+    checkIncremental(doc, "edit at offset " + std::to_string(edit.offset));
+    out << path << ": edit at offset " << edit.offset << " matches a full reparse; tokens "
+        << doc.lastEdit().tokensRescanned << " rescanned / " << doc.lastEdit().tokensReused << " reused\n";
+}
+
+// SCAN, PARSE AND (OPTIONALLY) RUN ONE FILE; report.ok IS false ON ANY ERROR.
+// RUNS ON A POOL THREAD: TOUCHES NOTHING BUT ITS OWN REPORT
+static void compileFile(const Options& options, FileReport& report, ThreadPool* pool,
+                        const AstCache* cache) {
+    const std::string& path = report.path;
+    profile::Phase filePhase("file", path);
+    std::ostringstream out;
+    auto started = std::chrono::steady_clock::now();
+    SourceFile file;
+    std::string_view text;
+    if (report.source) {
+        text = report.source;
+    } else {
+        try {
+            profile::Phase phase("load", path);
+            file = SourceFile::open(path);
+        } catch (const std::exception& e) {
+            report.err = std::string("Error: ") + e.what() + "\n";
+            report.ok = false;
+            return;
+        }
+        text = file.text();
+    }
+    report.bytes = text.size();
+    // LINE NUMBERS ARE ONLY WORKED OUT IF AN ERROR OR A LISTING NEEDS ONE
+    LineTable lines(text);
+
+    try {
+        if (options.verifyIncremental) {
+            if (report.edit) verifyEdit(path, text, *report.edit, out);
+            else verifyIncremental(path, text, out);
+            report.out = out.str();
+            return;
+        }
+        // ON A CACHE HIT THE SCANNER AND PARSER DO NOT RUN AT ALL: THE TREE IS
+        // USED STRAIGHT FROM THE MAPPED CACHE ENTRY
+        AstArena arena;
+        StmtList program;
+        CachedUnit cached;
+        uint64_t cacheKey = cache ? cache->key(text) : 0;
+        bool hit = false;
+        if (cache) {
+            profile::Phase phase("cache-load");
+            hit = cache->load(cacheKey, text, cached, options.dumpTokens);
+        }
+        if (hit) {
+            report.cacheHit = true;
+            program = cached.program();
+            report.tokens = cached.tokenCount() - 1; // END_OF_FILE
+            report.nodes = cached.nodeCount();
+            if (options.dumpTokens)
+                for (size_t i = 0; i < cached.tokenCount(); i++)
+                    out << cached.tokens()[i].lexeme << "-----> (" << tokenTypeToString(cached.tokens()[i].type) << ")\n";
+        } else {
+            // THE SCANNER RUNS DIRECTLY OVER THE MAPPED BYTES; TOKENS ARE VIEWS INTO THEM
+            std::vector<Token> tokens;
+            bool materialize = options.parallelLex || options.dumpTokens || cache;
+            if (materialize) {
+                profile::Phase phase("scan");
+                if (options.parallelLex) tokens = lexInParallel(text, options, *pool);
+                else tokens = Scanner(text).scanTokens();
+                phase.tokens(tokens.size() - 1);
+            }
+            if (options.dumpTokens) {
+                for (const auto &token : tokens) {
+                    out << token.lexeme << "-----> (" << tokenTypeToString(token.type) << ")\n";
+                }
+            }
+
+            // THE PARSER PULLS TOKENS ON DEMAND; NO TOKEN VECTOR IS MATERIALIZED
+            // UNLESS ONE WAS NEEDED ABOVE. TIMED, THE STREAMING PARSE IS ONE
+            // "scan+parse" PHASE WITH THE SCANNER'S SHARE ACCUMULATED INSIDE IT AS "scan"
+            // AST NODES LIVE IN THE FILE'S ARENA AND ARE FREED WITH IT IN ONE STEP
+            ParseResult parsed;
+            if (materialize) {
+                profile::Phase phase("parse");
+                parsed = Parser(tokens, arena).parse();
+                report.tokens = tokens.size() - 1; // END_OF_FILE
+                phase.nodes(arena.nodeCount());
+            } else {
+                profile::Phase phase("scan+parse");
+                profile::Accumulator scanTime("scan");
+                Scanner scanner(text);
+                Parser parser(scanner, arena);
+                parser.timeScanning(&scanTime);
+                parsed = parser.parse();
+                report.tokens = scanner.tokenCount();
+                scanTime.tokens(report.tokens);
+                phase.tokens(report.tokens);
+                phase.nodes(arena.nodeCount());
+            }
+            report.nodes = arena.nodeCount();
+            // EVERY SYNTAX ERROR IS REPORTED; A TREE WITH ERRORS GOES NO FURTHER
+            if (!parsed.ok()) {
+                for (const Diagnostic& d : parsed.diagnostics)
+                    report.err += path + ": Error: " + d.toString(lines) + "\n";
+                report.ok = false;
+                report.out = out.str();
+                report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+                return;
+            }
+            program = parsed.program;
+            // CACHE THE TREE AS PARSED, BEFORE FOLDING REWRITES IT
+            if (cache) {
+                profile::Phase phase("cache-store");
+                cache->store(cacheKey, text, tokens, program, report.nodes);
+            }
+        }
+        if (options.fold) {
+            ConstantFolder folder(arena);
+            {
+                profile::Phase phase("fold");
+                folder.run(program);
+            }
+            if (options.foldStats) {
+                const FoldStats& st = folder.stats();
+                out << path << ": folding eliminated " << st.nodesEliminated << " nodes ("
+                    << st.expressionsFolded << " constant expressions, " << st.identitiesApplied
+                    << " identities, " << st.branchesRemoved << " dead branches)\n";
+            }
+        }
+        // EVERY RESOLUTION ERROR IS REPORTED, LIKE SYNTAX ERRORS; WITHOUT THIS
+        // THE ENGINES STOP AT THE FIRST ONE
+        if (options.warnings) {
+            profile::Phase phase("resolve");
+            Resolution resolution = Resolver().resolve(program);
+            for (const Diagnostic& d : resolution.warnings)
+                out << path << ": warning: " << d.toString(lines) << "\n";
+            if (!resolution.ok()) {
+                for (const Diagnostic& d : resolution.errors) report.err += path + ": Error: " + d.toString(lines) + "\n";
+                report.ok = false;
+                report.out = out.str();
+                report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+                return;
+            }
+        }
+        if (options.emitC) {
+            ir::Program ir;
+            ir::PassStats stats;
+            buildIr(program, lines, false, ir, stats);
+            profile::Phase phase("emit-c");
+            cgen::emitProgram(ir, lines, path, out);
+        }
+        if (options.run || options.dumpBytecode || options.verifyJit || options.dumpIr || options.verifyIr)
+            runProgram(path, program, lines, options, out);
+        else if (!options.emitC) out << path << ": Parsing successful!\n";
     } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << "\n";
+        report.err = path + ": Error: " + e.what() + "\n";
+        report.ok = false;
     }
+    report.out = out.str();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+}
 
-    // if (argc < 2) {
-    //     std::cerr << "Usage: CompilerProject.exe <source_file>\n";
-    //     return 1;
-    // }
-    //
-    // std::ifstream file(argv[1]);
-    // if (!file) {
-    //     std::cerr << "Error: Could not open file: " << argv[1] << "\n";
-    //     return 1;
-    // }
-    //
-    // cout << "hiiiiiiii";
-    // std::stringstream buffer;
-    // buffer << file.rdbuf();
-    // std::string source = buffer.str();
-    //
-    // Scanner scanner(source);
-    // std::vector<Token> tokens = scanner.scanTokens();
-    //
-    //
-    // for (const auto& t : tokens) {
-    //     std::cout << t.lexeme << " -----> (" << (int)t.type
-    //               << ") [ " << t.line << " : " << t.col << " ]\n";
-    // }
-
-    return 0;
-}
\ No newline at end of file
+// DIRECTORIES EXPAND TO THEIR .astv FILES (RECURSIVELY, SORTED SO THE ORDER
+// DOES NOT DEPEND ON THE FILESYSTEM); EVERYTHING ELSE IS TAKEN AS GIVEN
+static std::vector<std::string> expandInputs(const std::vector<std::string>& args) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> paths;
+    for (const std::string& arg : args) {
+        std::error_code ec;
+        if (arg == "-" || !fs::is_directory(arg, ec)) {
+            paths.push_back(arg);
+            continue;
+        }
+        std::vector<std::string> found;
+        for (fs::recursive_directory_iterator it(arg, ec), end; !ec && it != end; it.increment(ec))
+            if (it->is_regular_file(ec) && it->path().extension() == ".astv")
+                found.push_back(it->path().string());
+        if (ec) throw std::runtime_error("cannot read directory '" + arg + "': " + ec.message());
+        std::sort(found.begin(), found.end());
+        paths.insert(paths.end(), found.begin(), found.end());
+    }
+    return paths;
+}
+
+static void printStats(const std::vector<FileReport>& reports, double wallSeconds, unsigned jobs) {
+    auto mbPerSec = [](size_t bytes, double s) { return s > 0 ? bytes / s / 1e6 : 0.0; };
+    size_t bytes = 0, tokens = 0, nodes = 0, failed = 0, cached = 0;
+    double busy = 0;
+    char line[512];
+    for (const FileReport& r : reports) {
+        std::snprintf(line, sizeof line, "%10zu B %9zu tok %9zu nodes %9.3f ms %8.1f MB/s %s %s\n",
+                      r.bytes, r.tokens, r.nodes, r.seconds * 1e3, mbPerSec(r.bytes, r.seconds),
+                      r.cacheHit ? "cached" : "      ", r.path.c_str());
+        std::cerr << line;
+        bytes += r.bytes, tokens += r.tokens, nodes += r.nodes, busy += r.seconds;
+        failed += !r.ok;
+        cached += r.cacheHit;
+    }
+    std::snprintf(line, sizeof line,
+                  "total: %zu files (%zu failed, %zu from cache), %zu bytes, %zu tokens, %zu nodes in "
+                  "%.3f ms on %u threads\n       %.1f MB/s, %.0f tokens/s, %.0f files/s, concurrency %.2fx\n",
+                  reports.size(), failed, cached, bytes, tokens, nodes, wallSeconds * 1e3, jobs,
+                  mbPerSec(bytes, wallSeconds), wallSeconds > 0 ? tokens / wallSeconds : 0.0,
+                  wallSeconds > 0 ? reports.size() / wallSeconds : 0.0,
+                  wallSeconds > 0 ? busy / wallSeconds : 0.0);
+    std::cerr << line;
+}
+
+// PROGRAMS THAT ONCE MADE TWO ENGINES DISAGREE; --verify-jit AND --verify-ir
+// CHECK THEM AHEAD OF THE FILES ON THE COMMAND LINE
+struct RegressionCase {
+    const char* name;
+    const char* source;
+};
+static const RegressionCase regressionPrograms[] = {
+    // a script variable assigned in a call argument left its temporary
+    // allocated, so the next argument went one register too far
+    {"global-assignment-argument",
+     "mass v1 = 3;\n"
+     "mass add(mass a, mass b) { blackHole a * 10 + b; }\n"
+     "mass f1(mass p) { blackHole add(v1 = 5, p); }\n"
+     "vacuum f2(mass p) { shine((v1 = 6), p); }\n"
+     "shine(f1(7));\n"
+     "f2(8);\n"},
+    // strength reduction of the inner loop's i * j put new products in its
+    // preheader, which the outer loop then picked up as its own
+    {"nested-loop-products",
+     "rotate (mass i = 0; i < 3; i += 1) {\n"
+     "    rotate (mass j = 0; j < 2; j += 1) { shine(i * j, j * 4); }\n"
+     "}\n"},
+    // a flux outside the range of a mass was converted with a plain cast:
+    // undefined, and each engine gave its own answer
+    {"flux-to-mass-saturates",
+     "flux big = 99999999999999999999.0;\n"
+     "flux nan = big * big * big * big * big * big * big * big * big * big * big * big * big * big * big * big;\n"
+     "nan = nan - nan;\n"
+     "rotate (mass i = 0; i < 3; i += 1) { mass a = big; mass b = -big; mass c = nan; shine(a, b, c); }\n"},
+    // a literal left operand was swapped to the right for the constant form,
+    // so the type error named the operands in reverse
+    {"literal-left-operand-error",
+     "vacuum s = \"moon\";\n"
+     "quantum t = starlight;\n"
+     "shine(\"<\" + s, 2 * 3.5);\n"
+     "shine(1 < t);\n"},
+    // the VM's frames live on the heap but were capped at the tree walker's
+    // depth, so a plain non-tail recursion 2500 deep overflowed
+    {"deep-non-tail-recursion",
+     "mass sum(mass n) { phase (n == 0) { blackHole 0; } blackHole n + sum(n - 1); }\n"
+     "shine(sum(10));\n"
+     "shine(sum(2500));\n"},
+    // enough short-lived stars to make the star heap collect several times
+    // while a function builds the right operand of a star held only by the
+    // engine (the tree walker's C++ stack, the VM's registers)
+    {"star-collection-keeps-operands",
+     "vacuum mk(mass n, vacuum unit) { vacuum r = \"\"; rotate (mass i = 0; i < n; i += 1) { r = r + unit; } blackHole r; }\n"
+     "vacuum keep = mk(3, \"keep-this-star-alive-\");\n"
+     "mass same = 0;\n"
+     "rotate (mass k = 0; k < 300; k += 1) {\n"
+     "    vacuum x = (mk(2, \"left-side-temporary-\") + \"|\") + mk(300, \"0123456789abcdefghij\");\n"
+     "    vacuum y = \"left-side-temporary-left-side-temporary-|\" + mk(300, \"0123456789abcdefghij\");\n"
+     "    phase (x == y) { same += 1; }\n"
+     "    vacuum z = \"pre-\" + mk(100, \"zzzzzzzzzzzzzzzzzzzz\");\n"
+     "    z += mk(50, \"tail-tail-tail-tail-\");\n"
+     "}\n"
+     "shine(same, keep);\n"},
+};
+
+// EDITS THE INCREMENTAL DOCUMENT ONCE GOT WRONG; --verify-incremental CHECKS
+// THEM AHEAD OF THE FILES ON THE COMMAND LINE
+struct RegressionEdit {
+    const char* name;
+    const char* source;
+    TextEdit edit;
+};
+static const RegressionEdit regressionEdits[] = {
+    // an out-of-range number became an ERROR token whose lexeme was the
+    // scanner's message, so re-lexing lost track of where it ended
+    {"number-out-of-range",
+     "mass a = 1;\nmass b = 2;\nmass c = 3;\nmass d = 99999999999999999999;\nmass e = 5;\n",
+     {9, 1, "11111111111111111111"}},
+    {"unterminated-star", "mass a = 1;\nvacuum s = \"open;\nmass b = 2;\n", {9, 1, "2"}},
+    // the keyword star has the string literal's token type and was taken to
+    // end one byte later, after a closing quote it does not have
+    {"star-keyword-before-comment", "vacuum s = star*** a\nb ***x;\nmass y = 1;\n", {24, 0, "*** a\nb ***"}},
+};
+
+// BROKEN PROGRAMS AND THE SYNTAX ERRORS THEY MUST REPORT: EACH ONE EXACTLY
+// ONCE AND NOTHING ELSE, SO PANIC-MODE RECOVERY NEITHER DROPS NOR INVENTS ANY
+struct DiagnosticCase {
+    const char* name;
+    const char* source;
+    std::vector<std::string> expected;
+};
+static const DiagnosticCase diagnosticCases[] = {
+    // the missing name used to be consumed, taking the ';' recovery needs
+    {"missing-name-then-bad-expression", "mass ;\nshine(;\n",
+     {"Line 1, col 6: Expected name after type", "Line 2, col 7: Expected expression"}},
+    {"missing-name-before-brace", "{ mass }\nshine(});\n",
+     {"Line 1, col 8: Expected name after type", "Line 2, col 7: Expected expression"}},
+    {"missing-loop-variable", "rotate (mass ; a < 3; a += 1) { }\nflux = 1;\n",
+     {"Line 1, col 14: Expected name after type", "Line 2, col 6: Expected name after type"}},
+    {"missing-function-name", "mass (mass a) { blackHole a; }\nshine(*);\n",
+     {"Line 1, col 6: Expected name after type", "Line 2, col 7: Expected expression"}},
+};
+
+// PARSE EVERY DIAGNOSTIC CASE AND COMPARE THE ERRORS WITH THE EXPECTED ONES
+static bool verifyDiagnostics(std::ostream& out) {
+    bool ok = true;
+    for (const DiagnosticCase& c : diagnosticCases) {
+        std::vector<Token> tokens = Scanner(c.source).scanTokens();
+        AstArena arena;
+        ParseResult parsed = Parser(tokens, arena).parse();
+        LineTable lines(c.source);
+        std::vector<std::string> got;
+        for (const Diagnostic& d : parsed.diagnostics) got.push_back(d.toString(lines));
+        if (got == c.expected) {
+            out << "<diagnostics: " << c.name << ">: " << got.size() << " errors as expected\n";
+            continue;
+        }
+        ok = false;
+        std::cerr << "<diagnostics: " << c.name << ">: Error: reported\n";
+        for (const std::string& d : got) std::cerr << "    " << d << "\n";
+        std::cerr << "  expected\n";
+        for (const std::string& d : c.expected) std::cerr << "    " << d << "\n";
+    }
+    return ok;
+}
+
+// COMPILE EVERY FILE ON A WORK-STEALING POOL. REPORTS ARE PRINTED IN INPUT
+// ORDER AS SOON AS THEY AND ALL THEIR PREDECESSORS ARE DONE
+static bool compileAll(const std::vector<std::string>& paths, const Options& options) {
+    std::vector<FileReport> reports;
+    if (options.verifyJit || options.verifyIr)
+        for (const RegressionCase& c : regressionPrograms) {
+            reports.emplace_back();
+            reports.back().path = std::string("<regression: ") + c.name + ">";
+            reports.back().source = c.source;
+        }
+    if (options.verifyIncremental)
+        for (const RegressionEdit& c : regressionEdits) {
+            reports.emplace_back();
+            reports.back().path = std::string("<regression: ") + c.name + ">";
+            reports.back().source = c.source;
+            reports.back().edit = &c.edit;
+        }
+    for (const std::string& path : paths) {
+        reports.emplace_back();
+        reports.back().path = path;
+    }
+
+    unsigned jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = unsigned(std::min<size_t>(jobs, reports.size()));
+    auto started = std::chrono::steady_clock::now();
+
+    std::unique_ptr<AstCache> cache;
+    if (!options.cacheDir.empty()) {
+        try {
+            cache = std::make_unique<AstCache>(options.cacheDir);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return false;
+        }
+    }
+
+    std::mutex doneLock;
+    std::condition_variable doneChanged;
+    std::vector<char> done(reports.size(), 0);
+    bool ok = true;
+    auto emit = [&](const FileReport& r) {
+        std::cout << r.out << std::flush;
+        std::cerr << r.err;
+        ok = ok && r.ok;
+    };
+
+    if (jobs <= 1) {
+        // ONE FILE AT A TIME; THE POOL IS ONLY NEEDED FOR CHUNKED LEXING
+        std::unique_ptr<ThreadPool> lexPool;
+        if (options.parallelLex) lexPool = std::make_unique<ThreadPool>(options.jobs);
+        for (FileReport& r : reports) {
+            compileFile(options, r, lexPool.get(), cache.get());
+            emit(r);
+        }
+    } else {
+        ThreadPool pool(jobs);
+        for (size_t i = 0; i < reports.size(); i++)
+            pool.submit([&, i] {
+                compileFile(options, reports[i], &pool, cache.get());
+                std::lock_guard<std::mutex> guard(doneLock);
+                done[i] = 1;
+                doneChanged.notify_one();
+            });
+        for (size_t i = 0; i < reports.size(); i++) {
+            {
+                std::unique_lock<std::mutex> guard(doneLock);
+                doneChanged.wait(guard, [&] { return done[i] != 0; });
+            }
+            emit(reports[i]);
+        }
+        pool.wait();
+    }
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    if (options.stats) printStats(reports, wall, std::max(1u, jobs));
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    std::string bench; // "", "vm", "calls", "strings" or "frontend"
+    bool diagnostics = false; // --verify-diagnostics: built-in cases only, no inputs
+    FrontendBenchOptions frontendBench;
+    std::vector<std::string> inputs;
+    auto parseJobs = [&](const std::string& text) {
+        char* end = nullptr;
+        long n = std::strtol(text.c_str(), &end, 10);
+        if (text.empty() || *end || n < 1 || n > 1024) {
+            std::cerr << "Error: invalid job count '" << text << "'\n";
+            return false;
+        }
+        options.jobs = unsigned(n);
+        return true;
+    };
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--tokens") options.dumpTokens = true;
+        else if (arg == "--run") options.run = true;
+        else if (arg == "--engine=vm") options.treeWalker = false;
+        else if (arg == "--engine=tree") options.treeWalker = true;
+        else if (arg == "--dump-bytecode") options.dumpBytecode = true;
+        else if (arg == "--emit=c") options.emitC = true;
+        else if (arg == "--vars") options.dumpVars = true;
+        else if (arg == "--jit") options.jit = true;
+        else if (arg == "--no-jit") options.jit = false;
+        else if (arg == "--verify-jit") options.verifyJit = true;
+        else if (arg == "--ir") options.ir = true;
+        else if (arg == "--dump-ir") options.dumpIr = true;
+        else if (arg == "--verify-ir") options.verifyIr = true;
+        else if (arg.rfind("--jit-threshold=", 0) == 0) {
+            char* end = nullptr;
+            unsigned long n = std::strtoul(arg.c_str() + 16, &end, 10);
+            if (arg.size() == 16 || *end || n > UINT32_MAX) {
+                std::cerr << "Error: invalid JIT threshold '" << arg.substr(16) << "'\n";
+                return 1;
+            }
+            options.jitThreshold = uint32_t(n);
+        }
+        else if (arg == "--bench" || arg == "--bench=vm") bench = "vm";
+        else if (arg == "--bench=calls") bench = "calls";
+        else if (arg == "--bench=strings") bench = "strings";
+        else if (arg == "--bench=frontend") bench = "frontend";
+        else if (arg.rfind("--bench-bytes=", 0) == 0) {
+            char* end = nullptr;
+            double n = std::strtod(arg.c_str() + 14, &end);
+            if (*end == 'K' || *end == 'k') n *= 1024, end++;
+            else if (*end == 'M' || *end == 'm') n *= 1024 * 1024, end++;
+            if (*end || n < 1) {
+                std::cerr << "Error: invalid size '" << arg.substr(14) << "'\n";
+                return 1;
+            }
+            frontendBench.bytes = size_t(n);
+        }
+        else if (arg.rfind("--bench-shape=", 0) == 0) {
+            CorpusShape shape;
+            if (!parseCorpusShape(arg.substr(14), shape)) {
+                std::cerr << "Error: unknown corpus shape '" << arg.substr(14) << "'\n";
+                return 1;
+            }
+            frontendBench.shapes.push_back(shape);
+        }
+        else if (arg.rfind("--bench-json=", 0) == 0) frontendBench.jsonPath = arg.substr(13);
+        else if (arg == "--no-fold") options.fold = false;
+        else if (arg == "--warnings") options.warnings = true;
+        else if (arg == "--fold-stats") options.foldStats = true;
+        else if (arg == "--stats") options.stats = true;
+        else if (arg == "--parallel-lex") options.parallelLex = true;
+        else if (arg == "--verify-lex") options.parallelLex = options.verifyLex = true;
+        else if (arg == "--verify-incremental") options.verifyIncremental = true;
+        else if (arg == "--verify-diagnostics") diagnostics = true;
+        else if (arg.rfind("--cache-dir=", 0) == 0) options.cacheDir = arg.substr(12);
+        else if (arg == "--time-phases") options.timePhases = true;
+        else if (arg.rfind("--trace=", 0) == 0) options.tracePath = arg.substr(8);
+        else if (arg.rfind("--lex-chunk=", 0) == 0) {
+            options.lexChunk = std::strtoull(arg.c_str() + 12, nullptr, 10);
+            if (options.lexChunk == 0) {
+                std::cerr << "Error: invalid chunk size '" << arg.substr(12) << "'\n";
+                return 1;
+            }
+        }
+        else if (arg.rfind("--jobs=", 0) == 0) { if (!parseJobs(arg.substr(7))) return 1; }
+        else if (arg == "-j" && i + 1 < argc) { if (!parseJobs(argv[++i])) return 1; }
+        else if (arg.rfind("-j", 0) == 0 && arg.size() > 2) { if (!parseJobs(arg.substr(2))) return 1; }
+        else if (arg == "-h" || arg == "--help") { printUsage(argv[0]); return 0; }
+        else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Error: unknown option '" << arg << "'\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+        else inputs.push_back(arg);
+    }
+    if (diagnostics) return verifyDiagnostics(std::cout) ? 0 : 1;
+    if (bench == "vm") return runVmBenchmark(std::cout);
+    if (bench == "calls") return runCallBenchmark(std::cout);
+    if (bench == "strings") return runStringBenchmark(std::cout);
+    if (bench == "frontend") {
+        // WITH THE JSON ON STDOUT THE TABLE MOVES TO STDERR
+        std::ostream& table = frontendBench.jsonPath == "-" ? std::cerr : std::cout;
+        return runFrontendBenchmark(table, frontendBench);
+    }
+    if (inputs.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (options.treeWalker && (!options.run || options.verifyJit)) options.treeWalker = false; // nothing to walk
+
+    std::vector<std::string> paths;
+    try {
+        paths = expandInputs(inputs);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    if (paths.empty()) {
+        std::cerr << "Error: no .astv files found\n";
+        return 1;
+    }
+    if (options.timePhases || !options.tracePath.empty()) profile::enable();
+    bool ok = compileAll(paths, options);
+    if (options.timePhases) profile::writeSummary(std::cerr);
+    if (!options.tracePath.empty() && !profile::writeTrace(options.tracePath)) {
+        std::cerr << "Error: cannot write trace '" << options.tracePath << "'\n";
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}